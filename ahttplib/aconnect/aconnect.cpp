@@ -87,6 +87,7 @@ namespace aconnect
 		port = 0; 
 		socket = INVALID_SOCKET;
 		server = NULL;
+		acceptTime = 0;
 		util::zeroMemory(ip, sizeof(ip));
 	}
 
@@ -134,6 +135,7 @@ namespace aconnect
 					clientInfo.socket = clientSock;
 					clientInfo.port = clientAddr.sin_port;
 					clientInfo.server = server;
+					clientInfo.acceptTime = util::getTimestamp();
 					util::readIpAddress (clientInfo.ip, clientAddr.sin_addr);
 					
 					if (server->settings().enablePooling && 
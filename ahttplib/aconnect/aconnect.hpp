@@ -34,6 +34,7 @@ distribution.
 
 
 #include "types.hpp"
+#include "time_util.hpp"
 #include "logger.hpp"
 #include "server_settings.hpp"
 
@@ -54,6 +55,7 @@ namespace aconnect
 		ip_addr_type	ip;
 		socket_type		socket;
 		class Server	*server;
+		util::timestamp_type	acceptTime;	// monotonic, see util::getTimestamp
 
 		// constructor
 		ClientInfo();
@@ -165,6 +167,12 @@ namespace aconnect
 		inline long currentPendingWorkersCount () {	
 			return pendingWorkersCount_;		
 		}
+
+		// accepted connections waiting for free worker
+		inline size_t queueLength () {	
+			boost::mutex::scoped_lock lock (pendingMutex_);
+			return requests_.size();		
+		}
 			
 		inline void logDebug (string_constptr format, ...)	{	
 			if (logger_) {
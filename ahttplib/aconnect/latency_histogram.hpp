@@ -0,0 +1,153 @@
+/*
+This file is part of [aconnect] library.
+
+Author: Artem Kustikov (kustikoff[at]tut.by)
+version: 0.1
+
+This code is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this code.
+
+Permission is granted to anyone to use this code for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this code must not be misrepresented; you must
+not claim that you wrote the original code. If you use this
+code in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original code.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+#ifndef ACONNECT_LATENCY_HISTOGRAM_H
+#define ACONNECT_LATENCY_HISTOGRAM_H
+
+#include <string.h>
+#include <boost/cstdint.hpp>
+
+namespace aconnect
+{
+	/**
+	*	HDR-style log-linear histogram of latencies (microseconds):
+	*	each power of 2 range is split to SubBucketsCount linear sub-buckets,
+	*	so relative error of percentile value is less than 1/SubBucketsCount (~6%).
+	*	Values above MaxValue are stored in the last bucket.
+	*	Not synchronized - designed to be used as ThreadShards item.
+	*/
+	class LatencyHistogram
+	{
+	public:
+		typedef boost::uint64_t value_type;
+		typedef boost::uint64_t count_type;
+
+		enum Params
+		{
+			SubBucketBits = 4,
+			SubBucketsCount = 1 << SubBucketBits,
+			MaxValueBits = 32,											// ~71 min
+			BucketsCount = (MaxValueBits - SubBucketBits + 1) * SubBucketsCount
+		};
+
+		LatencyHistogram () {
+			clear ();
+		}
+
+		inline void clear ()
+		{
+			memset (counts_, 0, sizeof (counts_));
+			totalCount_ = 0;
+			sum_ = 0;
+			max_ = 0;
+		}
+
+		inline void record (value_type value)
+		{
+			++counts_[bucketIndex (value)];
+			++totalCount_;
+			sum_ += value;
+			if (value > max_)
+				max_ = value;
+		}
+
+		void merge (const LatencyHistogram& other)
+		{
+			for (int ndx = 0; ndx < BucketsCount; ++ndx)
+				counts_[ndx] += other.counts_[ndx];
+
+			totalCount_ += other.totalCount_;
+			sum_ += other.sum_;
+			if (other.max_ > max_)
+				max_ = other.max_;
+		}
+
+		// percentile: 0..100, returns highest value equivalent to the found bucket
+		value_type percentile (double percentile) const
+		{
+			if (totalCount_ == 0)
+				return 0;
+
+			count_type target = (count_type) (percentile / 100.0 * (double) totalCount_ + 0.5);
+			if (target == 0)
+				target = 1;
+			if (target > totalCount_)
+				target = totalCount_;
+
+			count_type accumulated = 0;
+			for (int ndx = 0; ndx < BucketsCount; ++ndx)
+			{
+				accumulated += counts_[ndx];
+				if (accumulated >= target) {
+					value_type value = bucketUpperBound (ndx);
+					return (value < max_ ? value : max_);
+				}
+			}
+
+			return max_;
+		}
+
+		inline count_type count () const		{	return totalCount_;		}
+		inline value_type max () const			{	return max_;			}
+		inline value_type sum () const			{	return sum_;			}
+		inline value_type mean () const			{	return totalCount_ ? sum_ / totalCount_ : 0;	}
+
+	protected:
+		static inline int bucketIndex (value_type value)
+		{
+			if (value < 2 * SubBucketsCount)
+				return (int) value;
+
+			int msb = 0;
+			for (value_type v = value; v > 1; v >>= 1)
+				++msb;
+
+			const int shift = msb - SubBucketBits;
+			const int ndx = (shift + 1) * SubBucketsCount + (int) ((value >> shift) - SubBucketsCount);
+
+			return (ndx < BucketsCount ? ndx : BucketsCount - 1);
+		}
+
+		static inline value_type bucketUpperBound (int ndx)
+		{
+			if (ndx < 2 * SubBucketsCount)
+				return (value_type) ndx;
+
+			const int shift = ndx / SubBucketsCount - 1;
+			const value_type subBucket = ndx % SubBucketsCount + SubBucketsCount;
+
+			return ((subBucket + 1) << shift) - 1;
+		}
+
+	protected:
+		count_type counts_[BucketsCount];
+		count_type totalCount_;
+		value_type sum_;
+		value_type max_;
+	};
+}
+
+#endif // ACONNECT_LATENCY_HISTOGRAM_H
@@ -196,12 +196,15 @@ namespace aconnect
 
 
 	ProgressTimer::~ProgressTimer () {
+		if (!started_)
+			return;
+
 		try 
 		{
 			using boost::format;
 			
 			format f("%s: elapsed time - %f sec");
-			f % funcName_ % timer_.elapsed();
+			f % funcName_ % ((double) util::elapsedTime (started_, util::getTimestamp()) / 1000000);
 			
 			log_.processMessage (level_, f.str().c_str());
 
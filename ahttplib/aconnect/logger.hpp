@@ -28,9 +28,10 @@ distribution.
 #define ACONNECT_LOGGER_H
 
 #include <fstream>
-#include <boost/timer.hpp>
 #include <boost/thread.hpp>
 
+#include "time_util.hpp"
+
 namespace aconnect
 {
 	namespace Log
@@ -111,6 +112,7 @@ namespace aconnect
 		inline bool isDebugEnabled()						{	return level_>=Log::Debug;				}
 		inline bool isInfoEnabled()							{	return level_>=Log::Info;				}
 		inline bool isWarningEnabled()						{	return level_>=Log::Warning;			}
+		inline bool isEnabled (Log::LogLevel level)		{	return level_>=level;					}
 	};
 
 	class FakeLogger : public Logger
@@ -160,18 +162,20 @@ namespace aconnect
 		size_t maxFileSize_;
 	};
 
+	// measures wall time of scope execution, does nothing if log level is disabled
 	class ProgressTimer 
 	{
 	public:
 		ProgressTimer (Logger& log, string_constptr funcName, Log::LogLevel level = Log::Debug):
-		  log_ (log), funcName_(funcName), level_(level),  timer_() {}
+		  log_ (log), funcName_(funcName), level_(level),  
+		  started_ (log.isEnabled (level) ? util::getTimestamp() : 0) {}
 		~ProgressTimer ();
 
 	protected:
 		Logger& log_;
-		string funcName_;
+		string_constptr funcName_;
 		Log::LogLevel level_;
-		boost::timer timer_;
+		util::timestamp_type started_;
 
 	};
 }
@@ -180,6 +180,28 @@ namespace aconnect
 		*/
 		void writeToSocket (socket_type sock, string_constref data) throw (socket_error);
 		void writeToSocket (socket_type s, string_constptr buff, const int buffLen) throw (socket_error);
+		
+		/*
+		*	Write "size" bytes of file starting from "offset" to socket,
+		*	data is not copied to user space where sendfile() is available (Linux)
+		*	@throw socket_error on writing failure, std::runtime_error if file cannot be read
+		*/
+		void writeFileToSocket (socket_type s, string_constref filePath, 
+			size_t offset, size_t size) throw (std::runtime_error);
+#if defined (__linux__)
+		/*
+		*	Write part of already opened file to socket (sendfile), descriptor is not closed,
+		*	"filePath" is used in error messages only
+		*/
+		void writeFileToSocket (socket_type s, int fd, string_constref filePath, 
+			size_t offset, size_t size) throw (std::runtime_error);
+#endif
+		/*
+		*	Relay "size" bytes from socket "from" to socket "to", data is moved
+		*	through pipe in kernel where splice() is available (Linux)
+		*	@throw socket_error on reading/writing failure, std::runtime_error if "from" was closed
+		*/
+		void relaySocketData (socket_type from, socket_type to, size_t size) throw (std::runtime_error);
 		string readFromSocket (const socket_type s, SocketStateCheck &stateCheck, bool throwOnConnectionReset = true, 
 				const int buffSize = network::SocketReadBufferSize) throw (socket_error);
 		void readIpAddress (ip_addr_type ip, const in_addr &addr);
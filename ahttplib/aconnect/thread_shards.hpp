@@ -0,0 +1,152 @@
+/*
+This file is part of [aconnect] library.
+
+Author: Artem Kustikov (kustikoff[at]tut.by)
+version: 0.1
+
+This code is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this code.
+
+Permission is granted to anyone to use this code for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this code must not be misrepresented; you must
+not claim that you wrote the original code. If you use this
+code in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original code.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+#ifndef ACONNECT_THREAD_SHARDS_H
+#define ACONNECT_THREAD_SHARDS_H
+
+#include <set>
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/tss.hpp>
+
+namespace aconnect
+{
+	/**
+	*	Per-thread copies ("shards") of some statistics object.
+	*	Shard is updated only by the owner thread without locks,
+	*	readers merge all shards on demand (values can be slightly inconsistent).
+	*	When thread finishes its shard is merged to the "retired" total.
+	*	T requirements: copy constructor (new shards are copied from prototype),
+	*	void merge (const T& other).
+	*/
+	template <typename T>
+	class ThreadShards : private boost::noncopyable
+	{
+	protected:
+		struct Shard
+		{
+			Shard (ThreadShards* shardsOwner, const T& prototype) :
+				owner (shardsOwner), data (prototype) { }
+
+			ThreadShards* owner;
+			T data;
+		};
+
+	public:
+		ThreadShards () :
+			prototype_ (), retired_ (), shard_ (&ThreadShards::cleanupShard) { }
+
+		explicit ThreadShards (const T& prototype) :
+			prototype_ (prototype), retired_ (prototype), shard_ (&ThreadShards::cleanupShard) { }
+
+		// must be called before shards creation (at startup)
+		void setPrototype (const T& prototype)
+		{
+			boost::mutex::scoped_lock lock (mutex_);
+			prototype_ = prototype;
+			retired_ = prototype;
+		}
+
+		// current thread shard
+		inline T& local ()
+		{
+			Shard* shard = shard_.get();
+			if (shard)
+				return shard->data;
+
+			boost::mutex::scoped_lock lock (mutex_);
+			shard = new Shard (this, prototype_);
+			shard_.reset (shard);
+			shards_.insert (shard);
+
+			return shard->data;
+		}
+
+		// merge all shards to "result"
+		void collect (T& result)
+		{
+			boost::mutex::scoped_lock lock (mutex_);
+			result = retired_;
+
+			typename std::set<Shard*>::const_iterator it;
+			for (it = shards_.begin(); it != shards_.end(); ++it)
+				result.merge ((*it)->data);
+		}
+
+	protected:
+		static void cleanupShard (Shard* shard)
+		{
+			ThreadShards* owner = shard->owner;
+			{
+				boost::mutex::scoped_lock lock (owner->mutex_);
+				owner->retired_.merge (shard->data);
+				owner->shards_.erase (shard);
+			}
+			delete shard;
+		}
+
+	protected:
+		boost::mutex mutex_;
+		T prototype_;
+		T retired_;
+		std::set<Shard*> shards_;
+		boost::thread_specific_ptr<Shard> shard_;
+	};
+
+	// counter incremented without contention, value is calculated on read
+	class ShardedCounter : private boost::noncopyable
+	{
+	public:
+		inline ShardedCounter& operator++ () {
+			++shards_.local().value;
+			return *this;
+		}
+
+		inline ShardedCounter& operator+= (long value) {
+			shards_.local().value += value;
+			return *this;
+		}
+
+		inline operator long () {
+			Value total;
+			shards_.collect (total);
+			return total.value;
+		}
+
+	protected:
+		struct Value
+		{
+			Value () : value (0) { }
+			void merge (const Value& other)		{	value += other.value;	}
+			
+			long value;
+		};
+
+		ThreadShards<Value> shards_;
+	};
+}
+
+#endif // ACONNECT_THREAD_SHARDS_H
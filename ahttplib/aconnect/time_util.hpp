@@ -31,9 +31,11 @@ distribution.
 #	include <ctime>
 #elif defined(__GNUC__)
 #	include <sys/time.h>
+#	include <time.h>
 #endif
 
 #include <boost/thread.hpp>
+#include <boost/cstdint.hpp>
 #include "types.hpp"
 
 namespace aconnect 
@@ -86,6 +88,48 @@ namespace aconnect
 			return xt;
 		}
 
+		// monotonic time in microseconds, should be used to measure intervals only
+		typedef boost::uint64_t timestamp_type;
+
+		inline timestamp_type getTimestamp ()
+		{
+#ifdef WIN32
+			static LARGE_INTEGER frequency = {0};
+			LARGE_INTEGER counter;
+			
+			if (frequency.QuadPart == 0)
+				::QueryPerformanceFrequency (&frequency);
+			::QueryPerformanceCounter (&counter);
+
+			return (timestamp_type) (counter.QuadPart / frequency.QuadPart * 1000000 + 
+				(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart);
+#else
+			struct timespec ts;
+			clock_gettime (CLOCK_MONOTONIC, &ts);
+			return (timestamp_type) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+		}
+
+		// wall clock time in microseconds since epoch
+		inline timestamp_type getWallTime ()
+		{
+#ifdef WIN32
+			FILETIME ft;
+			::GetSystemTimeAsFileTime (&ft);
+			timestamp_type t = ((timestamp_type) ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+			return (t - 116444736000000000ULL) / 10; // 100-ns intervals since 1601
+#else
+			struct timeval tv;
+			gettimeofday (&tv, NULL);
+			return (timestamp_type) tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+		}
+
+		inline timestamp_type elapsedTime (timestamp_type from, timestamp_type to)
+		{
+			return (from != 0 && to > from ? to - from : 0);
+		}
+
 	}
 }
 
@@ -30,6 +30,12 @@ distribution.
 #	include <sys/signal.h>
 #endif  //__GNUC__
 
+#if defined (__linux__)
+#	include <sys/sendfile.h>
+#	include <fcntl.h>
+#endif
+
+#include <fstream>
 #include <boost/scoped_array.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
@@ -140,6 +146,142 @@ namespace aconnect {
 		} while (bytesCount > 0);
 	};
 
+	void writeFileToSocket (socket_type s, string_constref filePath, 
+		size_t offset, size_t size) throw (std::runtime_error)
+	{
+		if (0 == size)
+			return;
+
+#if defined (__linux__)
+		int fd = open (filePath.c_str(), O_RDONLY);
+		if (fd == -1)
+			throw std::runtime_error ("File opening failed: " + filePath);
+
+		try {
+			writeFileToSocket (s, fd, filePath, offset, size);
+		} catch (...) {
+			close (fd);
+			throw;
+		}
+
+		close (fd);
+#else
+		std::ifstream file (filePath.c_str(), std::ios::binary);
+		if (file.fail())
+			throw std::runtime_error ("File opening failed: " + filePath);
+
+		file.seekg ((std::streamoff) offset);
+
+		const size_t buffSize = min2 (size, (size_t) network::SocketReadBufferSize);
+		boost::scoped_array<char_type> buff (new char_type [buffSize]);
+		size_t bytesCount = size;
+
+		while (bytesCount > 0) 
+		{
+			file.read (buff.get(), (std::streamsize) min2 (bytesCount, buffSize));
+			if (file.gcount() <= 0)
+				throw std::runtime_error ("File was truncated while sending: " + filePath);
+
+			writeToSocket (s, buff.get(), (int) file.gcount());
+			bytesCount -= (size_t) file.gcount();
+		}
+#endif
+	}
+
+#if defined (__linux__)
+	void writeFileToSocket (socket_type s, int fd, string_constref filePath, 
+		size_t offset, size_t size) throw (std::runtime_error)
+	{
+		off_t fileOffset = (off_t) offset;
+		size_t bytesCount = size;
+
+		while (bytesCount > 0) 
+		{
+			ssize_t written = sendfile (s, fd, &fileOffset, bytesCount);
+			
+			if (written == -1 && errno == EINTR)
+				continue;
+			
+			if (written == 0)
+				throw std::runtime_error ("File was truncated while sending: " + filePath);
+
+			if (written < 0)
+				throw socket_error (s, "Writing file to socket");
+
+			bytesCount -= (size_t) written;
+		}
+	}
+#endif
+
+	void relaySocketData (socket_type from, socket_type to, size_t size) throw (std::runtime_error)
+	{
+		if (0 == size)
+			return;
+
+#if defined (__linux__)
+		int pipeFds[2];
+		if (pipe (pipeFds) == -1)
+			throw std::runtime_error ("Pipe creation failed");
+
+		size_t bytesCount = size;
+
+		try
+		{
+			while (bytesCount > 0) 
+			{
+				ssize_t received = splice (from, NULL, pipeFds[1], NULL, 
+					min2 (bytesCount, (size_t) network::SocketReadBufferSize), SPLICE_F_MOVE | SPLICE_F_MORE);
+
+				if (received == -1 && errno == EINTR)
+					continue;
+				if (received == -1)
+					throw socket_error (from, "Reading data from socket");
+				if (received == 0)
+					throw std::runtime_error ("Connection was closed before all data was relayed");
+
+				bytesCount -= (size_t) received;
+
+				while (received > 0) 
+				{
+					ssize_t written = splice (pipeFds[0], NULL, to, NULL, 
+						(size_t) received, SPLICE_F_MOVE | (bytesCount > 0 ? SPLICE_F_MORE : 0));
+					
+					if (written == -1 && errno == EINTR)
+						continue;
+					if (written <= 0)
+						throw socket_error (to, "Writing data to socket");
+
+					received -= written;
+				}
+			}
+
+		} catch (...) {
+			close (pipeFds[0]);
+			close (pipeFds[1]);
+			throw;
+		}
+
+		close (pipeFds[0]);
+		close (pipeFds[1]);
+#else
+		const size_t buffSize = min2 (size, (size_t) network::SocketReadBufferSize);
+		boost::scoped_array<char_type> buff (new char_type [buffSize]);
+		size_t bytesCount = size;
+
+		while (bytesCount > 0) 
+		{
+			int received = recv (from, buff.get(), (int) min2 (bytesCount, buffSize), 0);
+			if (received == SOCKET_ERROR)
+				throw socket_error (from, "Reading data from socket");
+			if (received == 0)
+				throw std::runtime_error ("Connection was closed before all data was relayed");
+
+			writeToSocket (to, buff.get(), received);
+			bytesCount -= (size_t) received;
+		}
+#endif
+	}
+
 	string readFromSocket (const socket_type s, 
 		SocketStateCheck &stateCheck, 
 		bool throwOnConnectionReset,
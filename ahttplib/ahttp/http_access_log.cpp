@@ -0,0 +1,555 @@
+/*
+This file is part of [ahttp] library.
+
+Author: Artem Kustikov (kustikoff[at]tut.by)
+version: 0.1
+
+This code is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this code.
+
+Permission is granted to anyone to use this code for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this code must not be misrepresented; you must
+not claim that you wrote the original code. If you use this
+code in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original code.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+#include "aconnect/boost_format_safe.hpp"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/static_assert.hpp>
+
+#include <assert.h>
+#include <string.h>
+
+#include "aconnect/aconnect.hpp"
+#include "aconnect/util.hpp"
+#include "aconnect/logger.hpp"
+
+#include "ahttp/http_access_log.hpp"
+#include "ahttp/http_server.hpp"
+
+namespace ahttp
+{
+	BOOST_STATIC_ASSERT (sizeof (AccessLogRecord) == AccessLogRecord::RecordSize);
+
+	const char AccessLog::BinaryMagic[8] = {'A', 'H', 'T', 'T', 'P', 'L', 'O', 'G'};
+
+	namespace detail
+	{
+		inline void copyField (char* dest, size_t destSize,
+			aconnect::string_constptr src, size_t srcSize)
+		{
+			const size_t len = aconnect::util::min2 (srcSize, destSize - 1);
+			memcpy (dest, src, len);
+			dest[len] = '\0';
+		}
+
+		inline void copyField (char* dest, size_t destSize, aconnect::string_constref src) {
+			copyField (dest, destSize, src.c_str(), src.size());
+		}
+
+		inline boost::uint32_t phaseDuration (aconnect::util::timestamp_type from,
+			aconnect::util::timestamp_type to)
+		{
+			aconnect::util::timestamp_type elapsed = aconnect::util::elapsedTime (from, to);
+			return (boost::uint32_t) aconnect::util::min2 (elapsed, (aconnect::util::timestamp_type) 0xFFFFFFFF);
+		}
+
+		// empty fields are written as "-" in NCSA formats
+		inline aconnect::string_constptr fieldValue (aconnect::string_constptr value) {
+			return (value[0] ? value : "-");
+		}
+
+		// thread buffer is written synchronously when flusher thread is behind by this count of batches
+		const size_t MaxBufferedBatches = 4;
+
+		struct BinaryLogHeader
+		{
+			char magic[8];
+			boost::uint32_t version;
+			boost::uint32_t recordSize;
+		};
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//		AccessLogRecord
+	//////////////////////////////////////////////////////////////////////////
+
+	void AccessLogRecord::clear () {
+		memset (this, 0, sizeof(AccessLogRecord));
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//		AccessLog
+	//////////////////////////////////////////////////////////////////////////
+
+	AccessLog::AccessLog () :
+		format_ (FormatCombined),
+		recordsPerBuffer_ (1),
+		flushInterval_ (0),
+		maxFileSize_ (0),
+		outputSize_ (0),
+		flushRequested_ (false),
+		flushThread_ (NULL),
+		stopped_ (false),
+		threadBuffer_ (&AccessLog::cleanupThreadBuffer),
+		droppedCount_ (0),
+		writtenCount_ (0)
+	{
+	}
+
+	AccessLog::~AccessLog () {
+		destroy ();
+	}
+
+	void AccessLog::init (aconnect::string_constref format,
+			aconnect::string_constref filePathTemplate,
+			size_t bufferSize,
+			int flushIntervalSec,
+			size_t maxFileSize) throw (std::runtime_error)
+	{
+		using namespace aconnect;
+
+		if (util::equals (format, AccessLogFormats::Common))
+			format_ = FormatCommon;
+		else if (util::equals (format, AccessLogFormats::Combined))
+			format_ = FormatCombined;
+		else if (util::equals (format, AccessLogFormats::Binary))
+			format_ = FormatBinary;
+		else
+			throw std::runtime_error ("Unknown access log format: " + format);
+
+		if (filePathTemplate.empty())
+			throw std::runtime_error ("Access log file name template is empty");
+
+		filePathTemplate_ = filePathTemplate;
+		recordsPerBuffer_ = util::max2 (bufferSize / sizeof (AccessLogRecord), (size_t) 1);
+		flushInterval_ = (util::timestamp_type) util::max2 (flushIntervalSec, 0) * 1000000;
+		maxFileSize_ = maxFileSize;
+
+		boost::mutex::scoped_lock lock (fileMutex_);
+		createLogFile ();
+	}
+
+	void AccessLog::destroy ()
+	{
+		{
+			boost::mutex::scoped_lock lock (registryMutex_);
+			stopped_ = true;
+		}
+		
+		if (flushThread_) {
+			{
+				boost::mutex::scoped_lock lock (flushMutex_);
+				flushCondition_.notify_one();
+			}
+			flushThread_->join();
+			delete flushThread_;
+			flushThread_ = NULL;
+		}
+		
+		flush ();
+
+		boost::mutex::scoped_lock lock (fileMutex_);
+		if (output_.is_open()) {
+			output_.flush();
+			output_.close();
+		}
+	}
+
+	void AccessLog::cleanupThreadBuffer (ThreadBuffer* buffer)
+	{
+		assert (buffer && buffer->owner);
+		AccessLog* owner = buffer->owner;
+		try
+		{
+			owner->flushBuffer (*buffer);
+		} catch (...) {
+			// eat exception - thread is finishing
+		}
+
+		{
+			boost::mutex::scoped_lock lock (owner->registryMutex_);
+			owner->buffers_.erase (buffer);
+		}
+		delete buffer;
+	}
+
+	AccessLog::ThreadBuffer* AccessLog::threadBuffer ()
+	{
+		ThreadBuffer* buffer = threadBuffer_.get();
+		if (buffer)
+			return buffer;
+
+		buffer = new ThreadBuffer();
+		buffer->owner = this;
+		buffer->records.reserve (recordsPerBuffer_);
+		buffer->lastFlush = aconnect::util::getTimestamp();
+		threadBuffer_.reset (buffer);
+
+		boost::mutex::scoped_lock lock (registryMutex_);
+		buffers_.insert (buffer);
+
+		if (!flushThread_ && !stopped_)
+			flushThread_ = new boost::thread (aconnect::ThreadProcAdapter<void (*) (AccessLog*), AccessLog*>
+				(AccessLog::flushThreadProc, this));
+
+		return buffer;
+	}
+
+	void AccessLog::write (const HttpContext& context)
+	{
+		AccessLogRecord record;
+		fillRecord (record, context);
+		write (record);
+	}
+
+	void AccessLog::write (const AccessLogRecord& record)
+	{
+		using namespace aconnect;
+
+		ThreadBuffer* buffer = threadBuffer();
+		bool flushRequired = false;
+		bool flushOverflow = false;
+
+		{
+			boost::mutex::scoped_lock lock (buffer->mutex);
+			buffer->records.push_back (record);
+			
+			flushRequired = (buffer->records.size() == recordsPerBuffer_);
+			flushOverflow = (buffer->records.size() >= recordsPerBuffer_ * detail::MaxBufferedBatches);
+		}
+
+		// flusher thread is behind (slow disk) - records are written by request thread
+		if (flushOverflow) {
+			flushBuffer (*buffer);
+			return;
+		}
+
+		if (!flushRequired)
+			return;
+
+		boost::mutex::scoped_lock lock (flushMutex_);
+		flushRequested_ = true;
+		flushCondition_.notify_one();
+	}
+
+	void AccessLog::flushThreadProc (AccessLog* log)
+	{
+		using namespace aconnect;
+		assert (log);
+
+		const int waitPeriod = (int) util::max2 (log->flushInterval_ / 1000000, (util::timestamp_type) 1);
+		batches_list batches;
+
+		while (!log->stopped_)
+		{
+			{
+				boost::mutex::scoped_lock lock (log->flushMutex_);
+				if (!log->flushRequested_ && !log->stopped_)
+					log->flushCondition_.timed_wait (lock, util::createTimePeriod (waitPeriod));
+				log->flushRequested_ = false;
+			}
+
+			try
+			{
+				log->writeBatches (batches, log->takeRecords (batches, false));
+			} catch (...) {
+				// eat exception - records are counted as dropped
+			}
+		}
+	}
+
+	size_t AccessLog::takeRecords (batches_list& batches, bool all)
+	{
+		const aconnect::util::timestamp_type now = aconnect::util::getTimestamp();
+		size_t count = 0;
+		
+		// buffers are removed from registry only on thread exit - registry lock 
+		// is held while records are moved, file is written without it
+		boost::mutex::scoped_lock lock (registryMutex_);
+		
+		for (std::set<ThreadBuffer*>::iterator it = buffers_.begin(); it != buffers_.end(); ++it)
+		{
+			ThreadBuffer& buffer = **it;
+			boost::mutex::scoped_lock bufferLock (buffer.mutex);
+			
+			if (buffer.records.empty() || (!all && buffer.records.size() < recordsPerBuffer_ 
+				&& (!flushInterval_ || now - buffer.lastFlush < flushInterval_)))
+				continue;
+
+			if (batches.size() <= count)
+				batches.resize (count + 1);
+
+			// records are taken without copying, buffer gets cleared storage of previous batch
+			std::vector<AccessLogRecord>& batch = batches[count++];
+			batch.clear();
+			batch.reserve (recordsPerBuffer_);
+			batch.swap (buffer.records);
+			buffer.lastFlush = now;
+		}
+
+		return count;
+	}
+
+	void AccessLog::writeBatches (batches_list& batches, size_t count)
+	{
+		for (size_t ndx = 0; ndx < count; ++ndx) {
+			writeRecords (batches[ndx]);
+			batches[ndx].clear();
+		}
+	}
+
+	void AccessLog::flush ()
+	{
+		batches_list batches;
+		writeBatches (batches, takeRecords (batches, true));
+	}
+
+	void AccessLog::flushBuffer (ThreadBuffer& buffer)
+	{
+		std::vector<AccessLogRecord> batch;
+		{
+			boost::mutex::scoped_lock lock (buffer.mutex);
+			buffer.lastFlush = aconnect::util::getTimestamp();
+			batch.swap (buffer.records);
+		}
+
+		if (!batch.empty())
+			writeRecords (batch);
+	}
+
+	void AccessLog::writeRecords (const std::vector<AccessLogRecord>& records)
+	{
+		boost::mutex::scoped_lock lock (fileMutex_);
+
+		if (!output_.is_open() || output_.fail()) {
+			for (size_t ndx = 0; ndx < records.size(); ++ndx)
+				++droppedCount_;
+			return;
+		}
+
+		size_t dataSize = 0;
+
+		if (format_ == FormatBinary) {
+			dataSize = records.size() * sizeof (AccessLogRecord);
+			output_.write ((const char*) &records[0], (std::streamsize) dataSize);
+
+		} else {
+			formatBuffer_.str ("");
+			for (std::vector<AccessLogRecord>::const_iterator it = records.begin(); it != records.end(); ++it) {
+				formatRecord (formatBuffer_, *it, format_);
+				formatBuffer_ << '\n';
+			}
+
+			const aconnect::string& data = formatBuffer_.str();
+			dataSize = data.size();
+			output_.write (data.c_str(), (std::streamsize) dataSize);
+		}
+		output_.flush();
+
+		if (output_.fail()) {
+			for (size_t ndx = 0; ndx < records.size(); ++ndx)
+				++droppedCount_;
+			return;
+		}
+
+		for (size_t ndx = 0; ndx < records.size(); ++ndx)
+			++writtenCount_;
+
+		outputSize_ += dataSize;
+		if (maxFileSize_ && outputSize_ >= maxFileSize_) {
+			try {
+				createLogFile ();
+			} catch (std::runtime_error &) {
+				// file is closed - next records will be counted as dropped
+			}
+		}
+	}
+
+	void AccessLog::createLogFile () throw (std::runtime_error)
+	{
+		namespace fs = boost::filesystem;
+		using boost::format;
+		using namespace aconnect;
+
+		struct tm tmTime = util::getDateTime();
+		format tsFormat ("%02.d_%02.d_%02.d_%02.d_%02.d_%02.d");
+		tsFormat % tmTime.tm_mday % (tmTime.tm_mon + 1) % (tmTime.tm_year + 1900);
+		tsFormat % (tmTime.tm_hour) % (tmTime.tm_min) % (tmTime.tm_sec);
+		const string ts = tsFormat.str();
+
+		string fileNameInit;
+		if (filePathTemplate_.find (Log::TimeStampMark) != string::npos )
+			fileNameInit = boost::algorithm::replace_all_copy (filePathTemplate_, Log::TimeStampMark, ts);
+		else
+			fileNameInit = filePathTemplate_ + ts;
+
+		fs::path fileName (fileNameInit);
+		const string ext = fs::extension (fileName);
+		format extFormat (".%06.d" + ext);
+
+		int ndx = 0;
+		while ( fs::exists (fileName) ) {
+			extFormat % ndx;
+			fileName = fs::change_extension (fs::path (fileNameInit),
+				extFormat.str() ) ;
+
+			extFormat.clear();
+			++ndx;
+		}
+
+		if (output_.is_open()) {
+			output_.flush();
+			output_.close();
+		}
+		output_.clear();
+		output_.open ( fileName.file_string().c_str(), std::ios::out | std::ios::binary );
+		outputSize_ = 0;
+
+		if (output_.fail())
+			throw std::runtime_error ( boost::str ( format("Cannot create \"%s\" access log file") % fileName.file_string().c_str()) );
+
+		if (format_ == FormatBinary)
+			writeFileHeader ();
+	}
+
+	void AccessLog::writeFileHeader ()
+	{
+		detail::BinaryLogHeader header;
+		memcpy (header.magic, BinaryMagic, sizeof (header.magic));
+		header.version = BinaryVersion;
+		header.recordSize = sizeof (AccessLogRecord);
+
+		output_.write ((const char*) &header, sizeof (header));
+		outputSize_ += sizeof (header);
+	}
+
+	void AccessLog::fillRecord (AccessLogRecord& record, const HttpContext& context)
+	{
+		using namespace aconnect;
+		typedef AccessLogRecord rec;
+
+		record.clear();
+
+		const HttpRequestTimes& times = context.Times;
+		const HttpResponseStream& stream = context.Response.Stream;
+
+		record.wallTime = util::getWallTime();
+		record.bytesSent = stream.bytesSent();
+		record.bytesReceived = context.RequestHeader.HeaderLength + context.RequestHeader.ContentLength;
+
+		record.durations[rec::PhaseQueueWait] = detail::phaseDuration (times.accepted, times.workerStarted);
+		record.durations[rec::PhaseRouting] = detail::phaseDuration (times.headerLoaded, times.targetFound);
+		record.durations[rec::PhaseHandler] = detail::phaseDuration (times.handlerStarted, times.handlerFinished);
+		record.durations[rec::PhaseSend] = detail::phaseDuration (stream.firstByteTime(), stream.lastByteTime());
+		record.durations[rec::PhaseTotal] = detail::phaseDuration (
+			times.accepted ? times.accepted : times.workerStarted, times.finished);
+
+		record.status = (boost::uint16_t) (context.Response.Header.Status > 0 ? context.Response.Header.Status : 0);
+		record.httpVersion = (boost::uint8_t) (context.RequestHeader.VersionHigh * 10 + context.RequestHeader.VersionLow);
+		memcpy (record.ip, context.Client->ip, sizeof (record.ip));
+
+		if (util::equals (context.RequestHeader.getHeader (detail::HeaderConnection), detail::ConnectionKeepAlive)
+			|| util::equals (context.RequestHeader.getHeader (detail::HeaderProxyConnection), detail::ConnectionKeepAlive))
+			record.flags |= rec::FlagKeepAlive;
+
+		detail::copyField (record.method, rec::MethodSize, context.RequestHeader.Method);
+		if (context.Handler)
+			detail::copyField (record.handler, rec::HandlerSize, context.Handler->name);
+		detail::copyField (record.path, rec::PathSize, context.RequestHeader.Path);
+		detail::copyField (record.referer, rec::RefererSize, context.RequestHeader.getHeader (detail::HeaderReferer));
+		detail::copyField (record.userAgent, rec::UserAgentSize, context.RequestHeader.getHeader (detail::HeaderUserAgent));
+	}
+
+	// sample: 127.0.0.1 - - [10/Oct/2000:13:55:36 +0000] "GET /apache_pb.gif HTTP/1.0" 200 2326 "http://www.example.com/start.html" "Mozilla/4.08"
+	void AccessLog::formatRecord (std::ostream& output, const AccessLogRecord& record, Format format)
+	{
+		using namespace aconnect;
+
+		const int buffSize = 32;
+		char_type buff[buffSize] = {0};
+
+		struct tm tmTime = util::getDateTimeUtc ((time_t) (record.wallTime / 1000000));
+		snprintf (buff, buffSize, "%.2d/%s/%.4d:%.2d:%.2d:%.2d +0000",
+			tmTime.tm_mday,
+			detail::Months_RFC1123[tmTime.tm_mon],
+			tmTime.tm_year + 1900,
+			tmTime.tm_hour,
+			tmTime.tm_min,
+			tmTime.tm_sec);
+
+		output << (int) record.ip[0] << '.' << (int) record.ip[1] << '.'
+			<< (int) record.ip[2] << '.' << (int) record.ip[3];
+		output << " - - [" << buff << "] \"";
+		output << detail::fieldValue (record.method) << ' ' << detail::fieldValue (record.path);
+		output << " HTTP/" << (record.httpVersion / 10) << '.' << (record.httpVersion % 10) << "\" ";
+		output << record.status << ' ';
+
+		if (record.bytesSent)
+			output << record.bytesSent;
+		else
+			output << '-';
+
+		if (format == FormatCommon)
+			return;
+
+		output << " \"" << detail::fieldValue (record.referer) << "\" \"" << detail::fieldValue (record.userAgent) << "\"";
+	}
+
+	size_t AccessLog::decode (std::istream& input, std::ostream& output) throw (std::runtime_error)
+	{
+		typedef AccessLogRecord rec;
+
+		detail::BinaryLogHeader header;
+		input.read ((char*) &header, sizeof (header));
+
+		if (input.gcount() != sizeof (header)
+			|| memcmp (header.magic, BinaryMagic, sizeof (header.magic)) != 0)
+			throw std::runtime_error ("Input is not a binary access log");
+
+		if (header.version != BinaryVersion || header.recordSize != sizeof (AccessLogRecord))
+			throw std::runtime_error ( boost::str (boost::format ("Unsupported binary access log version: %u, record size: %u")
+				% header.version % header.recordSize) );
+
+		AccessLogRecord record;
+		size_t count = 0;
+
+		while (input.read ((char*) &record, sizeof (record)) && input.gcount() == sizeof (record))
+		{
+			// make decoder safe against damaged records
+			record.method[rec::MethodSize - 1] = '\0';
+			record.handler[rec::HandlerSize - 1] = '\0';
+			record.path[rec::PathSize - 1] = '\0';
+			record.referer[rec::RefererSize - 1] = '\0';
+			record.userAgent[rec::UserAgentSize - 1] = '\0';
+
+			formatRecord (output, record, FormatCombined);
+
+			output << " queue=" << record.durations[rec::PhaseQueueWait]
+				<< " route=" << record.durations[rec::PhaseRouting]
+				<< " handler=" << record.durations[rec::PhaseHandler]
+				<< " send=" << record.durations[rec::PhaseSend]
+				<< " total=" << record.durations[rec::PhaseTotal]
+				<< " in=" << record.bytesReceived
+				<< " handler_name=" << detail::fieldValue (record.handler)
+				<< " keep_alive=" << ((record.flags & rec::FlagKeepAlive) ? 1 : 0)
+				<< '\n';
+			++count;
+		}
+
+		return count;
+	}
+}
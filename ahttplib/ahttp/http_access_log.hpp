@@ -0,0 +1,208 @@
+/*
+This file is part of [ahttp] library.
+
+Author: Artem Kustikov (kustikoff[at]tut.by)
+version: 0.1
+
+This code is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this code.
+
+Permission is granted to anyone to use this code for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this code must not be misrepresented; you must
+not claim that you wrote the original code. If you use this
+code in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original code.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+#ifndef AHTTP_ACCESS_LOG_H
+#define AHTTP_ACCESS_LOG_H
+#pragma once
+
+#include <set>
+#include <vector>
+#include <fstream>
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/detail/atomic_count.hpp>
+
+#include "aconnect/types.hpp"
+#include "aconnect/complex_types.hpp"
+#include "aconnect/time_util.hpp"
+
+namespace ahttp
+{
+	namespace AccessLogFormats
+	{
+		aconnect::string_constant Common = "common";		// NCSA common log format
+		aconnect::string_constant Combined = "combined";	// NCSA combined log format
+		aconnect::string_constant Binary = "binary";		// fixed-size AccessLogRecord entries, see AccessLog::decode
+	}
+
+	// Fixed-size access log record - stored "as is" (host byte order) in binary mode.
+	// String fields are zero-terminated and truncated to the field size.
+	struct AccessLogRecord
+	{
+		enum Sizes
+		{
+			RecordSize = 512,
+			MethodSize = 8,
+			HandlerSize = 16,
+			PathSize = 256,
+			RefererSize = 96,
+			UserAgentSize = 84
+		};
+
+		// request processing phases, microseconds
+		enum Phase
+		{
+			PhaseQueueWait = 0,		// accepted -> taken by worker
+			PhaseRouting,			// header loaded -> target found
+			PhaseHandler,			// handler execution
+			PhaseSend,				// first byte sent -> last byte sent
+			PhaseTotal,				// accepted (or taken by worker) -> request completed
+			PhasesCount
+		};
+
+		enum Flags
+		{
+			FlagKeepAlive = 0x01
+		};
+
+		boost::uint64_t wallTime;			// request completion time, microseconds since epoch
+		boost::uint64_t bytesSent;
+		boost::uint64_t bytesReceived;
+		boost::uint32_t durations[PhasesCount];
+		boost::uint16_t status;
+		boost::uint8_t flags;
+		boost::uint8_t httpVersion;			// VersionHigh * 10 + VersionLow
+		boost::uint8_t ip[4];
+		char method[MethodSize];
+		char handler[HandlerSize];
+		char path[PathSize];
+		char referer[RefererSize];
+		char userAgent[UserAgentSize];
+
+		void clear ();
+	};
+
+	/**
+	*	Buffered HTTP access log.
+	*	Records are collected in per-thread buffers without any shared lock, background
+	*	flusher thread writes them to file in batches when the buffer is filled or
+	*	flush interval is expired - request threads never wait for file I/O.
+	*	Formatting (for text formats) is performed on flush. Flusher thread is started
+	*	with the first request thread, so handlers can fork before it.
+	*/
+	class AccessLog : private boost::noncopyable
+	{
+	public:
+		static const char BinaryMagic[8];
+		static const boost::uint32_t BinaryVersion = 1;
+
+		AccessLog ();
+		~AccessLog ();
+
+		// filePathTemplate can contain "{timestamp}" mark (see FileLogger::init)
+		void init (aconnect::string_constref format,
+			aconnect::string_constref filePathTemplate,
+			size_t bufferSize,
+			int flushIntervalSec,
+			size_t maxFileSize) throw (std::runtime_error);
+
+		// stop flusher thread, flush all buffers and close file
+		void destroy ();
+
+		void write (const class HttpContext& context);
+		void write (const AccessLogRecord& record);
+
+		// flush buffers of all threads
+		void flush ();
+
+		inline bool isBinary () const				{	return format_ == FormatBinary;		}
+		inline long droppedCount () const			{	return droppedCount_;				}
+		inline long writtenCount () const			{	return writtenCount_;				}
+
+		static void fillRecord (AccessLogRecord& record, const class HttpContext& context);
+
+		/**
+		*	Decode binary access log to text: combined format with phases timing appended
+		*	returns count of decoded records
+		*/
+		static size_t decode (std::istream& input, std::ostream& output) throw (std::runtime_error);
+
+	protected:
+		enum Format
+		{
+			FormatCommon,
+			FormatCombined,
+			FormatBinary
+		};
+
+		struct ThreadBuffer
+		{
+			AccessLog* owner;
+			boost::mutex mutex;	// uncontended except flush from flusher thread
+			std::vector<AccessLogRecord> records;
+			aconnect::util::timestamp_type lastFlush;
+		};
+
+		static void cleanupThreadBuffer (ThreadBuffer* buffer);
+		static void formatRecord (std::ostream& output, const AccessLogRecord& record, Format format);
+		static void flushThreadProc (AccessLog* log);
+
+		typedef std::vector<std::vector<AccessLogRecord> > batches_list;
+
+		ThreadBuffer* threadBuffer ();
+		// buffer records are written without holding buffer lock
+		void flushBuffer (ThreadBuffer& buffer);
+		// records of filled and expired (or all) buffers are moved to "batches" under registry lock,
+		// returns count of filled batches - they are written by "writeBatches" after lock releasing
+		size_t takeRecords (batches_list& batches, bool all);
+		void writeBatches (batches_list& batches, size_t count);
+		void writeRecords (const std::vector<AccessLogRecord>& records);
+
+		void createLogFile () throw (std::runtime_error);
+		void writeFileHeader ();
+
+	protected:
+		Format format_;
+		aconnect::string filePathTemplate_;
+		size_t recordsPerBuffer_;
+		aconnect::util::timestamp_type flushInterval_;
+		size_t maxFileSize_;
+
+		boost::mutex fileMutex_;
+		std::ofstream output_;
+		size_t outputSize_;
+		aconnect::str_stream formatBuffer_;
+
+		boost::mutex registryMutex_;
+		std::set<ThreadBuffer*> buffers_;
+
+		boost::mutex flushMutex_;
+		boost::condition flushCondition_;
+		bool flushRequested_;
+		boost::thread* flushThread_;
+		volatile bool stopped_;
+
+		boost::thread_specific_ptr<ThreadBuffer> threadBuffer_;
+
+		boost::detail::atomic_count droppedCount_;
+		boost::detail::atomic_count writtenCount_;
+	};
+}
+
+#endif // AHTTP_ACCESS_LOG_H
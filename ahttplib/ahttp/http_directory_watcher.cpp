@@ -0,0 +1,216 @@
+/*
+This file is part of [ahttp] library. 
+
+Author: Artem Kustikov (kustikoff[at]tut.by)
+version: 0.1
+
+This code is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this code.
+
+Permission is granted to anyone to use this code for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this code must not be misrepresented; you must
+not claim that you wrote the original code. If you use this
+code in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original code.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#include <assert.h>
+#include <errno.h>
+
+#if defined (__linux__)
+#	include <unistd.h>
+#	include <poll.h>
+#	include <sys/inotify.h>
+#endif
+
+#include "ahttp/http_directory_watcher.hpp"
+
+namespace ahttp
+{
+	namespace detail
+	{
+		const int WatchPollTimeout = 1000;	// ms, watcher thread checks stop flag with this period
+	}
+
+	DirectoryWatcher::DirectoryWatcher (Listener& listener, int events, size_t maxWatches) :
+		listener_ (listener),
+		events_ (events),
+		maxWatches_ (maxWatches),
+		fd_ (-1),
+		watchThread_ (NULL),
+		stopped_ (false)
+	{
+	}
+
+	DirectoryWatcher::~DirectoryWatcher ()
+	{
+		stopped_ = true;
+		if (watchThread_) {
+			watchThread_->join();
+			delete watchThread_;
+		}
+#if defined (__linux__)
+		if (fd_ != -1)
+			close (fd_);
+#endif
+	}
+
+	bool DirectoryWatcher::start ()
+	{
+#if defined (__linux__)
+		if (fd_ != -1)
+			return true;
+
+		fd_ = inotify_init ();
+		if (fd_ == -1)
+			return false;
+
+		watchThread_ = new boost::thread (aconnect::ThreadProcAdapter<void (*) (DirectoryWatcher*), DirectoryWatcher*>
+			(DirectoryWatcher::watchThreadProc, this));
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	DirectoryWatcher::WatchResult DirectoryWatcher::watch (aconnect::string_constref dirPath)
+	{
+#if defined (__linux__)
+		if (fd_ == -1)
+			return Failed;
+
+		boost::mutex::scoped_lock lock (mutex_);
+
+		if (watches_.find (dirPath) != watches_.end())
+			return Watched;
+		if (watches_.size() >= maxWatches_)
+			return LimitReached;
+
+		uint32_t mask = IN_ONLYDIR | IN_DELETE_SELF | IN_MOVE_SELF;
+		if (events_ & ItemsAdded)
+			mask |= IN_CREATE | IN_MOVED_TO;
+		if (events_ & ItemsRemoved)
+			mask |= IN_DELETE | IN_MOVED_FROM;
+		if (events_ & ItemsModified)
+			mask |= IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB;
+
+		const int wd = inotify_add_watch (fd_, dirPath.c_str(), mask);
+		if (wd == -1)
+			return (errno == ENOENT || errno == ENOTDIR) ? NotFound : Failed;
+
+		watches_[dirPath] = wd;
+		paths_[wd] = dirPath;
+		return Watched;
+#else
+		return Failed;
+#endif
+	}
+
+	void DirectoryWatcher::unwatch (aconnect::string_constref dirPath)
+	{
+#if defined (__linux__)
+		boost::mutex::scoped_lock lock (mutex_);
+
+		std::map<aconnect::string, int>::iterator it = watches_.find (dirPath);
+		if (it == watches_.end())
+			return;
+
+		// IN_IGNORED event of removed watch is skipped - descriptor is unknown
+		inotify_rm_watch (fd_, it->second);
+		paths_.erase (it->second);
+		watches_.erase (it);
+#endif
+	}
+
+	void DirectoryWatcher::unwatchAll ()
+	{
+#if defined (__linux__)
+		boost::mutex::scoped_lock lock (mutex_);
+
+		for (std::map<int, aconnect::string>::const_iterator it = paths_.begin(); it != paths_.end(); ++it)
+			inotify_rm_watch (fd_, it->first);
+
+		paths_.clear();
+		watches_.clear();
+#endif
+	}
+
+	size_t DirectoryWatcher::watchesCount ()
+	{
+		boost::mutex::scoped_lock lock (mutex_);
+		return watches_.size();
+	}
+
+	void DirectoryWatcher::watchThreadProc (DirectoryWatcher* watcher)
+	{
+#if defined (__linux__)
+		assert (watcher);
+		// inotify_event records are aligned in buffer
+		union {
+			struct inotify_event event;
+			char data[16 * 1024];
+		} buff;
+
+		while (!watcher->stopped_)
+		{
+			pollfd pfd;
+			pfd.fd = watcher->fd_;
+			pfd.events = POLLIN;
+			pfd.revents = 0;
+
+			if (poll (&pfd, 1, detail::WatchPollTimeout) <= 0)
+				continue;
+
+			const ssize_t len = read (watcher->fd_, buff.data, sizeof (buff.data));
+			if (len > 0)
+				watcher->processEvents (buff.data, (size_t) len);
+		}
+#endif
+	}
+
+	void DirectoryWatcher::processEvents (const char* buff, size_t size)
+	{
+#if defined (__linux__)
+		for (size_t offset = 0; offset + sizeof (inotify_event) <= size; )
+		{
+			const inotify_event* event = (const inotify_event*) (buff + offset);
+			offset += sizeof (inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				listener_.directoryChanged (aconnect::string());
+				continue;
+			}
+
+			aconnect::string dirPath;
+			{
+				boost::mutex::scoped_lock lock (mutex_);
+				
+				std::map<int, aconnect::string>::iterator it = paths_.find (event->wd);
+				if (it == paths_.end())
+					continue;
+				
+				dirPath = it->second;
+				
+				// watch is removed (directory deleted or moved)
+				if (event->mask & IN_IGNORED) {
+					watches_.erase (dirPath);
+					paths_.erase (it);
+				}
+			}
+
+			listener_.directoryChanged (dirPath);
+		}
+#endif
+	}
+}
@@ -0,0 +1,104 @@
+/*
+This file is part of [ahttp] library. 
+
+Author: Artem Kustikov (kustikoff[at]tut.by)
+version: 0.1
+
+This code is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this code.
+
+Permission is granted to anyone to use this code for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this code must not be misrepresented; you must
+not claim that you wrote the original code. If you use this
+code in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original code.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#ifndef AHTTP_DIRECTORY_WATCHER_H
+#define AHTTP_DIRECTORY_WATCHER_H
+#pragma once
+
+#include <map>
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+
+#include "aconnect/types.hpp"
+
+namespace ahttp
+{
+	/**
+	*	File system directories watcher (inotify on Linux), events are read in separate thread 
+	*	and passed to listener. On other platforms watcher can not be started - caches must 
+	*	validate entries in other way.
+	*/
+	class DirectoryWatcher : private boost::noncopyable
+	{
+	public:
+		class Listener
+		{
+		public:
+			virtual ~Listener () { }
+			// called from watcher thread, "dirPath" is empty when events were lost (queue overflow)
+			virtual void directoryChanged (aconnect::string_constref dirPath) = 0;
+		};
+
+		enum Events
+		{
+			ItemsAdded		= 1,	// created, moved in
+			ItemsRemoved	= 2,	// deleted, moved out
+			ItemsModified	= 4		// content or attributes changed
+		};
+
+		enum WatchResult
+		{
+			Watched,
+			NotFound,				// directory does not exist
+			LimitReached,			// watches limit reached - unused watches must be removed
+			Failed					// system error or watcher is not started
+		};
+
+		DirectoryWatcher (Listener& listener, int events, size_t maxWatches);
+		~DirectoryWatcher ();
+
+		// returns false if watching is not supported
+		bool start ();
+		inline bool isStarted () const		{	return fd_ != -1;	}
+
+		// directory changes are reported until it is removed or moved
+		WatchResult watch (aconnect::string_constref dirPath);
+		// pending events of directory are ignored
+		void unwatch (aconnect::string_constref dirPath);
+		void unwatchAll ();
+		size_t watchesCount ();
+
+	protected:
+		static void watchThreadProc (DirectoryWatcher* watcher);
+		void processEvents (const char* buff, size_t size);
+
+	protected:
+		Listener& listener_;
+		const int events_;
+		const size_t maxWatches_;
+		
+		int fd_;
+		boost::mutex mutex_;
+		std::map<aconnect::string, int> watches_;	// key - directory path, value - watch descriptor
+		std::map<int, aconnect::string> paths_;
+		
+		boost::thread* watchThread_;
+		volatile bool stopped_;
+	};
+}
+
+#endif // AHTTP_DIRECTORY_WATCHER_H
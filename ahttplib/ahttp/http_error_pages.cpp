@@ -0,0 +1,142 @@
+/*
+This file is part of [ahttp] library. 
+
+Author: Artem Kustikov (kustikoff[at]tut.by)
+version: 0.1
+
+This code is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this code.
+
+Permission is granted to anyone to use this code for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this code must not be misrepresented; you must
+not claim that you wrote the original code. If you use this
+code in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original code.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#include <string.h>
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "aconnect/util.hpp"
+
+#include "ahttp/http_support.hpp"
+#include "ahttp/http_messages.hpp"
+#include "ahttp/http_response_header.hpp"
+#include "ahttp/http_error_pages.hpp"
+
+namespace ahttp
+{
+	namespace detail
+	{
+		// page is formatted with this description and split by it
+		aconnect::string_constant ErrorDescriptionMark = "\x01";
+	}
+
+	void HttpErrorPages::init (aconnect::string_constref serverName)
+	{
+		using namespace aconnect;
+
+		for (int status = FirstStatus; status <= LastStatus; ++status) {
+			if (!util::equals (detail::httpStatusDesc (status), "Undefined"))
+				preparePage (pages_[status - FirstStatus], status);
+		}
+
+		string page;
+		formatPage (page, 503, messages::Error503);
+
+		serviceUnavailableResponse_ = HttpResponseHeader::getResponseStatusString (503);
+		serviceUnavailableResponse_.append (detail::HeaderContentType).append (detail::HeaderValueDelimiter)
+			.append (detail::ContentTypeTextHtml).append (detail::HeadersDelimiter);
+		serviceUnavailableResponse_.append (detail::HeaderContentLength).append (detail::HeaderValueDelimiter)
+			.append (boost::lexical_cast<string> (page.size())).append (detail::HeadersDelimiter);
+		if (!serverName.empty())
+			serviceUnavailableResponse_.append (detail::HeaderServer).append (detail::HeaderValueDelimiter)
+				.append (serverName).append (detail::HeadersDelimiter);
+		serviceUnavailableResponse_.append (detail::HeaderConnection).append (detail::HeaderValueDelimiter)
+			.append (detail::ConnectionClose).append (detail::HeadersDelimiter);
+		serviceUnavailableResponse_.append (detail::HeadersDelimiter);
+		serviceUnavailableResponse_.append (page);
+	}
+
+	void HttpErrorPages::formatPage (aconnect::string& page, int status, 
+		aconnect::string_constptr message,
+		aconnect::string_constptr param1, 
+		aconnect::string_constptr param2) const
+	{
+		Page preparedPage;
+		const Page* source = NULL;
+		
+		if (status >= FirstStatus && status <= LastStatus && !pages_[status - FirstStatus].prefix.empty()) {
+			source = &pages_[status - FirstStatus];
+		} else {
+			preparePage (preparedPage, status);
+			source = &preparedPage;
+		}
+
+		if (!message)
+			message = messages::ErrorUndefined;
+
+		page.reserve (source->prefix.size() + source->suffix.size() + strlen (message)
+			+ (param1 ? strlen (param1) : 0) + (param2 ? strlen (param2) : 0));
+		
+		page.assign (source->prefix);
+		fillTemplate (page, message, param1, param2);
+		page.append (source->suffix);
+	}
+
+	void HttpErrorPages::fillTemplate (aconnect::string& out, aconnect::string_constptr format,
+		aconnect::string_constptr param1, 
+		aconnect::string_constptr param2)
+	{
+		aconnect::string_constptr params[] = { param1, param2 };
+		size_t paramNdx = 0;
+		aconnect::string_constptr chunk = format;
+
+		for (aconnect::string_constptr pos = format; *pos; ++pos)
+		{
+			if (*pos != '%')
+				continue;
+
+			out.append (chunk, pos - chunk);
+			
+			if (pos[1] == 's') {
+				if (paramNdx < sizeof (params) / sizeof (params[0]) && params[paramNdx])
+					out.append (params[paramNdx]);
+				++paramNdx;
+				++pos;
+			} else if (pos[1] == '%') {
+				out += '%';
+				++pos;
+			} else {
+				out += '%';
+			}
+
+			chunk = pos + 1;
+		}
+
+		out.append (chunk);
+	}
+
+	void HttpErrorPages::preparePage (Page& page, int status)
+	{
+		const aconnect::string statusDesc = detail::httpStatusDesc (status);
+		const aconnect::string content = boost::str (boost::format (messages::MessageFormat) 
+			% statusDesc % statusDesc % detail::ErrorDescriptionMark);
+
+		const size_t markPos = content.find (detail::ErrorDescriptionMark);
+		page.prefix = content.substr (0, markPos);
+		page.suffix = content.substr (markPos + 1);
+	}
+}
@@ -0,0 +1,87 @@
+/*
+This file is part of [ahttp] library. 
+
+Author: Artem Kustikov (kustikoff[at]tut.by)
+version: 0.1
+
+This code is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this code.
+
+Permission is granted to anyone to use this code for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this code must not be misrepresented; you must
+not claim that you wrote the original code. If you use this
+code in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original code.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#ifndef AHTTP_ERROR_PAGES_H
+#define AHTTP_ERROR_PAGES_H
+#pragma once
+
+#include "aconnect/types.hpp"
+
+namespace ahttp
+{
+	/**
+	*	Error pages prepared at settings load: page parts around description are formatted once
+	*	per status, description is filled from message template by simple "%s" substitution.
+	*	Complete 503 response (status line, headers, page) is kept for overload shedding path.
+	*/
+	class HttpErrorPages
+	{
+	public:
+		enum Statuses
+		{
+			FirstStatus = 300,
+			LastStatus = 505
+		};
+
+		// "serverName" - "Server" header value of serialized responses
+		void init (aconnect::string_constref serverName);
+
+		/*
+		*	Format error page, "message" - description template ("%s" marks are replaced 
+		*	by parameters, "%%" - by '%'), NULL - undefined error description.
+		*/
+		void formatPage (aconnect::string& page, int status, 
+			aconnect::string_constptr message = NULL,
+			aconnect::string_constptr param1 = NULL, 
+			aconnect::string_constptr param2 = NULL) const;
+
+		// complete "503 Service Unavailable" response, connection is closed after it
+		inline aconnect::string_constref serviceUnavailableResponse () const {
+			return serviceUnavailableResponse_;
+		}
+
+		// append "format" to "out" with "%s" marks replaced by parameters (NULL - empty string)
+		static void fillTemplate (aconnect::string& out, aconnect::string_constptr format,
+			aconnect::string_constptr param1 = NULL, 
+			aconnect::string_constptr param2 = NULL);
+
+	protected:
+		struct Page
+		{
+			aconnect::string prefix;	// page content before description
+			aconnect::string suffix;
+		};
+
+		static void preparePage (Page& page, int status);
+
+	protected:
+		Page pages_[LastStatus - FirstStatus + 1];
+		aconnect::string serviceUnavailableResponse_;
+	};
+}
+
+#endif // AHTTP_ERROR_PAGES_H
@@ -0,0 +1,101 @@
+/*
+This file is part of [ahttp] library. 
+
+Author: Artem Kustikov (kustikoff[at]tut.by)
+version: 0.1
+
+This code is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this code.
+
+Permission is granted to anyone to use this code for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this code must not be misrepresented; you must
+not claim that you wrote the original code. If you use this
+code in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original code.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#include <string.h>
+
+#include "ahttp/http_handler.hpp"
+
+namespace ahttp
+{
+	namespace
+	{
+		const size_t ArenaAlignment = 2 * sizeof (void*);
+	}
+
+	RequestArena::~RequestArena ()
+	{
+		reset ();
+
+		for (size_t ndx = 0; ndx < blocks_.size(); ++ndx)
+			delete [] blocks_[ndx];
+	}
+
+	void* RequestArena::allocate (size_t size)
+	{
+		if (0 == size)
+			size = 1;
+		size = (size + ArenaAlignment - 1) & ~(ArenaAlignment - 1);
+		
+		allocatedSize_ += size;
+
+		if (size > blockSize_ / 2) {
+			largeBlocks_.push_back (new aconnect::char_type [size]);
+			return largeBlocks_.back();
+		}
+
+		if (blocks_.empty() || blockUsed_ + size > blockSize_) 
+		{
+			if (!blocks_.empty())
+				++currentBlock_;
+			
+			if (currentBlock_ == blocks_.size())
+				blocks_.push_back (new aconnect::char_type [blockSize_]);
+			
+			blockUsed_ = 0;
+		}
+
+		void *ptr = blocks_[currentBlock_] + blockUsed_;
+		blockUsed_ += size;
+
+		return ptr;
+	}
+
+	aconnect::string_ptr RequestArena::copy (aconnect::string_constref str)
+	{
+		aconnect::string_ptr ptr = (aconnect::string_ptr) allocate (str.size() + 1);
+		str.copy (ptr, str.size());
+		ptr[str.size()] = '\0';
+
+		return ptr;
+	}
+
+	void RequestArena::reset ()
+	{
+		for (size_t ndx = 0; ndx < largeBlocks_.size(); ++ndx)
+			delete [] largeBlocks_[ndx];
+		largeBlocks_.clear();
+
+		while (blocks_.size() > defaults::RequestArenaKeptBlocks) {
+			delete [] blocks_.back();
+			blocks_.pop_back();
+		}
+
+		currentBlock_ = 0;
+		blockUsed_ = 0;
+		allocatedSize_ = 0;
+	}
+}
@@ -0,0 +1,113 @@
+/*
+This file is part of [ahttp] library. 
+
+Author: Artem Kustikov (kustikoff[at]tut.by)
+version: 0.1
+
+This code is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this code.
+
+Permission is granted to anyone to use this code for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this code must not be misrepresented; you must
+not claim that you wrote the original code. If you use this
+code in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original code.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#ifndef AHTTP_HANDLER_H
+#define AHTTP_HANDLER_H
+#pragma once
+
+#include <vector>
+#include <boost/noncopyable.hpp>
+
+#include "aconnect/types.hpp"
+#include "aconnect/complex_types.hpp"
+
+namespace ahttp
+{
+	class HttpContext;
+	class HttpServerSettings;
+
+	// version of IHttpHandler interface, passed to handler factory
+	const int HandlerApiVersion = 2;
+
+	namespace defaults
+	{
+		const size_t RequestArenaBlockSize		= 16 * 1024;	// bytes
+		const size_t RequestArenaKeptBlocks		= 4;			// blocks kept for the next request
+	}
+
+	/**
+	*	Request scoped memory: allocations are released together after request completion
+	*	(destructors are not called). Arena is owned by worker thread and reused by its requests.
+	*/
+	class RequestArena : private boost::noncopyable
+	{
+	public:
+		RequestArena (size_t blockSize = defaults::RequestArenaBlockSize) :
+			blockSize_ (blockSize), currentBlock_ (0), blockUsed_ (0), allocatedSize_ (0) { }
+		~RequestArena ();
+
+		// returns memory aligned for any fundamental type, throws std::bad_alloc
+		void* allocate (size_t size);
+		// zero-terminated copy of string
+		aconnect::string_ptr copy (aconnect::string_constref str);
+		
+		// releases all allocations, several blocks are kept for reuse
+		void reset ();
+
+		inline size_t allocatedSize () const	{	return allocatedSize_;	}
+
+	protected:
+		std::vector<aconnect::string_ptr> blocks_;
+		std::vector<aconnect::string_ptr> largeBlocks_;	// allocations bigger than half of block
+		size_t blockSize_;
+		size_t currentBlock_;
+		size_t blockUsed_;
+		size_t allocatedSize_;
+	};
+
+	/**
+	*	Native handler interface (API v2). Handler library exports factory:
+	*		HANDLER_EXPORT ahttp::IHttpHandler* createHandler (int apiVersion);
+	*	which returns NULL if "apiVersion" is not supported. Object is created once per
+	*	registered <handler>, so handler state is kept in object members instead of globals.
+	*	Libraries without factory are loaded as API v1 (initHandler/processHandlerRequest).
+	*/
+	class IHttpHandler
+	{
+	public:
+		virtual ~IHttpHandler () { }
+
+		// called once after settings loading, false - server startup fails
+		virtual bool init (const aconnect::str2str_map& params, HttpServerSettings* globalSettings) = 0;
+		
+		// called in each worker thread before the first request processed by handler in this thread
+		virtual void threadInit () { }
+
+		// returns true if request was completed by handler, "context.Arena" - request scoped memory
+		virtual bool process (HttpContext& context) = 0;
+
+		// called at server stop, after workers completion; handler is deleted after call
+		virtual void shutdown () { }
+
+		// handler statistics for "stat-handlers" command: "name: value\r\n" records
+		virtual void stats (aconnect::string& /*output*/) { }
+	};
+
+	typedef IHttpHandler* (*create_handler_function) (int apiVersion);
+}
+
+#endif // AHTTP_HANDLER_H
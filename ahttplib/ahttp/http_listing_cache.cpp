@@ -0,0 +1,277 @@
+/*
+This file is part of [ahttp] library. 
+
+Author: Artem Kustikov (kustikoff[at]tut.by)
+version: 0.1
+
+This code is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this code.
+
+Permission is granted to anyone to use this code for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this code must not be misrepresented; you must
+not claim that you wrote the original code. If you use this
+code in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original code.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#include <assert.h>
+#include <boost/crc.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "ahttp/http_listing_cache.hpp"
+
+namespace ahttp
+{
+	DirectoryListingCache::DirectoryListingCache () :
+		version_ (0),
+		maxSize_ (0),
+		watcher_ (*this, DirectoryWatcher::ItemsAdded | DirectoryWatcher::ItemsRemoved | DirectoryWatcher::ItemsModified, 
+			defaults::ListingCacheMaxWatches)
+	{
+	}
+
+	void DirectoryListingCache::init (size_t maxSize)
+	{
+		{
+			boost::mutex::scoped_lock lock (mutex_);
+			
+			clearEntries ();
+			stats_ = Stats();
+			maxSize_ = maxSize;
+		}
+
+		if (maxSize_ > 0)
+			watcher_.start();
+	}
+
+	directory_listing_ptr DirectoryListingCache::find (aconnect::string_constref key, std::time_t modifyTime)
+	{
+		if (0 == maxSize_)
+			return directory_listing_ptr ();
+
+		boost::mutex::scoped_lock lock (mutex_);
+
+		entries_map::iterator it = entries_.find (key);
+		if (it == entries_.end()) {
+			++stats_.misses;
+			return directory_listing_ptr ();
+		}
+
+		if (it->second->modifyTime != modifyTime) {
+			removeEntry (it);
+			++stats_.invalidations;
+			++stats_.misses;
+			return directory_listing_ptr ();
+		}
+
+		++stats_.hits;
+		return it->second;
+	}
+
+	DirectoryListingCache::counter_type DirectoryListingCache::prepare (aconnect::string_constref dirPath)
+	{
+		if (0 == maxSize_)
+			return 0;
+
+		counter_type version = 0;
+		{
+			boost::mutex::scoped_lock lock (mutex_);
+			
+			// state exists before watch is added - watch is not removed by concurrent "store"
+			DirectoryState& state = directories_[dirPath];
+			if (0 == state.version)
+				state.version = ++version_;
+			version = state.version;
+		}
+
+		if (!watcher_.isStarted())
+			return version;
+
+		DirectoryWatcher::WatchResult res = watcher_.watch (dirPath);
+		if (res == DirectoryWatcher::LimitReached) 
+		{
+			{
+				boost::mutex::scoped_lock lock (mutex_);
+				evictDirectory (dirPath);
+			}
+			res = watcher_.watch (dirPath);
+		}
+
+		if (res == DirectoryWatcher::Watched)
+			return version;
+
+		boost::mutex::scoped_lock lock (mutex_);
+		
+		directories_map::iterator dirIt = directories_.find (dirPath);
+		if (dirIt != directories_.end())
+			releaseDirectory (dirIt);
+
+		return 0;
+	}
+
+	void DirectoryListingCache::store (aconnect::string_constref key, directory_listing_ptr listing, 
+		counter_type version)
+	{
+		assert (listing);
+		
+		if (0 == version)
+			return;
+
+		const size_t listingSize = listing->size() + key.size();
+
+		boost::mutex::scoped_lock lock (mutex_);
+
+		directories_map::iterator dirIt = directories_.find (listing->directoryPath);
+		if (dirIt == directories_.end()) {
+			// directory was changed and released during rendering - watch is not used by anyone
+			watcher_.unwatch (listing->directoryPath);
+			return;
+		}
+
+		if (dirIt->second.version != version || 0 == maxSize_ || listingSize > maxSize_) {
+			releaseDirectory (dirIt);
+			return;
+		}
+
+		// new entry is counted first - directory is not released by removals below
+		++dirIt->second.entries;
+
+		entries_map::iterator it = entries_.find (key);
+		if (it != entries_.end())
+			removeEntry (it);
+
+		// listings are not ordered by usage - any entries are dropped to free space
+		while (stats_.size + listingSize > maxSize_ && !entries_.empty())
+			removeEntry (entries_.begin());
+
+		entries_[key] = listing;
+		stats_.size += listingSize;
+		++stats_.entries;
+	}
+
+	void DirectoryListingCache::cancel (aconnect::string_constref dirPath, counter_type version)
+	{
+		if (0 == version)
+			return;
+
+		boost::mutex::scoped_lock lock (mutex_);
+
+		directories_map::iterator dirIt = directories_.find (dirPath);
+		if (dirIt == directories_.end())
+			watcher_.unwatch (dirPath);
+		else
+			releaseDirectory (dirIt);
+	}
+
+	void DirectoryListingCache::clear ()
+	{
+		boost::mutex::scoped_lock lock (mutex_);
+		clearEntries ();
+	}
+
+	void DirectoryListingCache::collect (Stats& result)
+	{
+		boost::mutex::scoped_lock lock (mutex_);
+		result = stats_;
+	}
+
+	void DirectoryListingCache::directoryChanged (aconnect::string_constref dirPath)
+	{
+		boost::mutex::scoped_lock lock (mutex_);
+
+		entries_map::iterator it = entries_.begin();
+		while (it != entries_.end())
+		{
+			entries_map::iterator current = it++;
+			if (dirPath.empty() || current->second->directoryPath == dirPath) {
+				removeEntry (current);
+				++stats_.invalidations;
+			}
+		}
+
+		// listings rendered now are not stored
+		if (dirPath.empty()) {
+			for (directories_map::iterator dirIt = directories_.begin(); dirIt != directories_.end(); ++dirIt)
+				dirIt->second.version = ++version_;
+		
+		} else {
+			directories_map::iterator dirIt = directories_.find (dirPath);
+			if (dirIt != directories_.end())
+				dirIt->second.version = ++version_;
+		}
+	}
+
+	aconnect::string DirectoryListingCache::calculateEtag (aconnect::string_constref content)
+	{
+		boost::crc_32_type result;
+		result.process_bytes (content.c_str(), content.size());
+
+		return boost::lexical_cast <aconnect::string, boost::crc_32_type::value_type> (result.checksum());
+	}
+
+	void DirectoryListingCache::removeEntry (entries_map::iterator it)
+	{
+		stats_.size -= it->second->size() + it->first.size();
+		--stats_.entries;
+		
+		directories_map::iterator dirIt = directories_.find (it->second->directoryPath);
+		entries_.erase (it);
+
+		if (dirIt != directories_.end()) {
+			assert (dirIt->second.entries > 0);
+			--dirIt->second.entries;
+			releaseDirectory (dirIt);
+		}
+	}
+
+	void DirectoryListingCache::releaseDirectory (directories_map::iterator it)
+	{
+		if (it->second.entries > 0)
+			return;
+
+		watcher_.unwatch (it->first);
+		directories_.erase (it);
+	}
+
+	void DirectoryListingCache::evictDirectory (aconnect::string_constref exceptPath)
+	{
+		directories_map::const_iterator dirIt = directories_.begin();
+		while (dirIt != directories_.end() && (0 == dirIt->second.entries || dirIt->first == exceptPath))
+			++dirIt;
+
+		if (dirIt == directories_.end())
+			return;
+
+		// last removed entry releases directory and its watch
+		const aconnect::string evictedPath = dirIt->first;
+		
+		entries_map::iterator it = entries_.begin();
+		while (it != entries_.end())
+		{
+			entries_map::iterator current = it++;
+			if (current->second->directoryPath == evictedPath)
+				removeEntry (current);
+		}
+	}
+
+	void DirectoryListingCache::clearEntries ()
+	{
+		entries_.clear();
+		directories_.clear();
+		stats_.size = 0;
+		stats_.entries = 0;
+		
+		watcher_.unwatchAll ();
+	}
+}
@@ -0,0 +1,150 @@
+/*
+This file is part of [ahttp] library. 
+
+Author: Artem Kustikov (kustikoff[at]tut.by)
+version: 0.1
+
+This code is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this code.
+
+Permission is granted to anyone to use this code for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this code must not be misrepresented; you must
+not claim that you wrote the original code. If you use this
+code in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original code.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#ifndef AHTTP_LISTING_CACHE_H
+#define AHTTP_LISTING_CACHE_H
+#pragma once
+
+#include <map>
+#include <vector>
+#include <ctime>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include "aconnect/types.hpp"
+
+#include "ahttp/http_directory_watcher.hpp"
+
+namespace ahttp
+{
+	namespace defaults
+	{
+		const size_t ListingCacheSize			= 16 * 1048576;	// bytes, 0 - cache is disabled
+		const size_t ListingCacheMaxWatches		= 1024;	// watched directories
+		const size_t ListingPageLimit			= 1000;	// JSON listing items per page by default
+		const size_t ListingMaxPageLimit		= 10000;
+	}
+
+	// rendered directory listing page or JSON items index
+	struct DirectoryListing
+	{
+		aconnect::string content;
+		aconnect::string etag;
+		aconnect::string directoryPath;	// real path
+		std::time_t modifyTime;			// directory modification time at rendering
+		
+		// JSON index: sorted item records start positions in "content" (records are 
+		// followed by comma), last element - content size
+		std::vector<size_t> offsets;
+
+		inline size_t size () const {
+			return content.size() + offsets.size() * sizeof (size_t);
+		}
+	};
+
+	typedef boost::shared_ptr<const DirectoryListing> directory_listing_ptr;
+
+	/**
+	*	Rendered directory listings cache. Entry is dropped when directory content is changed 
+	*	(inotify on Linux, files size/time changes are detected too) or directory modification 
+	*	time differs from stored one (items added/removed/renamed, other platforms).
+	*	Directory is watched while it has cached listings, watch is removed with last one.
+	*/
+	class DirectoryListingCache : public DirectoryWatcher::Listener, private boost::noncopyable
+	{
+	public:
+		typedef boost::uint64_t counter_type;
+
+		struct Stats
+		{
+			Stats () : hits (0), misses (0), invalidations (0), entries (0), size (0) { }
+
+			counter_type hits;
+			counter_type misses;
+			counter_type invalidations;
+			size_t entries;
+			size_t size;
+		};
+
+		DirectoryListingCache ();
+
+		// drop entries and setup size limit, directories watcher is started on first call
+		void init (size_t maxSize);
+
+		// "key" - listing rendering parameters (directory settings, virtual path)
+		directory_listing_ptr find (aconnect::string_constref key, std::time_t modifyTime);
+		
+		// must be called before directory reading - directory is watched, so changes made during
+		// rendering are detected; returned version is passed to "store", 0 - caching is impossible
+		counter_type prepare (aconnect::string_constref dirPath);
+		// listing is not stored if its directory was changed after "prepare" call
+		void store (aconnect::string_constref key, directory_listing_ptr listing, counter_type version);
+		// rendering failed after "prepare" - directory without cached listings is released
+		void cancel (aconnect::string_constref dirPath, counter_type version);
+
+		void clear ();
+		void collect (Stats& result);
+
+		virtual void directoryChanged (aconnect::string_constref dirPath);
+
+		// ETag of rendered content
+		static aconnect::string calculateEtag (aconnect::string_constref content);
+
+	protected:
+		typedef std::map<aconnect::string, directory_listing_ptr> entries_map;
+
+		struct DirectoryState
+		{
+			DirectoryState () : entries (0), version (0) { }
+
+			size_t entries;			// cached listings of directory
+			counter_type version;	// changed on each directory change
+		};
+		typedef std::map<aconnect::string, DirectoryState> directories_map;
+
+		void removeEntry (entries_map::iterator it);
+		// directory without cached listings is forgotten and unwatched
+		void releaseDirectory (directories_map::iterator it);
+		// frees watch when watches limit is reached
+		void evictDirectory (aconnect::string_constref exceptPath);
+		void clearEntries ();
+
+	protected:
+		boost::mutex mutex_;
+		entries_map entries_;
+		directories_map directories_;
+		counter_type version_;
+		size_t maxSize_;
+		Stats stats_;
+
+		DirectoryWatcher watcher_;
+	};
+}
+
+#endif // AHTTP_LISTING_CACHE_H
@@ -0,0 +1,180 @@
+/*
+This file is part of [ahttp] library. 
+
+Author: Artem Kustikov (kustikoff[at]tut.by)
+version: 0.1
+
+This code is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this code.
+
+Permission is granted to anyone to use this code for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this code must not be misrepresented; you must
+not claim that you wrote the original code. If you use this
+code in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original code.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "aconnect/util.hpp"
+#include "aconnect/time_util.hpp"
+
+#include "ahttp/http_listing_template.hpp"
+#include "ahttp/http_server_settings.hpp"
+
+namespace ahttp
+{
+	namespace detail
+	{
+		struct ListingMark
+		{
+			ListingTemplate::Placeholder type;
+			aconnect::string_constptr text;
+			size_t length;
+		};
+
+		const ListingMark ListingMarks[] = 
+		{
+			{ ListingTemplate::Url,				SettingsTags::UrlMark,				sizeof (SettingsTags::UrlMark) - 1 },
+			{ ListingTemplate::Name,			SettingsTags::NameMark,				sizeof (SettingsTags::NameMark) - 1 },
+			{ ListingTemplate::Size,			SettingsTags::SizeMark,				sizeof (SettingsTags::SizeMark) - 1 },
+			{ ListingTemplate::Time,			SettingsTags::TimeMark,				sizeof (SettingsTags::TimeMark) - 1 },
+			{ ListingTemplate::PageUrl,			SettingsTags::PageUrlMark,			sizeof (SettingsTags::PageUrlMark) - 1 },
+			{ ListingTemplate::ParentUrl,		SettingsTags::ParentUrlMark,		sizeof (SettingsTags::ParentUrlMark) - 1 },
+			{ ListingTemplate::FilesCount,		SettingsTags::FilesCountMark,		sizeof (SettingsTags::FilesCountMark) - 1 },
+			{ ListingTemplate::DirectoriesCount,	SettingsTags::DirectoriesCountMark,	sizeof (SettingsTags::DirectoriesCountMark) - 1 },
+			{ ListingTemplate::ErrorsCount,		SettingsTags::ErrorsCountMark,		sizeof (SettingsTags::ErrorsCountMark) - 1 }
+		};
+
+		const size_t ListingMarksCount = sizeof (ListingMarks) / sizeof (ListingMarks[0]);
+	}
+
+	void ListingTemplate::compile (aconnect::string_constref text, int marks)
+	{
+		text_ = text;
+		segments_.clear();
+		marks_ = 0;
+
+		size_t literalStart = 0, pos = 0;
+		while ( (pos = text_.find ('{', pos)) != aconnect::string::npos) 
+		{
+			const detail::ListingMark* found = NULL;
+			for (size_t ndx = 0; ndx < detail::ListingMarksCount && !found; ++ndx) {
+				if ( (detail::ListingMarks[ndx].type & marks) 
+					&& text_.compare (pos, detail::ListingMarks[ndx].length, detail::ListingMarks[ndx].text) == 0)
+					found = &detail::ListingMarks[ndx];
+			}
+
+			if (!found) {
+				++pos;
+				continue;
+			}
+
+			if (pos > literalStart) {
+				Segment literal = { Literal, literalStart, pos - literalStart };
+				segments_.push_back (literal);
+			}
+
+			Segment placeholder = { found->type, pos, found->length };
+			segments_.push_back (placeholder);
+			marks_ |= found->type;
+
+			pos += found->length;
+			literalStart = pos;
+		}
+
+		if (literalStart < text_.size()) {
+			Segment literal = { Literal, literalStart, text_.size() - literalStart };
+			segments_.push_back (literal);
+		}
+	}
+
+	void ListingTemplate::render (aconnect::string& output, const ListingValues& values) const
+	{
+		for (std::vector<Segment>::const_iterator it = segments_.begin(); it != segments_.end(); ++it)
+		{
+			switch (it->type)
+			{
+			case Url:
+				output.append (values.url);
+				break;
+			case Name:
+				output.append (values.name);
+				break;
+			case PageUrl:
+				output.append (values.pageUrl);
+				break;
+			case ParentUrl:
+				output.append (values.parentUrl);
+				break;
+			case Size:
+				if (values.size != (size_t) -1)
+					appendNumber (output, values.size);
+				else
+					output.append (text_, it->offset, it->length);
+				break;
+			case Time:
+				if (values.time != (std::time_t) -1)
+					appendDateTime (output, values.time);
+				else
+					output.append (text_, it->offset, it->length);
+				break;
+			case FilesCount:
+				appendNumber (output, values.filesCount);
+				break;
+			case DirectoriesCount:
+				appendNumber (output, values.directoriesCount);
+				break;
+			case ErrorsCount:
+				appendNumber (output, values.errorsCount);
+				break;
+			default:
+				output.append (text_, it->offset, it->length);
+			}
+		}
+	}
+
+	void ListingTemplate::appendNumber (aconnect::string& output, size_t value)
+	{
+		aconnect::char_type buff[24];
+		aconnect::char_type* pos = buff + sizeof (buff);
+
+		do {
+			*--pos = (aconnect::char_type) ('0' + value % 10);
+			value /= 10;
+		} while (value);
+
+		output.append (pos, buff + sizeof (buff));
+	}
+
+	void ListingTemplate::appendDateTime (aconnect::string& output, std::time_t value)
+	{
+		const struct tm dateTime = aconnect::util::getDateTimeUtc (value);
+
+		const int buffSize = 20;
+		aconnect::char_type buff[buffSize] = {0};
+
+		int cnt = snprintf (buff, buffSize, "%.2d.%.2d.%.4d %.2d:%.2d:%.2d", 
+			dateTime.tm_mday,
+			dateTime.tm_mon + 1,
+			dateTime.tm_year + 1900,
+			dateTime.tm_hour,
+			dateTime.tm_min,
+			dateTime.tm_sec
+			);
+
+		output.append (buff, aconnect::util::min2 (cnt, buffSize - 1));
+	}
+}
@@ -0,0 +1,112 @@
+/*
+This file is part of [ahttp] library. 
+
+Author: Artem Kustikov (kustikoff[at]tut.by)
+version: 0.1
+
+This code is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this code.
+
+Permission is granted to anyone to use this code for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this code must not be misrepresented; you must
+not claim that you wrote the original code. If you use this
+code in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original code.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#ifndef AHTTP_LISTING_TEMPLATE_H
+#define AHTTP_LISTING_TEMPLATE_H
+#pragma once
+
+#include <vector>
+#include <ctime>
+
+#include "aconnect/types.hpp"
+
+namespace ahttp
+{
+	// values substituted to directory listing templates
+	struct ListingValues
+	{
+		ListingValues () :
+			url (NULL), name (NULL), pageUrl (NULL), parentUrl (NULL),
+			size ((size_t) -1), time ((std::time_t) -1),
+			filesCount (0), directoriesCount (0), errorsCount (0) { }
+
+		aconnect::string_constptr url;
+		aconnect::string_constptr name;
+		aconnect::string_constptr pageUrl;
+		aconnect::string_constptr parentUrl;
+		size_t size;			// -1 - "{size}" mark is not replaced
+		std::time_t time;		// -1 - "{time}" mark is not replaced
+		size_t filesCount;
+		size_t directoriesCount;
+		size_t errorsCount;
+	};
+
+	/**
+	*	Directory listing template compiled to literal and placeholder segments at settings load,
+	*	rendering appends segments to output without intermediate strings.
+	*/
+	class ListingTemplate
+	{
+	public:
+		enum Placeholder
+		{
+			Literal				= 0,
+			Url					= 0x001,
+			Name				= 0x002,
+			Size				= 0x004,
+			Time				= 0x008,
+			PageUrl				= 0x010,
+			ParentUrl			= 0x020,
+			FilesCount			= 0x040,
+			DirectoriesCount	= 0x080,
+			ErrorsCount			= 0x100
+		};
+
+		// placeholders sets used by templates kinds
+		static const int ItemMarks = Url | Name | Size | Time;
+		static const int HeaderMarks = PageUrl;
+		static const int ParentDirectoryMarks = ParentUrl;
+		static const int FooterMarks = PageUrl | FilesCount | DirectoriesCount | ErrorsCount;
+
+		ListingTemplate () : marks_ (0) { }
+
+		// "marks" - placeholders recognized in template, other marks are kept as text
+		void compile (aconnect::string_constref text, int marks);
+		void render (aconnect::string& output, const ListingValues& values) const;
+
+		inline bool empty () const				{	return text_.empty();	}
+		inline bool hasMarks (int marks) const	{	return (marks_ & marks) != 0;	}
+		inline void clear ()					{	text_.clear(); segments_.clear(); marks_ = 0;	}
+
+	protected:
+		struct Segment
+		{
+			Placeholder type;
+			size_t offset;		// segment text (placeholder mark) in template
+			size_t length;
+		};
+
+		static void appendNumber (aconnect::string& output, size_t value);
+		static void appendDateTime (aconnect::string& output, std::time_t value);
+
+		aconnect::string text_;
+		std::vector<Segment> segments_;
+		int marks_;			// placeholders found in template
+	};
+}
+
+#endif // AHTTP_LISTING_TEMPLATE_H
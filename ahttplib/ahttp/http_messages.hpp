@@ -39,6 +39,9 @@ namespace ahttp { namespace messages
 	aconnect::string_constant ErrorDocumentMoved = 
 		"This document may be found <a HREF=\"%s\">here</a>";
 
+	aconnect::string_constant Error400_InvalidListingRange = 
+		"Invalid directory listing \"offset\" or \"limit\" parameter.";
+
 	aconnect::string_constant Error403_BrowseContent = 
 		"This Virtual Directory does not allow contents to be listed.";
 
@@ -48,6 +51,9 @@ namespace ahttp { namespace messages
 	aconnect::string_constant Error404 = 
 		"The requested page cannot be found: \"%s\"";
 
+	aconnect::string_constant Error404_NotFound = 
+		"The requested page cannot be found.";
+
 	aconnect::string_constant Error405 = 
 		"The requested HTTP method is not allowed for the resource: %s.<br /> Allowed methods: %s.";
 
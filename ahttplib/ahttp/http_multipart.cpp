@@ -0,0 +1,200 @@
+/*
+This file is part of [ahttp] library. 
+
+Author: Artem Kustikov (kustikoff[at]tut.by)
+version: 0.1
+
+This code is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this code.
+
+Permission is granted to anyone to use this code for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this code must not be misrepresented; you must
+not claim that you wrote the original code. If you use this
+code in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original code.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+
+#include "ahttp/http_support.hpp"
+#include "ahttp/http_multipart.hpp"
+
+namespace ahttp
+{
+	MultipartParser::MultipartParser (aconnect::string_constref boundary, size_t bufferSize, Listener& listener) :
+		listener_ (listener),
+		state_ (Preamble),
+		delimiter_ (aconnect::string (detail::HeadersDelimiter) + detail::MultipartBoundaryPrefix + boundary),
+		begin_ (0),
+		end_ (0)
+	{
+		const size_t last = delimiter_.size() - 1;
+
+		for (size_t ndx = 0; ndx < 256; ++ndx)
+			skip_[ndx] = delimiter_.size();
+		for (size_t ndx = 0; ndx < last; ++ndx)
+			skip_[(unsigned char) delimiter_[ndx]] = last - ndx;
+
+		// tail of unmatched delimiter is kept between portions
+		buffer_.resize (bufferSize + delimiter_.size());
+
+		// first delimiter can be placed at body start - without leading CRLF
+		const size_t crlfLen = strlen (detail::HeadersDelimiter);
+		memcpy (&buffer_[0], detail::HeadersDelimiter, crlfLen);
+		end_ = crlfLen;
+	}
+
+	aconnect::string_ptr MultipartParser::buffer (size_t& size)
+	{
+		size = (state_ == Completed ? 0 : buffer_.size() - end_);
+		return &buffer_[0] + end_;
+	}
+
+	bool MultipartParser::parse (size_t size) throw (aconnect::request_processing_error)
+	{
+		assert (end_ + size <= buffer_.size());
+		end_ += size;
+
+		const aconnect::string_constptr data = &buffer_[0];
+		const size_t crlfLen = strlen (detail::HeadersDelimiter);
+		const size_t endMarkLen = strlen (detail::HeadersEndMark);
+		bool moreData = true;
+
+		while (moreData && state_ != Completed)
+		{
+			switch (state_)
+			{
+			case Preamble:
+			case PartData:
+				{
+					const size_t pos = findDelimiter (data + begin_, end_ - begin_);
+					
+					if (pos == aconnect::string::npos) {
+						// delimiter can start in kept tail
+						const size_t safeEnd = (end_ - begin_ >= delimiter_.size() ? end_ - delimiter_.size() + 1 : begin_);
+						if (state_ == PartData && safeEnd > begin_)
+							listener_.partData (data + begin_, safeEnd - begin_);
+						
+						begin_ = safeEnd;
+						moreData = false;
+						break;
+					}
+
+					if (state_ == PartData) {
+						if (pos > 0)
+							listener_.partData (data + begin_, pos);
+						listener_.partEnd ();
+					}
+
+					begin_ += pos + delimiter_.size();
+					state_ = DelimiterEnd;
+				}
+				break;
+
+			case DelimiterEnd:
+				{
+					const size_t prefixLen = strlen (detail::MultipartBoundaryPrefix);
+					if (end_ - begin_ < prefixLen) {
+						moreData = false;
+						break;
+					}
+
+					if (memcmp (data + begin_, detail::MultipartBoundaryPrefix, prefixLen) == 0) {
+						state_ = Completed;
+						break;
+					}
+
+					// transport padding is skipped
+					const aconnect::string_constptr lineEnd = std::search (data + begin_, data + end_, 
+						detail::HeadersDelimiter, detail::HeadersDelimiter + crlfLen);
+					
+					if (lineEnd == data + end_) {
+						if (end_ == buffer_.size() && begin_ == 0)
+							throw aconnect::request_processing_error ("Incorrect multipart delimiter line");
+						moreData = false;
+						break;
+					}
+
+					begin_ = (lineEnd - data) + crlfLen;
+					state_ = PartHeader;
+				}
+				break;
+
+			case PartHeader:
+				{
+					// part without header lines
+					if (end_ - begin_ >= crlfLen && memcmp (data + begin_, detail::HeadersDelimiter, crlfLen) == 0) {
+						begin_ += crlfLen;
+						listener_.partBegin (aconnect::string());
+						state_ = PartData;
+						break;
+					}
+
+					const aconnect::string_constptr headerEnd = std::search (data + begin_, data + end_, 
+						detail::HeadersEndMark, detail::HeadersEndMark + endMarkLen);
+
+					if (headerEnd == data + end_) {
+						if (end_ == buffer_.size() && begin_ == 0)
+							throw aconnect::request_processing_error ("Multipart part header is too large");
+						moreData = false;
+						break;
+					}
+
+					listener_.partBegin (aconnect::string (data + begin_, headerEnd));
+					begin_ = (headerEnd - data) + endMarkLen;
+					state_ = PartData;
+				}
+				break;
+
+			default:
+				assert (false && "Unknown multipart parser state");
+				moreData = false;
+			}
+		}
+
+		// unparsed data is moved to buffer start (delimiter tail or incomplete header)
+		if (begin_ > 0) {
+			if (end_ > begin_)
+				memmove (&buffer_[0], &buffer_[0] + begin_, end_ - begin_);
+			end_ -= begin_;
+			begin_ = 0;
+		}
+
+		return state_ == Completed;
+	}
+
+	size_t MultipartParser::findDelimiter (aconnect::string_constptr data, size_t size) const
+	{
+		const size_t patternSize = delimiter_.size();
+		if (size < patternSize)
+			return aconnect::string::npos;
+
+		const aconnect::string_constptr pattern = delimiter_.c_str();
+		const size_t last = patternSize - 1;
+		size_t pos = 0;
+
+		while (pos <= size - patternSize)
+		{
+			const unsigned char ch = (unsigned char) data[pos + last];
+			if (ch == (unsigned char) pattern[last] && memcmp (data + pos, pattern, last) == 0)
+				return pos;
+
+			pos += skip_[ch];
+		}
+
+		return aconnect::string::npos;
+	}
+}
@@ -0,0 +1,99 @@
+/*
+This file is part of [ahttp] library. 
+
+Author: Artem Kustikov (kustikoff[at]tut.by)
+version: 0.1
+
+This code is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this code.
+
+Permission is granted to anyone to use this code for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this code must not be misrepresented; you must
+not claim that you wrote the original code. If you use this
+code in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original code.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#ifndef AHTTP_MULTIPART_H
+#define AHTTP_MULTIPART_H
+#pragma once
+
+#include <vector>
+#include <boost/noncopyable.hpp>
+
+#include "aconnect/types.hpp"
+#include "aconnect/error.hpp"
+
+namespace ahttp
+{
+	/**
+	*	Streaming "multipart/form-data" parser: input is read directly to parser buffer (see buffer()),
+	*	delimiter is found by Boyer-Moore-Horspool search, parts content is passed to listener 
+	*	without accumulation - only unmatched delimiter tail and incomplete part header are kept.
+	*/
+	class MultipartParser : private boost::noncopyable
+	{
+	public:
+		class Listener
+		{
+		public:
+			virtual ~Listener () { }
+
+			// "header" - part header lines (without empty line)
+			virtual void partBegin (aconnect::string_constref header) = 0;
+			virtual void partData (aconnect::string_constptr data, size_t size) = 0;
+			virtual void partEnd () = 0;
+		};
+
+		// "bufferSize" - input portion size, part header must fit to it
+		MultipartParser (aconnect::string_constref boundary, size_t bufferSize, Listener& listener);
+
+		// free space to read input to, "size" is not 0 until parsing is completed
+		aconnect::string_ptr buffer (size_t& size);
+
+		/**
+		*	Parse "size" bytes written to buffer(), returns true when closing delimiter is parsed 
+		*	(epilogue is ignored).
+		*	@throw aconnect::request_processing_error if part header does not fit to buffer
+		*/
+		bool parse (size_t size) throw (aconnect::request_processing_error);
+
+		inline bool isCompleted () const	{	return state_ == Completed;	}
+
+	protected:
+		enum State
+		{
+			Preamble,
+			DelimiterEnd,		// transport padding and CRLF or "--" after delimiter
+			PartHeader,
+			PartData,
+			Completed
+		};
+
+		// Boyer-Moore-Horspool search of delimiter, npos - not found
+		size_t findDelimiter (aconnect::string_constptr data, size_t size) const;
+
+		Listener& listener_;
+		State state_;
+		
+		aconnect::string delimiter_;		// CRLF "--" boundary
+		size_t skip_[256];
+
+		std::vector<aconnect::char_type> buffer_;
+		size_t begin_;						// unparsed data start
+		size_t end_;						// loaded data end
+	};
+}
+
+#endif // AHTTP_MULTIPART_H
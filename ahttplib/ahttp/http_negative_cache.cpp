@@ -0,0 +1,233 @@
+/*
+This file is part of [ahttp] library. 
+
+Author: Artem Kustikov (kustikoff[at]tut.by)
+version: 0.1
+
+This code is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this code.
+
+Permission is granted to anyone to use this code for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this code must not be misrepresented; you must
+not claim that you wrote the original code. If you use this
+code in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original code.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#include <assert.h>
+#include <boost/filesystem/operations.hpp>
+
+#include "aconnect/util.hpp"
+
+#include "ahttp/http_negative_cache.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace ahttp
+{
+	NegativePathCache::NegativePathCache () :
+		generation_ (0),
+		maxSize_ (0),
+		ttl_ (0),
+		watcher_ (*this, DirectoryWatcher::ItemsAdded, defaults::NegativeCacheMaxWatches)
+	{
+	}
+
+	void NegativePathCache::init (size_t maxSize, int ttlSec)
+	{
+		{
+			boost::mutex::scoped_lock lock (mutex_);
+			
+			clearEntries ();
+			stats_ = Stats();
+			maxSize_ = (ttlSec > 0 ? maxSize : 0);
+			ttl_ = ttlSec;
+		}
+
+		if (maxSize_ > 0)
+			watcher_.start();
+	}
+
+	bool NegativePathCache::contains (aconnect::string_constref virtualPath)
+	{
+		using namespace aconnect;
+
+		if (0 == maxSize_)
+			return false;
+
+		boost::mutex::scoped_lock lock (mutex_);
+		
+		entries_map::const_iterator it = entries_.find (virtualPath);
+		if (it == entries_.end() || it->second.expiresAt <= util::getTimestamp())
+			return false;
+
+		++stats_.hits;
+		return true;
+	}
+
+	void NegativePathCache::add (aconnect::string_constref virtualPath, 
+		const fs::path& filePath,
+		const fs::path& rootPath)
+	{
+		using namespace aconnect;
+
+		if (0 == maxSize_ || virtualPath.size() > defaults::NegativeCacheMaxPathLength)
+			return;
+
+		Entry entry;
+		counter_type generation = 0;
+		{
+			boost::mutex::scoped_lock lock (mutex_);
+			generation = generation_;
+		}
+		
+		if (watcher_.isStarted()) 
+		{
+			DirectoryWatcher::WatchResult res = watchParentDirectory (filePath, rootPath, entry.dirPath);
+			if (res == DirectoryWatcher::LimitReached) 
+			{
+				// all watches are used by cached entries - cache is restarted
+				{
+					boost::mutex::scoped_lock lock (mutex_);
+					clearEntries ();
+					generation = generation_;
+				}
+				res = watchParentDirectory (filePath, rootPath, entry.dirPath);
+			}
+
+			if (res != DirectoryWatcher::Watched)
+				return;
+
+			// file could be created before watch was added
+			if (fs::exists (filePath)) {
+				boost::mutex::scoped_lock lock (mutex_);
+				releaseDirectory (entry.dirPath);
+				return;
+			}
+		}
+
+		entry.expiresAt = util::getTimestamp() + (util::timestamp_type) ttl_ * 1000000;
+
+		boost::mutex::scoped_lock lock (mutex_);
+
+		// entries were dropped or watch was removed after watching - changes could be missed
+		if (generation != generation_) {
+			releaseDirectory (entry.dirPath);
+			return;
+		}
+
+		std::pair<entries_map::iterator, bool> res = entries_.insert (std::make_pair (virtualPath, entry));
+		if (!res.second) {
+			res.first->second.expiresAt = entry.expiresAt;
+			releaseDirectory (entry.dirPath);
+			return;
+		}
+
+		queue_.push_back (res.first);
+		++stats_.stored;
+		
+		if (!entry.dirPath.empty())
+			++directories_[entry.dirPath];
+
+		if (queue_.size() > maxSize_)
+			eraseOldest ();
+	}
+
+	void NegativePathCache::clear ()
+	{
+		boost::mutex::scoped_lock lock (mutex_);
+		clearEntries ();
+	}
+
+	void NegativePathCache::collect (Stats& result)
+	{
+		boost::mutex::scoped_lock lock (mutex_);
+		
+		result = stats_;
+		result.entries = entries_.size();
+		result.watches = watcher_.watchesCount();
+	}
+
+	void NegativePathCache::directoryChanged (aconnect::string_constref dirPath)
+	{
+		boost::mutex::scoped_lock lock (mutex_);
+
+		clearEntries ();
+		++stats_.invalidations;
+	}
+
+	void NegativePathCache::eraseOldest ()
+	{
+		assert (!queue_.empty());
+		
+		const aconnect::string dirPath = queue_.front()->second.dirPath;
+		entries_.erase (queue_.front());
+		queue_.pop_front();
+
+		if (dirPath.empty())
+			return;
+
+		directories_map::iterator it = directories_.find (dirPath);
+		assert (it != directories_.end());
+		
+		if (--it->second == 0) {
+			directories_.erase (it);
+			releaseDirectory (dirPath);
+		}
+	}
+
+	void NegativePathCache::releaseDirectory (aconnect::string_constref dirPath)
+	{
+		if (dirPath.empty() || directories_.find (dirPath) != directories_.end())
+			return;
+
+		// entries being added with this watch are rejected by generation check
+		watcher_.unwatch (dirPath);
+		++generation_;
+	}
+
+	void NegativePathCache::clearEntries ()
+	{
+		entries_.clear();
+		queue_.clear();
+		directories_.clear();
+		
+		watcher_.unwatchAll ();
+		++generation_;
+	}
+
+	DirectoryWatcher::WatchResult NegativePathCache::watchParentDirectory (const fs::path& filePath, 
+		const fs::path& rootPath, aconnect::string& watchedPath)
+	{
+		const aconnect::string root = rootPath.string();
+		fs::path dirPath = filePath.branch_path();
+
+		// nearest existing parent is watched - creation of any missing directory is detected
+		while (!dirPath.empty())
+		{
+			const aconnect::string dir = dirPath.string();
+			const DirectoryWatcher::WatchResult res = watcher_.watch (dir);
+			
+			if (res == DirectoryWatcher::Watched)
+				watchedPath = dir;
+
+			if (res != DirectoryWatcher::NotFound || dir.size() <= root.size())
+				return res;
+
+			dirPath = dirPath.branch_path();
+		}
+
+		return DirectoryWatcher::NotFound;
+	}
+}
@@ -0,0 +1,128 @@
+/*
+This file is part of [ahttp] library. 
+
+Author: Artem Kustikov (kustikoff[at]tut.by)
+version: 0.1
+
+This code is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this code.
+
+Permission is granted to anyone to use this code for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this code must not be misrepresented; you must
+not claim that you wrote the original code. If you use this
+code in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original code.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#ifndef AHTTP_NEGATIVE_CACHE_H
+#define AHTTP_NEGATIVE_CACHE_H
+#pragma once
+
+#include <map>
+#include <deque>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include "aconnect/types.hpp"
+#include "aconnect/time_util.hpp"
+
+#include "ahttp/http_directory_watcher.hpp"
+
+namespace ahttp
+{
+	namespace defaults
+	{
+		const size_t NegativeCacheSize			= 8192;	// entries, 0 - cache is disabled
+		const int NegativeCacheTtl				= 10;	// sec
+		const size_t NegativeCacheMaxPathLength	= 1024;	// longer paths are not cached
+		const size_t NegativeCacheMaxWatches	= 1024;	// watched directories
+	}
+
+	/**
+	*	Recently requested missing virtual paths (404 without handler): repeated requests are 
+	*	answered without mappings and file system lookups. Entries expire after TTL, on Linux
+	*	nearest existing parent directory of missing file is watched (inotify) and whole cache
+	*	is dropped when something is created in watched directory. Directory is watched while
+	*	cached entries refer to it.
+	*/
+	class NegativePathCache : public DirectoryWatcher::Listener, private boost::noncopyable
+	{
+	public:
+		typedef boost::uint64_t counter_type;
+
+		struct Stats
+		{
+			Stats () : hits (0), stored (0), invalidations (0), entries (0), watches (0) { }
+
+			counter_type hits;
+			counter_type stored;
+			counter_type invalidations;		// cache drops by file system changes
+			size_t entries;
+			size_t watches;
+		};
+
+		NegativePathCache ();
+
+		// drop entries and setup limits, file system watcher is started on first call
+		void init (size_t maxSize, int ttlSec);
+
+		bool contains (aconnect::string_constref virtualPath);
+		
+		// "rootPath" - directory real path, parent directories above it are not watched
+		void add (aconnect::string_constref virtualPath, 
+			const boost::filesystem::path& filePath,
+			const boost::filesystem::path& rootPath);
+		
+		void clear ();
+		void collect (Stats& result);
+
+		// any change in watched directory drops all entries
+		virtual void directoryChanged (aconnect::string_constref dirPath);
+
+	protected:
+		struct Entry
+		{
+			aconnect::util::timestamp_type expiresAt;
+			aconnect::string dirPath;	// watched directory, empty - watcher is not used
+		};
+		
+		typedef std::map<aconnect::string, Entry> entries_map;
+		typedef std::deque<entries_map::iterator> entries_queue;
+		typedef std::map<aconnect::string, size_t> directories_map;
+
+		DirectoryWatcher::WatchResult watchParentDirectory (const boost::filesystem::path& filePath,
+			const boost::filesystem::path& rootPath, aconnect::string& watchedPath);
+
+		void eraseOldest ();
+		// watch of directory without entries is removed
+		void releaseDirectory (aconnect::string_constref dirPath);
+		void clearEntries ();
+
+	protected:
+		boost::mutex mutex_;
+		entries_map entries_;
+		entries_queue queue_;		// insertion order, oldest entries are evicted first
+		directories_map directories_;	// watched directory -> entries count
+		counter_type generation_;	// changed on each entries drop and watch removal
+		size_t maxSize_;
+		int ttl_;
+		Stats stats_;
+
+		DirectoryWatcher watcher_;
+	};
+}
+
+#endif // AHTTP_NEGATIVE_CACHE_H
@@ -44,6 +44,7 @@ namespace ahttp
 
 		VersionHigh = VersionLow = 0;
 		ContentLength = 0;
+		HeaderLength = 0;
 
 		Method.clear ();
 		Path.clear ();
@@ -43,12 +43,13 @@ namespace ahttp
 
 		int VersionHigh, VersionLow;
 		size_t ContentLength;				// Content-Length for POST
+		size_t HeaderLength;				// size of loaded header in bytes (with end mark)
 
 		aconnect::string Method;
 		aconnect::string Path;		// path to source - with query string...
 
 	public:
-		HttpRequestHeader () : VersionHigh(0), VersionLow(0), ContentLength (0) {
+		HttpRequestHeader () : VersionHigh(0), VersionLow(0), ContentLength (0), HeaderLength (0) {
 
 		}
 
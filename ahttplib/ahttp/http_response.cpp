@@ -62,9 +62,17 @@ namespace ahttp
 
 		applyContentEncoding();
 		fillCommonResponseHeaders();
+
+		if (serverTimingSource_) {
+			// handler can still be running - send timing at response end
+			if (Stream.isChunked())
+				Header.Headers[detail::HeaderTrailer] = detail::HeaderServerTiming;
+			else
+				Header.Headers[detail::HeaderServerTiming] = formatServerTiming (*serverTimingSource_);
+		}
 		
-		aconnect::util::writeToSocket (clientInfo_->socket, 
-			Header.getContent());
+		const aconnect::string headers = Header.getContent();
+		Stream.send (headers.c_str(), headers.size());
 
 		headersSent_ = true;
 	}
@@ -122,6 +130,58 @@ namespace ahttp
 		write (content.c_str(), content.size() );
 	}
 
+	void HttpResponse::writeUnbuffered (aconnect::string_constptr buff, size_t dataSize) throw (aconnect::socket_error)
+	{
+		if (finished_)
+			throw std::runtime_error ("Response already sent");
+
+		if (!headersSent_)
+			sentHeaders();
+
+		Stream.writeUnbuffered (buff, dataSize);
+	}
+
+	void HttpResponse::sendFile (aconnect::string_constref filePath, size_t offset, size_t size) throw (std::runtime_error)
+	{
+		if (finished_)
+			throw std::runtime_error ("Response already sent");
+		
+		assert (Header.hasHeader (detail::HeaderContentLength) && "Content-Length must be set");
+
+		if (!headersSent_)
+			sentHeaders();
+
+		Stream.sendFile (filePath, offset, size);
+	}
+
+#if defined (__linux__)
+	void HttpResponse::sendFile (int fd, aconnect::string_constref filePath, size_t offset, size_t size) throw (std::runtime_error)
+	{
+		if (finished_)
+			throw std::runtime_error ("Response already sent");
+		
+		assert (Header.hasHeader (detail::HeaderContentLength) && "Content-Length must be set");
+
+		if (!headersSent_)
+			sentHeaders();
+
+		Stream.sendFile (fd, filePath, offset, size);
+	}
+#endif
+
+	void HttpResponse::sendFromSocket (aconnect::socket_type source, size_t size) throw (std::runtime_error)
+	{
+		if (finished_)
+			throw std::runtime_error ("Response already sent");
+		
+		assert (Header.hasHeader (detail::HeaderContentLength) && "Content-Length must be set");
+
+		if (!headersSent_)
+			sentHeaders();
+
+		Stream.sendFromSocket (source, size);
+	}
+
 	void HttpResponse::flush () throw (aconnect::socket_error) 
 	{
 		if (!headersSent_)
@@ -137,7 +197,12 @@ namespace ahttp
 			Header.setContentLength ( Stream.getBufferContentSize() );
 		
 		flush();
-		Stream.end();
+		
+		if (serverTimingSource_ && Stream.isChunked())
+			Stream.end (aconnect::string (detail::HeaderServerTiming) + detail::HeaderValueDelimiter 
+				+ formatServerTiming (*serverTimingSource_) + detail::HeadersDelimiter);
+		else
+			Stream.end();
 
 		// INVESTIGATE: Keep-alive fix for Firefox
 		Stream.writeDirectly ("");
@@ -145,23 +210,43 @@ namespace ahttp
 		finished_ = true;
 	}
 
+	void HttpResponse::abort ()
+	{
+		Stream.clear();
+		finished_ = aborted_ = true;
+	}
+
 	//////////////////////////////////////////////////////////////////////////
 	// statics
-	aconnect::string HttpResponse::getErrorResponse (int status, 
-		aconnect::string_constptr messageFormat, ...)
+	aconnect::string HttpResponse::formatServerTiming (const HttpRequestTimes& times)
 	{
-		using namespace boost;
-		aconnect::str_stream ret;
-		aconnect::string statusDesc = detail::httpStatusDesc (status);
-		aconnect::string description = messages::ErrorUndefined;
-
-		if (messageFormat) {
-			FORMAT_VA_MESSAGE (messageFormat, message);
-			description.swap (message);
-		}
+		using namespace aconnect;
+		
+		const util::timestamp_type now = util::getTimestamp();
+		const util::timestamp_type started = times.accepted ? times.accepted : times.workerStarted;
+		const int buffSize = 160;
+		char_type buff[buffSize];
+		int cnt = 0;
+
+		// durations in milliseconds
+		if (times.targetFound)
+			cnt += snprintf (buff + cnt, buffSize - cnt, "route;dur=%.3f, ", 
+				(double) util::elapsedTime (times.headerLoaded, times.targetFound) / 1000);
+		
+		if (times.fileSystemTime && cnt < buffSize)
+			cnt += snprintf (buff + cnt, buffSize - cnt, "fs;dur=%.3f, ", 
+				(double) times.fileSystemTime / 1000);
 		
-		ret << str(format(messages::MessageFormat) % statusDesc % statusDesc % description);
-		return ret.str();
+		if (times.handlerStarted && cnt < buffSize)
+			cnt += snprintf (buff + cnt, buffSize - cnt, "handler;dur=%.3f, ", 
+				(double) util::elapsedTime (times.handlerStarted, 
+					times.handlerFinished >= times.handlerStarted ? times.handlerFinished : now) / 1000);
+		
+		if (cnt < buffSize)
+			cnt += snprintf (buff + cnt, buffSize - cnt, "total;dur=%.3f", 
+				(double) util::elapsedTime (started, now) / 1000);
+
+		return string (buff, util::min2 (cnt, buffSize - 1));
 	}
 
 	//
@@ -191,23 +276,94 @@ namespace ahttp
 	{
 		assert (!chunked_ && "writeDirectly must not be called in 'chunked' mode");
 		if (sendContent_)
-			aconnect::util::writeToSocket (socket_, content);
+			send (content.c_str(), content.size());
+	}
+
+	void HttpResponseStream::send (aconnect::string_constptr buff, size_t dataSize) throw (aconnect::socket_error)
+	{
+		if (0 == dataSize)
+			return;
+
+		aconnect::util::writeToSocket (socket_, buff, (int) dataSize);
+		registerSentData (dataSize);
+	}
+
+	void HttpResponseStream::sendFile (aconnect::string_constref filePath, size_t offset, size_t size) throw (std::runtime_error)
+	{
+		assert (!chunked_ && "sendFile must not be called in 'chunked' mode");
+		flush ();
+
+		if (!sendContent_ || 0 == size)
+			return;
+
+		aconnect::util::writeFileToSocket (socket_, filePath, offset, size);
+		registerSentData (size);
+	}
+
+#if defined (__linux__)
+	void HttpResponseStream::sendFile (int fd, aconnect::string_constref filePath, size_t offset, size_t size) throw (std::runtime_error)
+	{
+		assert (!chunked_ && "sendFile must not be called in 'chunked' mode");
+		flush ();
+
+		if (!sendContent_ || 0 == size)
+			return;
+
+		aconnect::util::writeFileToSocket (socket_, fd, filePath, offset, size);
+		registerSentData (size);
+	}
+#endif
+
+	void HttpResponseStream::sendFromSocket (aconnect::socket_type source, size_t size) throw (std::runtime_error)
+	{
+		assert (!chunked_ && "sendFromSocket must not be called in 'chunked' mode");
+		flush ();
+
+		if (!sendContent_ || 0 == size)
+			return;
+
+		aconnect::util::relaySocketData (source, socket_, size);
+		registerSentData (size);
+	}
+
+	void HttpResponseStream::registerSentData (size_t dataSize)
+	{
+		lastByteTime_ = aconnect::util::getTimestamp();
+		if (0 == bytesSent_)
+			firstByteTime_ = lastByteTime_;
+		bytesSent_ += dataSize;
 	}
 
 	void HttpResponseStream::flush () throw (aconnect::socket_error)
 	{	
-		using boost::format;
-		using namespace aconnect;
-
 		if (buffer_.empty())
 			return;
 		
 		if (!sendContent_)
 			return;
 
+		sendContent (buffer_.c_str(), buffer_.size());
+		buffer_.clear();
+	};
+
+	void HttpResponseStream::writeUnbuffered (aconnect::string_constptr buff, size_t dataSize) throw (aconnect::socket_error)
+	{
+		flush ();
+
+		if (sendContent_)
+			sendContent (buff, dataSize);
+	}
+
+	void HttpResponseStream::sendContent (aconnect::string_constptr buff, size_t dataSize) throw (aconnect::socket_error)
+	{	
+		using boost::format;
+		using namespace aconnect;
+
+		if (0 == dataSize)
+			return;
+
 		if (chunked_) {
-			const size_t bufferLen = buffer_.size();
-			size_t curPos = 0, chunkSize = bufferLen;
+			size_t curPos = 0, chunkSize = dataSize;
 			format chunkFormat (detail::ChunkHeaderFormat);
 
 			if (chunkSize > maxChunkSize_)
@@ -217,33 +373,38 @@ namespace ahttp
 			{
 				// write chunk size
 				chunkFormat % chunkSize;
-				util::writeToSocket (socket_, chunkFormat.str());
+				const string chunkHeader = chunkFormat.str();
+				send (chunkHeader.c_str(), chunkHeader.size());
 				chunkFormat.clear();
 
 				// write data
-				util::writeToSocket (socket_, buffer_.c_str() + curPos, 
-					(int) chunkSize);
+				send (buff + curPos, chunkSize);
 				
 				// write chunk end mark
-				util::writeToSocket (socket_, detail::ChunkEndMark);
+				send (detail::ChunkEndMark, ARRAY_SIZE(detail::ChunkEndMark) - 1);
 
 				curPos += chunkSize;
-				chunkSize = util::min2 (maxChunkSize_, bufferLen- curPos);
+				chunkSize = util::min2 (maxChunkSize_, dataSize - curPos);
 
-			} while (curPos < bufferLen);
+			} while (curPos < dataSize);
 			
 		} else {
-			util::writeToSocket (socket_, buffer_);
+			send (buff, dataSize);
 		}
-
-		buffer_.clear();
 	};
 
-	void HttpResponseStream::end () throw (aconnect::socket_error)
+	void HttpResponseStream::end (aconnect::string_constref trailers) throw (aconnect::socket_error)
 	{	
-		if (chunked_ && sendContent_) {
-			// write last chunk
-			aconnect::util::writeToSocket (socket_, aconnect::string (detail::LastChunkFormat) );
+		if (!chunked_ || !sendContent_) 
+			return;
+		
+		// write last chunk
+		if (trailers.empty()) {
+			send (detail::LastChunkFormat, ARRAY_SIZE(detail::LastChunkFormat) - 1);
+		
+		} else {
+			const aconnect::string lastChunk = detail::LastChunkWithTrailerMark + trailers + detail::HeadersDelimiter;
+			send (lastChunk.c_str(), lastChunk.size());
 		}
 	};
 }
@@ -31,6 +31,7 @@ distribution.
 
 #include "aconnect/types.hpp"
 #include "aconnect/complex_types.hpp"
+#include "aconnect/time_util.hpp"
 
 #include "http_support.hpp"
 
@@ -48,7 +49,10 @@ namespace ahttp
 			maxChunkSize_ (chunkSize),
 			socket_(INVALID_SOCKET),
 			chunked_ (false),
-			sendContent_ (true)
+			sendContent_ (true),
+			bytesSent_ (0),
+			firstByteTime_ (0),
+			lastByteTime_ (0)
 		  {};
 
 		  inline void clear ()  {
@@ -59,6 +63,8 @@ namespace ahttp
 		  inline void destroy ()  {
 			  clear();
 			  socket_ = INVALID_SOCKET;
+			  bytesSent_ = 0;
+			  firstByteTime_ = lastByteTime_ = 0;
 		  }
 
 		  inline void init (aconnect::socket_type sock) {	
@@ -73,9 +79,25 @@ namespace ahttp
 		  inline size_t getBufferContentSize() {
 			  return buffer_.size();
 		  }
+		  // buffered (not sent) content
+		  inline aconnect::string_constref getBufferContent() const {
+			  return buffer_;
+		  }
 		  inline aconnect::socket_type socket()	{	
 			  return socket_; 
 		  }
+		  
+		  // sending statistics: bytes written to socket (headers included),
+		  // first/last write time (see aconnect::util::getTimestamp)
+		  inline size_t bytesSent() const	{
+			  return bytesSent_;
+		  }
+		  inline aconnect::util::timestamp_type firstByteTime() const	{
+			  return firstByteTime_;
+		  }
+		  inline aconnect::util::timestamp_type lastByteTime() const	{
+			  return lastByteTime_;
+		  }
 
 		  friend class HttpResponse;
 
@@ -94,8 +116,22 @@ namespace ahttp
 		void write (aconnect::string_constref content);
 		void write (aconnect::string_constptr buff, size_t dataSize);
 		void flush () throw (aconnect::socket_error);
-		void end () throw (aconnect::socket_error);
+		// flush buffer and send data without copying to buffer
+		void writeUnbuffered (aconnect::string_constptr buff, size_t dataSize) throw (aconnect::socket_error);
+		// trailers - "Name: value\r\n" records, sent in "chunked" mode only
+		void end (aconnect::string_constref trailers = aconnect::string()) throw (aconnect::socket_error);
 		void writeDirectly (aconnect::string_constref content) throw (aconnect::socket_error);
+		void send (aconnect::string_constptr buff, size_t dataSize) throw (aconnect::socket_error);
+		// send content (split to chunks in "chunked" mode)
+		void sendContent (aconnect::string_constptr buff, size_t dataSize) throw (aconnect::socket_error);
+		// flush buffer and send file part directly, "chunked" mode is not supported
+		void sendFile (aconnect::string_constref filePath, size_t offset, size_t size) throw (std::runtime_error);
+#if defined (__linux__)
+		void sendFile (int fd, aconnect::string_constref filePath, size_t offset, size_t size) throw (std::runtime_error);
+#endif
+		// flush buffer and relay data from other socket directly, "chunked" mode is not supported
+		void sendFromSocket (aconnect::socket_type source, size_t size) throw (std::runtime_error);
+		void registerSentData (size_t dataSize);
 		
 
 	protected:
@@ -106,6 +142,10 @@ namespace ahttp
 		aconnect::socket_type socket_;
 		bool chunked_;
 		bool sendContent_;
+
+		size_t bytesSent_;
+		aconnect::util::timestamp_type firstByteTime_;
+		aconnect::util::timestamp_type lastByteTime_;
 	};
 
 	class HttpResponse : private boost::noncopyable
@@ -118,7 +158,9 @@ namespace ahttp
 			clientInfo_ (NULL),
 			headersSent_ (false), 
 			finished_ (false),
-			httpMethod_ (ahttp::HttpMethod::Unknown)
+			aborted_ (false),
+			httpMethod_ (ahttp::HttpMethod::Unknown),
+			serverTimingSource_ (NULL)
 
 		{
 			
@@ -129,8 +171,9 @@ namespace ahttp
 			Header.clear();
 			Stream.destroy();
 			clientInfo_ = NULL;
-			finished_ = headersSent_ = false;
+			finished_ = headersSent_ = aborted_ = false;
 			serverName_.clear();
+			serverTimingSource_ = NULL;
 		}
 
 		inline void init (const aconnect::ClientInfo* clientInfo) 
@@ -143,25 +186,56 @@ namespace ahttp
 		void write (aconnect::string_constref content);
 		void write (aconnect::string_constptr buff, size_t dataSize);
 		void flush () throw (aconnect::socket_error);
+		/**
+		*	Streaming write: headers (if not sent) and buffered content are sent first,
+		*	then data is sent to socket directly - without copying to response buffer.
+		*	Response is sent in "chunked" mode if Content-Length is not set.
+		*/
+		void writeUnbuffered (aconnect::string_constptr buff, size_t dataSize) throw (aconnect::socket_error);
+		/**
+		*	Send file part as response content (zero-copy where supported), 
+		*	Content-Length must be set before call.
+		*/
+		void sendFile (aconnect::string_constref filePath, size_t offset, size_t size) throw (std::runtime_error);
+#if defined (__linux__)
+		// send part of already opened file, descriptor is not closed
+		void sendFile (int fd, aconnect::string_constref filePath, size_t offset, size_t size) throw (std::runtime_error);
+#endif
+		/**
+		*	Relay "size" bytes from "source" socket as response content (splice where supported),
+		*	Content-Length must be set before call.
+		*/
+		void sendFromSocket (aconnect::socket_type source, size_t size) throw (std::runtime_error);
 		void writeCompleteResponse (aconnect::string_constref response) throw (std::runtime_error);
 		void writeCompleteHtmlResponse (aconnect::string_constref response) throw (std::runtime_error);
 
 		void end () throw (aconnect::socket_error);
+		/**
+		*	Stop response without completion (content source failed after headers sending):
+		*	buffered content is dropped, connection is closed - client can not take 
+		*	truncated content as complete one.
+		*/
+		void abort ();
 
 		inline bool isFinished ()			{ return finished_;		};
+		inline bool isAborted ()			{ return aborted_;		};
 		inline bool isHeadersSent ()		{ return headersSent_;	};
 		inline bool canSendContent()		{ return httpMethod_ != HttpMethod::Head;	};
 		inline void setServerName (aconnect::string_constref serverName) {
 			serverName_ = serverName;
 		}
+		// send request phases durations in "Server-Timing" header (or trailer in "chunked" mode)
+		inline void setServerTiming (const HttpRequestTimes* times) {
+			serverTimingSource_ = times;
+		}
 		inline void setHttpMethod (ahttp::HttpMethod::HttpMethodType httpMethod) {
 			httpMethod_ = httpMethod;
 			Stream.setSendContent (canSendContent());
 		}
 
-		
-		static aconnect::string getErrorResponse (int status, 
-			aconnect::string_constptr messageFormat = NULL, ...);
+
+		// sample: route;dur=0.120, fs;dur=0.045, handler;dur=12.300, total;dur=12.900
+		static aconnect::string formatServerTiming (const HttpRequestTimes& times);
 
 	protected:
 		void fillCommonResponseHeaders ();
@@ -177,8 +251,10 @@ namespace ahttp
 		const aconnect::ClientInfo*	clientInfo_;
 		bool headersSent_;
 		bool finished_;	
+		bool aborted_;
 		aconnect::string serverName_;
 		ahttp::HttpMethod::HttpMethodType httpMethod_;
+		const HttpRequestTimes* serverTimingSource_;
 	};
 
 }
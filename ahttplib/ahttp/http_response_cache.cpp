@@ -0,0 +1,493 @@
+/*
+This file is part of [ahttp] library. 
+
+Author: Artem Kustikov (kustikoff[at]tut.by)
+version: 0.1
+
+This code is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this code.
+
+Permission is granted to anyone to use this code for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this code must not be misrepresented; you must
+not claim that you wrote the original code. If you use this
+code in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original code.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+
+#include "aconnect/util.hpp"
+
+#include "ahttp/http_support.hpp"
+#include "ahttp/http_response_cache.hpp"
+
+namespace algo = boost::algorithm;
+
+namespace ahttp
+{
+	namespace detail
+	{
+		const size_t CachedResponseOverhead = 256;	// bytes, approximate size of entry structures
+		const size_t CacheKeyOverhead = 64;			// bytes, approximate size of map node
+		const aconnect::util::timestamp_type CacheSweepInterval = 1000000;	// mks
+
+		// handlers and clients use different header names case
+		const aconnect::string* findHeader (const aconnect::str2str_map& headers, aconnect::string_constptr name)
+		{
+			for (aconnect::str2str_map::const_iterator it = headers.begin(); it != headers.end(); ++it) {
+				if (aconnect::util::equals (it->first, name))
+					return &it->second;
+			}
+			return NULL;
+		}
+
+		size_t getVarySize (aconnect::string_constref requestKey, const aconnect::str_vector& headers)
+		{
+			size_t result = requestKey.size() + CacheKeyOverhead;
+			for (aconnect::str_vector::const_iterator it = headers.begin(); it != headers.end(); ++it)
+				result += it->size();
+
+			return result;
+		}
+
+		void splitHeaderValue (aconnect::string_constref value, aconnect::str_vector& tokens)
+		{
+			algo::split (tokens, value, algo::is_any_of (","));
+			for (aconnect::str_vector::iterator it = tokens.begin(); it != tokens.end(); ++it)
+				algo::trim (*it);
+		}
+
+		// "name=N" token value, -1 if token has other name
+		int getDirectiveValue (aconnect::string_constref token, aconnect::string_constptr name)
+		{
+			const size_t nameLen = strlen (name);
+			if (token.size() <= nameLen || token[nameLen] != '=' 
+				|| !algo::iequals (token.substr (0, nameLen), name))
+				return -1;
+
+			return (int) strtol (token.c_str() + nameLen + 1, NULL, 10);
+		}
+	}
+
+	size_t CachedResponse::size () const
+	{
+		size_t result = content.size() + detail::CachedResponseOverhead;
+		for (aconnect::str2str_map::const_iterator it = headers.begin(); it != headers.end(); ++it)
+			result += it->first.size() + it->second.size();
+
+		return result;
+	}
+
+	HttpResponseCache::HttpResponseCache (size_t maxSize, size_t maxKeys) :
+		maxSize_ (maxSize),
+		maxKeys_ (maxKeys),
+		lastSweep_ (0)
+	{
+	}
+
+	void HttpResponseCache::init (size_t maxSize, size_t maxKeys)
+	{
+		boost::mutex::scoped_lock lock (mutex_);
+
+		slots_.clear();
+		vary_.clear();
+		stats_ = Stats();
+		maxSize_ = maxSize;
+		maxKeys_ = maxKeys;
+		lastSweep_ = 0;
+	}
+
+	cached_response_ptr HttpResponseCache::find (aconnect::string_constref requestKey, 
+		const aconnect::str2str_map& requestHeaders,
+		int waitTimeoutSec, 
+		aconnect::string& updateKey)
+	{
+		using namespace aconnect;
+
+		const util::timestamp_type deadline = util::getTimestamp() + (util::timestamp_type) waitTimeoutSec * 1000000;
+		bool waited = false;
+		updateKey.clear();
+
+		boost::mutex::scoped_lock lock (mutex_);
+
+		while (true)
+		{
+			const util::timestamp_type now = util::getTimestamp();
+			sweepExpired (now);
+
+			// "Vary" list can be changed by concurrent update
+			const string key = buildEntryKey (requestKey, requestHeaders);
+			slots_map::iterator slotIter = slots_.find (key);
+
+			// slot is created only for request that fills it
+			if (slotIter == slots_.end()) 
+			{
+				Slot* slot = insertSlot (key, now);
+				if (!slot) {
+					++stats_.bypassed;
+					return cached_response_ptr ();
+				}
+
+				slot->updating = true;
+				++stats_.misses;
+				updateKey = key;
+				return cached_response_ptr ();
+			}
+
+			Slot& slot = slotIter->second;
+			if (slot.response)
+			{
+				if (now < slot.response->freshUntil) {
+					++stats_.hits;
+					return slot.response;
+				}
+
+				if (now < slot.response->staleUntil) 
+				{
+					if (slot.updating) {
+						++stats_.stale;
+						return slot.response;
+					}
+
+					// current request updates entry, stale response is sent to others meanwhile
+					slot.updating = true;
+					++stats_.misses;
+					updateKey = key;
+					return cached_response_ptr ();
+				}
+
+				removeResponse (slot);
+			}
+
+			if (now < slot.passUntil) {
+				++stats_.passed;
+				return cached_response_ptr ();
+			}
+
+			if (!slot.updating) {
+				slot.updating = true;
+				++stats_.misses;
+				updateKey = key;
+				return cached_response_ptr ();
+			}
+
+			// entry is filled by concurrent request
+			if (!waited) {
+				++stats_.coalesced;
+				waited = true;
+			}
+
+			if (now >= deadline) {
+				++stats_.bypassed;
+				return cached_response_ptr ();
+			}
+
+			updatedCondition_.timed_wait (lock, util::createTimePeriod (1));
+		}
+	}
+
+	void HttpResponseCache::store (aconnect::string_constref requestKey, 
+		aconnect::string_constref updateKey,
+		const aconnect::str2str_map& requestHeaders,
+		cached_response_ptr response)
+	{
+		using namespace aconnect;
+		assert (response);
+
+		str_vector varyHeaders;
+		if (const string* vary = detail::findHeader (response->headers, detail::HeaderVary))
+			detail::splitHeaderValue (*vary, varyHeaders);
+
+		const size_t responseSize = response->size();
+		{
+			boost::mutex::scoped_lock lock (mutex_);
+			const util::timestamp_type now = util::getTimestamp();
+
+			// updated slot keeps "updating" flag until completion - it is not evicted meanwhile
+			slots_map::iterator updated = slots_.find (updateKey);
+
+			bool varyStored = true;
+			if (varyHeaders.empty()) {
+				vary_map::iterator varyIter = vary_.find (requestKey);
+				if (varyIter != vary_.end())
+					eraseVary (varyIter);
+			} else {
+				varyStored = insertVary (requestKey, varyHeaders, now);
+			}
+
+			// entry key is built with actual "Vary" list
+			const string key = buildEntryKey (requestKey, requestHeaders);
+			slots_map::iterator slotIter = slots_.find (key);
+			Slot* slot = NULL;
+
+			if (slotIter != slots_.end())
+				slot = &slotIter->second;
+			else if (varyStored)
+				slot = insertSlot (key, now);
+
+			if (slot && varyStored) 
+			{
+				const bool updating = slot->updating;
+				slot->updating = true;
+
+				removeResponse (*slot);
+				slot->passUntil = 0;
+
+				if (stats_.size + responseSize > maxSize_)
+					sweepExpired (now);
+
+				if (stats_.size + responseSize <= maxSize_) {
+					slot->response = response;
+					stats_.size += responseSize;
+					++stats_.entries;
+					++stats_.stored;
+				}
+
+				slot->updating = updating;
+			}
+
+			if (updated != slots_.end()) 
+			{
+				updated->second.updating = false;
+				if (!updated->second.response)
+					eraseSlot (updated);
+			}
+		}
+
+		updatedCondition_.notify_all ();
+	}
+
+	void HttpResponseCache::cancel (aconnect::string_constref updateKey, int passTimeoutSec)
+	{
+		using namespace aconnect;
+		{
+			boost::mutex::scoped_lock lock (mutex_);
+			const util::timestamp_type now = util::getTimestamp();
+
+			slots_map::iterator it = slots_.find (updateKey);
+			if (it != slots_.end()) 
+			{
+				it->second.updating = false;
+				
+				if (passTimeoutSec > 0) {
+					// stale response must not be sent instead of not cacheable one
+					removeResponse (it->second);
+					it->second.passUntil = now + (util::timestamp_type) passTimeoutSec * 1000000;
+				
+				} else if (!it->second.response) {
+					eraseSlot (it);
+				}
+			}
+
+			sweepExpired (now);
+		}
+
+		updatedCondition_.notify_all ();
+	}
+
+	bool HttpResponseCache::getLifetime (const aconnect::str2str_map& responseHeaders, int& ttl, int& stale, bool& shared)
+	{
+		using namespace aconnect;
+		shared = false;
+
+		if (detail::findHeader (responseHeaders, detail::HeaderSetCookie))
+			return false;
+
+		str_vector tokens;
+		if (const string* vary = detail::findHeader (responseHeaders, detail::HeaderVary)) {
+			detail::splitHeaderValue (*vary, tokens);
+			for (str_vector::const_iterator it = tokens.begin(); it != tokens.end(); ++it) {
+				if (*it == detail::VaryAny)
+					return false;
+				if (util::equals (*it, detail::HeaderCookie))
+					shared = true;
+			}
+		}
+
+		const string* cacheControl = detail::findHeader (responseHeaders, detail::HeaderCacheControl);
+		if (!cacheControl)
+			return ttl > 0;
+
+		int maxAge = -1, sharedMaxAge = -1, value;
+		detail::splitHeaderValue (*cacheControl, tokens);
+
+		for (str_vector::const_iterator it = tokens.begin(); it != tokens.end(); ++it)
+		{
+			if (util::equals (*it, detail::CacheControlNoStore) 
+				|| util::equals (*it, detail::CacheControlNoCache)
+				|| util::equals (*it, detail::CacheControlPrivate))
+				return false;
+
+			if (util::equals (*it, detail::CacheControlPublic))
+				shared = true;
+			else if ((value = detail::getDirectiveValue (*it, detail::CacheControlSharedMaxAge)) >= 0)
+				sharedMaxAge = value;
+			else if ((value = detail::getDirectiveValue (*it, detail::CacheControlMaxAge)) >= 0)
+				maxAge = value;
+			else if ((value = detail::getDirectiveValue (*it, detail::CacheControlStaleWhileRevalidate)) >= 0)
+				stale = value;
+		}
+
+		// "s-maxage" is applied to shared caches only, it overrides "max-age"
+		if (sharedMaxAge >= 0) {
+			ttl = sharedMaxAge;
+			shared = true;
+		}
+		else if (maxAge >= 0)
+			ttl = maxAge;
+
+		return ttl > 0;
+	}
+
+	void HttpResponseCache::collect (Stats& result)
+	{
+		boost::mutex::scoped_lock lock (mutex_);
+		result = stats_;
+		result.keys = slots_.size() + vary_.size();
+	}
+
+	aconnect::string HttpResponseCache::buildEntryKey (aconnect::string_constref requestKey, 
+		const aconnect::str2str_map& requestHeaders)
+	{
+		using namespace aconnect;
+
+		vary_map::const_iterator varyIter = vary_.find (requestKey);
+		if (varyIter == vary_.end())
+			return requestKey;
+
+		string key = requestKey;
+		for (str_vector::const_iterator it = varyIter->second.begin(); it != varyIter->second.end(); ++it) 
+		{
+			const string* value = detail::findHeader (requestHeaders, it->c_str());
+			key += '\n';
+			key += *it;
+			key += ':';
+			if (value)
+				key += *value;
+		}
+
+		return key;
+	}
+
+	void HttpResponseCache::evictExpired (aconnect::util::timestamp_type now)
+	{
+		slots_map::iterator it = slots_.begin();
+		while (it != slots_.end())
+		{
+			if (it->second.response && it->second.response->staleUntil <= now)
+				removeResponse (it->second);
+
+			if (!it->second.response && !it->second.updating && it->second.passUntil <= now)
+				eraseSlot (it++);
+			else
+				++it;
+		}
+
+		// "Vary" lists are kept while request key has slots
+		vary_map::iterator varyIter = vary_.begin();
+		while (varyIter != vary_.end())
+		{
+			if (!hasSlots (varyIter->first))
+				eraseVary (varyIter++);
+			else
+				++varyIter;
+		}
+
+		lastSweep_ = now;
+	}
+
+	void HttpResponseCache::sweepExpired (aconnect::util::timestamp_type now)
+	{
+		if (now - lastSweep_ >= detail::CacheSweepInterval)
+			evictExpired (now);
+	}
+
+	void HttpResponseCache::removeResponse (Slot& slot)
+	{
+		if (!slot.response)
+			return;
+
+		stats_.size -= slot.response->size();
+		--stats_.entries;
+		slot.response.reset();
+	}
+
+	HttpResponseCache::Slot* HttpResponseCache::insertSlot (aconnect::string_constref key, 
+		aconnect::util::timestamp_type now)
+	{
+		const size_t keySize = key.size() + detail::CacheKeyOverhead;
+
+		if (isKeysLimitReached() || stats_.size + keySize > maxSize_)
+			sweepExpired (now);
+
+		if (isKeysLimitReached() || stats_.size + keySize > maxSize_)
+			return NULL;
+
+		stats_.size += keySize;
+		return &slots_[key];
+	}
+
+	void HttpResponseCache::eraseSlot (slots_map::iterator it)
+	{
+		removeResponse (it->second);
+		stats_.size -= it->first.size() + detail::CacheKeyOverhead;
+		slots_.erase (it);
+	}
+
+	bool HttpResponseCache::insertVary (aconnect::string_constref requestKey, const aconnect::str_vector& headers, 
+			aconnect::util::timestamp_type now)
+	{
+		const size_t varySize = detail::getVarySize (requestKey, headers);
+		vary_map::iterator it = vary_.find (requestKey);
+		
+		if (it != vary_.end()) {
+			stats_.size -= detail::getVarySize (it->first, it->second);
+			stats_.size += varySize;
+			it->second = headers;
+			return true;
+		}
+
+		if (isKeysLimitReached() || stats_.size + varySize > maxSize_)
+			sweepExpired (now);
+
+		if (isKeysLimitReached() || stats_.size + varySize > maxSize_)
+			return false;
+
+		stats_.size += varySize;
+		vary_[requestKey] = headers;
+		return true;
+	}
+
+	void HttpResponseCache::eraseVary (vary_map::iterator it)
+	{
+		stats_.size -= detail::getVarySize (it->first, it->second);
+		vary_.erase (it);
+	}
+
+	bool HttpResponseCache::hasSlots (aconnect::string_constref requestKey) const
+	{
+		if (slots_.find (requestKey) != slots_.end())
+			return true;
+
+		// keys built with "Vary" headers values
+		const aconnect::string prefix = requestKey + '\n';
+		slots_map::const_iterator it = slots_.lower_bound (prefix);
+		
+		return it != slots_.end() && it->first.compare (0, prefix.size(), prefix) == 0;
+	}
+}
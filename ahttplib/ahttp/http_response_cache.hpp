@@ -0,0 +1,177 @@
+/*
+This file is part of [ahttp] library. 
+
+Author: Artem Kustikov (kustikoff[at]tut.by)
+version: 0.1
+
+This code is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this code.
+
+Permission is granted to anyone to use this code for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this code must not be misrepresented; you must
+not claim that you wrote the original code. If you use this
+code in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original code.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#ifndef AHTTP_RESPONSE_CACHE_H
+#define AHTTP_RESPONSE_CACHE_H
+#pragma once
+
+#include <map>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include "aconnect/types.hpp"
+#include "aconnect/complex_types.hpp"
+#include "aconnect/time_util.hpp"
+
+namespace ahttp
+{
+	namespace defaults
+	{
+		const size_t ResponseCacheSize			= 32 * 1048576;	// bytes, cached content, headers and keys
+		const size_t ResponseCacheMaxKeys		= 65536;	// slots and "Vary" lists count
+		const int ResponseCacheWaitTimeout		= 5;	// sec, wait for concurrent handler filling the same entry
+	}
+
+	// handler response stored in cache
+	struct CachedResponse
+	{
+		int status;
+		aconnect::str2str_map headers;
+		aconnect::string content;
+
+		aconnect::util::timestamp_type storedAt;
+		aconnect::util::timestamp_type freshUntil;
+		aconnect::util::timestamp_type staleUntil;	// stale response can be sent while it is updated
+		bool shared;	// can be sent to requests with cookies ("public", "s-maxage" or "Vary: Cookie")
+
+		size_t size () const;
+	};
+
+	typedef boost::shared_ptr<const CachedResponse> cached_response_ptr;
+
+	/**
+	*	Handlers responses micro-cache. Entry key is built from request key (method, path, query)
+	*	and values of request headers listed in response "Vary" header.
+	*	Only one request fills (or updates) an entry: concurrent requests for the same key wait for it
+	*	or get stale response if it is available.
+	*/
+	class HttpResponseCache : private boost::noncopyable
+	{
+	public:
+		typedef boost::uint64_t counter_type;
+
+		struct Stats
+		{
+			Stats () : hits (0), stale (0), misses (0), coalesced (0), 
+				bypassed (0), passed (0), stored (0), entries (0), keys (0), size (0) { }
+
+			counter_type hits;
+			counter_type stale;			// stale response sent while entry is updated
+			counter_type misses;
+			counter_type coalesced;		// requests waited for concurrent entry filling
+			counter_type bypassed;		// entry filling wait timed out or keys limit reached
+			counter_type passed;		// not cacheable response is remembered for key
+			counter_type stored;
+			size_t entries;
+			size_t keys;				// slots (including pass and updating ones) and "Vary" lists
+			size_t size;
+		};
+
+		HttpResponseCache (size_t maxSize = defaults::ResponseCacheSize, 
+			size_t maxKeys = defaults::ResponseCacheMaxKeys);
+
+		// drop all entries and setup limits
+		void init (size_t maxSize, size_t maxKeys = defaults::ResponseCacheMaxKeys);
+
+		/*
+		*	Returns response to send or NULL. When "updateKey" is filled on return, caller must
+		*	run handler and complete update by "store" or "cancel" call. Both empty - cache is bypassed
+		*	(concurrent update is running longer than "waitTimeoutSec").
+		*/
+		cached_response_ptr find (aconnect::string_constref requestKey, 
+			const aconnect::str2str_map& requestHeaders,
+			int waitTimeoutSec, 
+			aconnect::string& updateKey);
+
+		void store (aconnect::string_constref requestKey, 
+			aconnect::string_constref updateKey,
+			const aconnect::str2str_map& requestHeaders,
+			cached_response_ptr response);
+		
+		// "passTimeoutSec" - handler response is not cacheable, requests with the same key 
+		// are not coalesced during this period
+		void cancel (aconnect::string_constref updateKey, int passTimeoutSec = 0);
+
+		/*
+		*	Loads response lifetime from "Cache-Control" header ("max-age", "s-maxage", "stale-while-revalidate"),
+		*	returns false if response must not be stored ("no-store", "private", "no-cache", "Set-Cookie", "Vary: *").
+		*	"shared" is set when response is explicitly allowed for requests with cookies
+		*	("public", "s-maxage" or "Cookie" in "Vary" list).
+		*/
+		static bool getLifetime (const aconnect::str2str_map& responseHeaders, int& ttl, int& stale, bool& shared);
+
+		void collect (Stats& result);
+
+	protected:
+		struct Slot
+		{
+			Slot () : updating (false), passUntil (0) { }
+			cached_response_ptr response;
+			bool updating;
+			aconnect::util::timestamp_type passUntil;
+		};
+
+		typedef std::map<aconnect::string, Slot> slots_map;
+		// key - request key, value - request headers names from response "Vary" header
+		typedef std::map<aconnect::string, aconnect::str_vector> vary_map;
+
+		aconnect::string buildEntryKey (aconnect::string_constref requestKey, 
+			const aconnect::str2str_map& requestHeaders);
+		void evictExpired (aconnect::util::timestamp_type now);
+		// expired entries are swept at most once per second - full scan is not run on each insertion 
+		// into filled cache
+		void sweepExpired (aconnect::util::timestamp_type now);
+		void removeResponse (Slot& slot);
+
+		// NULL when keys limit is reached
+		Slot* insertSlot (aconnect::string_constref key, aconnect::util::timestamp_type now);
+		void eraseSlot (slots_map::iterator it);
+		bool insertVary (aconnect::string_constref requestKey, const aconnect::str_vector& headers, 
+			aconnect::util::timestamp_type now);
+		void eraseVary (vary_map::iterator it);
+		bool hasSlots (aconnect::string_constref requestKey) const;
+		inline bool isKeysLimitReached () const {
+			return slots_.size() + vary_.size() >= maxKeys_;
+		}
+
+	protected:
+		boost::mutex mutex_;
+		boost::condition updatedCondition_;
+
+		slots_map slots_;
+		vary_map vary_;
+		size_t maxSize_;
+		size_t maxKeys_;
+		aconnect::util::timestamp_type lastSweep_;
+
+		Stats stats_;
+	};
+}
+
+#endif // AHTTP_RESPONSE_CACHE_H
@@ -28,6 +28,8 @@ distribution.
 
 #include <boost/lexical_cast.hpp>
 
+#include "aconnect/util.hpp"
+
 #include "ahttp/http_support.hpp"
 #include "ahttp/http_response_header.hpp"
 
@@ -46,6 +48,12 @@ namespace ahttp
 				it->second << detail::HeadersDelimiter;
 		}
 
+		for (str_vector::iterator it = Cookies.begin(); it != Cookies.end(); it++)
+		{
+			content << detail::HeaderSetCookie << detail::HeaderValueDelimiter <<
+				*it << detail::HeadersDelimiter;
+		}
+
 		content << detail::HeadersDelimiter;
 		return content.str();
 	}
@@ -61,6 +69,48 @@ namespace ahttp
 			Headers[detail::HeaderContentType] = contentType + "; charset=" + charset;
 	}
 
+	void HttpResponseHeader::mergeHeaders (const aconnect::str2str_map& headers, const aconnect::str_vector& cookies)
+	{
+		using namespace aconnect;
+
+		for (str2str_map::const_iterator it = headers.begin(); it != headers.end(); ++it)
+		{
+			str2str_map::iterator current = Headers.begin();
+			while (current != Headers.end()) {
+				if (current->first != it->first && util::equals (current->first, it->first))
+					Headers.erase (current++);
+				else
+					++current;
+			}
+
+			Headers[it->first] = it->second;
+		}
+
+		Cookies.insert (Cookies.end(), cookies.begin(), cookies.end());
+	}
+
+	void HttpResponseHeader::addHeader (aconnect::str2str_map& headers, aconnect::str_vector& cookies,
+		aconnect::string_constref name, aconnect::string_constref value)
+	{
+		using namespace aconnect;
+
+		if (util::equals (name, detail::HeaderSetCookie)) {
+			cookies.push_back (value);
+			return;
+		}
+
+		for (str2str_map::iterator it = headers.begin(); it != headers.end(); ++it) 
+		{
+			if (util::equals (it->first, name)) {
+				it->second += ", ";
+				it->second += value;
+				return;
+			}
+		}
+
+		headers[name] = value;
+	}
+
 	aconnect::string HttpResponseHeader::getResponseStatusString (int status)
 	{
 		aconnect::str_stream ret;
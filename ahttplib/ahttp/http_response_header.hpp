@@ -42,6 +42,7 @@ namespace ahttp
 
 		// properties
 		aconnect::str2str_map Headers;
+		aconnect::str_vector Cookies;		// "Set-Cookie" values, sent as separate lines
 		int Status;
 
 	public:
@@ -52,14 +53,28 @@ namespace ahttp
 		{
 			Status = UnknownStatus;
 			Headers.clear ();
+			Cookies.clear ();
 		}
 
 		aconnect::string getContent ();
 		void setContentLength (size_t length);
 		void setContentType (aconnect::string_constref contentType, aconnect::string_constref charset = "");
 
+		/**
+		*	Merges headers loaded from handler or backend response (see addHeader), 
+		*	header already set by server is replaced (names are compared ignoring case).
+		*/
+		void mergeHeaders (const aconnect::str2str_map& headers, const aconnect::str_vector& cookies);
+
 		static aconnect::string getResponseStatusString (int status);
 
+		/**
+		*	Adds header line loaded from handler or backend response: values of repeated header 
+		*	are combined with ", ", "Set-Cookie" values are collected to "cookies" - they can not be combined.
+		*/
+		static void addHeader (aconnect::str2str_map& headers, aconnect::str_vector& cookies,
+			aconnect::string_constref name, aconnect::string_constref value);
+
 		// inlines
 		inline bool hasHeader (aconnect::string_constref headerName) const {
 			return (Headers.find (headerName) != Headers.end());
@@ -38,6 +38,8 @@ distribution.
 #include "aconnect/complex_types.hpp"
 
 #include "ahttp/http_messages.hpp"
+#include "ahttp/http_access_log.hpp"
+#include "ahttp/http_multipart.hpp"
 #include "ahttplib.hpp"
 
 
@@ -47,11 +49,150 @@ namespace algo = boost::algorithm;
 namespace ahttp 
 {
 	HttpServerSettings* HttpServer::globalSettings_ = NULL;
-	boost::detail::atomic_count HttpServer::RequestsCount (0);
+	aconnect::Server* HttpServer::server_ = NULL;
+	aconnect::ShardedCounter HttpServer::RequestsCount;
+	HttpServerStatistics HttpServer::Statistics;
+	RequestTracer HttpServer::Tracer;
+	HttpResponseCache HttpServer::ResponseCache;
+	NegativePathCache HttpServer::NegativeCache;
+	DirectoryListingCache HttpServer::ListingCache;
+	HttpErrorPages HttpServer::ErrorPages;
+	boost::thread_specific_ptr<HttpServer::WorkerThreadState> HttpServer::threadState_;
+	aconnect::string HttpServer::notFoundResponse_;
 	
 
 #include "http_header_read_check.inl"
 
+	namespace detail
+	{
+		// adds scope execution time to "total" (microseconds)
+		class ScopedTimeAccumulator : private boost::noncopyable
+		{
+		public:
+			ScopedTimeAccumulator (aconnect::util::timestamp_type& total) : 
+				total_ (total), started_ (aconnect::util::getTimestamp()) { }
+			
+			~ScopedTimeAccumulator () {
+				total_ += aconnect::util::elapsedTime (started_, aconnect::util::getTimestamp());
+			}
+
+		private:
+			aconnect::util::timestamp_type& total_;
+			aconnect::util::timestamp_type started_;
+		};
+
+		// checks that absolute "path" is located in "root" directory, ".." is not allowed
+		bool isPathInside (const fs::path& root, const fs::path& path)
+		{
+			if (!root.is_complete() || !path.is_complete())
+				return false;
+
+			fs::path::iterator rootIter = root.begin(), pathIter = path.begin();
+			while (rootIter != root.end()) 
+			{
+				if (*rootIter == ".") {
+					++rootIter;
+					continue;
+				}
+				if (pathIter == path.end() || *pathIter != *rootIter)
+					return false;
+				
+				++rootIter;
+				++pathIter;
+			}
+
+			for (; pathIter != path.end(); ++pathIter)
+				if (*pathIter == "..")
+					return false;
+
+			return true;
+		}
+
+		// fills form fields and uploaded files from multipart parts
+		class MultipartFormLoader : public MultipartParser::Listener
+		{
+		public:
+			MultipartFormLoader (HttpContext& context) : 
+				context_ (context), field_ (NULL) { }
+			
+			~MultipartFormLoader () {
+				closeFile ();
+			}
+
+			virtual void partBegin (aconnect::string_constref header)
+			{
+				using namespace aconnect;
+
+				closeFile ();
+				field_ = NULL;
+
+				uploadInfo_.loadHeader (header);
+				fieldName_ = util::decodeUrl (uploadInfo_.name);
+
+				if ( !uploadInfo_.isFileData ) {
+					field_ = &context_.PostParameters [fieldName_];
+					return;
+				}
+
+				if ( !uploadInfo_.fileName.empty() ) 
+				{
+					fs::path uploadPath;
+					string fileNamePrefix;
+					
+					// UNDONE: replace += '$' to "timestamp + rnd()"
+					// fast upload name search
+					do {
+						uploadPath = context_.UploadsDirPath / (fileNamePrefix + uploadInfo_.fileName);
+						fileNamePrefix += '$';
+					} while (fs::exists (uploadPath));
+
+					// open file, content is written unbuffered - parts data is passed in large portions
+					do {
+						uploadPath = context_.UploadsDirPath / (fileNamePrefix + uploadInfo_.fileName);
+						file_.clear ();
+						file_.rdbuf()->pubsetbuf (NULL, 0);
+						file_.open ( uploadPath.file_string().c_str(), std::ios::out | std::ios::binary );
+						fileNamePrefix += '$';
+
+					} while (file_.bad());
+
+					uploadInfo_.uploadPath = uploadPath.file_string();
+				}
+
+				context_.UploadedFiles[fieldName_] = uploadInfo_;
+			}
+
+			virtual void partData (aconnect::string_constptr data, size_t size)
+			{
+				if (field_)
+					field_->append (data, size);
+				else if (file_.is_open())
+					file_.write (data, (std::streamsize) size);
+			}
+
+			virtual void partEnd ()
+			{
+				closeFile ();
+				field_ = NULL;
+			}
+
+		protected:
+			void closeFile () 
+			{
+				if (file_.is_open()) {
+					file_.flush();
+					file_.rdbuf()->close();
+				}
+			}
+
+			HttpContext& context_;
+			UploadFileInfo uploadInfo_;
+			aconnect::string fieldName_;
+			aconnect::string* field_;		// current form field value, NULL - file part
+			std::ofstream file_;
+		};
+	}
+
 	//////////////////////////////////////////////////////////////////////////
 	//		UploadFileInfo class
 	//////////////////////////////////////////////////////////////////////////
@@ -128,7 +269,9 @@ namespace ahttp
 			globalSettings ? globalSettings->maxChunkSize() : ahttp::defaults::MaxChunkSize),
 		Method (HttpMethod::Unknown),
 		GlobalSettings (globalSettings),
-		Log (log)
+		Log (log),
+		Handler (NULL),
+		Arena (NULL)
 	{
 		assert (clientInfo);
 		assert (globalSettings);
@@ -136,10 +279,18 @@ namespace ahttp
 	}
 
 	HttpContext::~HttpContext()
+	{
+		removeUploadedFiles ();
+	}
+
+	void HttpContext::removeUploadedFiles ()
 	{
 		std::map <aconnect::string, UploadFileInfo>::const_iterator iter;
 		for (iter = UploadedFiles.begin(); iter != UploadedFiles.end(); ++iter)
 		{
+			if (iter->second.uploadPath.empty())
+				continue;
+
 			try	{
 				fs::remove(iter->second.uploadPath);
 			} catch (std::exception &ex)  {
@@ -152,6 +303,7 @@ namespace ahttp
 			}
 		}
 		
+		UploadedFiles.clear();
 	}
 
 	bool HttpContext::init (bool isKeepAliveConnect,
@@ -164,6 +316,7 @@ namespace ahttp
 		if (check.connectionWasClosed() || requestBodyBegin.empty())
 			return false;
 
+		RequestHeader.HeaderLength = check.headerSize();
 		boost::algorithm::erase_head ( requestBodyBegin, (int) check.headerSize());
 		RequestStream.init (requestBodyBegin, (int) RequestHeader.ContentLength, Client->socket);
 
@@ -184,8 +337,11 @@ namespace ahttp
 		Cookies.clear();
 		
 		UploadedFiles.clear();
+		Target.clear();
 		
 		Method = HttpMethod::Unknown;
+		Times = HttpRequestTimes();
+		Handler = NULL;
 	}
 	
 	void HttpContext::setHtmlResponse() {
@@ -316,129 +472,37 @@ namespace ahttp
 	void HttpContext::loadMultipartFormData (aconnect::string_constref boundary) 
 	{
 		using namespace aconnect;
-		const int buffSize = (int) util::min2 (Response.Stream.getBufferSize(), RequestHeader.ContentLength);
+		const size_t buffSize = util::min2 (Response.Stream.getBufferSize(), RequestHeader.ContentLength);
 
-		boost::scoped_array<char_type> buff (new char_type [buffSize]);
+		detail::MultipartFormLoader loader (*this);
+		MultipartParser parser (boundary, buffSize, loader);
 
+		// request body is read directly to parser buffer
 		int readBytes = 0;
-		string record, fieldName;
-		size_t boundaryPos, endPos;
-		fs::path uploadPath;
+		size_t freeSize = 0;
 		
-		const string boundaryBegin = detail::MultipartBoundaryPrefix + boundary;
-		const string boundaryBeginWithEndMark = string(detail::HeadersDelimiter) + detail::MultipartBoundaryPrefix + boundary;
-		const string boundaryEnd = detail::MultipartBoundaryPrefix + boundary + detail::MultipartBoundaryPrefix;
-
-		const size_t boundOffset = (boundaryBegin + detail::HeadersDelimiter).size();
-		const size_t endMarkLen = strlen (detail::HeadersEndMark);
-		const size_t headerEndMarkLen = strlen (detail::HeadersDelimiter);
-
-		UploadFileInfo uploadInfo;
-		std::ofstream currentFile;
-		string fileNamePrefix;
-				
 		do 
 		{
-			readBytes = RequestStream.read (buff.get(), buffSize);
-			record.append (buff.get(), readBytes);
-
-			boundaryPos = record.find (boundaryBegin);
-			
-			while (record.length()) 
-			{
-				// start reading
-				if (boundaryPos == 0 
-					&& (endPos = record.find (detail::HeadersEndMark, 0)) != string::npos) 
-				{
-					if (currentFile.is_open()) {
-						currentFile.flush();
-						currentFile.rdbuf()->close();
-					}
-
-					uploadInfo.loadHeader (record.substr(boundOffset, endPos - boundOffset));
-					fieldName = util::decodeUrl (uploadInfo.name);
-
-					record.erase(0, endPos + endMarkLen);
-					boundaryPos = util::findSequence (record, boundaryBeginWithEndMark);
-					
-					if ( !uploadInfo.isFileData ) {
-						PostParameters [fieldName] += record.substr (0, boundaryPos);
+			string_ptr buff = parser.buffer (freeSize);
+			readBytes = RequestStream.read (buff, (int) freeSize);
 			
-					} else {
-						
-						if ( !uploadInfo.fileName.empty() ) 
-						{
-							fileNamePrefix.clear();
-							// UNDONE: replace += '$' to "timestamp + rnd()"
-							// fast upload name search
-							do {
-								uploadPath = UploadsDirPath / (fileNamePrefix + uploadInfo.fileName);
-								fileNamePrefix += '$';
-							} while (fs::exists (uploadPath));
-
-							// open file
-							do {
-								uploadPath = UploadsDirPath / (fileNamePrefix + uploadInfo.fileName);
-								currentFile.open ( uploadPath.file_string().c_str(), std::ios::out | std::ios::binary );
-								fileNamePrefix += '$';
-
-							} while (currentFile.bad());
-
-
-							uploadInfo.uploadPath = uploadPath.file_string();
-							
-							if (record.size()) {
-								currentFile << record.substr (0, boundaryPos);
-							}
-						}
-
-						UploadedFiles[fieldName] = uploadInfo;
-					}
-
-					record.erase(0, boundaryPos);
-					boundaryPos = 0;
+			if (readBytes > 0 && parser.parse ((size_t) readBytes)) {
+				// eat request
+				boost::scoped_array<char_type> rest (new char_type [buffSize]);
+				while (!RequestStream.isRead() && readBytes > 0)
+					readBytes = RequestStream.read (rest.get(), (int) buffSize);
 				
-				} else if (!fieldName.empty() && boundaryPos != 0 && boundaryPos != string::npos) {
-					
-					if ( !uploadInfo.isFileData ) {
-						PostParameters [fieldName] += record.substr (0, boundaryPos - headerEndMarkLen);
-					} else {
-						currentFile << record.substr (0, boundaryPos - headerEndMarkLen);
-					}
-					
-					record.erase(0, boundaryPos);
-					boundaryPos = 0;
-
-				} else { 
-					
-					if ( uploadInfo.isFileData 
-						&& currentFile.is_open()
-						&&  util::findSequence (record, boundaryBeginWithEndMark) == string::npos
-						&&  util::findSequence (record, boundaryBegin) == string::npos) 
-					{
-						currentFile << record;
-						record.clear();
-									
-					} else {
-						break;
-					}
-				}
-				
-				if (record.find (boundaryEnd) == 0) {
-					// eat request
-					while (!RequestStream.isRead() && readBytes > 0)
-						readBytes = RequestStream.read (buff.get(), buffSize);
-					
-					readBytes = 0;
-					break;
-				}
+				readBytes = 0;
 			}
-			
+		
 		} while (readBytes > 0);
 
-		if (currentFile.is_open()) {
-			currentFile.flush();
-			currentFile.rdbuf()->close();
+		loader.partEnd ();
+
+		// client disconnected or body is shorter than Content-Length - partial files are not accepted
+		if (!parser.isCompleted()) {
+			removeUploadedFiles ();
+			throw request_processing_error ("Multipart form data is truncated, boundary: %s", boundary.c_str());
 		}
 
 		// read files info
@@ -467,20 +531,11 @@ namespace ahttp
 	// Process worker thread creation fail
 	void HttpServer::processWorkerCreationError (const aconnect::socket_type clientSock) 
 	{
-		using namespace aconnect;
-		
-		string content = HttpResponse::getErrorResponse(503,
-			messages::Error503);
-
-		str_stream response;
+		// prepared at settings load - nothing is allocated under overload
+		aconnect::string_constref response = ErrorPages.serviceUnavailableResponse();
+		assert (!response.empty() && "Error pages are not initialized");
 
-		// create header
-		response << HttpResponseHeader::getResponseStatusString (503);
-		response << detail::HeaderContentType << detail::HeaderValueDelimiter << detail::ContentTypeTextHtml << detail::HeadersDelimiter;
-		response << detail::HeaderContentLength << detail::HeaderValueDelimiter << content.length() << detail::HeadersDelimiter;
-		response << detail::HeaderServer << detail::HeaderValueDelimiter << GlobalSettings()->serverVersion() << detail::HeadersDelimiter;
-
-		aconnect::util::writeToSocket (clientSock, response.str());
+		aconnect::util::writeToSocket (clientSock, response.c_str(), (int) response.size());
 	}
 
 	// check HTTP method availability - sent 501 on fail
@@ -509,7 +564,8 @@ namespace ahttp
 
 		// format "Not Implemented" response
 		context.Response.Header.Status = 501;
-		aconnect::string errorResponse = HttpResponse::getErrorResponse (context.Response.Header.Status,
+		aconnect::string errorResponse;
+		ErrorPages.formatPage (errorResponse, context.Response.Header.Status,
 			messages::Error501_MethodNotImplemented, method.c_str());
 
 		context.Response.Header.setContentType (detail::ContentTypeTextHtml);
@@ -527,7 +583,8 @@ namespace ahttp
 		context.Response.Header.Status = status;
 		context.Response.Header.Headers [detail::HeaderLocation] = virtualPath;
 
-		aconnect::string errorResponse = HttpResponse::getErrorResponse (context.Response.Header.Status,
+		aconnect::string errorResponse;
+		ErrorPages.formatPage (errorResponse, context.Response.Header.Status,
 			messages::ErrorDocumentMoved, virtualPath.c_str() );
 		
 		context.Response.writeCompleteHtmlResponse (errorResponse);
@@ -540,8 +597,8 @@ namespace ahttp
 		using namespace aconnect;
 		
 		context.Response.Header.Status = 403;
-		aconnect::string errorResponse = HttpResponse::getErrorResponse (context.Response.Header.Status,
-			message);
+		aconnect::string errorResponse;
+		ErrorPages.formatPage (errorResponse, context.Response.Header.Status, message);
 		context.Response.writeCompleteHtmlResponse (errorResponse);
 	}
 
@@ -552,12 +609,19 @@ namespace ahttp
 
 		// format "Not Found" response
 		context.Response.Header.Status = 404;
-		aconnect::string errorResponse = HttpResponse::getErrorResponse (context.Response.Header.Status,
+		aconnect::string errorResponse;
+		ErrorPages.formatPage (errorResponse, context.Response.Header.Status,
 			messages::Error404, context.VirtualPath.c_str());
 		
 		context.Response.writeCompleteHtmlResponse (errorResponse);
 	}
 
+	void HttpServer::processCachedError404 (HttpContext& context)
+	{
+		context.Response.Header.Status = 404;
+		context.Response.writeCompleteHtmlResponse (notFoundResponse_);
+	}
+
 	void HttpServer::processError405 (HttpContext& context,
 									  aconnect::string_constref allowedMethods) 
 	{
@@ -566,7 +630,8 @@ namespace ahttp
 
 		// format "Method Not Allowed" response
 		context.Response.Header.Status = 405;
-		aconnect::string errorResponse = HttpResponse::getErrorResponse (context.Response.Header.Status,
+		aconnect::string errorResponse;
+		ErrorPages.formatPage (errorResponse, context.Response.Header.Status,
 			messages::Error405, context.RequestHeader.Method.c_str(), allowedMethods.c_str());
 
 		context.Response.Header.Headers[detail::HeaderAllow] = allowedMethods;
@@ -574,13 +639,23 @@ namespace ahttp
 		context.Response.writeCompleteHtmlResponse (errorResponse);
 	}
 
+	void HttpServer::processError400 (HttpContext& context, 
+		aconnect::string_constptr message) 
+	{
+		// format "Bad Request" response
+		context.Response.Header.Status = 400;
+		aconnect::string errorResponse;
+		ErrorPages.formatPage (errorResponse, context.Response.Header.Status, message);
+		context.Response.writeCompleteHtmlResponse (errorResponse);
+	}
+
 	void HttpServer::processError406 (HttpContext& context, 
 		aconnect::string_constref message) 
 	{
 		// format "Not Acceptable" response
 		context.Response.Header.Status = 406;
-		aconnect::string errorResponse = HttpResponse::getErrorResponse (context.Response.Header.Status,
-			message.c_str());
+		aconnect::string errorResponse;
+		ErrorPages.formatPage (errorResponse, context.Response.Header.Status, message.c_str());
 		context.Response.writeCompleteHtmlResponse (errorResponse);
 	}
 
@@ -593,17 +668,17 @@ namespace ahttp
 		if (!context.Response.isHeadersSent() &&
 			!context.Response.isFinished()) 
 		{
-			aconnect::string errorResponse = HttpResponse::getErrorResponse (status,
-				messages::Error500, (message ? message : "") );
+			aconnect::string errorResponse;
+			ErrorPages.formatPage (errorResponse, status, messages::Error500, message);
 
 			context.Response.Header.Status = status;
 			context.Response.writeCompleteHtmlResponse (errorResponse);
 		
 		} else {
 
-			string response = 
-				boost::str(boost::format (messages::MessageFormatInline) % 
-					detail::httpStatusDesc (status) % (message ? message : ""));
+			string response;
+			HttpErrorPages::fillTemplate (response, messages::MessageFormatInline, 
+				detail::httpStatusDesc (status).c_str(), message);
 			
 			context.Response.write (response);
 			context.Response.end();
@@ -618,23 +693,46 @@ namespace ahttp
 	{
 		using namespace aconnect;
 		string connectionHeader, requestString;
+		RequestArena& arena = workerThreadState().arena;
 		try
 		{
 			bool isKeepAliveConnect = false;
+			AccessLog* accessLog = GlobalSettings()->accessLog();
+			util::timestamp_type previousFinished = 0;
 
 			do {
 				HttpContext context (&client, 
 					HttpServer::GlobalSettings(),
 					HttpServer::GlobalSettings()->logger());
 
+				// queue wait is accounted for the first request on connection only
+				if (!isKeepAliveConnect)
+					context.Times.accepted = client.acceptTime;
+				context.Times.previousFinished = previousFinished;
+				context.Times.workerStarted = util::getTimestamp();
+				context.Arena = &arena;
+
 				bool loaded = context.init (isKeepAliveConnect, 
 					GlobalSettings()->keepAliveTimeout());
 
 				if (!loaded)
 					break;
+				context.Times.headerLoaded = util::getTimestamp();
 				requestString = context.RequestHeader.Path;
 
-				if (processRequest (context))
+				bool closeConnection = processRequest (context);
+				context.Times.finished = util::getTimestamp();
+
+				previousFinished = context.Times.finished;
+
+				Statistics.registerRequest (context);
+				Tracer.record (context);
+				if (accessLog)
+					accessLog->write (context);
+				
+				arena.reset ();
+
+				if (closeConnection)
 					break;
 				
 				if (!GlobalSettings()->isKeepAliveEnabled())
@@ -663,6 +761,8 @@ namespace ahttp
 				util::formatIpAddr (client.ip).c_str() );
 		}
 
+		// request failed with exception
+		arena.reset ();
 	}
 
 	bool HttpServer::processRequest (HttpContext &context)
@@ -682,6 +782,11 @@ namespace ahttp
 		context.MappedVirtualPath = 
 			context.VirtualPath = context.RequestHeader.Path.substr(0, context.RequestHeader.Path.find("?"));
 		
+		// fast path: routing and handlers are skipped,
+		// close connection if request body was not read
+		if (tryProcessMetricsRequest (context))
+			return !context.RequestStream.isRead();
+
 		try {
 			
 			// find request target by URL and process it is a real file
@@ -694,6 +799,10 @@ namespace ahttp
 			processServerError(context, 500, ex.what());
 		}
 		
+		// truncated response - connection must be closed
+		if (context.Response.isAborted())
+			return true;
+
 		// check request state - it must be read at this point
 		if ( !context.RequestStream.isRead()) {
 			processServerError(context, 500, messages::Error500_RequestNotLoaded);
@@ -716,13 +825,54 @@ namespace ahttp
 		return false;
 	}
 
+	bool HttpServer::tryProcessMetricsRequest (HttpContext& context)
+	{
+		using namespace aconnect;
+		HttpServerSettings* settings = GlobalSettings();
+
+		if (!settings->isMetricsEnabled())
+			return false;
+
+		const bool metricsPort = settings->metricsPort() != 0 
+			&& context.Client->server 
+			&& context.Client->server->port() == settings->metricsPort();
+
+		if (!metricsPort && settings->metricsPort() != 0)
+			return false;
+
+		if (context.VirtualPath != settings->metricsPath()) {
+			if (!metricsPort)
+				return false;
+
+			processError404 (context);
+			return true;
+		}
+
+		context.Response.Header.Status = 200;
+		context.Response.Header.setContentType (detail::ContentTypeMetrics);
+		context.Response.Header.Headers[detail::HeaderCacheControl] = detail::CacheControlNoCache;
+		context.Response.writeCompleteResponse (
+			Statistics.formatMetrics (server_ ? server_ : (metricsPort ? NULL : context.Client->server), 
+				settings->accessLog(), &ResponseCache, &NegativeCache, &ListingCache));
+
+		return true;
+	}
+
 	bool HttpServer::findTarget (HttpContext& context) 
 	{
 		using namespace aconnect;
 		const directories_map &directories = GlobalSettings()->Directories();
-		directories_map::const_iterator rootRecord = directories.find (detail::Slash);
+
+		// recently missing path - mappings and file system checks are skipped
+		if (NegativeCache.contains (context.VirtualPath)) {
+			processCachedError404 (context);
+			return false;
+		}
+		
+		// find registered directory
+		directories_map::const_iterator dirRecord = findDirectory (context.VirtualPath);
  
-		if (rootRecord == directories.end()) 
+		if (dirRecord == directories.end()) 
 		{
 			Log()->error("Root web directory (\"/\") is not registered");
 
@@ -730,24 +880,7 @@ namespace ahttp
 			return false;
 		}
 
-		DirectorySettings parentDirSettings = rootRecord->second;
-
-		// find registered directory
-		if ( !util::equals (context.VirtualPath, detail::Slash) ) 
-		{
-			string::size_type slashPos = 0;
-			directories_map::const_iterator dirIter;
-			string parentDir;
-			
-			while ((slashPos = context.VirtualPath.find(detail::Slash, slashPos + 1)) != string::npos) {
-				parentDir = context.VirtualPath.substr(0, slashPos + 1);
-				
-				if ( (dirIter = directories.find (parentDir)) != directories.end())
-					parentDirSettings = dirIter->second;
-				else
-					break;
-			} 
-		}
+		const DirectorySettings& parentDirSettings = dirRecord->second;
 
 		// apply mappings
 		if (!parentDirSettings.mappings.empty ()) {
@@ -756,7 +889,7 @@ namespace ahttp
             boost::smatch matches;
 			string val;
                 
-			for (mappings_vector::iterator iter = parentDirSettings.mappings.begin();
+			for (mappings_vector::const_iterator iter = parentDirSettings.mappings.begin();
 					iter != parentDirSettings.mappings.end();
 					++iter) 
 			{
@@ -788,22 +921,51 @@ namespace ahttp
 			}
 		}
 
+		string relativePath;
 		if (context.MappedVirtualPath == parentDirSettings.virtualPath) {
 			context.FileSystemPath = fs::path (parentDirSettings.realPath, fs::native);
 		} else {
+			relativePath = util::decodeUrl (context.MappedVirtualPath.substr (
+				parentDirSettings.virtualPath.length()));
+			
 			context.FileSystemPath = fs::complete (
-					fs::path (util::decodeUrl (context.MappedVirtualPath.substr (
-						parentDirSettings.virtualPath.length())), fs::portable_name), 
+					fs::path (relativePath, fs::portable_name), 
 					fs::path (parentDirSettings.realPath, fs::native)
 				);
 		}
 		
 		
+		context.Times.targetFound = util::getTimestamp();
+		if (parentDirSettings.serverTimingEnabled == 1)
+			context.Response.setServerTiming (&context.Times);
+
 		if ( runHandlers(context, parentDirSettings) )
 			return false; // processed by handler
 
 		
-		if (fs::is_directory(context.FileSystemPath) ) 
+		bool isDirectory = false;
+		{
+			detail::ScopedTimeAccumulator fsTimer (context.Times.fileSystemTime);
+
+#if defined (__linux__)
+			// single lookup relative to directory root: status and descriptor for file sending
+			if (parentDirSettings.rootFd != -1)
+				detail::openTarget (parentDirSettings.rootFd, relativePath, context.Target);
+#endif
+			if (context.Target.resolved)
+				isDirectory = context.Target.isDirectory;
+			else if (!detail::resolvesInside (parentDirSettings.realPath, context.FileSystemPath.string()))
+				context.Target.outside = true;	// symbolic link leaves directory, as with openat2
+			else
+				isDirectory = fs::is_directory (context.FileSystemPath);
+		}
+
+		if (context.Target.outside) {
+			processError403 (context, messages::Error403_AccessDenied);
+			return false;
+		}
+
+		if (isDirectory) 
 		{
 			if (context.VirtualPath == context.MappedVirtualPath) {
 				if (algo::ends_with (context.VirtualPath, detail::Slash))
@@ -832,7 +994,21 @@ namespace ahttp
 			virtDirIter++;
 		} 
 
-		if ( !fs::exists( context.FileSystemPath ) ) {
+		bool fileExists = context.Target.exists;
+		if (!context.Target.resolved) {
+			detail::ScopedTimeAccumulator fsTimer (context.Times.fileSystemTime);
+			fileExists = fs::exists (context.FileSystemPath);
+		}
+
+		if ( !fileExists ) {
+			// handlers could process the same path in other way
+			if (!hasHandler (fs::extension (context.FileSystemPath), parentDirSettings)) {
+				// parent directory watch and existence re-check
+				detail::ScopedTimeAccumulator fsTimer (context.Times.fileSystemTime);
+				NegativeCache.add (context.VirtualPath, context.FileSystemPath, 
+					fs::path (parentDirSettings.realPath, fs::native));
+			}
+			
 			// 404 error
 			processError404 (context);
 			return false;
@@ -841,7 +1017,150 @@ namespace ahttp
 		return true;
 	}
 
+	directories_map::const_iterator HttpServer::findDirectory (aconnect::string_constref virtualPath)
+	{
+		using namespace aconnect;
+		const directories_map &directories = GlobalSettings()->Directories();
+		directories_map::const_iterator result = directories.find (detail::Slash);
+
+		if (result == directories.end() || util::equals (virtualPath, detail::Slash))
+			return result;
+
+		string::size_type slashPos = 0;
+		directories_map::const_iterator dirIter;
+		
+		while ((slashPos = virtualPath.find(detail::Slash, slashPos + 1)) != string::npos) {
+			if ( (dirIter = directories.find (virtualPath.substr(0, slashPos + 1))) != directories.end())
+				result = dirIter;
+			else
+				break;
+		} 
+
+		return result;
+	}
+
 	bool HttpServer::runHandlers (HttpContext& context, const struct DirectorySettings& dirSettings)
+	{
+		if (dirSettings.responseCacheTtl > 0
+			&& (context.Method == HttpMethod::Get || context.Method == HttpMethod::Head)
+			&& !context.RequestHeader.hasHeader (detail::HeaderAuthorization)
+			&& hasHandler (fs::extension(context.FileSystemPath), dirSettings))
+			return runCachedHandlers (context, dirSettings);
+
+		return executeHandlers (context, dirSettings);
+	}
+
+	bool HttpServer::hasHandler (aconnect::string_constref extension, const struct DirectorySettings& dirSettings)
+	{
+		using namespace aconnect;
+		
+		for (directory_handlers_map::const_iterator it = dirSettings.handlers.begin(); 
+			it != dirSettings.handlers.end(); ++it)
+		{
+			if (util::equals (it->first, extension) || 
+				util::equals (it->first, SettingsTags::AllExtensionsMark))
+				return true;
+		}
+
+		return false;
+	}
+
+	bool HttpServer::runCachedHandlers (HttpContext& context, const struct DirectorySettings& dirSettings)
+	{
+		using namespace aconnect;
+
+		const string::size_type queryPos = context.RequestHeader.Path.find ('?');
+		string requestKey = context.RequestHeader.Method + ' ' + context.FileSystemPath.string();
+		if (queryPos != string::npos)
+			requestKey += context.RequestHeader.Path.substr (queryPos);
+		
+		string updateKey;
+		cached_response_ptr cached = ResponseCache.find (requestKey, context.RequestHeader.Headers, 
+			dirSettings.responseCacheWaitTimeout, updateKey);
+
+		// responses for requests with cookies can be user specific - they are shared 
+		// only when explicitly allowed
+		const bool hasCookies = context.RequestHeader.hasHeader (detail::HeaderCookie);
+
+		if (cached && (!hasCookies || cached->shared)) {
+			sendCachedResponse (context, *cached);
+			return true;
+		}
+
+		// concurrent update is not completed in time or cached response is not shared
+		if (updateKey.empty())
+			return executeHandlers (context, dirSettings);
+
+		bool completed = false;
+		try {
+			completed = executeHandlers (context, dirSettings);
+		} catch (...) {
+			ResponseCache.cancel (updateKey);
+			throw;
+		}
+
+		HttpResponse& response = context.Response;
+		const int status = response.Header.Status;
+		int ttl = dirSettings.responseCacheTtl, 
+			stale = dirSettings.responseCacheStale;
+		bool shared = false;
+
+		if (status != 200 && status != 203 && status != 301 && status != 404) {
+			// errors are not remembered - next request tries to fill entry again
+			ResponseCache.cancel (updateKey);
+			return completed;
+		}
+
+		// streamed or not cacheable response
+		if (!completed || response.isHeadersSent() || response.isFinished() 
+			|| !response.Header.Cookies.empty()
+			|| !HttpResponseCache::getLifetime (response.Header.Headers, ttl, stale, shared)) 
+		{
+			ResponseCache.cancel (updateKey, dirSettings.responseCacheTtl);
+			return completed;
+		}
+
+		// requests without cookies are not passed because of user specific response
+		if (hasCookies && !shared) {
+			ResponseCache.cancel (updateKey);
+			return completed;
+		}
+
+		boost::shared_ptr<CachedResponse> entry (new CachedResponse ());
+		entry->status = status;
+		entry->headers = response.Header.Headers;
+		entry->content = response.Stream.getBufferContent();
+		entry->storedAt = util::getTimestamp();
+		entry->freshUntil = entry->storedAt + (util::timestamp_type) ttl * 1000000;
+		entry->staleUntil = entry->freshUntil + (util::timestamp_type) (stale > 0 ? stale : 0) * 1000000;
+		entry->shared = shared;
+
+		ResponseCache.store (requestKey, updateKey, context.RequestHeader.Headers, entry);
+
+		return true;
+	}
+
+	void HttpServer::sendCachedResponse (HttpContext& context, const CachedResponse& cached)
+	{
+		using namespace aconnect;
+
+		if ( Log()->isDebugEnabled() )
+			Log()->debug ("Cached response sent for \"%s\"", context.VirtualPath.c_str());
+
+		HttpResponse& response = context.Response;
+		response.Header.Status = cached.status;
+		
+		for (str2str_map::const_iterator it = cached.headers.begin(); it != cached.headers.end(); ++it)
+			response.Header.Headers[it->first] = it->second;
+
+		response.Header.Headers[detail::HeaderAge] = boost::lexical_cast<string> (
+			(util::getTimestamp() - cached.storedAt) / 1000000);
+		
+		response.Header.setContentLength (cached.content.size());
+		response.write (cached.content);
+	}
+
+	bool HttpServer::executeHandlers (HttpContext& context, const struct DirectorySettings& dirSettings)
 	{
 		using namespace aconnect;
 
@@ -857,14 +1176,154 @@ namespace ahttp
 			if (util::equals (it->first, extension) || 
 				util::equals (it->first, SettingsTags::AllExtensionsMark))
 			{
-				if (reinterpret_cast<process_request_function> (it->second) (context))
+				bool completed = false;
+				context.Times.handlerStarted = util::getTimestamp();
+				
+				if (IHttpHandler* handler = it->second->handler) 
+				{
+					std::vector<bool>& inited = workerThreadState().initedHandlers;
+					if (inited.size() <= it->second->id)
+						inited.resize (it->second->id + 1, false);
+					
+					if (!inited[it->second->id]) {
+						handler->threadInit ();
+						inited[it->second->id] = true;
+					}
+
+					completed = handler->process (context);
+				
+				} else if (it->second->processRequestFunc) {
+					completed = reinterpret_cast<process_request_function> (it->second->processRequestFunc) (context);
+				}
+				
+				context.Times.handlerFinished = util::getTimestamp();
+
+				if (completed) {
+					context.Handler = it->second;
+					processInternalRedirect (context, dirSettings);
 					return true;
+				}
 			}
 		}
 
 		return false;
 	}
 
+	HttpServer::WorkerThreadState& HttpServer::workerThreadState ()
+	{
+		WorkerThreadState* state = threadState_.get();
+		if (!state) {
+			state = new WorkerThreadState ();
+			threadState_.reset (state);
+		}
+
+		return *state;
+	}
+
+	void HttpServer::processInternalRedirect (HttpContext& context, const struct DirectorySettings& dirSettings)
+	{
+		using namespace aconnect;
+		
+		str2str_map& headers = context.Response.Header.Headers;
+		const bool isSendfile = headers.find (detail::HeaderXSendfile) != headers.end();
+
+		if (!isSendfile && headers.find (detail::HeaderXAccelRedirect) == headers.end())
+			return;
+
+		const string target = headers[isSendfile ? detail::HeaderXSendfile : detail::HeaderXAccelRedirect];
+		headers.erase (detail::HeaderXSendfile);
+		headers.erase (detail::HeaderXAccelRedirect);
+
+		if (context.Response.isHeadersSent() || context.Response.isFinished()) {
+			Log()->warn ("Internal redirect to \"%s\" ignored - response already sent, path: %s", 
+				target.c_str(), context.VirtualPath.c_str());
+			return;
+		}
+
+		// handler content is replaced by file
+		context.Response.Stream.clear();
+		context.Response.Header.Status = HttpResponseHeader::UnknownStatus;
+		headers.erase (detail::HeaderContentLength);
+		headers.erase (detail::HeaderContentType);
+		headers.erase (detail::HeaderTransferEncoding);
+
+		// handler script status must not be used for redirect target
+		context.Target.clear();
+
+		fs::path filePath;
+		bool fileExists = false;
+		int targetRootFd = -1;
+		string targetRelativePath;
+		string targetRootPath;
+
+		try
+		{
+			if (isSendfile) {
+				filePath = fs::path (target, fs::native);
+
+				if (dirSettings.sendfileRoot.empty() || 
+					!detail::isPathInside (fs::path (dirSettings.sendfileRoot, fs::native), filePath)) 
+				{
+					Log()->error ("X-Sendfile target is not allowed: \"%s\", directory: %s", 
+						target.c_str(), dirSettings.name.c_str());
+					return processError403 (context, messages::Error403_AccessDenied);
+				}
+				targetRootPath = dirSettings.sendfileRoot;
+
+			} else {
+				const string virtualPath = target.substr (0, target.find ('?'));
+				directories_map::const_iterator dirIter = findDirectory (virtualPath);
+
+				if (dirIter == GlobalSettings()->Directories().end() || 
+					!algo::starts_with (virtualPath, dirIter->second.virtualPath))
+					return processError404 (context);
+
+				const fs::path dirPath (dirIter->second.realPath, fs::native);
+				targetRelativePath = util::decodeUrl (virtualPath.substr (dirIter->second.virtualPath.length()));
+				targetRootFd = dirIter->second.rootFd;
+				targetRootPath = dirIter->second.realPath;
+				filePath = fs::complete (fs::path (targetRelativePath, fs::portable_name), dirPath);
+
+				if (!detail::isPathInside (dirPath, filePath)) {
+					Log()->error ("X-Accel-Redirect target is outside of directory: \"%s\"", target.c_str());
+					return processError403 (context, messages::Error403_AccessDenied);
+				}
+			}
+
+			detail::ScopedTimeAccumulator fsTimer (context.Times.fileSystemTime);
+#if defined (__linux__)
+			if (targetRootFd != -1)
+				detail::openTarget (targetRootFd, targetRelativePath, context.Target);
+#endif
+			if (context.Target.resolved)
+				fileExists = context.Target.exists && !context.Target.isDirectory;
+			else if (!detail::resolvesInside (targetRootPath, filePath.string()))
+				context.Target.outside = true;
+			else
+				fileExists = fs::exists (filePath) && !fs::is_directory (filePath);
+
+		} catch (std::exception &ex) {
+			Log()->error ("Internal redirect to \"%s\" failed (%s): %s", 
+				target.c_str(), typeid(ex).name(), ex.what());
+			return processServerError (context, 500);
+		}
+
+		if (context.Target.outside) {
+			Log()->error ("Internal redirect target is outside of directory: \"%s\"", target.c_str());
+			return processError403 (context, messages::Error403_AccessDenied);
+		}
+
+		if (!fileExists) {
+			Log()->error ("Internal redirect target does not exist: \"%s\"", filePath.string().c_str());
+			return processError404 (context);
+		}
+
+		Log()->debug ("Internal redirect to \"%s\"", filePath.string().c_str());
+		
+		context.FileSystemPath = filePath;
+		processDirectFileRequest (context, false);
+	}
+
 	void HttpServer::processDirectoryRequest ( HttpContext& context, 
 											const DirectorySettings& dirSettings)
 	{
@@ -877,9 +1336,16 @@ namespace ahttp
 			it != dirSettings.defaultDocuments.end(); it++) 
 		{
 			fs::path docPath = context.FileSystemPath / fs::path(it->second);
-			if (fs::exists (docPath)) 
+			bool docExists = false;
+			{
+				detail::ScopedTimeAccumulator fsTimer (context.Times.fileSystemTime);
+				docExists = fs::exists (docPath);
+			}
+
+			if (docExists) 
 			{
 				context.FileSystemPath = docPath;
+				context.Target.clear();
 				context.VirtualPath += it->second;
 				Log()->debug ( "Redirection to \"%s\"", context.VirtualPath.c_str() );				
 
@@ -904,14 +1370,20 @@ namespace ahttp
 			&& context.Method != HttpMethod::Head) 
 			return processError405 (context, "GET, HEAD");
 		
-		if ( !fs::exists( context.FileSystemPath ) ) {
+		bool dirExists = context.Target.exists;
+		bool isDirectory = context.Target.isDirectory;
+		if (!context.Target.resolved) {
+			detail::ScopedTimeAccumulator fsTimer (context.Times.fileSystemTime);
+			dirExists = fs::exists (context.FileSystemPath);
+			isDirectory = dirExists && fs::is_directory (context.FileSystemPath);
+		}
+		
+		if ( !dirExists ) {
 			// 404 error
 			return processError404 (context);
 		}
 
-		string record;
-		
-		if ( fs::is_directory( context.FileSystemPath ) )
+		if ( isDirectory )
 		{
 			// check "Accept-Charset" header
 			if (context.RequestHeader.hasHeader(detail::HeaderAcceptCharset)) 
@@ -930,88 +1402,58 @@ namespace ahttp
 
 			}
 
-			// start response
-			context.Response.Header.Status = 200;
-			context.Response.Header.setContentType (detail::ContentTypeTextHtml, dirSettings.charset);
-
-			// format header
-			context.Response.write (formatHeaderRecord (dirSettings, context.VirtualPath));
-
-			if ( !util::equals (context.VirtualPath, detail::Slash)) {
-				string parentDir = context.VirtualPath.substr (0, context.VirtualPath.rfind (detail::SlashCh, context.VirtualPath.size() - 2) + 1);
-				context.Response.write (formatParentDirRecord (dirSettings, parentDir ));
+			std::time_t modifyTime = context.Target.modifyTime;
+			if (!context.Target.resolved) {
+				detail::ScopedTimeAccumulator fsTimer (context.Times.fileSystemTime);
+				modifyTime = fs::last_write_time (context.FileSystemPath);
 			}
-			
-			std::vector<WebDirectoryItem> directoryItems;
 
-			// write virtual directories
-			const directories_map &directories = GlobalSettings()->Directories();
-			directories_map::const_iterator virtDirIter = directories.begin();
+			const string listingKey = dirSettings.name + '\n' + context.VirtualPath 
+				+ '\n' + context.FileSystemPath.string();
 
-			while (virtDirIter != directories.end()) {
-				if (virtDirIter->second.isLinkedDirectory &&
-						virtDirIter->second.parentName == dirSettings.name &&
-						context.VirtualPath == dirSettings.virtualPath) 
-				{
-					WebDirectoryItem item;
-					item.url = virtDirIter->second.virtualPath;
-					item.name = virtDirIter->second.relativePath;
-					item.type = WdVirtualDirectory;
-					item.lastWriteTime = fs::last_write_time (virtDirIter->second.realPath);
-
-					directoryItems.push_back (item);
-				}
-
-				virtDirIter++;
-			} 
-
-			size_t fileCount = 0, dirCount = 0, errCount = 0;
-
-			// get filesystem items
-			detail::readDirectoryContent (context.FileSystemPath.string(), 
-					context.VirtualPath,
-					directoryItems,
-					*Log(),
-					errCount/*, WdSortByTypeAndName*/);
-			
-			// write content
+			// "?format=json" - paged items index for programmatic clients
+			context.parseQueryStringParams ();
+			str2str_map::const_iterator formatIter = context.GetParameters.find (detail::ListingFormatParam);
+			if (formatIter != context.GetParameters.end() 
+				&& util::equals (formatIter->second, detail::ListingFormatJson))
+				return processDirectoryIndexRequest (context, dirSettings, listingKey, modifyTime);
 			
-			for ( std::vector<WebDirectoryItem>::const_iterator itemIter = directoryItems.begin();
-				itemIter != directoryItems.end();
-				++itemIter )
+			directory_listing_ptr listing = ListingCache.find (listingKey, modifyTime);
+			if (!listing) 
 			{
+				boost::shared_ptr<DirectoryListing> rendered (new DirectoryListing ());
+				rendered->directoryPath = context.FileSystemPath.string();
+				rendered->modifyTime = modifyTime;
 				
-				if (itemIter->type == WdVirtualDirectory) {
-					record = formatItemRecord (dirSettings.virtualDirectoryTemplate,
-						itemIter->url,
-						itemIter->name, 
-						(size_t) itemIter->size,
-						itemIter->lastWriteTime);
-				
-				} else if (itemIter->type == WdDirectory) {
-					record = formatItemRecord (dirSettings.directoryTemplate,
-						itemIter->url,
-						itemIter->name, 
-						(size_t)itemIter->size,
-						itemIter->lastWriteTime);
-					
-					++dirCount;
-
-				} else {
-					record = formatItemRecord (dirSettings.fileTemplate,
-							itemIter->url,
-							itemIter->name,
-							(size_t)itemIter->size,
-							itemIter->lastWriteTime);
-					++fileCount;
+				const DirectoryListingCache::counter_type version = ListingCache.prepare (rendered->directoryPath);
+				try {
+					formatDirectoryListing (rendered->content, context, dirSettings);
+				} catch (...) {
+					ListingCache.cancel (rendered->directoryPath, version);
+					throw;
 				}
+				rendered->etag = DirectoryListingCache::calculateEtag (rendered->content);
 
-				context.Response.write (record);
+				ListingCache.store (listingKey, rendered, version);
+				listing = rendered;
+			}
+
+			context.Response.Header.Headers[detail::HeaderETag] = listing->etag;
+
+			if (context.RequestHeader.hasHeader (detail::HeaderIfNoneMatch) 
+				&& listing->etag == context.RequestHeader.Headers[detail::HeaderIfNoneMatch]) 
+			{
+				context.Response.Header.Status = 304;
+				context.Response.Header.setContentLength ( 0 );
+				return;
 			}
 
-			// format footer
-			context.Response.write (formatFooterRecord (dirSettings, context.VirtualPath,
-				fileCount, dirCount, errCount));
+			// send response
+			context.Response.Header.Status = 200;
+			context.Response.Header.setContentType (detail::ContentTypeTextHtml, dirSettings.charset);
+			context.Response.Header.setContentLength (listing->content.size());
+			
+			context.Response.write (listing->content);
 			context.Response.end();
 
 		} else {
@@ -1023,25 +1465,268 @@ namespace ahttp
 		}
 	}
 
-	void HttpServer::processDirectFileRequest (HttpContext& context) 
+	void HttpServer::formatDirectoryListing (aconnect::string& content, 
+											HttpContext& context, 
+											const DirectorySettings& dirSettings)
+	{
+		using namespace aconnect;
+		ListingValues values;
+		values.pageUrl = context.VirtualPath.c_str();
+
+		// format header
+		dirSettings.compiledHeaderTemplate.render (content, values);
+
+		if ( !util::equals (context.VirtualPath, detail::Slash)) {
+			string parentDir = context.VirtualPath.substr (0, context.VirtualPath.rfind (detail::SlashCh, context.VirtualPath.size() - 2) + 1);
+			values.parentUrl = parentDir.c_str();
+			dirSettings.compiledParentDirectoryTemplate.render (content, values);
+		}
+		
+		std::vector<WebDirectoryItem> directoryItems;
+		size_t fileCount = 0, dirCount = 0, errCount = 0;
+
+		// items status is not required when templates do not show size and time
+		const bool loadAttributes = 
+			dirSettings.compiledFileTemplate.hasMarks (ListingTemplate::Size | ListingTemplate::Time)
+			|| dirSettings.compiledDirectoryTemplate.hasMarks (ListingTemplate::Time);
+
+		loadDirectoryItems (directoryItems, errCount, context, dirSettings, loadAttributes);
+		
+		// write content
+		for ( std::vector<WebDirectoryItem>::const_iterator itemIter = directoryItems.begin();
+			itemIter != directoryItems.end();
+			++itemIter )
+		{
+			values.url = itemIter->url.c_str();
+			values.name = itemIter->name.c_str();
+			values.size = (size_t) itemIter->size;
+			values.time = itemIter->lastWriteTime;
+
+			if (itemIter->type == WdVirtualDirectory) {
+				dirSettings.compiledVirtualDirectoryTemplate.render (content, values);
+			
+			} else if (itemIter->type == WdDirectory) {
+				dirSettings.compiledDirectoryTemplate.render (content, values);
+				++dirCount;
+
+			} else {
+				dirSettings.compiledFileTemplate.render (content, values);
+				++fileCount;
+			}
+		}
+
+		// format footer
+		values.filesCount = fileCount;
+		values.directoriesCount = dirCount;
+		values.errorsCount = errCount;
+		dirSettings.compiledFooterTemplate.render (content, values);
+	}
+
+	void HttpServer::loadDirectoryItems (std::vector<WebDirectoryItem>& items, 
+										size_t& errCount,
+										HttpContext& context, 
+										const DirectorySettings& dirSettings,
+										bool loadAttributes)
+	{
+		using namespace aconnect;
+
+		// write virtual directories
+		const directories_map &directories = GlobalSettings()->Directories();
+		directories_map::const_iterator virtDirIter = directories.begin();
+
+		// linked directories times and filesystem items
+		detail::ScopedTimeAccumulator fsTimer (context.Times.fileSystemTime);
+		
+		while (virtDirIter != directories.end()) {
+			if (virtDirIter->second.isLinkedDirectory &&
+					virtDirIter->second.parentName == dirSettings.name &&
+					context.VirtualPath == dirSettings.virtualPath) 
+			{
+				WebDirectoryItem item;
+				item.url = virtDirIter->second.virtualPath;
+				item.name = virtDirIter->second.relativePath;
+				item.type = WdVirtualDirectory;
+				item.lastWriteTime = fs::last_write_time (virtDirIter->second.realPath);
+
+				items.push_back (item);
+			}
+
+			virtDirIter++;
+		} 
+
+		detail::readDirectoryContent (context.FileSystemPath.string(), 
+				context.VirtualPath,
+				items,
+				*Log(),
+				errCount,
+				WdSortByName,
+				loadAttributes);
+	}
+
+	void HttpServer::formatDirectoryIndex (DirectoryListing& index, 
+										  HttpContext& context, 
+										  const DirectorySettings& dirSettings)
+	{
+		using namespace aconnect;
+
+		std::vector<WebDirectoryItem> directoryItems;
+		size_t errCount = 0;
+
+		loadDirectoryItems (directoryItems, errCount, context, dirSettings, true);
+
+		index.offsets.reserve (directoryItems.size() + 1);
+
+		// {"name":"file.txt","url":"/dir/file.txt","type":"file","size":10,"time":1199145600},
+		for ( std::vector<WebDirectoryItem>::const_iterator itemIter = directoryItems.begin();
+			itemIter != directoryItems.end();
+			++itemIter )
+		{
+			index.offsets.push_back (index.content.size());
+
+			index.content += "{\"name\":";
+			detail::appendJsonString (index.content, itemIter->name.c_str());
+			index.content += ",\"url\":";
+			detail::appendJsonString (index.content, itemIter->url.c_str());
+			
+			index.content += ",\"type\":\"";
+			if (itemIter->type == WdVirtualDirectory)
+				index.content += "virtual-directory\"";
+			else if (itemIter->type == WdDirectory)
+				index.content += "directory\"";
+			else
+				index.content += "file\"";
+
+			if (itemIter->size != (boost::uintmax_t) -1)
+				index.content += ",\"size\":" + boost::lexical_cast<string> (itemIter->size);
+			if (itemIter->lastWriteTime != (std::time_t) -1)
+				index.content += ",\"time\":" + boost::lexical_cast<string> (itemIter->lastWriteTime);
+			
+			index.content += "},";
+		}
+
+		index.offsets.push_back (index.content.size());
+	}
+
+	void HttpServer::processDirectoryIndexRequest (HttpContext& context, 
+												 const DirectorySettings& dirSettings,
+												 aconnect::string_constref listingKey,
+												 std::time_t modifyTime)
+	{
+		using namespace aconnect;
+
+		size_t offset = 0, limit = defaults::ListingPageLimit;
+		try 
+		{
+			str2str_map::const_iterator paramIter = context.GetParameters.find (detail::ListingOffsetParam);
+			if (paramIter != context.GetParameters.end())
+				offset = boost::lexical_cast<size_t> (paramIter->second);
+
+			paramIter = context.GetParameters.find (detail::ListingLimitParam);
+			if (paramIter != context.GetParameters.end())
+				limit = boost::lexical_cast<size_t> (paramIter->second);
+
+		} catch (boost::bad_lexical_cast &) {
+			return processError400 (context, messages::Error400_InvalidListingRange);
+		}
+
+		if (0 == limit || limit > defaults::ListingMaxPageLimit)
+			return processError400 (context, messages::Error400_InvalidListingRange);
+
+		// sorted index is built once per directory change, pages are sliced from it
+		const string indexKey = listingKey + '\n' + detail::ListingFormatJson;
+		
+		directory_listing_ptr index = ListingCache.find (indexKey, modifyTime);
+		if (!index) 
+		{
+			boost::shared_ptr<DirectoryListing> built (new DirectoryListing ());
+			built->directoryPath = context.FileSystemPath.string();
+			built->modifyTime = modifyTime;
+
+			const DirectoryListingCache::counter_type version = ListingCache.prepare (built->directoryPath);
+			try {
+				formatDirectoryIndex (*built, context, dirSettings);
+			} catch (...) {
+				ListingCache.cancel (built->directoryPath, version);
+				throw;
+			}
+			built->etag = DirectoryListingCache::calculateEtag (built->content);
+
+			ListingCache.store (indexKey, built, version);
+			index = built;
+		}
+
+		// page is defined by URL (offset, limit) - index ETag identifies page content too
+		context.Response.Header.Headers[detail::HeaderETag] = index->etag;
+
+		if (context.RequestHeader.hasHeader (detail::HeaderIfNoneMatch) 
+			&& index->etag == context.RequestHeader.Headers[detail::HeaderIfNoneMatch]) 
+		{
+			context.Response.Header.Status = 304;
+			context.Response.Header.setContentLength ( 0 );
+			return;
+		}
+
+		const size_t total = index->offsets.size() - 1;
+		const size_t first = util::min2 (offset, total);
+		const size_t count = util::min2 (limit, total - first);
+
+		string pageHeader = "{\"path\":";
+		detail::appendJsonString (pageHeader, context.VirtualPath.c_str());
+		pageHeader += ",\"total\":" + boost::lexical_cast<string> (total);
+		pageHeader += ",\"offset\":" + boost::lexical_cast<string> (first);
+		pageHeader += ",\"count\":" + boost::lexical_cast<string> (count);
+		pageHeader += ",\"items\":[";
+
+		// records without trailing comma
+		const size_t recordsSize = (count > 0 ? 
+			index->offsets[first + count] - index->offsets[first] - 1 : 0);
+		
+		// page is sliced from cached index - its size is known before sending
+		context.Response.Header.Status = 200;
+		context.Response.Header.setContentType (detail::ContentTypeJson, dirSettings.charset);
+		context.Response.Header.setContentLength (pageHeader.size() + recordsSize + 2);
+
+		context.Response.write (pageHeader);
+		
+		if (recordsSize > 0)
+			context.Response.write (index->content.c_str() + index->offsets[first], recordsSize);
+		
+		context.Response.write ("]}", 2);
+		context.Response.end();
+	}
+
+	void HttpServer::processDirectFileRequest (HttpContext& context, bool checkMethod) 
 	{
 		using namespace aconnect;
 		ProgressTimer progress (*Log(), __FUNCTION__);
 
 		// HTTP method must be GET or HEAD, if not - sent 405, with "Allow: GET, HEAD"
-		if (context.Method != HttpMethod::Get 
+		if (checkMethod && context.Method != HttpMethod::Get 
 			&& context.Method != HttpMethod::Head) 
 			return processError405 (context, "GET, HEAD");
 
-		std::ifstream file (context.FileSystemPath.string().c_str(), std::ios::binary);
-		if ( file.fail() ) {
-			// Access denied (404 checked previously)
-			processError403(context, messages::Error403_AccessDenied);
-			return;
+		size_t fileSize = 0;
+		std::time_t modifyTime = 0;
+		
+		if (context.Target.fd != -1) {
+			// opened at path resolution
+			fileSize = (size_t) context.Target.size;
+			modifyTime = context.Target.modifyTime;
+		
+		} else {
+			detail::ScopedTimeAccumulator fsTimer (context.Times.fileSystemTime);
+			std::ifstream file (context.FileSystemPath.string().c_str(), std::ios::binary);
+			
+			if ( file.fail() ) {
+				// Access denied (404 checked previously)
+				processError403(context, messages::Error403_AccessDenied);
+				return;
+			}
+
+			fileSize = (size_t) fs::file_size (context.FileSystemPath);
+			modifyTime = fs::last_write_time ( context.FileSystemPath);
 		}
 		
-		size_t fileSize = (size_t) fs::file_size (context.FileSystemPath);
-		std::time_t modifyTime = fs::last_write_time ( context.FileSystemPath);
 		string etag = util::calculateFileCrc (context.FileSystemPath.string(), modifyTime);
 
 		if (context.RequestHeader.hasHeader (detail::HeaderIfNoneMatch) ) {
@@ -1054,11 +1739,44 @@ namespace ahttp
 			}
 		}
 		
+		// single byte range, "If-Range" - ETag only
+		size_t rangeFirst = 0, contentLength = fileSize;
+		detail::ByteRangeParseResult rangeResult = detail::RangeIgnored;
+
+		if (context.RequestHeader.hasHeader (detail::HeaderRange) && 
+			(!context.RequestHeader.hasHeader (detail::HeaderIfRange) || 
+				etag == context.RequestHeader.Headers[detail::HeaderIfRange]))
+		{
+			rangeResult = detail::parseByteRange (context.RequestHeader.Headers[detail::HeaderRange], 
+				fileSize, rangeFirst, contentLength);
+		}
+
+		context.Response.Header.Headers[detail::HeaderAcceptRanges] = detail::RangeUnitBytes;
+
+		if (rangeResult == detail::RangeNotSatisfiable) {
+			context.Response.Header.Status = 416;
+			context.Response.Header.Headers[detail::HeaderContentRange] = 
+				boost::str (boost::format (detail::ContentRangeUnsatisfiedFormat) % fileSize);
+			string errorResponse;
+			ErrorPages.formatPage (errorResponse, 416);
+			context.Response.writeCompleteHtmlResponse (errorResponse);
+			return;
+		}
+		
 		Log()->debug ("Send file: %s", context.FileSystemPath.string().c_str());
 
 		// prepare response
-		context.Response.Header.Status = 200;
-		context.Response.Header.setContentLength ( fileSize );
+		if (rangeResult == detail::RangeSatisfiable) {
+			context.Response.Header.Status = 206;
+			context.Response.Header.Headers[detail::HeaderContentRange] = 
+				boost::str (boost::format (detail::ContentRangeFormat) % rangeFirst % (rangeFirst + contentLength - 1) % fileSize);
+		} else {
+			context.Response.Header.Status = 200;
+			rangeFirst = 0;
+			contentLength = fileSize;
+		}
+
+		context.Response.Header.setContentLength ( contentLength );
 		context.Response.Header.setContentType ( context.GlobalSettings->getMimeType (
 			fs::extension (context.FileSystemPath) ) );
 		
@@ -1066,70 +1784,14 @@ namespace ahttp
 		context.Response.Header.Headers[detail::HeaderETag] = etag;
 		context.Response.Header.Headers[detail::HeaderLastModified] = detail::formatDate_RFC1123 (util::getDateTimeUtc (modifyTime));
 
-		// send file
-		const std::streamsize buffSize = (std::streamsize) util::min2( fileSize, context.Response.Stream.getBufferSize());
-		boost::scoped_array<char_type> buff (new char_type [buffSize]);
-		do {
-			file.read (buff.get(), buffSize);
-			context.Response.write (buff.get(), file.gcount());
-
-		} while (file.good());
-	}
-
-
-
-	aconnect::string HttpServer::formatHeaderRecord (const DirectorySettings& dirSettings, 
-													   aconnect::string_constref virtualPath) 
-	{
-		aconnect::string record = algo::replace_all_copy (dirSettings.headerTemplate,
-		   SettingsTags::PageUrlMark, virtualPath);
-		return record;
-	}
-
-	aconnect::string HttpServer::formatParentDirRecord (const DirectorySettings& dirSettings, 
-													   aconnect::string_constref parentPath) 
-	{
-		aconnect::string record = algo::replace_all_copy (dirSettings.parentDirectoryTemplate,
-			SettingsTags::ParentUrlMark, parentPath);
-		return record;
-	}
-
-	aconnect::string HttpServer::formatItemRecord (aconnect::string_constref itemTemplate,
-													 aconnect::string_constref itemUrl,
-													 aconnect::string_constref itemName,
-													 const size_t itemSize,
-													 std::time_t lastWriteTime) 
-	{
-		 aconnect::string record = algo::replace_all_copy (itemTemplate,
-			 SettingsTags::UrlMark, itemUrl);
-		 algo::replace_all (record, SettingsTags::NameMark, itemName);
-
-		if (itemSize != (size_t)-1)
-			algo::replace_all (record, SettingsTags::SizeMark,
-				 boost::lexical_cast<aconnect::string> (itemSize) );
-
-		if (lastWriteTime != (std::time_t) -1)
-			algo::replace_all (record, SettingsTags::TimeMark,
-				formatDateTime ( aconnect::util::getDateTimeUtc(lastWriteTime) ) );
-
-		 return record;
-	}
-
-	aconnect::string HttpServer::formatFooterRecord (const DirectorySettings& dirSettings, 
-													   aconnect::string_constref virtualPath,
-													   const size_t fileCount, const size_t dirCount, const size_t errCount) 
-	{
-		aconnect::string record = algo::replace_all_copy (dirSettings.footerTemplate,
-			SettingsTags::PageUrlMark, virtualPath);
-
-		algo::replace_all (record, SettingsTags::FilesCountMark, 
-			boost::lexical_cast<aconnect::string> (fileCount) );
-		algo::replace_all (record, SettingsTags::DirectoriesCountMark, 
-			boost::lexical_cast<aconnect::string> (dirCount) );
-		algo::replace_all (record, SettingsTags::ErrorsCountMark, 
-			boost::lexical_cast<aconnect::string> (errCount) );
-
-		return record;
+		// send file directly from file system to socket
+#if defined (__linux__)
+		if (context.Target.fd != -1) {
+			context.Response.sendFile (context.Target.fd, context.FileSystemPath.string(), rangeFirst, contentLength);
+			return;
+		}
+#endif
+		context.Response.sendFile (context.FileSystemPath.string(), rangeFirst, contentLength);
 	}
 }
 
@@ -30,16 +30,26 @@ distribution.
 #include <boost/filesystem.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/detail/atomic_count.hpp>
+#include <boost/thread/tss.hpp>
 
 
 #include "aconnect/types.hpp"
 #include "aconnect/util.hpp"
+#include "aconnect/thread_shards.hpp"
 
 #include "ahttp/http_support.hpp"
+#include "ahttp/http_messages.hpp"
 #include "ahttp/http_server_settings.hpp"
+#include "ahttp/http_handler.hpp"
 #include "ahttp/http_request.hpp"
 #include "ahttp/http_response_header.hpp"
 #include "ahttp/http_response.hpp"
+#include "ahttp/http_server_statistics.hpp"
+#include "ahttp/http_tracer.hpp"
+#include "ahttp/http_response_cache.hpp"
+#include "ahttp/http_negative_cache.hpp"
+#include "ahttp/http_listing_cache.hpp"
+#include "ahttp/http_error_pages.hpp"
 
 namespace ahttp
 {
@@ -83,6 +93,7 @@ namespace ahttp
 		void parsePostParams ();
 		void parseCookies ();
 		void loadMultipartFormData (aconnect::string_constref boundary);
+		void removeUploadedFiles ();
 		
 
 		// properties
@@ -97,10 +108,15 @@ namespace ahttp
 		aconnect::string						VirtualPath;
 		aconnect::string						MappedVirtualPath;
 		boost::filesystem::path					FileSystemPath;
+		TargetStatus							Target;		// FileSystemPath status, loaded by directory root descriptor
 		
 		HttpServerSettings*						GlobalSettings;
 		aconnect::Logger*						Log;	
 
+		HttpRequestTimes						Times;
+		const struct HandlerInfo*				Handler;	// handler completed request, NULL - processed by server
+		RequestArena*							Arena;		// request scoped memory of worker thread
+
 		boost::filesystem::path					UploadsDirPath;
 		
 		aconnect::str2str_map					GetParameters;
@@ -115,6 +131,16 @@ namespace ahttp
 	{
 	private:
 		static HttpServerSettings* globalSettings_;
+		static aconnect::Server* server_;
+		
+		// worker thread state: request arena, API v2 handlers initialized in thread (by handler id)
+		struct WorkerThreadState
+		{
+			RequestArena arena;
+			std::vector<bool> initedHandlers;
+		};
+		static boost::thread_specific_ptr<WorkerThreadState> threadState_;
+		static aconnect::string notFoundResponse_;	// 404 page without path, sent for cached missing paths
 		
 	public:
 		static HttpServerSettings* GlobalSettings() throw (std::runtime_error) {
@@ -132,9 +158,35 @@ namespace ahttp
 
 		static void setGlobalSettings (HttpServerSettings* settings) {
 			globalSettings_ = settings;
+			if (settings) {
+				Statistics.init (settings->registeredHandlers());
+				resetCaches ();
+				ErrorPages.init (settings->serverVersion());
+				ErrorPages.formatPage (notFoundResponse_, 404, messages::Error404_NotFound);
+			}
+		}
+
+		// drop cached content and apply caches limits from global settings (on settings reload)
+		static void resetCaches () {
+			if (globalSettings_) {
+				ResponseCache.init (globalSettings_->responseCacheSize());
+				NegativeCache.init (globalSettings_->negativeCacheSize(), globalSettings_->negativeCacheTtl());
+				ListingCache.init (globalSettings_->listingCacheSize());
+			}
+		}
+
+		// main HTTP server - source of workers/queue gauges for metrics
+		static void setServer (aconnect::Server* server) {
+			server_ = server;
 		}
 
-		static boost::detail::atomic_count RequestsCount;
+		static aconnect::ShardedCounter RequestsCount;
+		static HttpServerStatistics Statistics;
+		static RequestTracer Tracer;
+		static HttpResponseCache ResponseCache;
+		static NegativePathCache NegativeCache;
+		static DirectoryListingCache ListingCache;
+		static HttpErrorPages ErrorPages;
 
 		/**
 		* Process HTTP request (and following keep-alive requests on opened socket)
@@ -153,12 +205,18 @@ namespace ahttp
 
 		static void processError404 (HttpContext& context);
 
+		// precomputed 404 response
+		static void processCachedError404 (HttpContext& context);
+
 		static void processError403 (HttpContext& context,
 			aconnect::string_constptr message);
 
 		static void processError405 (HttpContext& context,
 			aconnect::string_constref allowedMethods);
 
+		static void processError400 (HttpContext& context,
+			aconnect::string_constptr message);
+
 		static void processError406 (HttpContext& context, 
 			aconnect::string_constref message);
 		
@@ -176,9 +234,19 @@ namespace ahttp
 		static bool processRequest (HttpContext& context);
 
 		static bool isMethodImplemented (HttpContext& context);
+
+		/**
+		* Check metrics endpoint request, on dedicated metrics port all other requests get 404.
+		* Returns true if request was processed.
+		*/
+		static bool tryProcessMetricsRequest (HttpContext& context);
 		
 		static bool findTarget (HttpContext& context);
 
+		// find registered directory for virtual path (deepest registered parent), 
+		// returns Directories().end() if root directory is not registered
+		static directories_map::const_iterator findDirectory (aconnect::string_constref virtualPath);
+
 		/**
 		* Run handlers registered for current directory against current target,
 		* returns true if request was completed.
@@ -186,40 +254,56 @@ namespace ahttp
 		*/
 		static bool runHandlers (HttpContext& context, const struct DirectorySettings& dirSettings);
 
-		static void processDirectFileRequest (HttpContext& context);
+		static bool executeHandlers (HttpContext& context, const struct DirectorySettings& dirSettings);
+
+		static bool hasHandler (aconnect::string_constref extension, const struct DirectorySettings& dirSettings);
+
+		/**
+		* Run handlers through response cache (directory "response-cache" settings): fresh cached
+		* response is sent without handler call, concurrent requests for the same entry wait for 
+		* single handler execution or get stale response while it is updated.
+		*/
+		static bool runCachedHandlers (HttpContext& context, const struct DirectorySettings& dirSettings);
+
+		static void sendCachedResponse (HttpContext& context, const CachedResponse& cached);
+
+		static WorkerThreadState& workerThreadState ();
+
+		/**
+		* Serve file instead of handler response if handler set "X-Sendfile" (file path inside
+		* directory "sendfile-root") or "X-Accel-Redirect" (virtual path) header.
+		* Handler content is dropped, other handler headers (Content-Disposition etc.) are sent.
+		*/
+		static void processInternalRedirect (HttpContext& context, const struct DirectorySettings& dirSettings);
+
+		// "checkMethod" - false for internal redirect target, it is sent for any handled method
+		static void processDirectFileRequest (HttpContext& context, bool checkMethod = true);
 
 		static void processDirectoryRequest (HttpContext& context, 
 			const struct DirectorySettings& dirSettings);
 
-		static aconnect::string formatParentDirRecord (const DirectorySettings& dirSettings, 
-			aconnect::string_constref parentPath);
-		static aconnect::string formatHeaderRecord (const DirectorySettings& dirSettings, 
-			aconnect::string_constref virtualPath);
-		static aconnect::string formatItemRecord (aconnect::string_constref itemTemplate,
-			aconnect::string_constref itemUrl,
-			aconnect::string_constref itemName,
-			const size_t itemSize,
-			std::time_t lastWriteTime);
-		static aconnect::string formatFooterRecord (const DirectorySettings& dirSettings, 
-			aconnect::string_constref virtualPath,
-			const size_t fileCount, const size_t dirCount, const size_t errCount);
-
-		inline static aconnect::string formatDateTime (const struct tm& dateTime)
-		{
-			const int buffSize = 20;
-			aconnect::char_type buff[buffSize] = {0};
-
-			int cnt = snprintf (buff, buffSize, "%.2d.%.2d.%.4d %.2d:%.2d:%.2d", 
-				dateTime.tm_mday,
-				dateTime.tm_mon + 1,
-				dateTime.tm_year + 1900,
-				dateTime.tm_hour,
-				dateTime.tm_min,
-				dateTime.tm_sec
-				);
-
-			return aconnect::string (buff, aconnect::util::min2(cnt, buffSize) );
-		}
+		// renders listing page (header, items, footer) into "content"
+		static void formatDirectoryListing (aconnect::string& content, 
+			HttpContext& context, 
+			const DirectorySettings& dirSettings);
+
+		// paged JSON listing ("?format=json&offset=N&limit=M"), served from cached sorted index
+		static void processDirectoryIndexRequest (HttpContext& context, 
+			const DirectorySettings& dirSettings,
+			aconnect::string_constref listingKey,
+			std::time_t modifyTime);
+
+		// JSON records of sorted directory items
+		static void formatDirectoryIndex (DirectoryListing& index, 
+			HttpContext& context, 
+			const DirectorySettings& dirSettings);
+
+		// linked virtual directories and file system items
+		static void loadDirectoryItems (std::vector<WebDirectoryItem>& items, 
+			size_t& errCount,
+			HttpContext& context, 
+			const DirectorySettings& dirSettings,
+			bool loadAttributes);
 	};
 }
 #endif // AHTTP_SERVER_H
@@ -37,11 +37,20 @@ distribution.
 #include "aconnect/util.hpp"
 #include "ahttp/http_support.hpp"
 #include "ahttp/http_server_settings.hpp"
+#include "ahttp/http_access_log.hpp"
+#include "ahttp/http_handler.hpp"
+#include "ahttp/http_response_cache.hpp"
+#include "ahttp/http_negative_cache.hpp"
+#include "ahttp/http_listing_cache.hpp"
 
 #if defined(__GNUC__)
 #	include <dlfcn.h>
 #endif
 
+#if defined (__linux__)
+#	include <unistd.h>
+#endif
+
 namespace algo = boost::algorithm;
 namespace fs = boost::filesystem;
 
@@ -50,8 +59,13 @@ namespace ahttp
 
 	DirectorySettings::DirectorySettings () : 
 		browsingEnabled (-1), 
+		serverTimingEnabled (-1), 
+		responseCacheTtl (-1),
+		responseCacheStale (0),
+		responseCacheWaitTimeout (defaults::ResponseCacheWaitTimeout),
 		isLinkedDirectory(false),
-		charset ()
+		charset (),
+		rootFd (-1)
 	{
 
 	}
@@ -61,10 +75,19 @@ namespace ahttp
 		commandPort_ (-1),
 		logLevel_ (aconnect::Log::Debug), 				   
 		maxLogFileSize_ (aconnect::Log::MaxFileSize), 
+		accessLogBufferSize_ (defaults::AccessLogBufferSize),
+		accessLogFlushInterval_ (defaults::AccessLogFlushInterval),
+		maxAccessLogFileSize_ (defaults::MaxAccessLogFileSize),
+		accessLog_ (NULL),
+		metricsPort_ (0),
 		enableKeepAlive_ (defaults::EnableKeepAlive),
 		keepAliveTimeout_ (defaults::KeepAliveTimeout),
 		commandSocketTimeout_ (defaults::CommandSocketTimeout),
 		responseBufferSize_ (defaults::ResponseBufferSize),
+		responseCacheSize_ (defaults::ResponseCacheSize),
+		negativeCacheSize_ (defaults::NegativeCacheSize),
+		negativeCacheTtl_ (defaults::NegativeCacheTtl),
+		listingCacheSize_ (defaults::ListingCacheSize),
 		maxChunkSize_ (defaults::MaxChunkSize),
 		logger_ (NULL),
 		serverVersion_ (defaults::ServerVersion),
@@ -77,6 +100,7 @@ namespace ahttp
 
 	HttpServerSettings::~HttpServerSettings()
 	{
+		closeRootDescriptors ();
 	}
 
 	aconnect::string HttpServerSettings::getMimeType (aconnect::string_constref ext) const 
@@ -128,11 +152,18 @@ namespace ahttp
 
 			// logger setup
 			loadLoggerSettings (logElement);
+
+			// access log setup - OPTIONAL
+			TiXmlElement* accessLogElement = serverElem->FirstChildElement (SettingsTags::AccessLogElement);
+			if (accessLogElement)
+				loadAccessLogSettings (accessLogElement);
 		} 
 		else 
 		{
-			// clear directories info
+			// clear directories info, roots are reopened - directory could be replaced
+			// (renamed, symlink switched on deploy), old descriptor refers to previous tree
 			directories_.clear();
+			closeRootDescriptors ();
 		}
 		
 		TiXmlElement* directoryElem = root->FirstChildElement (SettingsTags::DirectoryElement);
@@ -174,6 +205,8 @@ namespace ahttp
 			tryLoadLocalSettings (dirConfigFile.string(), *it);
 
 			// register root
+			compileTemplates (*it);
+			it->rootFd = openDirectoryRoot (it->realPath);
 			directories_ [it->virtualPath] = *it;
 
 			fillDirectoriesMap (directoriesList, it);
@@ -275,9 +308,21 @@ namespace ahttp
 				if (childIter->browsingEnabled == -1)
 					childIter->browsingEnabled = parent->browsingEnabled;
 
+				if (childIter->serverTimingEnabled == -1)
+					childIter->serverTimingEnabled = parent->serverTimingEnabled;
+
+				if (childIter->responseCacheTtl == -1) {
+					childIter->responseCacheTtl = parent->responseCacheTtl;
+					childIter->responseCacheStale = parent->responseCacheStale;
+					childIter->responseCacheWaitTimeout = parent->responseCacheWaitTimeout;
+				}
+
 				if (childIter->charset.empty())
 					childIter->charset = parent->charset;
 
+				if (childIter->sendfileRoot.empty())
+					childIter->sendfileRoot = parent->sendfileRoot;
+
 				if (childIter->fileTemplate.empty())	childIter->fileTemplate = parent->fileTemplate;
 				if (childIter->directoryTemplate.empty())	childIter->directoryTemplate = parent->directoryTemplate;
 				if (childIter->parentDirectoryTemplate.empty())	childIter->parentDirectoryTemplate = parent->parentDirectoryTemplate;
@@ -317,6 +362,8 @@ namespace ahttp
 						childIter->handlers.insert (*handlerIter);
 				}
 
+				compileTemplates (*childIter);
+				childIter->rootFd = openDirectoryRoot (childIter->realPath);
 				directories_[childIter->virtualPath] = *childIter;
 				
 				fillDirectoriesMap (directoriesList, childIter);
@@ -326,6 +373,43 @@ namespace ahttp
 
 	}
 
+	void HttpServerSettings::compileTemplates (DirectorySettings& dirInfo)
+	{
+		dirInfo.compiledHeaderTemplate.compile (dirInfo.headerTemplate, ListingTemplate::HeaderMarks);
+		dirInfo.compiledDirectoryTemplate.compile (dirInfo.directoryTemplate, ListingTemplate::ItemMarks);
+		dirInfo.compiledParentDirectoryTemplate.compile (dirInfo.parentDirectoryTemplate, ListingTemplate::ParentDirectoryMarks);
+		dirInfo.compiledVirtualDirectoryTemplate.compile (dirInfo.virtualDirectoryTemplate, ListingTemplate::ItemMarks);
+		dirInfo.compiledFileTemplate.compile (dirInfo.fileTemplate, ListingTemplate::ItemMarks);
+		dirInfo.compiledFooterTemplate.compile (dirInfo.footerTemplate, ListingTemplate::FooterMarks);
+	}
+
+	int HttpServerSettings::openDirectoryRoot (aconnect::string_constref realPath)
+	{
+#if defined (__linux__)
+		std::map<aconnect::string, int>::const_iterator it = rootDescriptors_.find (realPath);
+		if (it != rootDescriptors_.end())
+			return it->second;
+
+		const int fd = detail::openDirectoryRoot (realPath);
+		if (fd != -1)
+			rootDescriptors_[realPath] = fd;
+		
+		return fd;
+#else
+		return -1;
+#endif
+	}
+
+	void HttpServerSettings::closeRootDescriptors ()
+	{
+#if defined (__linux__)
+		for (std::map<aconnect::string, int>::const_iterator it = rootDescriptors_.begin(); 
+			it != rootDescriptors_.end(); ++it)
+			::close (it->second);
+#endif
+		rootDescriptors_.clear();
+	}
+
 	void HttpServerSettings::tryLoadLocalSettings (aconnect::string_constref filePath, DirectorySettings& dirInfo) 
 		throw (settings_load_error)
 	{
@@ -410,6 +494,21 @@ namespace ahttp
 		if (!util::isNullOrEmpty(strValue))
 			responseBufferSize_ = boost::lexical_cast<size_t> (strValue);
 
+		strValue = serverElem->Attribute (SettingsTags::ResponseCacheSizeAttr);
+		if (!util::isNullOrEmpty(strValue))
+			responseCacheSize_ = boost::lexical_cast<size_t> (strValue);
+
+		strValue = serverElem->Attribute (SettingsTags::NegativeCacheSizeAttr);
+		if (!util::isNullOrEmpty(strValue))
+			negativeCacheSize_ = boost::lexical_cast<size_t> (strValue);
+
+		getAttrRes = serverElem->QueryIntAttribute (SettingsTags::NegativeCacheTtlAttr, &intValue );
+		negativeCacheTtl_ = (getAttrRes == TIXML_SUCCESS ? intValue : defaults::NegativeCacheTtl);
+
+		strValue = serverElem->Attribute (SettingsTags::ListingCacheSizeAttr);
+		if (!util::isNullOrEmpty(strValue))
+			listingCacheSize_ = boost::lexical_cast<size_t> (strValue);
+
 		strValue = serverElem->Attribute (SettingsTags::MaxChunkSizeAttr);
 		if (!util::isNullOrEmpty(strValue))
 			maxChunkSize_ = boost::lexical_cast<size_t> (strValue);
@@ -430,6 +529,30 @@ namespace ahttp
 		TiXmlElement* handlersElem = serverElem->FirstChildElement (SettingsTags::HandlersElement);
 		if (handlersElem)
 			loadHandlers (handlersElem);
+
+		// metrics endpoint - OPTIONAL
+		TiXmlElement* metricsElem = serverElem->FirstChildElement (SettingsTags::MetricsElement);
+		if (metricsElem)
+			loadMetricsSettings (metricsElem);
+	}
+
+	void HttpServerSettings::loadMetricsSettings (TiXmlElement* metricsElement) throw (settings_load_error)
+	{
+		using namespace aconnect;
+		assert (metricsElement);
+
+		string_constptr strValue = metricsElement->Attribute (SettingsTags::PathAttr);
+		metricsPath_ = util::isNullOrEmpty(strValue) ? defaults::MetricsPath : strValue;
+		
+		if (metricsPath_[0] != '/')
+			throw settings_load_error ("Invalid metrics path: %s", metricsPath_.c_str());
+
+		int intValue = 0;
+		if (loadIntAttribute (metricsElement, SettingsTags::PortAttr, intValue)) {
+			if (intValue < 0 || intValue == port_ || intValue == commandPort_)
+				throw settings_load_error ("Invalid metrics port: %d", intValue);
+			metricsPort_ = intValue;
+		}
 	}
 
 	void HttpServerSettings::loadLoggerSettings (TiXmlElement* logElement) throw (settings_load_error)
@@ -466,6 +589,42 @@ namespace ahttp
 		logFileTemplate_ = strValue;
 	}
 
+	void HttpServerSettings::loadAccessLogSettings (TiXmlElement* accessLogElement) throw (settings_load_error)
+	{
+		using namespace aconnect;
+		assert (accessLogElement);
+		string_constptr strValue;
+		int intValue = 0;
+
+		// "common", "combined" or "binary"
+		strValue = accessLogElement->Attribute (SettingsTags::FormatAttr);
+		accessLogFormat_ = util::isNullOrEmpty(strValue) ? AccessLogFormats::Combined : strValue;
+
+		if (!util::equals (accessLogFormat_, AccessLogFormats::Common) 
+			&& !util::equals (accessLogFormat_, AccessLogFormats::Combined) 
+			&& !util::equals (accessLogFormat_, AccessLogFormats::Binary) )
+			throw settings_load_error ("Unknown access log format: %s", accessLogFormat_.c_str());
+
+		if (loadIntAttribute (accessLogElement, SettingsTags::BufferSizeAttr, intValue) && intValue > 0)
+			accessLogBufferSize_ = intValue;
+		
+		loadIntAttribute (accessLogElement, SettingsTags::FlushIntervalAttr, accessLogFlushInterval_);
+		
+		if (loadIntAttribute (accessLogElement, SettingsTags::MaxFileSizeAttr, intValue) && intValue > 0)
+			maxAccessLogFileSize_ = intValue;
+
+		TiXmlElement* pathElement = accessLogElement->FirstChildElement (SettingsTags::PathElement);
+		if (!pathElement)
+			throw settings_load_error ("<%s> has no <%s> element", 
+				SettingsTags::AccessLogElement, SettingsTags::PathElement);
+
+		strValue = pathElement->GetText();
+		if ( util::isNullOrEmpty(strValue) ) 
+			throw settings_load_error ("Invalid access log file template");
+		
+		accessLogFileTemplate_ = strValue;
+	}
+
 
 	DirectorySettings HttpServerSettings::loadDirectory (TiXmlElement* directoryElem) throw (settings_load_error)
 	{
@@ -487,6 +646,10 @@ namespace ahttp
 		if (directoryElem->QueryValueAttribute( SettingsTags::BrowsingEnabledAttr, &strValue) == TIXML_SUCCESS) 
 			ds.browsingEnabled = util::equals(strValue, SettingsTags::BooleanTrue) ? 1 : 0;
 
+		// load server-timing
+		if (directoryElem->QueryValueAttribute( SettingsTags::ServerTimingAttr, &strValue) == TIXML_SUCCESS) 
+			ds.serverTimingEnabled = util::equals(strValue, SettingsTags::BooleanTrue) ? 1 : 0;
+
 		// load charset
 		if (directoryElem->QueryValueAttribute( SettingsTags::CharsetAttr, &strValue) == TIXML_SUCCESS) 
 			ds.charset = strValue;
@@ -518,6 +681,28 @@ namespace ahttp
 				ds.virtualPath = strPtrValue;
 		}
 
+		// sendfile-root
+		pathElement = directoryElem->FirstChildElement (SettingsTags::SendfileRootElement);
+		if (pathElement) {
+			strPtrValue = pathElement->GetText();
+			if ( !util::isNullOrEmpty(strPtrValue) ) {
+				ds.sendfileRoot = strPtrValue;
+				updateAppLocationInPath (ds.sendfileRoot);
+			}
+		}
+
+		// response-cache
+		if (TiXmlElement* cacheElement = directoryElem->FirstChildElement (SettingsTags::ResponseCacheElement)) 
+		{
+			if (cacheElement->QueryIntAttribute (SettingsTags::TtlAttr, &ds.responseCacheTtl) != TIXML_SUCCESS
+				|| ds.responseCacheTtl < 0)
+				throw settings_load_error ("Invalid <%s> \"%s\" attribute, directory: %s", 
+					SettingsTags::ResponseCacheElement, SettingsTags::TtlAttr, ds.name.c_str());
+
+			cacheElement->QueryIntAttribute (SettingsTags::StaleAttr, &ds.responseCacheStale);
+			cacheElement->QueryIntAttribute (SettingsTags::WaitTimeoutAttr, &ds.responseCacheWaitTimeout);
+		}
+
 		// relative-path
 		pathElement = directoryElem->FirstChildElement (SettingsTags::RelativePathElement);
 		if (pathElement) {
@@ -751,15 +936,27 @@ namespace ahttp
 		if (NULL == dll)
 			throw settings_load_error ("Handler loading failed, library: %s", pathToLoad.c_str());
 
-		info.processRequestFunc = ::GetProcAddress (dll, SettingsTags::ProcessRequestFunName);
-		if (!info.processRequestFunc) 
-			throw settings_load_error ("Request processing function loading failed, "
-				"library: %s, error code: %d", pathToLoad.c_str(), ::GetLastError());
+		create_handler_function createFunc = reinterpret_cast<create_handler_function> (
+			::GetProcAddress (dll, SettingsTags::CreateHandlerFunName));
 
-		info.initFunc = ::GetProcAddress (dll, SettingsTags::InitFunName);
-		if (!info.initFunc) 
-			throw settings_load_error ("Handler initialization function loading failed, "
-				"library: %s, error code: %d", pathToLoad.c_str(), ::GetLastError());
+		if (createFunc) 
+		{
+			info.handler = createFunc (HandlerApiVersion);
+			if (!info.handler)
+				throw settings_load_error ("Handler does not support server API version %d, library: %s", 
+					HandlerApiVersion, pathToLoad.c_str());
+		
+		} else {
+			info.processRequestFunc = ::GetProcAddress (dll, SettingsTags::ProcessRequestFunName);
+			if (!info.processRequestFunc) 
+				throw settings_load_error ("Request processing function loading failed, "
+					"library: %s, error code: %d", pathToLoad.c_str(), ::GetLastError());
+
+			info.initFunc = ::GetProcAddress (dll, SettingsTags::InitFunName);
+			if (!info.initFunc) 
+				throw settings_load_error ("Handler initialization function loading failed, "
+					"library: %s, error code: %d", pathToLoad.c_str(), ::GetLastError());
+		}
 #else
 		void * dll = dlopen (pathToLoad.c_str(), RTLD_NOW | RTLD_LOCAL | RTLD_DEEPBIND );
 		if (NULL == dll) {
@@ -768,18 +965,31 @@ namespace ahttp
 				pathToLoad.c_str(), errorMsg ? errorMsg : "Unknown error");
 		}
 
-		info.processRequestFunc = dlsym (dll, SettingsTags::ProcessRequestFunName);
-		if (!info.processRequestFunc) 
-			throw settings_load_error ("Request processing function loading failed, "
-				"library: %s, error: %s", pathToLoad.c_str(), dlerror());
-		
-		info.initFunc = dlsym (dll, SettingsTags::InitFunName);
-		if (!info.initFunc) 
-			throw settings_load_error ("Handler initialization function loading failed, "
-				"library: %s, error: %s", pathToLoad.c_str(), dlerror());
+		create_handler_function createFunc = reinterpret_cast<create_handler_function> (
+			dlsym (dll, SettingsTags::CreateHandlerFunName));
 
+		if (createFunc) 
+		{
+			info.handler = createFunc (HandlerApiVersion);
+			if (!info.handler)
+				throw settings_load_error ("Handler does not support server API version %d, library: %s", 
+					HandlerApiVersion, pathToLoad.c_str());
+		
+		} else {
+			info.processRequestFunc = dlsym (dll, SettingsTags::ProcessRequestFunName);
+			if (!info.processRequestFunc) 
+				throw settings_load_error ("Request processing function loading failed, "
+					"library: %s, error: %s", pathToLoad.c_str(), dlerror());
+		
+			info.initFunc = dlsym (dll, SettingsTags::InitFunName);
+			if (!info.initFunc) 
+				throw settings_load_error ("Handler initialization function loading failed, "
+					"library: %s, error: %s", pathToLoad.c_str(), dlerror());
+		}
 #endif
 		
+		info.name = handlerName;
+		info.id = registeredHandlers_.size() + 1;
 		registeredHandlers_[handlerName] = info;
 	}
 
@@ -832,7 +1042,7 @@ namespace ahttp
 			else if (ext.empty())
 				ext = info.defaultExtension;
 
-			dirInfo.handlers.insert ( std::make_pair (ext, info.processRequestFunc) );
+			dirInfo.handlers.insert ( std::make_pair (ext, &info) );
 
 			item = item->NextSiblingElement (SettingsTags::RegisterElement);
 		}
@@ -884,8 +1094,12 @@ namespace ahttp
 		global_handlers_map::const_iterator iter;
 		for (iter = registeredHandlers_.begin(); iter != registeredHandlers_.end(); ++iter)
 		{
-			bool inited = reinterpret_cast<init_handler_function> (iter->second.initFunc) 
-				(iter->second.params, this);
+			bool inited = false;
+			if (iter->second.handler)
+				inited = iter->second.handler->init (iter->second.params, this);
+			else
+				inited = reinterpret_cast<init_handler_function> (iter->second.initFunc) 
+					(iter->second.params, this);
 			
 			if (!inited)
 				throw settings_load_error ("Handler \"%s\" initialization failed failed",
@@ -893,5 +1107,47 @@ namespace ahttp
 		}
 	}
 
+	void HttpServerSettings::destroyHandlers ()
+	{
+		global_handlers_map::iterator iter;
+		for (iter = registeredHandlers_.begin(); iter != registeredHandlers_.end(); ++iter)
+		{
+			IHttpHandler* handler = iter->second.handler;
+			if (!handler)
+				continue;
+			
+			// directories keep pointers to HandlerInfo - handler must not be called after shutdown
+			iter->second.handler = NULL;
+
+			try {
+				handler->shutdown ();
+			} catch (std::exception &ex) {
+				if (logger_)
+					logger_->error ("Handler \"%s\" shutdown failed (%s): %s", 
+						iter->first.c_str(), typeid(ex).name(), ex.what());
+			}
+
+			delete handler;
+		}
+	}
+
+	aconnect::string HttpServerSettings::formatHandlersStatistics ()
+	{
+		aconnect::string output;
+		global_handlers_map::const_iterator iter;
+		
+		for (iter = registeredHandlers_.begin(); iter != registeredHandlers_.end(); ++iter)
+		{
+			output += "[" + iter->first + "]\r\n";
+			
+			if (iter->second.handler)
+				iter->second.handler->stats (output);
+			else
+				output += "API v1 handler - statistics is not available\r\n";
+		}
+
+		return output;
+	}
+
 } // namespace ahttp
 
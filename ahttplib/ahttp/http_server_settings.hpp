@@ -37,9 +37,12 @@ distribution.
 #include "aconnect/logger.hpp"
 #include "aconnect/server_settings.hpp"
 
+#include "ahttp/http_listing_template.hpp"
+
 namespace ahttp
 {
 	class HttpServerSettings;
+	class IHttpHandler;
 
 	typedef bool (*init_handler_function) (const aconnect::str2str_map& params, 
 		HttpServerSettings* globalSettings);
@@ -47,8 +50,8 @@ namespace ahttp
 	typedef std::map <aconnect::string, struct DirectorySettings> directories_map;
 	typedef std::vector<std::pair<bool, aconnect::string> > default_documents_vector;
 	
-	// key - extension, value - pointer to executor (process_request_function)
-	typedef std::multimap <aconnect::string, void*> directory_handlers_map; 
+	// key - extension, value - registered handler info (owned by HttpServerSettings)
+	typedef std::multimap <aconnect::string, const struct HandlerInfo*> directory_handlers_map; 
 
 	// key - registered handler name, value - handler settings
 	typedef std::map <aconnect::string, struct HandlerInfo> global_handlers_map;
@@ -63,6 +66,10 @@ namespace ahttp
 		const int CommandSocketTimeout	= 30;	// sec
 		const size_t ResponseBufferSize	= 2 * 1024 * 1024;	// bytes
 		const size_t MaxChunkSize				= 65535;	// bytes
+		const size_t AccessLogBufferSize		= 64 * 1024;	// bytes, per worker thread
+		const int AccessLogFlushInterval		= 1;	// sec
+		const size_t MaxAccessLogFileSize		= 64 * 1048576; // bytes
+		aconnect::string_constant MetricsPath	= "/metrics";
 		aconnect::string_constant ServerVersion = "ahttpserver";
 		aconnect::string_constant DirectoryConfigFile = "directory.config";
 	}
@@ -93,9 +100,13 @@ namespace ahttp
 		aconnect::string_constant RootElement = "settings";
 		aconnect::string_constant ServerElement = "server";
 		aconnect::string_constant LogElement = "log";
+		aconnect::string_constant AccessLogElement = "access-log";
+		aconnect::string_constant MetricsElement = "metrics";
 		aconnect::string_constant PathElement = "path";
 		aconnect::string_constant RelativePathElement = "relative-path";
 		aconnect::string_constant VirtualPathElement = "virtual-path";
+		aconnect::string_constant SendfileRootElement = "sendfile-root";
+		aconnect::string_constant ResponseCacheElement = "response-cache";
 
 		aconnect::string_constant DirectoryElement = "directory";
 		aconnect::string_constant DefaultDocumentsElement = "default-documents";
@@ -130,17 +141,29 @@ namespace ahttp
 		aconnect::string_constant RootAttr = "root";
 		aconnect::string_constant LogLevelAttr = "log-level";
 		aconnect::string_constant MaxFileSizeAttr = "max-file-size";
+		aconnect::string_constant FormatAttr = "format";
+		aconnect::string_constant BufferSizeAttr = "buffer-size";
+		aconnect::string_constant FlushIntervalAttr = "flush-interval";
+		aconnect::string_constant PathAttr = "path";
 		
 		aconnect::string_constant BrowsingEnabledAttr = "browsing-enabled";
+		aconnect::string_constant ServerTimingAttr = "server-timing";
 		aconnect::string_constant NameAttr = "name";
 		aconnect::string_constant ParentAttr = "parent";
 		aconnect::string_constant CharsetAttr = "charset";
+		aconnect::string_constant TtlAttr = "ttl";
+		aconnect::string_constant StaleAttr = "stale";
+		aconnect::string_constant WaitTimeoutAttr = "wait-timeout";
 
 		aconnect::string_constant KeepAliveEnabledAttr = "keep-alive-enabled";
 		aconnect::string_constant KeepAliveTimeoutAttr = "keep-alive-timeout";
 		aconnect::string_constant ServerSocketTimeoutAttr = "server-socket-timeout";
 		aconnect::string_constant CommandSocketTimeoutAttr = "command-socket-timeout";
 		aconnect::string_constant ResponseBufferSizeAttr = "response-buffer-size";
+		aconnect::string_constant ResponseCacheSizeAttr = "response-cache-size";
+		aconnect::string_constant NegativeCacheSizeAttr = "negative-cache-size";
+		aconnect::string_constant NegativeCacheTtlAttr = "negative-cache-ttl";
+		aconnect::string_constant ListingCacheSizeAttr = "listing-cache-size";
 		
 		aconnect::string_constant VersionAttr = "version";
 		aconnect::string_constant MaxChunkSizeAttr = "max-chunk-size";
@@ -170,19 +193,23 @@ namespace ahttp
 
 		aconnect::string_constant ProcessRequestFunName = "processHandlerRequest";
 		aconnect::string_constant InitFunName = "initHandler";
+		aconnect::string_constant CreateHandlerFunName = "createHandler";
 
 		aconnect::string_constant AllExtensionsMark = "*";
 	}
 
 	struct HandlerInfo
 	{
+		aconnect::string		name;
+		size_t					id;			// registration order number, starts from 1
 		aconnect::string		pathToLoad;
 		aconnect::string		defaultExtension;
 		void*					processRequestFunc;
 		void*					initFunc;
+		IHttpHandler*			handler;	// API v2 handler object, NULL - API v1 functions are used
 		aconnect::str2str_map	params;
 
-		HandlerInfo() :  processRequestFunc (NULL), initFunc (NULL) {}
+		HandlerInfo() :  id (0), processRequestFunc (NULL), initFunc (NULL), handler (NULL) {}
 	};
 
 	struct DirectorySettings
@@ -194,9 +221,15 @@ namespace ahttp
 		aconnect::string relativePath;	// virtual path from parent
 		aconnect::string virtualPath;		// full virtual path
 		aconnect::string realPath;		// real physical path
+		aconnect::string sendfileRoot;	// files allowed in handlers "X-Sendfile" header, empty - X-Sendfile is disabled
 		int browsingEnabled;				// -1: unknown; 0: false; 1: true
+		int serverTimingEnabled;			// -1: unknown; 0: false; 1: true - send "Server-Timing" header
+		int responseCacheTtl;				// sec, handlers responses cache: -1: unknown; 0: disabled
+		int responseCacheStale;				// sec, stale response is sent while it is updated
+		int responseCacheWaitTimeout;		// sec, wait for concurrent handler filling the same entry
 		bool isLinkedDirectory;
 		aconnect::string charset;
+		int rootFd;							// realPath descriptor (Linux, O_PATH), -1 - paths are resolved from "/"
 
 		default_documents_vector defaultDocuments; // bool - add/remove (false/true)
 		directory_handlers_map handlers;
@@ -209,6 +242,14 @@ namespace ahttp
 			virtualDirectoryTemplate,
 			fileTemplate,
 			footerTemplate;
+
+		// templates compiled after inheritance from parent directory
+		ListingTemplate compiledHeaderTemplate,
+			compiledDirectoryTemplate,
+			compiledParentDirectoryTemplate,
+			compiledVirtualDirectoryTemplate,
+			compiledFileTemplate,
+			compiledFooterTemplate;
 	};
 
 
@@ -253,19 +294,41 @@ namespace ahttp
 		inline const aconnect::string logFileTemplate() const		{		return logFileTemplate_;		}
 		inline const size_t	maxLogFileSize() const					{		return maxLogFileSize_;			}
 		inline const aconnect::port_type commandPort() const		{		return commandPort_;			}
+
+		inline class AccessLog* accessLog()							{		return accessLog_;				}
+		inline void setAccessLog (class AccessLog* accessLog)		{		accessLog_ = accessLog;			}
+		inline bool isAccessLogEnabled() const						{		return !accessLogFileTemplate_.empty();	}
+		inline const aconnect::string accessLogFileTemplate() const	{		return accessLogFileTemplate_;	}
+		inline const aconnect::string accessLogFormat() const		{		return accessLogFormat_;		}
+		inline const size_t accessLogBufferSize() const				{		return accessLogBufferSize_;	}
+		inline const int accessLogFlushInterval() const				{		return accessLogFlushInterval_;	}
+		inline const size_t maxAccessLogFileSize() const			{		return maxAccessLogFileSize_;	}
+
+		inline bool isMetricsEnabled() const						{		return !metricsPath_.empty();	}
+		inline const aconnect::string& metricsPath() const			{		return metricsPath_;			}
+		inline const aconnect::port_type metricsPort() const		{		return metricsPort_;			}
 		
 		inline const bool isKeepAliveEnabled() const				{		return enableKeepAlive_;		}
 		inline const int keepAliveTimeout() const					{		return keepAliveTimeout_;		}
 		inline const int commandSocketTimeout() const				{		return commandSocketTimeout_;	}
 		inline const size_t responseBufferSize() const				{		return responseBufferSize_;		}
+		inline const size_t responseCacheSize() const				{		return responseCacheSize_;		}
+		inline const size_t negativeCacheSize() const				{		return negativeCacheSize_;		}
+		inline const int negativeCacheTtl() const					{		return negativeCacheTtl_;		}
+		inline const size_t listingCacheSize() const				{		return listingCacheSize_;		}
 		inline const size_t maxChunkSize() const					{		return maxChunkSize_;			}
 		inline const directories_map& Directories() const			{		return directories_;			}
+		inline const global_handlers_map& registeredHandlers() const	{		return registeredHandlers_;		}
 
 		void updateAppLocationInPath (aconnect::string &pathStr) const;
 		
 		aconnect::string getMimeType (aconnect::string_constref ext) const;
 
 		void initHandlers ();
+		// API v2 handlers shutdown, must be called after server stop
+		void destroyHandlers ();
+		// statistics of API v2 handlers
+		aconnect::string formatHandlersStatistics ();
 
 		static bool loadIntAttribute (class TiXmlElement* elem, 
 			aconnect::string_constptr attr, int &value);
@@ -277,6 +340,8 @@ namespace ahttp
 	protected:
 		void loadServerSettings (class TiXmlElement* serverElem) throw (settings_load_error);
 		void loadLoggerSettings (class TiXmlElement* logElement) throw (settings_load_error);
+		void loadAccessLogSettings (class TiXmlElement* accessLogElement) throw (settings_load_error);
+		void loadMetricsSettings (class TiXmlElement* metricsElement) throw (settings_load_error);
 		
 		DirectorySettings loadDirectory (class TiXmlElement* dirElement) throw (settings_load_error);
 
@@ -288,6 +353,11 @@ namespace ahttp
 		void loadLocalDirectorySettings (class TiXmlElement* dirElement, DirectorySettings& dirInfo) throw (settings_load_error);
 
 		void fillDirectoriesMap (std::vector <DirectorySettings>& directoriesList, std::vector <DirectorySettings>::iterator parent);
+		static void compileTemplates (DirectorySettings& dirInfo);
+		// descriptors are opened once per settings load (shared by directories with the same path) 
+		// and closed on reload - server must be stopped while settings are reloaded
+		int openDirectoryRoot (aconnect::string_constref realPath);
+		void closeRootDescriptors ();
 		void loadMimeTypes (class TiXmlElement* mimeTypesElement) throw (settings_load_error);
 		
 		void loadHandlers (class TiXmlElement* handlersElement) throw (settings_load_error);
@@ -309,14 +379,31 @@ namespace ahttp
 		aconnect::Log::LogLevel logLevel_;
 		aconnect::string logFileTemplate_;
 		size_t maxLogFileSize_;
+		
+		// access log
+		aconnect::string accessLogFileTemplate_;
+		aconnect::string accessLogFormat_;
+		size_t accessLogBufferSize_;
+		int accessLogFlushInterval_;
+		size_t maxAccessLogFileSize_;
+		class AccessLog* accessLog_;
+
+		// metrics endpoint, disabled when path is empty
+		aconnect::string metricsPath_;
+		aconnect::port_type metricsPort_;	// 0 - served on main port
 
 		bool enableKeepAlive_;
 		int keepAliveTimeout_;
 		int commandSocketTimeout_;
 		size_t responseBufferSize_;
+		size_t responseCacheSize_;
+		size_t negativeCacheSize_;
+		int negativeCacheTtl_;
+		size_t listingCacheSize_;
 		size_t maxChunkSize_;
 
 		directories_map directories_;
+		std::map<aconnect::string, int> rootDescriptors_;
 		aconnect::str2str_map mimeTypes_;
 
 		aconnect::Logger*	logger_;
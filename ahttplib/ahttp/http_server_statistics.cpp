@@ -0,0 +1,363 @@
+/*
+This file is part of [ahttp] library. 
+
+Author: Artem Kustikov (kustikoff[at]tut.by)
+version: 0.1
+
+This code is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this code.
+
+Permission is granted to anyone to use this code for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this code must not be misrepresented; you must
+not claim that you wrote the original code. If you use this
+code in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original code.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#include <iomanip>
+#include <string.h>
+
+#include "aconnect/aconnect.hpp"
+#include "aconnect/util.hpp"
+#include "aconnect/time_util.hpp"
+
+#include "ahttp/http_server_statistics.hpp"
+#include "ahttp/http_access_log.hpp"
+#include "ahttp/http_server.hpp"
+
+namespace ahttp
+{
+	namespace detail
+	{
+		inline void formatHistogramRecord (aconnect::str_stream& out, aconnect::string_constref name,
+			const aconnect::LatencyHistogram& histogram)
+		{
+			out << std::setw (24) << std::left << name << std::right
+				<< std::setw (10) << histogram.count()
+				<< std::setw (10) << histogram.percentile (50)
+				<< std::setw (10) << histogram.percentile (90)
+				<< std::setw (10) << histogram.percentile (99)
+				<< std::setw (10) << histogram.percentile (99.9)
+				<< std::setw (10) << histogram.max()
+				<< "\r\n";
+		}
+
+		const string_constptr StatusClassNames[HttpServerStatistics::StatusClassesCount] = {
+			"unknown", "1xx", "2xx", "3xx", "4xx", "5xx"
+		};
+		const string_constptr MethodNames[HttpServerStatistics::MethodsCount] = {
+			"unknown", MethodGet, MethodPost, MethodHead
+		};
+
+		inline void formatMetricHeader (aconnect::str_stream& out, aconnect::string_constptr name,
+			aconnect::string_constptr type, aconnect::string_constptr help)
+		{
+			out << "# HELP " << name << ' ' << help << '\n';
+			out << "# TYPE " << name << ' ' << type << '\n';
+		}
+
+		inline void formatSummary (aconnect::str_stream& out, aconnect::string_constptr name,
+			aconnect::string_constptr labels, const aconnect::LatencyHistogram& histogram)
+		{
+			const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+			const string separator = (labels[0] ? "," : "");
+			
+			for (size_t ndx = 0; ndx < ARRAY_SIZE (quantiles); ++ndx) {
+				out << name << '{' << labels << separator << "quantile=\"" << quantiles[ndx] << "\"} " 
+					<< (double) histogram.percentile (quantiles[ndx] * 100) / 1000000 << '\n';
+			}
+			
+			const string labelsValue = (labels[0] ? string ("{") + labels + "}" : string());
+			out << name << "_sum" << labelsValue << ' ' << (double) histogram.sum() / 1000000 << '\n';
+			out << name << "_count" << labelsValue << ' ' << histogram.count() << '\n';
+		}
+	}
+
+	HttpServerStatistics::Data::Data () :
+		bytesReceived (0),
+		bytesSent (0),
+		keepAliveRequests (0)
+	{
+		memset (requests, 0, sizeof (requests));
+	}
+
+	void HttpServerStatistics::HandlerLatency::merge (const HandlerLatency& other)
+	{
+		total.merge (other.total);
+		handler.merge (other.handler);
+	}
+
+	void HttpServerStatistics::Data::merge (const Data& other)
+	{
+		total.merge (other.total);
+		queueWait.merge (other.queueWait);
+		handler.merge (other.handler);
+		firstByte.merge (other.firstByte);
+
+		for (int ndx = 0; ndx < StatusClassesCount; ++ndx)
+			byStatus[ndx].merge (other.byStatus[ndx]);
+
+		const size_t handlersCount = aconnect::util::min2 (byHandler.size(), other.byHandler.size());
+		for (size_t ndx = 0; ndx < handlersCount; ++ndx)
+			byHandler[ndx].merge (other.byHandler[ndx]);
+
+		for (int statusNdx = 0; statusNdx < StatusClassesCount; ++statusNdx)
+			for (int methodNdx = 0; methodNdx < MethodsCount; ++methodNdx)
+				requests[statusNdx][methodNdx] += other.requests[statusNdx][methodNdx];
+
+		bytesReceived += other.bytesReceived;
+		bytesSent += other.bytesSent;
+		keepAliveRequests += other.keepAliveRequests;
+	}
+
+	void HttpServerStatistics::init (const global_handlers_map& handlers)
+	{
+		handlerNames_.assign (handlers.size() + 1, aconnect::string());
+		handlerNames_[0] = "<server>";
+
+		for (global_handlers_map::const_iterator it = handlers.begin(); it != handlers.end(); ++it) {
+			if (it->second.id < handlerNames_.size())
+				handlerNames_[it->second.id] = it->second.name;
+		}
+
+		Data prototype;
+		prototype.byHandler.resize (handlerNames_.size());
+		shards_.setPrototype (prototype);
+	}
+
+	void HttpServerStatistics::registerRequest (const HttpContext& context)
+	{
+		using namespace aconnect;
+
+		const HttpRequestTimes& times = context.Times;
+		const util::timestamp_type started = times.accepted ? times.accepted : times.workerStarted;
+		const util::timestamp_type total = util::elapsedTime (started, times.finished);
+		const int status = context.Response.Header.Status;
+		const int statusClass = (status >= 100 && status < 600 ? status / 100 : StatusUnknown);
+		const int methodNdx = (int) context.Method;
+		const int method = (methodNdx >= 0 && methodNdx < (int) MethodsCount ? methodNdx : (int) HttpMethod::Unknown);
+
+		Data& data = shards_.local();
+
+		++data.requests[statusClass][method];
+		data.bytesReceived += context.RequestHeader.HeaderLength + context.RequestHeader.ContentLength;
+		data.bytesSent += context.Response.Stream.bytesSent();
+		if (!times.accepted)
+			++data.keepAliveRequests;
+
+		data.total.record (total);
+		if (times.accepted)
+			data.queueWait.record (util::elapsedTime (times.accepted, times.workerStarted));
+		if (context.Response.Stream.firstByteTime())
+			data.firstByte.record (util::elapsedTime (started, context.Response.Stream.firstByteTime()));
+
+		data.byStatus[statusClass].record (total);
+
+		const size_t handlerId = context.Handler ? context.Handler->id : 0;
+		if (handlerId < data.byHandler.size()) {
+			HandlerLatency& handlerLatency = data.byHandler[handlerId];
+			handlerLatency.total.record (total);
+			
+			if (context.Handler) {
+				const util::timestamp_type handlerTime = util::elapsedTime (times.handlerStarted, times.handlerFinished);
+				handlerLatency.handler.record (handlerTime);
+				data.handler.record (handlerTime);
+			}
+		}
+	}
+
+	void HttpServerStatistics::collect (Data& result)
+	{
+		shards_.collect (result);
+	}
+
+	aconnect::string HttpServerStatistics::formatLatencyReport ()
+	{
+		using namespace aconnect;
+		
+		Data data;
+		collect (data);
+
+		str_stream out;
+		out << "ahttpserver latency statistics (usec)\r\n";
+		out << std::setw (24) << std::left << "" << std::right
+			<< std::setw (10) << "count"
+			<< std::setw (10) << "p50"
+			<< std::setw (10) << "p90"
+			<< std::setw (10) << "p99"
+			<< std::setw (10) << "p999"
+			<< std::setw (10) << "max"
+			<< "\r\n";
+
+		detail::formatHistogramRecord (out, "total", data.total);
+		detail::formatHistogramRecord (out, "queue wait", data.queueWait);
+		detail::formatHistogramRecord (out, "handler", data.handler);
+		detail::formatHistogramRecord (out, "first byte", data.firstByte);
+
+		string_constptr statusNames[StatusClassesCount] = {
+			"status unknown", "status 1xx", "status 2xx", "status 3xx", "status 4xx", "status 5xx"
+		};
+		for (int ndx = 0; ndx < StatusClassesCount; ++ndx) {
+			if (data.byStatus[ndx].count())
+				detail::formatHistogramRecord (out, statusNames[ndx], data.byStatus[ndx]);
+		}
+
+		const size_t handlersCount = util::min2 (data.byHandler.size(), handlerNames_.size());
+		for (size_t ndx = 0; ndx < handlersCount; ++ndx) 
+		{
+			if (!data.byHandler[ndx].total.count())
+				continue;
+			
+			detail::formatHistogramRecord (out, handlerNames_[ndx] + " total", data.byHandler[ndx].total);
+			if (ndx != 0)
+				detail::formatHistogramRecord (out, handlerNames_[ndx] + " handler", data.byHandler[ndx].handler);
+		}
+
+		return out.str();
+	}
+
+	aconnect::string HttpServerStatistics::formatMetrics (aconnect::Server* server, AccessLog* accessLog,
+		HttpResponseCache* responseCache, NegativePathCache* negativeCache,
+		DirectoryListingCache* listingCache)
+	{
+		using namespace aconnect;
+
+		Data data;
+		collect (data);
+
+		str_stream out;
+
+		detail::formatMetricHeader (out, "ahttp_requests_total", "counter", "Processed HTTP requests.");
+		for (int statusNdx = 0; statusNdx < StatusClassesCount; ++statusNdx) {
+			for (int methodNdx = 0; methodNdx < MethodsCount; ++methodNdx) {
+				if (!data.requests[statusNdx][methodNdx])
+					continue;
+				out << "ahttp_requests_total{status=\"" << detail::StatusClassNames[statusNdx] 
+					<< "\",method=\"" << detail::MethodNames[methodNdx] << "\"} " 
+					<< data.requests[statusNdx][methodNdx] << '\n';
+			}
+		}
+
+		detail::formatMetricHeader (out, "ahttp_handler_requests_total", "counter", "HTTP requests completed by handler.");
+		const size_t handlersCount = util::min2 (data.byHandler.size(), handlerNames_.size());
+		for (size_t ndx = 0; ndx < handlersCount; ++ndx) 
+			out << "ahttp_handler_requests_total{handler=\"" << handlerNames_[ndx] << "\"} " 
+				<< data.byHandler[ndx].total.count() << '\n';
+
+		detail::formatMetricHeader (out, "ahttp_received_bytes_total", "counter", "Received request bytes (headers and body).");
+		out << "ahttp_received_bytes_total " << data.bytesReceived << '\n';
+
+		detail::formatMetricHeader (out, "ahttp_sent_bytes_total", "counter", "Sent response bytes.");
+		out << "ahttp_sent_bytes_total " << data.bytesSent << '\n';
+
+		detail::formatMetricHeader (out, "ahttp_keep_alive_requests_total", "counter", "Requests processed on reused keep-alive connections.");
+		out << "ahttp_keep_alive_requests_total " << data.keepAliveRequests << '\n';
+
+		detail::formatMetricHeader (out, "ahttp_request_duration_seconds", "summary", "Total request processing time.");
+		detail::formatSummary (out, "ahttp_request_duration_seconds", "", data.total);
+
+		detail::formatMetricHeader (out, "ahttp_queue_wait_seconds", "summary", "Time between connection accept and worker start.");
+		detail::formatSummary (out, "ahttp_queue_wait_seconds", "", data.queueWait);
+
+		detail::formatMetricHeader (out, "ahttp_first_byte_seconds", "summary", "Time to first response byte.");
+		detail::formatSummary (out, "ahttp_first_byte_seconds", "", data.firstByte);
+
+		if (server) 
+		{
+			detail::formatMetricHeader (out, "ahttp_workers", "gauge", "Worker threads count.");
+			out << "ahttp_workers{state=\"active\"} " << server->currentWorkersCount() << '\n';
+			out << "ahttp_workers{state=\"pending\"} " << server->currentPendingWorkersCount() << '\n';
+
+			detail::formatMetricHeader (out, "ahttp_queue_length", "gauge", "Accepted connections waiting for worker.");
+			out << "ahttp_queue_length " << server->queueLength() << '\n';
+		}
+
+		if (accessLog) 
+		{
+			detail::formatMetricHeader (out, "ahttp_access_log_records_total", "counter", "Access log records by write result.");
+			out << "ahttp_access_log_records_total{result=\"written\"} " << accessLog->writtenCount() << '\n';
+			out << "ahttp_access_log_records_total{result=\"dropped\"} " << accessLog->droppedCount() << '\n';
+		}
+
+		if (responseCache) 
+		{
+			HttpResponseCache::Stats cacheStats;
+			responseCache->collect (cacheStats);
+
+			detail::formatMetricHeader (out, "ahttp_response_cache_requests_total", "counter", "Response cache lookups by result.");
+			out << "ahttp_response_cache_requests_total{result=\"hit\"} " << cacheStats.hits << '\n';
+			out << "ahttp_response_cache_requests_total{result=\"stale\"} " << cacheStats.stale << '\n';
+			out << "ahttp_response_cache_requests_total{result=\"miss\"} " << cacheStats.misses << '\n';
+			out << "ahttp_response_cache_requests_total{result=\"pass\"} " << cacheStats.passed << '\n';
+			out << "ahttp_response_cache_requests_total{result=\"bypass\"} " << cacheStats.bypassed << '\n';
+
+			detail::formatMetricHeader (out, "ahttp_response_cache_coalesced_total", "counter", "Requests waited for concurrent handler filling the same entry.");
+			out << "ahttp_response_cache_coalesced_total " << cacheStats.coalesced << '\n';
+
+			detail::formatMetricHeader (out, "ahttp_response_cache_stored_total", "counter", "Handler responses stored in cache.");
+			out << "ahttp_response_cache_stored_total " << cacheStats.stored << '\n';
+
+			detail::formatMetricHeader (out, "ahttp_response_cache_entries", "gauge", "Cached responses count.");
+			out << "ahttp_response_cache_entries " << cacheStats.entries << '\n';
+
+			detail::formatMetricHeader (out, "ahttp_response_cache_keys", "gauge", "Response cache slots and Vary lists count.");
+			out << "ahttp_response_cache_keys " << cacheStats.keys << '\n';
+
+			detail::formatMetricHeader (out, "ahttp_response_cache_bytes", "gauge", "Cached responses and keys size.");
+			out << "ahttp_response_cache_bytes " << cacheStats.size << '\n';
+		}
+
+		if (negativeCache) 
+		{
+			NegativePathCache::Stats cacheStats;
+			negativeCache->collect (cacheStats);
+
+			detail::formatMetricHeader (out, "ahttp_negative_cache_hits_total", "counter", "Requests for missing paths answered from cache.");
+			out << "ahttp_negative_cache_hits_total " << cacheStats.hits << '\n';
+
+			detail::formatMetricHeader (out, "ahttp_negative_cache_stored_total", "counter", "Missing paths stored in cache.");
+			out << "ahttp_negative_cache_stored_total " << cacheStats.stored << '\n';
+
+			detail::formatMetricHeader (out, "ahttp_negative_cache_invalidations_total", "counter", "Cache drops caused by file system changes.");
+			out << "ahttp_negative_cache_invalidations_total " << cacheStats.invalidations << '\n';
+
+			detail::formatMetricHeader (out, "ahttp_negative_cache_entries", "gauge", "Cached missing paths count.");
+			out << "ahttp_negative_cache_entries " << cacheStats.entries << '\n';
+
+			detail::formatMetricHeader (out, "ahttp_negative_cache_watches", "gauge", "Watched directories count.");
+			out << "ahttp_negative_cache_watches " << cacheStats.watches << '\n';
+		}
+
+		if (listingCache) 
+		{
+			DirectoryListingCache::Stats cacheStats;
+			listingCache->collect (cacheStats);
+
+			detail::formatMetricHeader (out, "ahttp_listing_cache_requests_total", "counter", "Directory listing cache lookups by result.");
+			out << "ahttp_listing_cache_requests_total{result=\"hit\"} " << cacheStats.hits << '\n';
+			out << "ahttp_listing_cache_requests_total{result=\"miss\"} " << cacheStats.misses << '\n';
+
+			detail::formatMetricHeader (out, "ahttp_listing_cache_invalidations_total", "counter", "Listings dropped because of directory changes.");
+			out << "ahttp_listing_cache_invalidations_total " << cacheStats.invalidations << '\n';
+
+			detail::formatMetricHeader (out, "ahttp_listing_cache_entries", "gauge", "Cached directory listings count.");
+			out << "ahttp_listing_cache_entries " << cacheStats.entries << '\n';
+
+			detail::formatMetricHeader (out, "ahttp_listing_cache_bytes", "gauge", "Cached directory listings size.");
+			out << "ahttp_listing_cache_bytes " << cacheStats.size << '\n';
+		}
+
+		return out.str();
+	}
+}
@@ -0,0 +1,114 @@
+/*
+This file is part of [ahttp] library. 
+
+Author: Artem Kustikov (kustikoff[at]tut.by)
+version: 0.1
+
+This code is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this code.
+
+Permission is granted to anyone to use this code for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this code must not be misrepresented; you must
+not claim that you wrote the original code. If you use this
+code in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original code.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#ifndef AHTTP_SERVER_STATISTICS_H
+#define AHTTP_SERVER_STATISTICS_H
+#pragma once
+
+#include <vector>
+#include <boost/cstdint.hpp>
+
+#include "aconnect/types.hpp"
+#include "aconnect/complex_types.hpp"
+#include "aconnect/thread_shards.hpp"
+#include "aconnect/latency_histogram.hpp"
+
+#include "ahttp/http_support.hpp"
+#include "ahttp/http_server_settings.hpp"
+
+namespace ahttp
+{
+	/**
+	*	Server statistics: request counters and processing phases histograms,
+	*	collected in per-thread shards (without locks on request path) and merged on read.
+	*/
+	class HttpServerStatistics
+	{
+	public:
+		enum StatusClass
+		{
+			StatusUnknown = 0,
+			Status1xx,
+			Status2xx,
+			Status3xx,
+			Status4xx,
+			Status5xx,
+			StatusClassesCount
+		};
+
+		enum { MethodsCount = HttpMethod::Head + 1 };
+
+		typedef boost::uint64_t counter_type;
+
+		struct HandlerLatency
+		{
+			aconnect::LatencyHistogram total;
+			aconnect::LatencyHistogram handler;
+
+			void merge (const HandlerLatency& other);
+		};
+
+		struct Data
+		{
+			aconnect::LatencyHistogram total;		// accepted (or taken by worker) -> request completed
+			aconnect::LatencyHistogram queueWait;	// accepted -> taken by worker, first request on connection only
+			aconnect::LatencyHistogram handler;		// handler execution time
+			aconnect::LatencyHistogram firstByte;	// accepted (or taken by worker) -> first response byte sent
+
+			aconnect::LatencyHistogram byStatus[StatusClassesCount];	// total time
+			std::vector<HandlerLatency> byHandler;	// index - HandlerInfo::id, 0 - processed by server
+
+			counter_type requests[StatusClassesCount][MethodsCount];
+			counter_type bytesReceived;
+			counter_type bytesSent;
+			counter_type keepAliveRequests;			// requests on reused connections
+
+			Data ();
+			void merge (const Data& other);
+		};
+
+		// reset statistics, prepare shards for registered handlers
+		void init (const global_handlers_map& handlers);
+
+		void registerRequest (const class HttpContext& context);
+		void collect (Data& result);
+
+		// percentiles report for "stat-latency" command
+		aconnect::string formatLatencyReport ();
+		
+		// Prometheus text exposition format, gauges are loaded from "server" (can be NULL)
+		aconnect::string formatMetrics (class aconnect::Server* server, class AccessLog* accessLog,
+			class HttpResponseCache* responseCache, class NegativePathCache* negativeCache,
+			class DirectoryListingCache* listingCache);
+
+	protected:
+		aconnect::ThreadShards<Data> shards_;
+		aconnect::str_vector handlerNames_;
+	};
+}
+
+#endif // AHTTP_SERVER_STATISTICS_H
@@ -29,19 +29,65 @@ distribution.
 // #endif
 
 #include <algorithm>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if defined (__linux__)
+#	include <fcntl.h>
+#	include <unistd.h>
+#	include <errno.h>
+#	include <dirent.h>
+#	include <sys/syscall.h>
+#	include <boost/cstdint.hpp>
+
+#	if !defined (SYS_openat2)
+#		define SYS_openat2	437
+#	endif
+#	if !defined (O_PATH)
+#		define O_PATH		010000000
+#	endif
+#endif
+
 #include <boost/filesystem.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
 
 #include "aconnect/time_util.hpp"
 
 #include "ahttp/http_support.hpp"
 
 namespace fs = boost::filesystem;
+namespace algo = boost::algorithm;
 
 namespace ahttp { 
 	namespace detail
 {
 
 
+	void appendJsonString (string& out, string_constptr value)
+	{
+		out += '"';
+		for (; *value; ++value)
+		{
+			const unsigned char ch = (unsigned char) *value;
+			if (ch == '"' || ch == '\\') {
+				out += '\\';
+				out += ch;
+			} else if (ch < 0x20) {
+				char buff[8];
+				snprintf (buff, sizeof (buff), "\\u%04x", ch);
+				out += buff;
+			} else {
+				out += ch;
+			}
+		}
+		out += '"';
+	}
+
 	// sample: Sun, 06 Nov 1994 08:49:37 GMT  ; RFC 822, updated by RFC 1123
 	aconnect::string formatDate_RFC1123 (const tm& dateTime) 
 	{
@@ -61,6 +107,70 @@ namespace ahttp {
 		return aconnect::string (buff, cnt);
 	}
 
+	ByteRangeParseResult parseByteRange (string_constref rangeHeader, size_t contentSize,
+		size_t& first, size_t& length)
+	{
+		using boost::lexical_cast;
+
+		string range = algo::trim_copy (rangeHeader);
+		const size_t unitLength = ARRAY_SIZE (RangeUnitBytes) - 1;
+
+		if (!algo::istarts_with (range, RangeUnitBytes) 
+			|| range.size() <= unitLength || range[unitLength] != '=')
+			return RangeIgnored;
+		
+		range = algo::trim_copy (range.substr (unitLength + 1));
+
+		const size_t dashPos = range.find ('-');
+		if (dashPos == string::npos || range.find (',') != string::npos)
+			return RangeIgnored;
+
+		const string firstStr = algo::trim_copy (range.substr (0, dashPos)),
+			lastStr = algo::trim_copy (range.substr (dashPos + 1));
+
+		if (!firstStr.empty() && !algo::all (firstStr, algo::is_digit()))
+			return RangeIgnored;
+		if (!lastStr.empty() && !algo::all (lastStr, algo::is_digit()))
+			return RangeIgnored;
+		
+		try 
+		{
+			if (firstStr.empty()) {
+				// suffix range: last N bytes
+				if (lastStr.empty())
+					return RangeIgnored;
+				
+				size_t suffixLength = lexical_cast<size_t> (lastStr);
+				if (0 == suffixLength || 0 == contentSize)
+					return RangeNotSatisfiable;
+
+				length = (suffixLength < contentSize ? suffixLength : contentSize);
+				first = contentSize - length;
+				return RangeSatisfiable;
+			}
+
+			first = lexical_cast<size_t> (firstStr);
+			if (first >= contentSize)
+				return RangeNotSatisfiable;
+
+			size_t last = contentSize - 1;
+			if (!lastStr.empty()) {
+				last = lexical_cast<size_t> (lastStr);
+				if (last < first)
+					return RangeIgnored;
+				if (last >= contentSize)
+					last = contentSize - 1;
+			}
+
+			length = last - first + 1;
+
+		} catch (boost::bad_lexical_cast &) {
+			return RangeIgnored;
+		}
+
+		return RangeSatisfiable;
+	}
+
 	bool sortWdByTypeAndName (const WebDirectoryItem& item1, const WebDirectoryItem& item2)
 	{
 		if (item1.type != item2.type)
@@ -68,16 +178,235 @@ namespace ahttp {
 		return item1.name < item2.name;
 	}
 
+	bool sortWdByName (const WebDirectoryItem& item1, const WebDirectoryItem& item2)
+	{
+		return item1.name < item2.name;
+	}
+
+#if defined (__linux__)
+	// getdents64 record
+	struct KernelDirent64
+	{
+		boost::uint64_t		d_ino;
+		boost::int64_t		d_off;
+		unsigned short		d_reclen;
+		unsigned char		d_type;
+		char				d_name[1];
+	};
+
+	const size_t DirectoryReadBufferSize = 32768;
+
+	/*
+	*	Reads directory entries in bulk from opened descriptor, items status is loaded 
+	*	by fstatat relative to it (entry name is resolved only). Status is skipped when
+	*	item attributes are not required and entry type is known.
+	*/
+	static void scanDirectory (string_constref dirPath,
+							   string_constref dirVirtualPath,
+							   std::vector<WebDirectoryItem> &items, 
+							   aconnect::Logger& logger,
+							   size_t &errCount,
+							   bool loadAttributes)
+	{
+		const int dirFd = ::open (dirPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (dirFd == -1)
+			throw std::runtime_error ("Directory opening failed: " + dirPath);
+
+		try
+		{
+			std::vector<char> buffer (DirectoryReadBufferSize);
+
+			while (true)
+			{
+				const long readBytes = ::syscall (SYS_getdents64, dirFd, &buffer[0], buffer.size());
+				if (readBytes == 0)
+					break;
+
+				if (readBytes < 0) {
+					if (errno == EINTR)
+						continue;
+					throw std::runtime_error ("Directory reading failed: " + dirPath);
+				}
+
+				for (long offset = 0; offset < readBytes; )
+				{
+					const KernelDirent64* entry = (const KernelDirent64*) (&buffer[0] + offset);
+					offset += entry->d_reclen;
+
+					const char* name = entry->d_name;
+					if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+						continue;
+
+					WebDirectoryItem item;
+					item.name = name;
+					
+					bool isDirectory = (entry->d_type == DT_DIR);
+
+					// symbolic links are followed
+					if (loadAttributes || entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) 
+					{
+						struct stat itemStat;
+						if (::fstatat (dirFd, name, &itemStat, 0) != 0) {
+							logger.error ("Item status loading failed at directory \"%s\": %s", 
+								dirVirtualPath.c_str(), name);
+							++errCount;
+							continue;
+						}
+
+						isDirectory = S_ISDIR (itemStat.st_mode);
+						if (loadAttributes) {
+							item.lastWriteTime = itemStat.st_mtime;
+							if (!isDirectory)
+								item.size = itemStat.st_size;
+						}
+					}
+
+					if ( isDirectory ) {
+						item.type = WdDirectory;
+						item.url = dirVirtualPath + item.name + Slash;
+					} else  {
+						item.type = WdFile;
+						item.url = dirVirtualPath + item.name;
+					}
+
+					items.push_back (item);
+				}
+			}
+
+		} catch (...) {
+			::close (dirFd);
+			throw;
+		}
+
+		::close (dirFd);
+	}
+#endif
+
+#if defined (__linux__)
+	// linux/openat2.h: "struct open_how", RESOLVE_BENEATH
+	struct OpenHow
+	{
+		boost::uint64_t flags;
+		boost::uint64_t mode;
+		boost::uint64_t resolve;
+	};
+
+	const boost::uint64_t ResolveBeneath = 0x08;
+
+	// reset when kernel does not provide openat2 (before 5.6)
+	static volatile bool openat2Supported = true;
+
+	int openDirectoryRoot (string_constref dirPath)
+	{
+		return ::open (dirPath.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+	}
+
+	bool openTarget (int rootFd, string_constref relativePath, TargetStatus& status)
+	{
+		status.clear();
+		if (!openat2Supported)
+			return false;
+
+		const size_t start = relativePath.find_first_not_of (SlashCh);
+		string_constptr path = (start == string::npos ? "." : relativePath.c_str() + start);
+
+		OpenHow how;
+		how.flags = O_RDONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC;
+		how.mode = 0;
+		how.resolve = ResolveBeneath;
+
+		int fd = -1;
+		do {
+			fd = (int) ::syscall (SYS_openat2, rootFd, path, &how, sizeof (how));
+		} while (fd == -1 && errno == EINTR);
+
+		if (fd == -1) 
+		{
+			switch (errno) 
+			{
+			case ENOENT:
+			case ENOTDIR:
+			case ENAMETOOLONG:
+				status.resolved = true;
+				return true;
+			
+			case EXDEV:
+				status.resolved = true;
+				status.outside = true;
+				return true;
+
+			case ENOSYS:
+				openat2Supported = false;
+				return false;
+			
+			default:
+				return false;
+			}
+		}
+
+		struct stat itemStat;
+		if (::fstat (fd, &itemStat) != 0) {
+			::close (fd);
+			return false;
+		}
+
+		status.resolved = true;
+		status.exists = true;
+		status.isDirectory = S_ISDIR (itemStat.st_mode);
+		status.size = itemStat.st_size;
+		status.modifyTime = itemStat.st_mtime;
+
+		// descriptor is kept for file sending
+		if (S_ISREG (itemStat.st_mode))
+			status.fd = fd;
+		else
+			::close (fd);
+
+		return true;
+	}
+#endif
+
+	bool resolvesInside (string_constref rootPath, string_constref path)
+	{
+#if defined (WIN32)
+		// symbolic links are not followed out of web directories on Windows
+		return true;
+#else
+		char_type rootReal[PATH_MAX];
+		char_type pathReal[PATH_MAX];
+
+		// root existence is checked at settings load
+		if (!::realpath (rootPath.c_str(), rootReal))
+			return true;
+
+		if (!::realpath (path.c_str(), pathReal))
+			return (errno == ENOENT || errno == ENOTDIR);	// missing item - nothing is served
+
+		const size_t rootLength = strlen (rootReal);
+		if (strncmp (pathReal, rootReal, rootLength) != 0)
+			return false;
+
+		return pathReal[rootLength] == '\0' || pathReal[rootLength] == '/' || rootReal[rootLength - 1] == '/';
+#endif
+	}
+
 	void readDirectoryContent (string_constref dirPath,
 							   string_constref dirVirtualPath,
 							   std::vector<WebDirectoryItem> &items, 
 							   aconnect::Logger& logger,
 							   size_t &errCount,
-							   WebDirectorySortType sortType)
+							   WebDirectorySortType sortType,
+							   bool loadAttributes)
 	{
 
 		aconnect::ProgressTimer progress (logger, __FUNCTION__);
 
+		// items added before (virtual directories) keep their order
+		const size_t firstItem = items.size();
+
+#if defined (__linux__)
+		scanDirectory (dirPath, dirVirtualPath, items, logger, errCount, loadAttributes);
+#else
 		fs::directory_iterator endTter;
 		for ( fs::directory_iterator dirIter (dirPath);
 			dirIter != endTter;
@@ -88,16 +417,31 @@ namespace ahttp {
 				WebDirectoryItem item;
 
 				item.name = dirIter->path().leaf();
+
+#if defined (WIN32)
 				item.lastWriteTime = fs::last_write_time (dirIter->path());
+				const bool isDirectory = fs::is_directory( dirIter->status() );
+				if (!isDirectory)
+					item.size = fs::file_size (dirIter->path());
+#else
+				// single stat call per item
+				struct stat itemStat;
+				if (::stat (dirIter->path().string().c_str(), &itemStat) != 0)
+					throw std::runtime_error ("Item status loading failed: " + item.name);
 
-				if ( fs::is_directory( dirIter->status() ) ) {
+				item.lastWriteTime = itemStat.st_mtime;
+				const bool isDirectory = S_ISDIR (itemStat.st_mode);
+				if (!isDirectory)
+					item.size = itemStat.st_size;
+#endif
+
+				if ( isDirectory ) {
 					item.type = WdDirectory;
 					item.url = dirVirtualPath + item.name + Slash;
 
 				} else  {
 					item.type = WdFile;
 					item.url = dirVirtualPath + item.name;
-					item.size = fs::file_size (dirIter->path());
 				}
 
 				items.push_back (item);
@@ -108,11 +452,25 @@ namespace ahttp {
 					typeid(ex).name(), ex.what());
 				++errCount;
 			}
-
-			if (sortType == WdSortByTypeAndName)
-				std::sort(items.begin(), items.end(), sortWdByTypeAndName);
 		}
+#endif
 
+		std::sort (items.begin() + firstItem, items.end(), 
+			sortType == WdSortByTypeAndName ? sortWdByTypeAndName : sortWdByName);
 	}
 }}
 
+namespace ahttp
+{
+	void TargetStatus::clear ()
+	{
+#if defined (__linux__)
+		if (fd != -1)
+			::close (fd);
+#endif
+		resolved = exists = outside = isDirectory = false;
+		fd = -1;
+		size = 0;
+		modifyTime = 0;
+	}
+}
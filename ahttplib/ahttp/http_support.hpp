@@ -31,6 +31,7 @@ distribution.
 #include <boost/cstdint.hpp>
 
 #include "aconnect/types.hpp"
+#include "aconnect/time_util.hpp"
 #include "aconnect/logger.hpp"
 
 namespace ahttp 
@@ -72,6 +73,51 @@ namespace ahttp
 		WebDirectoryItem () : type (WdUnknown), size(-1), lastWriteTime(-1) { }
 	};
 
+	// request target status loaded by descriptor (see detail::openTarget)
+	struct TargetStatus
+	{
+		TargetStatus () : resolved (false), exists (false), outside (false), isDirectory (false), 
+			fd (-1), size (0), modifyTime (0) { }
+		~TargetStatus () {
+			clear ();
+		}
+		
+		// close descriptor, status must be loaded by path again
+		void clear ();
+
+		bool resolved;				// false - status was not loaded, file system must be checked by path
+		bool exists;
+		bool outside;				// path leaves directory root (".." or symbolic link)
+		bool isDirectory;
+		int fd;						// regular file opened for reading, -1 - not opened
+		boost::uintmax_t size;
+		std::time_t modifyTime;
+
+	private:
+		TargetStatus (const TargetStatus&);
+		TargetStatus& operator= (const TargetStatus&);
+	};
+
+	// request processing phases timestamps (see aconnect::util::getTimestamp),
+	// zero - phase was not reached
+	struct HttpRequestTimes
+	{
+		aconnect::util::timestamp_type	previousFinished;	// previous request on keep-alive connection completed
+		aconnect::util::timestamp_type	accepted;		// connection accepted (first request on connection only)
+		aconnect::util::timestamp_type	workerStarted;	// connection taken by worker thread
+		aconnect::util::timestamp_type	headerLoaded;
+		aconnect::util::timestamp_type	targetFound;	// request route resolved
+		aconnect::util::timestamp_type	handlerStarted;
+		aconnect::util::timestamp_type	handlerFinished;
+		aconnect::util::timestamp_type	finished;		// request processing completed
+
+		aconnect::util::timestamp_type	fileSystemTime;	// duration of file system lookups (exists/is_directory checks)
+
+		HttpRequestTimes () :
+			previousFinished (0), accepted (0), workerStarted (0), headerLoaded (0), targetFound (0),
+			handlerStarted (0), handlerFinished (0), finished (0), fileSystemTime (0) { }
+	};
+
 
 	namespace detail 
 	{
@@ -133,6 +179,8 @@ namespace ahttp
 		string_constant HeaderReferer = "Referer";
 		string_constant HeaderRetryAfter = "Retry-After";
 		string_constant HeaderServer = "Server";
+		string_constant HeaderServerTiming = "Server-Timing";
+		string_constant HeaderSetCookie = "Set-Cookie";
 		string_constant HeaderTE = "TE";
 		string_constant HeaderTrailer = "Trailer";
 		string_constant HeaderTransferEncoding = "Transfer-Encoding";
@@ -142,6 +190,10 @@ namespace ahttp
 		string_constant HeaderVia = "Via";
 		string_constant HeaderWarning = "Warning";
 		string_constant HeaderWWWAuthenticate = "WWW-Authenticate";
+		
+		// internal headers: set by handler to delegate file sending to server, not sent to client
+		string_constant HeaderXSendfile = "X-Sendfile";				// file system path
+		string_constant HeaderXAccelRedirect = "X-Accel-Redirect";	// virtual path
 
 		// HTTP headers values
 		string_constant ConnectionKeepAlive = "Keep-Alive";
@@ -150,6 +202,8 @@ namespace ahttp
 		string_constant ContentTypeTextHtml = "text/html";
 		string_constant ContentTypeOctetStream = "application/octet-stream";
 		string_constant ContentTypeMultipartFormData = "multipart/form-data";
+		string_constant ContentTypeMetrics = "text/plain; version=0.0.4";	// Prometheus text format
+		string_constant ContentTypeJson = "application/json";
 
 		string_constant ContentDispositionFormData = "form-data";
 		string_constant ContentDispositionAttachment = "attachment";
@@ -158,6 +212,17 @@ namespace ahttp
 
 		string_constant CacheControlNoCache = "no-cache";
 		string_constant CacheControlPrivate = "private";
+		string_constant CacheControlPublic = "public";
+		string_constant CacheControlNoStore = "no-store";
+		string_constant CacheControlMaxAge = "max-age";
+		string_constant CacheControlSharedMaxAge = "s-maxage";
+		string_constant CacheControlStaleWhileRevalidate = "stale-while-revalidate";
+
+		string_constant VaryAny = "*";
+
+		string_constant RangeUnitBytes = "bytes";
+		string_constant ContentRangeFormat = "bytes %u-%u/%u";
+		string_constant ContentRangeUnsatisfiedFormat = "bytes */%u";
 		
 		//////////////////////////////////////////////////////////////////////////
 		//
@@ -168,6 +233,7 @@ namespace ahttp
 		string_constant ChunkHeaderFormat = "%x\r\n";
 		string_constant ChunkEndMark = "\r\n";
 		string_constant LastChunkFormat = "0\r\n\r\n";
+		string_constant LastChunkWithTrailerMark = "0\r\n";
 			
 		string_constant HttpVersion = "HTTP/1.1";
 		string_constant HeadersDelimiter = "\r\n";
@@ -180,6 +246,12 @@ namespace ahttp
 		string_constant MultipartBoundaryMark = "boundary=";
 		string_constant MultipartBoundaryPrefix = "--";
 
+		// directory listing query parameters: "?format=json&offset=0&limit=1000"
+		string_constant ListingFormatParam = "format";
+		string_constant ListingFormatJson = "json";
+		string_constant ListingOffsetParam = "offset";
+		string_constant ListingLimitParam = "limit";
+
 		//
 		//////////////////////////////////////////////////////////////////////////
 
@@ -192,11 +264,48 @@ namespace ahttp
 			std::vector<WebDirectoryItem> &items,
 			class aconnect::Logger& logger,
 			size_t &errCount,
-			WebDirectorySortType sortType = WdSortByName);
+			WebDirectorySortType sortType = WdSortByName,
+			bool loadAttributes = true);	// false - items size and time can be skipped
+
+#if defined (__linux__)
+		/*
+		*	Open "relativePath" beneath "rootFd" directory (openat2, RESOLVE_BENEATH) and load its status 
+		*	by descriptor. Returns false if status cannot be loaded this way (openat2 is not supported, 
+		*	access denied etc.) - path based checks must be used.
+		*/
+		bool openTarget (int rootFd, string_constref relativePath, TargetStatus& status);
+		
+		// O_PATH descriptor of directory, -1 on failure
+		int openDirectoryRoot (string_constref dirPath);
+#endif
+
+		/*
+		*	Check that "path" with symbolic links resolved is beneath "rootPath" - the same 
+		*	containment as openTarget provides, used when openat2 is not available.
+		*	Missing paths are accepted (nothing is served).
+		*/
+		bool resolvesInside (string_constref rootPath, string_constref path);
+
+		// append quoted and escaped JSON string
+		void appendJsonString (string& out, string_constptr value);
 
 		// sample: Sun, 06 Nov 1994 08:49:37 GMT  ; RFC 822, updated by RFC 1123
 		string formatDate_RFC1123 (const struct tm& dateTime);
 
+		enum ByteRangeParseResult
+		{
+			RangeIgnored,			// invalid or multiple ranges - whole content is sent
+			RangeSatisfiable,
+			RangeNotSatisfiable
+		};
+
+		/*
+		*	Parse single "Range: bytes=first-last" request header value,
+		*	supported forms: "first-last", "first-", "-suffixLength"
+		*/
+		ByteRangeParseResult parseByteRange (string_constref rangeHeader, size_t contentSize,
+			size_t& first, size_t& length);
+
 		inline string httpStatusDesc (int status) 
 		{
 			string desc;
@@ -0,0 +1,176 @@
+/*
+This file is part of [ahttp] library. 
+
+Author: Artem Kustikov (kustikoff[at]tut.by)
+version: 0.1
+
+This code is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this code.
+
+Permission is granted to anyone to use this code for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this code must not be misrepresented; you must
+not claim that you wrote the original code. If you use this
+code in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original code.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#include <string.h>
+#include <stdio.h>
+
+#include "aconnect/aconnect.hpp"
+#include "aconnect/util.hpp"
+
+#include "ahttp/http_tracer.hpp"
+#include "ahttp/http_server.hpp"
+
+namespace ahttp
+{
+	namespace detail
+	{
+		inline void copyTraceField (char* dest, size_t destSize, aconnect::string_constref src)
+		{
+			const size_t len = aconnect::util::min2 (src.size(), destSize - 1);
+			memcpy (dest, src.c_str(), len);
+			dest[len] = '\0';
+		}
+
+		// complete ("X") event, skipped when phase was not reached
+		void appendTraceEvent (aconnect::string& out, bool& firstEvent,
+			aconnect::string_constptr name, 
+			aconnect::util::timestamp_type from, aconnect::util::timestamp_type to,
+			const RequestTrace& trace)
+		{
+			if (!from || !to || to < from)
+				return;
+
+			char buff[128];
+			int cnt = snprintf (buff, sizeof (buff), 
+				"%s{\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%.0f,\"dur\":%.0f,\"name\":",
+				(firstEvent ? "" : ",\n"),
+				trace.threadId,
+				(double) from,
+				(double) (to - from));
+			out.append (buff, aconnect::util::min2 (cnt, (int) sizeof (buff) - 1));
+			firstEvent = false;
+
+			appendJsonString (out, name);
+			out += ",\"args\":{\"path\":";
+			appendJsonString (out, trace.path);
+			
+			cnt = snprintf (buff, sizeof (buff), ",\"status\":%d", trace.status);
+			out.append (buff, aconnect::util::min2 (cnt, (int) sizeof (buff) - 1));
+
+			if (trace.handler[0]) {
+				out += ",\"handler\":";
+				appendJsonString (out, trace.handler);
+			}
+			out += "}}";
+		}
+	}
+
+	RequestTracer::RequestTracer (size_t bufferSize) :
+		active_ (false),
+		sampleRate_ (1),
+		sequence_ (0),
+		traces_ (aconnect::util::max2 (bufferSize, (size_t) 1)),
+		nextIndex_ (0),
+		count_ (0)
+	{
+	}
+
+	void RequestTracer::start (long sampleRate)
+	{
+		boost::mutex::scoped_lock lock (mutex_);
+		sampleRate_ = aconnect::util::max2 (sampleRate, 1L);
+		nextIndex_ = 0;
+		count_ = 0;
+		active_ = true;
+	}
+
+	void RequestTracer::stop ()
+	{
+		active_ = false;
+	}
+
+	void RequestTracer::record (const HttpContext& context)
+	{
+		if (!active_)
+			return;
+
+		if (sampleRate_ > 1 && (++sequence_ % sampleRate_) != 0)
+			return;
+
+		RequestTrace trace;
+		const HttpRequestTimes& times = context.Times;
+
+		trace.previousFinished = times.previousFinished;
+		trace.accepted = times.accepted;
+		trace.workerStarted = times.workerStarted;
+		trace.headerLoaded = times.headerLoaded;
+		trace.targetFound = times.targetFound;
+		trace.handlerStarted = times.handlerStarted;
+		trace.handlerFinished = times.handlerFinished;
+		trace.firstByte = context.Response.Stream.firstByteTime();
+		trace.lastByte = context.Response.Stream.lastByteTime();
+		trace.finished = times.finished;
+
+		trace.threadId = aconnect::util::getCurrentThreadId();
+		trace.status = context.Response.Header.Status;
+		detail::copyTraceField (trace.path, RequestTrace::PathSize, context.RequestHeader.Path);
+		detail::copyTraceField (trace.handler, RequestTrace::HandlerSize, 
+			context.Handler ? context.Handler->name : aconnect::string());
+
+		boost::mutex::scoped_lock lock (mutex_);
+		traces_[nextIndex_] = trace;
+		nextIndex_ = (nextIndex_ + 1) % traces_.size();
+		if (count_ < traces_.size())
+			++count_;
+	}
+
+	void RequestTracer::formatTrace (aconnect::string& out, const RequestTrace& trace, bool& firstEvent)
+	{
+		const aconnect::util::timestamp_type started = 
+			trace.accepted ? trace.accepted : trace.workerStarted;
+
+		detail::appendTraceEvent (out, firstEvent, "request", started, trace.finished, trace);
+		detail::appendTraceEvent (out, firstEvent, "connection idle", trace.previousFinished, trace.headerLoaded, trace);
+		detail::appendTraceEvent (out, firstEvent, "accept queue", trace.accepted, trace.workerStarted, trace);
+		detail::appendTraceEvent (out, firstEvent, "read header", trace.accepted ? trace.workerStarted : 0, trace.headerLoaded, trace);
+		detail::appendTraceEvent (out, firstEvent, "route", trace.headerLoaded, trace.targetFound, trace);
+		detail::appendTraceEvent (out, firstEvent, "handler", trace.handlerStarted, trace.handlerFinished, trace);
+		detail::appendTraceEvent (out, firstEvent, "send", trace.firstByte, trace.lastByte, trace);
+	}
+
+	aconnect::string RequestTracer::formatChromeTrace ()
+	{
+		std::vector<RequestTrace> traces;
+		{
+			boost::mutex::scoped_lock lock (mutex_);
+			traces.reserve (count_);
+
+			const size_t first = (count_ < traces_.size() ? 0 : nextIndex_);
+			for (size_t ndx = 0; ndx < count_; ++ndx)
+				traces.push_back (traces_[(first + ndx) % traces_.size()]);
+		}
+
+		aconnect::string out = "{\"traceEvents\":[\n";
+		bool firstEvent = true;
+
+		for (std::vector<RequestTrace>::const_iterator it = traces.begin(); it != traces.end(); ++it)
+			formatTrace (out, *it, firstEvent);
+
+		out += "\n],\"displayTimeUnit\":\"ms\"}\n";
+		return out;
+	}
+}
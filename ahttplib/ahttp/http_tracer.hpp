@@ -0,0 +1,110 @@
+/*
+This file is part of [ahttp] library. 
+
+Author: Artem Kustikov (kustikoff[at]tut.by)
+version: 0.1
+
+This code is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this code.
+
+Permission is granted to anyone to use this code for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this code must not be misrepresented; you must
+not claim that you wrote the original code. If you use this
+code in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original code.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#ifndef AHTTP_TRACER_H
+#define AHTTP_TRACER_H
+#pragma once
+
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+#include <boost/detail/atomic_count.hpp>
+
+#include "aconnect/types.hpp"
+#include "aconnect/time_util.hpp"
+
+namespace ahttp
+{
+	namespace defaults
+	{
+		const size_t TraceBufferSize			= 4096;	// traces count
+	}
+
+	// request phases timestamps copy, zero - phase was not reached
+	struct RequestTrace
+	{
+		enum Sizes
+		{
+			PathSize = 128,
+			HandlerSize = 16
+		};
+
+		aconnect::util::timestamp_type previousFinished;	// keep-alive connection idle start
+		aconnect::util::timestamp_type accepted;
+		aconnect::util::timestamp_type workerStarted;
+		aconnect::util::timestamp_type headerLoaded;
+		aconnect::util::timestamp_type targetFound;
+		aconnect::util::timestamp_type handlerStarted;
+		aconnect::util::timestamp_type handlerFinished;
+		aconnect::util::timestamp_type firstByte;
+		aconnect::util::timestamp_type lastByte;
+		aconnect::util::timestamp_type finished;
+
+		unsigned long threadId;
+		int status;
+		char path[PathSize];
+		char handler[HandlerSize];
+	};
+
+	/**
+	*	Sampled requests tracer: when started, each N-th request phases timestamps 
+	*	are stored in ring buffer and can be exported in Chrome trace-event JSON format
+	*	(chrome://tracing, Perfetto). Does nothing when stopped.
+	*/
+	class RequestTracer : private boost::noncopyable
+	{
+	public:
+		RequestTracer (size_t bufferSize = defaults::TraceBufferSize);
+
+		// trace each "sampleRate"-th request, previously collected traces are cleared
+		void start (long sampleRate = 1);
+		void stop ();
+
+		inline bool isActive () const		{	return active_;		}
+
+		void record (const class HttpContext& context);
+
+		// {"traceEvents":[...]} document, traces are ordered from oldest to newest
+		aconnect::string formatChromeTrace ();
+
+	protected:
+		static void formatTrace (aconnect::string& out, const RequestTrace& trace, bool& firstEvent);
+
+	protected:
+		volatile bool active_;
+		long sampleRate_;
+		boost::detail::atomic_count sequence_;
+
+		boost::mutex mutex_;
+		std::vector<RequestTrace> traces_;
+		size_t nextIndex_;
+		size_t count_;
+	};
+}
+
+#endif // AHTTP_TRACER_H
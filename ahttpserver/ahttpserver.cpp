@@ -1,11 +1,13 @@
 #include "aconnect/boost_format_safe.hpp"
 
 #include <iostream>
+#include <fstream>
 #include <assert.h>
 
 #include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/timer.hpp>
 
 
@@ -18,6 +20,7 @@
 // aconnect
 #include "ahttplib.hpp"
 #include "aconnect/util.hpp"
+#include "ahttp/http_access_log.hpp"
 
 #include "constants.hpp"
 
@@ -32,8 +35,10 @@ namespace Global
 	
 	ahttp::HttpServerSettings globalSettings;
 	aconnect::FileLogger logger;
+	ahttp::AccessLog accessLog;
 	aconnect::Server httpServer;
 	aconnect::Server commandServer;
+	aconnect::Server metricsServer;
 }
 
 // declarations
@@ -48,6 +53,7 @@ aconnect::socket_type findRunningServer();
 void processCommand (const aconnect::ClientInfo& client);
 void sendCommand (const aconnect::socket_type sock, aconnect::string_constref command);
 void processServerCommand (aconnect::string command);
+int decodeAccessLog (aconnect::string_constptr filePath);
 
 // definitions
 void init (aconnect::string_constptr relativeAppPath) 
@@ -85,8 +91,11 @@ void init (aconnect::string_constptr relativeAppPath)
 void destroy () 
 {
 	try {
-		// force stop
-		Global::httpServer.stop();
+		// handlers are destroyed below - wait for workers completion
+		Global::httpServer.stop (true);
+		Global::metricsServer.stop (true);
+
+		Global::globalSettings.destroyHandlers ();
 
         // unload socket library
 		aconnect::Initializer::destroy ();
@@ -95,6 +104,9 @@ void destroy ()
 		std::cerr << ex.what() << std::endl;
 		Global::logger.error(ex);
 	}
+
+	// write buffered access log records
+	Global::accessLog.destroy ();
     
 	// close logger
     Global::logger.info ( "Server stopped" );
@@ -146,6 +158,25 @@ void initLogger () {
 		logger.init (globalSettings.logLevel(), logFileTemplate.c_str(), globalSettings.maxLogFileSize());
 		logger.info ( "Server started" );
 
+		// init access log
+		if (globalSettings.isAccessLogEnabled()) 
+		{
+			string accessLogFileTemplate = globalSettings.accessLogFileTemplate();
+			Global::globalSettings.updateAppLocationInPath (accessLogFileTemplate);
+
+			fs::path accessLogFilesDir = fs::path (accessLogFileTemplate, fs::native).branch_path();
+			if (!fs::exists (accessLogFilesDir))
+				fs::create_directories(accessLogFilesDir);
+
+			accessLog.init (globalSettings.accessLogFormat(), 
+				accessLogFileTemplate,
+				globalSettings.accessLogBufferSize(),
+				globalSettings.accessLogFlushInterval(),
+				globalSettings.maxAccessLogFileSize());
+
+			globalSettings.setAccessLog (&accessLog);
+		}
+
 	} catch (std::exception &ex) {
 		processException (ex.what(), ReturnCodes::LoggerSetupFailed);
 	}
@@ -217,10 +248,43 @@ void processCommand (const aconnect::ClientInfo& client)
 				Settings::StatisticsFormat,
 				(long) ahttp::HttpServer::RequestsCount,
 				(long) Global::httpServer.currentWorkersCount(),
-				(long) Global::httpServer.currentPendingWorkersCount());
+				(long) Global::httpServer.currentPendingWorkersCount(),
+				Global::accessLog.writtenCount(),
+				Global::accessLog.droppedCount());
 			
 			response.append (buff, util::min2(formattedCount, buffSize));
 		
+		} else if (util::equals (command, Settings::CommandStatLatency)) {
+			response = ahttp::HttpServer::Statistics.formatLatencyReport();
+
+		} else if (util::equals (command, Settings::CommandStatHandlers)) {
+			response = Global::globalSettings.formatHandlersStatistics();
+
+		} else if (algo::starts_with (command, Settings::CommandTraceStart)) {
+			long sampleRate = 1;
+			string param = algo::trim_copy (command.substr (strlen (Settings::CommandTraceStart)));
+			if (!param.empty()) {
+				try {
+					sampleRate = boost::lexical_cast<long> (param);
+				} catch (boost::bad_lexical_cast &) {
+					sampleRate = 0;
+				}
+			}
+
+			if (sampleRate < 1) {
+				response = "Invalid trace sample rate: " + param;
+			} else {
+				ahttp::HttpServer::Tracer.start (sampleRate);
+				response = "Tracing started, sample rate: " + boost::lexical_cast<string> (sampleRate);
+			}
+
+		} else if (util::equals (command, Settings::CommandTraceStop)) {
+			ahttp::HttpServer::Tracer.stop ();
+			response = ahttp::HttpServer::Tracer.formatChromeTrace();
+
+		} else if (util::equals (command, Settings::CommandTraceDump)) {
+			response = ahttp::HttpServer::Tracer.formatChromeTrace();
+
 		} else if (util::equals (command, Settings::CommandReload)) {
 
 			response = "Directories settings reloaded";
@@ -228,6 +292,8 @@ void processCommand (const aconnect::ClientInfo& client)
 			{
 				Global::httpServer.stop (true);
 				Global::globalSettings.load ( Global::settingsFilePath.c_str() );
+				// cached responses, listings and missing paths depend on directories settings
+				ahttp::HttpServer::resetCaches ();
 				Global::httpServer.start();
 
 			} catch (ahttp::settings_load_error &ex) {
@@ -316,6 +382,30 @@ void processServerCommand (aconnect::string command)
 	}
 }
 
+int decodeAccessLog (aconnect::string_constptr filePath)
+{
+	if (aconnect::util::isNullOrEmpty (filePath)) {
+		std::cerr << "Access log file path is not specified" << std::endl;
+		return ReturnCodes::AccessLogDecodeFailed;
+	}
+
+	std::ifstream input (filePath, std::ios::in | std::ios::binary);
+	if (input.fail()) {
+		std::cerr << "Cannot open access log file: " << filePath << std::endl;
+		return ReturnCodes::AccessLogDecodeFailed;
+	}
+
+	try {
+		ahttp::AccessLog::decode (input, std::cout);
+
+	} catch (std::exception &ex) {
+		std::cerr << "Access log decoding failed: " << ex.what() << std::endl;
+		return ReturnCodes::AccessLogDecodeFailed;
+	}
+
+	return ReturnCodes::Success;
+}
+
 //////////////////////////////////////////////////////////////////////////
 //		Entry point
 //////////////////////////////////////////////////////////////////////////
@@ -324,6 +414,10 @@ int main (int argc, char* args[])
 	using namespace aconnect;
 	namespace fs = boost::filesystem;
 
+	// offline tool - does not require settings and server
+	if (argc > 1 && util::equals (Settings::CommandDecodeLog, args[1]))
+		return decodeAccessLog (argc > 2 ? args[2] : NULL);
+
 	init (args[0]);
 	
 	boost::timer loadTimer;
@@ -336,8 +430,12 @@ int main (int argc, char* args[])
 	settingsLoadTime = loadTimer.elapsed(); loadTimer.restart();
 
 	string command = Settings::CommandStat;
-	if (argc > 1) 
+	if (argc > 1) {
+		// multi-word commands: "trace start 10"
 		command = args[1];
+		for (int ndx = 2; ndx < argc; ++ndx)
+			command += string (" ") + args[ndx];
+	}
 	
 #if !defined (WIN32)
 	if (util::equals (Settings::CommandStart, command))
@@ -358,11 +456,13 @@ int main (int argc, char* args[])
 	loggerInitTime = loadTimer.elapsed(); loadTimer.restart();
 
 	Global::globalSettings.setLogger ( &Global::logger);
-	ahttp::HttpServer::setGlobalSettings ( &Global::globalSettings);
 
+	// handlers can fork processes - they are initialized before server caches start watcher threads
 	initHandlers ();
 	handlersInitTime = loadTimer.elapsed(); loadTimer.restart();
 
+	ahttp::HttpServer::setGlobalSettings ( &Global::globalSettings);
+
 	// init HTTP server (in child thread)
 	Global::httpServer.setLog ( &Global::logger);
 	Global::httpServer.init (Global::globalSettings.port(), 
@@ -370,6 +470,19 @@ int main (int argc, char* args[])
 		Global::globalSettings.serverSettings());
 	
 	Global::httpServer.setErrorProcessProc (ahttp::HttpServer::processWorkerCreationError);
+	ahttp::HttpServer::setServer (&Global::httpServer);
+
+	// init metrics server - OPTIONAL, metrics requests are served on main port by default
+	const bool useMetricsServer = Global::globalSettings.isMetricsEnabled() 
+		&& Global::globalSettings.metricsPort() != 0;
+
+	if (useMetricsServer) {
+		Global::metricsServer.setLog ( &Global::logger);
+		Global::metricsServer.init (Global::globalSettings.metricsPort(), 
+			ahttp::HttpServer::processConnection, 
+			Global::globalSettings.serverSettings());
+		Global::metricsServer.setErrorProcessProc (ahttp::HttpServer::processWorkerCreationError);
+	}
 
 	// init command server
 	ServerSettings cmdServerSettings;
@@ -385,6 +498,8 @@ int main (int argc, char* args[])
 		util::detachFromConsole ();	
 
 		Global::httpServer.start();
+		if (useMetricsServer)
+			Global::metricsServer.start();
 		serverStartupTime = loadTimer.elapsed(); loadTimer.restart();
 
 		// write timing
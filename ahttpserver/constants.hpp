@@ -10,6 +10,7 @@ namespace ReturnCodes
 	const int SettingsLoadFailed = 2;
 	const int LoggerSetupFailed = 3;
 	const int ServerStartupFailed = 4;
+	const int AccessLogDecodeFailed = 5;
 	const int ForceStopped = 10;
 }
 
@@ -21,17 +22,30 @@ namespace Settings
 		"ahttpserver commands: \r\n"
 		"- to start server run \"ahttpserver start\"\r\n"
 		"- to stop server run \"ahttpserver stop\"\r\n"
-		"- to get statistics run \"ahttpserver stat\"\r\n";
+		"- to get statistics run \"ahttpserver stat\"\r\n"
+		"- to get latency percentiles run \"ahttpserver stat-latency\"\r\n"
+		"- to get handlers statistics run \"ahttpserver stat-handlers\"\r\n"
+		"- to trace requests run \"ahttpserver trace start [sample-rate]\", \"ahttpserver trace dump\", \"ahttpserver trace stop\"\r\n"
+		"  (Chrome trace-event JSON is returned by 'dump' and 'stop')\r\n"
+		"- to decode binary access log run \"ahttpserver decode-log <file>\"\r\n";
 	const aconnect::string_constant StatisticsFormat = 
 		"ahttpserver statistics\r\nprocessed requests count: %d\r\n"
 		"worker threads count: %d\r\n"
-		"pending threads count: %d\r\n";
+		"pending threads count: %d\r\n"
+		"access log records written: %d\r\n"
+		"access log records dropped: %d\r\n";
 
 	const aconnect::string_constant CommandStat = "stat";
+	const aconnect::string_constant CommandStatLatency = "stat-latency";
+	const aconnect::string_constant CommandStatHandlers = "stat-handlers";
 	const aconnect::string_constant CommandStart = "start";
 	const aconnect::string_constant CommandRun = "run";
 	const aconnect::string_constant CommandStop = "stop";
 	const aconnect::string_constant CommandReload = "reload";
+	const aconnect::string_constant CommandDecodeLog = "decode-log";
+	const aconnect::string_constant CommandTraceStart = "trace start";
+	const aconnect::string_constant CommandTraceStop = "trace stop";
+	const aconnect::string_constant CommandTraceDump = "trace dump";
 	const aconnect::string_constant CommandUnknown = "unknown";
 	
 	const aconnect::string_constant BreakLine = "----------------------------------------------------------------";
@@ -0,0 +1,280 @@
+
+#include <assert.h>
+#include <string.h>
+#include <boost/lexical_cast.hpp>
+
+#if !defined (WIN32)
+#	include <sys/un.h>
+#endif
+
+#include "aconnect/network.hpp"
+#include "aconnect/util.hpp"
+#include "aconnect/time_util.hpp"
+
+#include "backend_pool.hpp"
+
+namespace
+{
+	aconnect::string_constant UnixSocketPrefix = "unix:";
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	BackendAddress
+bool BackendAddress::parse (aconnect::string_constref address)
+{
+	using aconnect::string;
+
+	if (address.compare (0, sizeof (UnixSocketPrefix) - 1, UnixSocketPrefix) == 0) {
+#if defined (WIN32)
+		return false;
+#else
+		isUnixSocket = true;
+		path = address.substr (sizeof (UnixSocketPrefix) - 1);
+		return !path.empty() && path.size() < sizeof (((sockaddr_un*) 0)->sun_path);
+#endif
+	}
+
+	const size_t pos = address.rfind (':');
+	if (pos == string::npos || pos == 0)
+		return false;
+
+	isUnixSocket = false;
+	host = address.substr (0, pos);
+	try {
+		port = boost::lexical_cast<int> (address.substr (pos + 1));
+	} catch (boost::bad_lexical_cast &) {
+		return false;
+	}
+
+	return port > 0 && port <= 0xFFFF;
+}
+
+aconnect::string BackendAddress::toString () const
+{
+	if (isUnixSocket)
+		return UnixSocketPrefix + path;
+
+	return host + ":" + boost::lexical_cast<aconnect::string> (port);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	Backend
+Backend::Backend (const BackendAddress& address, size_t maxConnections, int ioTimeout) :
+	address_ (address),
+	maxConnections_ (maxConnections),
+	ioTimeout_ (ioTimeout),
+	busyCount_ (0),
+	requestsCount_ (0),
+	connectionsCount_ (0),
+	failuresCount_ (0),
+	rejectedCount_ (0)
+{
+	assert (maxConnections > 0);
+}
+
+Backend::~Backend ()
+{
+	closeIdleConnections ();
+}
+
+aconnect::socket_type Backend::lease (int timeoutSec, bool& reused) throw (aconnect::socket_error)
+{
+	using namespace aconnect;
+
+	const util::timestamp_type deadline = util::getTimestamp() + (util::timestamp_type) timeoutSec * 1000000;
+	reused = false;
+
+	{
+		boost::mutex::scoped_lock lock (mutex_);
+
+		while (true)
+		{
+			while (!idle_.empty())
+			{
+				socket_type s = idle_.back();
+				idle_.pop_back();
+
+				if (isIdleConnectionAlive (s)) {
+					++busyCount_;
+					++requestsCount_;
+					reused = true;
+					return s;
+				}
+				closeConnection (s);
+			}
+
+			if (busyCount_ < maxConnections_)
+				break;
+
+			if (util::getTimestamp() >= deadline) {
+				if (timeoutSec > 0)
+					++rejectedCount_;
+				return INVALID_SOCKET;
+			}
+
+			freeCondition_.timed_wait (lock, util::createTimePeriod (1));
+		}
+
+		// connection slot is reserved before connecting (outside of lock)
+		++busyCount_;
+		++requestsCount_;
+	}
+
+	try {
+		socket_type s = connect ();
+
+		boost::mutex::scoped_lock lock (mutex_);
+		++connectionsCount_;
+		return s;
+
+	} catch (...) {
+		{
+			boost::mutex::scoped_lock lock (mutex_);
+			--busyCount_;
+			++failuresCount_;
+		}
+		freeCondition_.notify_one ();
+		throw;
+	}
+}
+
+void Backend::release (aconnect::socket_type s, bool reusable)
+{
+	{
+		boost::mutex::scoped_lock lock (mutex_);
+		assert (busyCount_ > 0);
+		--busyCount_;
+
+		if (reusable) {
+			idle_.push_back (s);
+			s = INVALID_SOCKET;
+		}
+	}
+
+	if (s != INVALID_SOCKET)
+		closeConnection (s);
+
+	freeCondition_.notify_one ();
+}
+
+void Backend::closeIdleConnections ()
+{
+	std::vector<aconnect::socket_type> idle;
+	{
+		boost::mutex::scoped_lock lock (mutex_);
+		idle.swap (idle_);
+	}
+
+	for (size_t ndx = 0; ndx < idle.size(); ++ndx)
+		closeConnection (idle[ndx]);
+}
+
+void Backend::registerFailure ()
+{
+	boost::mutex::scoped_lock lock (mutex_);
+	++failuresCount_;
+}
+
+void Backend::stats (aconnect::string& output)
+{
+	using boost::lexical_cast;
+	using aconnect::string;
+
+	const string prefix = "backend[" + address_.toString() + "].";
+
+	boost::mutex::scoped_lock lock (mutex_);
+
+	output += prefix + "busy: " + lexical_cast<string> (busyCount_) + "\r\n";
+	output += prefix + "idle: " + lexical_cast<string> (idle_.size()) + "\r\n";
+	output += prefix + "max-connections: " + lexical_cast<string> (maxConnections_) + "\r\n";
+	output += prefix + "requests: " + lexical_cast<string> (requestsCount_) + "\r\n";
+	output += prefix + "connections: " + lexical_cast<string> (connectionsCount_) + "\r\n";
+	output += prefix + "failures: " + lexical_cast<string> (failuresCount_) + "\r\n";
+	output += prefix + "rejected: " + lexical_cast<string> (rejectedCount_) + "\r\n";
+}
+
+aconnect::socket_type Backend::connect () throw (aconnect::socket_error)
+{
+	using namespace aconnect;
+
+	socket_type s = INVALID_SOCKET;
+	int res = 0;
+
+#if !defined (WIN32)
+	if (address_.isUnixSocket)
+	{
+		struct sockaddr_un addr;
+		util::zeroMemory (&addr, sizeof (addr));
+		addr.sun_family = AF_UNIX;
+		strncpy (addr.sun_path, address_.path.c_str(), sizeof (addr.sun_path) - 1);
+
+		s = util::createSocket (AF_UNIX, SOCK_STREAM);
+		res = ::connect (s, (sockaddr*) &addr, sizeof (addr));
+	}
+	else
+#endif
+	{
+		struct sockaddr_in addr;
+		util::zeroMemory (&addr, sizeof (addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons ((unsigned short) address_.port);
+		addr.sin_addr.s_addr = inet_addr (address_.host.c_str());
+
+		if (addr.sin_addr.s_addr == INADDR_NONE) {
+			// host name is resolved on each connect to follow DNS changes
+			struct addrinfo hints, *info = NULL;
+			util::zeroMemory (&hints, sizeof (hints));
+			hints.ai_family = AF_INET;
+			hints.ai_socktype = SOCK_STREAM;
+
+			if (getaddrinfo (address_.host.c_str(), NULL, &hints, &info) != 0 || !info)
+				throw socket_error ("Backend host resolving failed: " + address_.host);
+
+			addr.sin_addr = ((sockaddr_in*) info->ai_addr)->sin_addr;
+			freeaddrinfo (info);
+		}
+
+		s = util::createSocket (AF_INET, SOCK_STREAM);
+		res = ::connect (s, (sockaddr*) &addr, sizeof (addr));
+	}
+
+	if (res != 0) {
+		socket_error err (s, ("Backend connection failed: " + address_.toString()).c_str());
+		closeConnection (s);
+		throw err;
+	}
+
+	try {
+		util::setSocketReadTimeout (s, ioTimeout_);
+		util::setSocketWriteTimeout (s, ioTimeout_);
+	} catch (...) {
+		closeConnection (s);
+		throw;
+	}
+
+	return s;
+}
+
+bool Backend::isIdleConnectionAlive (aconnect::socket_type s)
+{
+	fd_set readSet;
+	FD_ZERO (&readSet);
+	FD_SET (s, &readSet);
+
+	timeval timeout;
+	timeout.tv_sec = 0;
+	timeout.tv_usec = 0;
+
+	return (0 == select ((int) s + 1, &readSet, NULL, NULL, &timeout));
+}
+
+void Backend::closeConnection (aconnect::socket_type s)
+{
+	try {
+		aconnect::util::closeSocket (s);
+	} catch (aconnect::socket_error &) {
+		// connection is already broken
+	}
+}
@@ -0,0 +1,101 @@
+#ifndef FASTCGI_HANDLER_BACKEND_POOL_H
+#define FASTCGI_HANDLER_BACKEND_POOL_H
+
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+
+#include "aconnect/types.hpp"
+#include "aconnect/error.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	Backend address: "unix:/path/to/socket" (POSIX only) or "host:port"
+struct BackendAddress
+{
+	BackendAddress () : isUnixSocket (false), port (0) { }
+
+	// returns false if address format is invalid
+	bool parse (aconnect::string_constref address);
+	aconnect::string toString () const;
+
+	bool isUnixSocket;
+	aconnect::string path;
+	aconnect::string host;
+	int port;
+};
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	Persistent connections to one backend: idle connections are reused by the next
+//	requests, count of connections (busy + idle) is limited by backend concurrency limit
+class Backend : private boost::noncopyable
+{
+public:
+	Backend (const BackendAddress& address, size_t maxConnections, int ioTimeout);
+	~Backend ();
+
+	/*
+	*	Returns idle or new connection, INVALID_SOCKET if concurrency limit is reached
+	*	and no connection was released in "timeoutSec" (0 - do not wait).
+	*	Throws socket_error if backend connection failed.
+	*/
+	aconnect::socket_type lease (int timeoutSec, bool& reused) throw (aconnect::socket_error);
+	// "reusable" - request completed and backend keeps connection open
+	void release (aconnect::socket_type s, bool reusable);
+
+	void closeIdleConnections ();
+	void registerFailure ();
+
+	// "name: value\r\n" records
+	void stats (aconnect::string& output);
+
+	inline const BackendAddress& address () const	{	return address_;	}
+
+protected:
+	aconnect::socket_type connect () throw (aconnect::socket_error);
+	// idle connection closed by backend (or with unexpected data) is readable
+	static bool isIdleConnectionAlive (aconnect::socket_type s);
+	static void closeConnection (aconnect::socket_type s);
+
+	BackendAddress address_;
+	const size_t maxConnections_;
+	const int ioTimeout_;
+
+	boost::mutex mutex_;
+	boost::condition freeCondition_;
+	std::vector<aconnect::socket_type> idle_;
+	size_t busyCount_;
+
+	// statistics
+	size_t requestsCount_;
+	size_t connectionsCount_;
+	size_t failuresCount_;
+	size_t rejectedCount_;
+};
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	Leased backend connection: released as broken unless request is completed
+class BackendConnection : private boost::noncopyable
+{
+public:
+	BackendConnection (Backend& backend, aconnect::socket_type s) :
+		backend_ (backend), socket_ (s), reusable_ (false) { }
+	~BackendConnection () {
+		backend_.release (socket_, reusable_);
+	}
+
+	inline void complete (bool reusable)		{	reusable_ = reusable;	}
+	inline aconnect::socket_type socket () const	{	return socket_;			}
+	inline Backend& backend ()					{	return backend_;		}
+
+protected:
+	Backend& backend_;
+	aconnect::socket_type socket_;
+	bool reusable_;
+};
+
+#endif // FASTCGI_HANDLER_BACKEND_POOL_H
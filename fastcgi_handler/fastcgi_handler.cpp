@@ -0,0 +1,534 @@
+// fastcgi_handler.cpp : FastCGI/SCGI upstream handler (handler API v2)
+//
+
+#include <string.h>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "ahttplib.hpp"
+#include "aconnect/util.hpp"
+
+#include "protocol.hpp"
+#include "backend_pool.hpp"
+
+namespace algo = boost::algorithm;
+
+// constants
+
+const aconnect::string ProtocolParam = "protocol";				// "fastcgi" (default) or "scgi"
+const aconnect::string BackendsParam = "backends";				// "unix:/path/to/socket" or "host:port", comma separated
+const aconnect::string MaxConnectionsParam = "max-connections";	// per backend concurrency limit (persistent connections count)
+const aconnect::string WaitTimeoutParam = "wait-timeout";		// sec, 503 is returned when all backend connections are busy
+const aconnect::string IoTimeoutParam = "io-timeout";			// sec, backend socket read/write timeout
+const aconnect::string DocumentRootParam = "document-root";		// scripts root on backend side, server file path is sent by default
+const size_t DefaultMaxConnections = 8;
+const int DefaultWaitTimeout = 5;
+const int DefaultIoTimeout = 60;
+const int BodyChunkSize = 32 * 1024;		// request body chunk, FastCGI record content can't exceed 64K
+const int ReceiveBufferSize = 64 * 1024;
+
+aconnect::string_constant ProtocolFastCgi = "fastcgi";
+aconnect::string_constant ProtocolScgi = "scgi";
+aconnect::string_constant EnvironHeaderPrefix = "HTTP_";
+aconnect::string_constant DefaultServerName = "localhost";
+
+struct BackendExchange;
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	Forwards requests to FastCGI (PHP-FPM etc.) or SCGI backends. Backend connections are
+//	persistent (FastCGI FCGI_KEEP_CONN) and serve one request at a time, so per backend
+//	concurrency is limited by the pool size. Request body is streamed to backend as it is read
+//	from client, response is written to client as it arrives.
+class FastCgiHandler : public ahttp::IHttpHandler
+{
+public:
+	FastCgiHandler () :
+		globalSettings_ (NULL),
+		useScgi_ (false),
+		waitTimeout_ (DefaultWaitTimeout),
+		nextBackend_ (0) { }
+	virtual ~FastCgiHandler ();
+
+	virtual bool init (const aconnect::str2str_map& params, ahttp::HttpServerSettings* globalSettings);
+	virtual void threadInit ();
+	virtual bool process (ahttp::HttpContext& context);
+	virtual void shutdown ();
+	virtual void stats (aconnect::string& output);
+
+protected:
+	void fillParams (aconnect::str2str_map& params, const ahttp::HttpContext& context);
+
+	// round-robin over backends: free connection of any backend is preferred,
+	// returns INVALID_SOCKET when all are busy during wait timeout
+	aconnect::socket_type leaseConnection (Backend*& backend, bool& reused, ahttp::HttpContext& context);
+
+	// request body is sent in chunks, pending backend output is read between them -
+	// backend can start response before the whole body is sent
+	void sendBody (BackendExchange& exchange) throw (backend_error);
+
+	// returns false when response is completed
+	bool receiveResponse (BackendExchange& exchange) throw (backend_error);
+	bool processFastCgiRecords (BackendExchange& exchange) throw (backend_error);
+
+	static void sendToBackend (aconnect::socket_type s, aconnect::string_constref data) throw (backend_error);
+	static bool isDataAvailable (aconnect::socket_type s);
+
+	ahttp::HttpServerSettings* globalSettings_;
+	std::vector<Backend*> backends_;
+	bool useScgi_;
+	int waitTimeout_;
+	aconnect::string documentRoot_;
+
+	boost::mutex mutex_;
+	size_t nextBackend_;
+
+	// ReceiveBufferSize bytes per worker thread - too large for request arena block
+	boost::thread_specific_ptr<std::vector<aconnect::char_type> > receiveBuffer_;
+};
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	Request exchange with backend over leased connection
+struct BackendExchange
+{
+	BackendExchange (ahttp::HttpContext& httpContext, aconnect::socket_type s, aconnect::string_ptr buffer) :
+		context (httpContext), response (httpContext), socket (s), buff (buffer),
+		completed (false), reusable (false) { }
+
+	ahttp::HttpContext& context;
+	CgiResponseWriter response;
+	aconnect::socket_type socket;
+	aconnect::string_ptr buff;	// ReceiveBufferSize bytes: request body chunks and backend output
+	aconnect::string inbound;	// unprocessed FastCGI records
+	bool completed;
+	bool reusable;				// backend keeps connection open after request
+};
+
+
+/*
+*	Handler factory
+*/
+HANDLER_EXPORT ahttp::IHttpHandler* createHandler (int apiVersion)
+{
+	if (apiVersion != ahttp::HandlerApiVersion)
+		return NULL;
+
+	return new FastCgiHandler ();
+}
+
+
+FastCgiHandler::~FastCgiHandler ()
+{
+	for (size_t ndx = 0; ndx < backends_.size(); ++ndx)
+		delete backends_[ndx];
+}
+
+bool FastCgiHandler::init (const aconnect::str2str_map& params, ahttp::HttpServerSettings* globalSettings)
+{
+	using namespace aconnect;
+
+	assert (globalSettings);
+	assert (globalSettings->logger());
+
+	globalSettings_ = globalSettings;
+
+	size_t maxConnections = DefaultMaxConnections;
+	int ioTimeout = DefaultIoTimeout;
+
+	str2str_map::const_iterator it = params.find (ProtocolParam);
+	if (it != params.end()) {
+		if (util::equals (it->second, ProtocolScgi)) {
+			useScgi_ = true;
+		} else if (!util::equals (it->second, ProtocolFastCgi)) {
+			globalSettings->logger()->error ("Invalid '%s' parameter value: %s",
+				ProtocolParam.c_str(), it->second.c_str() );
+			return false;
+		}
+	}
+
+	try
+	{
+		it = params.find (MaxConnectionsParam);
+		if (it != params.end())
+			maxConnections = boost::lexical_cast<size_t> (it->second);
+
+		it = params.find (WaitTimeoutParam);
+		if (it != params.end())
+			waitTimeout_ = boost::lexical_cast<int> (it->second);
+
+		it = params.find (IoTimeoutParam);
+		if (it != params.end())
+			ioTimeout = boost::lexical_cast<int> (it->second);
+
+	} catch (boost::bad_lexical_cast &) {
+		globalSettings->logger()->error ("Invalid '%s' parameter value: %s",
+			it->first.c_str(), it->second.c_str() );
+		return false;
+	}
+
+	if (maxConnections == 0)
+		maxConnections = DefaultMaxConnections;
+
+	it = params.find (DocumentRootParam);
+	if (it != params.end())
+		documentRoot_ = algo::trim_right_copy_if (it->second, algo::is_any_of ("/\\"));
+
+	it = params.find (BackendsParam);
+	if (it == params.end()) {
+		globalSettings->logger()->error ("Mandatory parameter '%s' is absent", BackendsParam.c_str() );
+		return false;
+	}
+
+	std::vector<string> addresses;
+	algo::split (addresses, it->second, algo::is_any_of (", \t"), algo::token_compress_on);
+
+	for (size_t ndx = 0; ndx < addresses.size(); ++ndx)
+	{
+		if (addresses[ndx].empty())
+			continue;
+
+		BackendAddress address;
+		if (!address.parse (addresses[ndx])) {
+			globalSettings->logger()->error ("Invalid backend address: %s, "
+				"\"unix:/path/to/socket\" or \"host:port\" expected", addresses[ndx].c_str() );
+			return false;
+		}
+
+		backends_.push_back (new Backend (address, maxConnections, ioTimeout));
+	}
+
+	if (backends_.empty()) {
+		globalSettings->logger()->error ("Parameter '%s' does not contain backend addresses", BackendsParam.c_str() );
+		return false;
+	}
+
+	return true;
+}
+
+void FastCgiHandler::threadInit ()
+{
+	if (!receiveBuffer_.get())
+		receiveBuffer_.reset (new std::vector<aconnect::char_type> (ReceiveBufferSize));
+}
+
+bool FastCgiHandler::process (ahttp::HttpContext& context)
+{
+	using namespace aconnect;
+	using ahttp::HttpServer;
+
+	str2str_map params;
+	fillParams (params, context);
+
+	string requestHeader;
+	if (useScgi_) {
+		scgi::appendRequestHeader (requestHeader, params);
+	} else {
+		fcgi::appendBeginRequest (requestHeader, fcgi::ConnectionRequestId, true);
+		fcgi::appendParams (requestHeader, fcgi::ConnectionRequestId, params);
+	}
+
+	// allocated by threadInit
+	string_ptr buff = &(*receiveBuffer_)[0];
+
+	for (int attempt = 0; ; ++attempt)
+	{
+		Backend *backend = NULL;
+		bool reused = false;
+
+		socket_type s = leaseConnection (backend, reused, context);
+		if (s == INVALID_SOCKET) {
+			context.Log->warn ("All backend connections are busy, request rejected: %s", context.VirtualPath.c_str());
+			HttpServer::processServerError (context, 503);
+			return true;
+		}
+
+		BackendConnection connection (*backend, s);
+		BackendExchange exchange (context, s, buff);
+
+		try
+		{
+			try {
+				sendToBackend (s, requestHeader);
+			} catch (backend_error const &) {
+				// idle connection could be closed by backend after liveness check
+				if (reused && attempt == 0)
+					continue;
+				throw;
+			}
+
+			sendBody (exchange);
+
+			while (receiveResponse (exchange))
+				;
+
+			exchange.response.finish ();
+			connection.complete (exchange.reusable);
+
+		} catch (backend_error const &ex) {
+			backend->registerFailure ();
+			context.Log->error ("Backend %s request failed: %s",
+				backend->address().toString().c_str(), ex.what());
+
+			if (!exchange.response.isContentStarted())
+				HttpServer::processServerError (context, 502);
+			else
+				context.Response.abort (); // truncated content must not look complete
+		}
+
+		return true;
+	}
+}
+
+void FastCgiHandler::shutdown ()
+{
+	for (size_t ndx = 0; ndx < backends_.size(); ++ndx)
+		backends_[ndx]->closeIdleConnections ();
+}
+
+void FastCgiHandler::stats (aconnect::string& output)
+{
+	output += "protocol: ";
+	output += (useScgi_ ? ProtocolScgi : ProtocolFastCgi);
+	output += "\r\n";
+
+	for (size_t ndx = 0; ndx < backends_.size(); ++ndx)
+		backends_[ndx]->stats (output);
+}
+
+void FastCgiHandler::fillParams (aconnect::str2str_map& params, const ahttp::HttpContext& context)
+{
+	using namespace aconnect;
+	using boost::lexical_cast;
+
+	const ahttp::HttpRequestHeader& header = context.RequestHeader;
+
+	string queryString;
+	size_t pos = header.Path.find ('?');
+	if (pos != string::npos)
+		queryString = header.Path.substr (pos + 1);
+
+	string serverName = header.getHeader (ahttp::detail::HeaderHost);
+	if ((pos = serverName.find (':')) != string::npos)
+		serverName.erase (pos);
+	if (serverName.empty())
+		serverName = DefaultServerName;
+
+	params["GATEWAY_INTERFACE"] = "CGI/1.1";
+	params["SERVER_SOFTWARE"] = globalSettings_->serverVersion();
+	params["REQUEST_METHOD"] = header.Method;
+	params["REQUEST_URI"] = header.Path;
+	params["SCRIPT_NAME"] = context.VirtualPath;
+	params["PATH_INFO"] = "";
+	params["QUERY_STRING"] = queryString;
+	params["SERVER_NAME"] = serverName;
+	params["SERVER_PORT"] = lexical_cast<string> (context.Client->server->port());
+	params["SERVER_PROTOCOL"] = "HTTP/" + lexical_cast<string> (header.VersionHigh)
+		+ "." + lexical_cast<string> (header.VersionLow);
+	params["REMOTE_ADDR"] = util::formatIpAddr (context.Client->ip);
+	params["REMOTE_PORT"] = lexical_cast<string> (context.Client->port);
+	// PHP (cgi.force_redirect) rejects requests without it
+	params["REDIRECT_STATUS"] = "200";
+
+	if (documentRoot_.empty()) {
+		params["SCRIPT_FILENAME"] = context.FileSystemPath.string();
+	} else {
+		params["DOCUMENT_ROOT"] = documentRoot_;
+		params["SCRIPT_FILENAME"] = documentRoot_ + context.VirtualPath;
+	}
+
+	for (str2str_map::const_iterator it = header.Headers.begin(); it != header.Headers.end(); ++it)
+	{
+		if (algo::iequals (it->first, ahttp::detail::HeaderContentType)) {
+			params["CONTENT_TYPE"] = it->second;
+
+		} else if (algo::iequals (it->first, ahttp::detail::HeaderContentLength)) {
+			params["CONTENT_LENGTH"] = it->second;
+
+		} else if (algo::iequals (it->first, "Proxy")) {
+			// HTTP_PROXY is used by backend HTTP clients as proxy setting ("httpoxy")
+			continue;
+
+		} else {
+			string name = EnvironHeaderPrefix + algo::to_upper_copy (it->first);
+			algo::replace_all (name, "-", "_");
+			params[name] = it->second;
+		}
+	}
+}
+
+aconnect::socket_type FastCgiHandler::leaseConnection (Backend*& backend, bool& reused,
+													   ahttp::HttpContext& context)
+{
+	using namespace aconnect;
+
+	size_t first = 0;
+	{
+		boost::mutex::scoped_lock lock (mutex_);
+		first = nextBackend_++ % backends_.size();
+	}
+
+	// pass 0: connections available without waiting, pass 1: wait for the first alive backend
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		for (size_t ndx = 0; ndx < backends_.size(); ++ndx)
+		{
+			backend = backends_[(first + ndx) % backends_.size()];
+			try {
+				socket_type s = backend->lease (pass == 0 ? 0 : waitTimeout_, reused);
+				if (s != INVALID_SOCKET)
+					return s;
+				if (pass == 1)
+					break;
+
+			} catch (socket_error const &ex) {
+				context.Log->error ("%s", ex.what());
+			}
+		}
+	}
+
+	return INVALID_SOCKET;
+}
+
+void FastCgiHandler::sendBody (BackendExchange& exchange) throw (backend_error)
+{
+	using namespace aconnect;
+
+	string records;
+	int bytesRead = 0;
+
+	while ((bytesRead = exchange.context.RequestStream.read (exchange.buff, BodyChunkSize)) > 0)
+	{
+		records.clear();
+		if (useScgi_)
+			records.assign (exchange.buff, bytesRead);
+		else
+			fcgi::appendRecord (records, fcgi::Stdin, fcgi::ConnectionRequestId, exchange.buff, bytesRead);
+
+		while (!exchange.completed && isDataAvailable (exchange.socket))
+			receiveResponse (exchange);
+
+		// response completed before the whole body sent, connection state is unknown
+		if (exchange.completed) {
+			exchange.reusable = false;
+			return;
+		}
+
+		sendToBackend (exchange.socket, records);
+	}
+
+	if (!useScgi_) {
+		records.clear();
+		fcgi::appendRecord (records, fcgi::Stdin, fcgi::ConnectionRequestId, NULL, 0);
+		sendToBackend (exchange.socket, records);
+	}
+}
+
+bool FastCgiHandler::receiveResponse (BackendExchange& exchange) throw (backend_error)
+{
+	if (exchange.completed)
+		return false;
+
+	const int received = recv (exchange.socket, exchange.buff, ReceiveBufferSize, 0);
+
+	if (received < 0)
+		throw backend_error (aconnect::socket_error (exchange.socket, "Reading backend response").what());
+
+	if (received == 0) {
+		// SCGI response is completed by connection closing
+		if (!useScgi_)
+			throw backend_error ("Backend closed connection before request completion");
+
+		exchange.completed = true;
+		return false;
+	}
+
+	if (useScgi_) {
+		exchange.response.write (exchange.buff, received);
+		return true;
+	}
+
+	exchange.inbound.append (exchange.buff, received);
+	return processFastCgiRecords (exchange);
+}
+
+bool FastCgiHandler::processFastCgiRecords (BackendExchange& exchange) throw (backend_error)
+{
+	using namespace aconnect;
+
+	string& inbound = exchange.inbound;
+	size_t offset = 0;
+
+	while (!exchange.completed && inbound.size() - offset >= fcgi::HeaderSize)
+	{
+		fcgi::RecordHeader header;
+		fcgi::parseRecordHeader (inbound.c_str() + offset, header);
+
+		const size_t recordSize = fcgi::HeaderSize + header.contentLength + header.paddingLength;
+		if (inbound.size() - offset < recordSize)
+			break;
+
+		string_constptr content = inbound.c_str() + offset + fcgi::HeaderSize;
+		offset += recordSize;
+
+		// management records (GET_VALUES_RESULT, UNKNOWN_TYPE) are not requested - skipped
+		if (header.requestId != fcgi::ConnectionRequestId)
+			continue;
+
+		switch (header.type)
+		{
+		case fcgi::Stdout:
+			exchange.response.write (content, header.contentLength);
+			break;
+
+		case fcgi::Stderr:
+			if (header.contentLength > 0) {
+				string message = algo::trim_right_copy (string (content, header.contentLength));
+				if (!message.empty())
+					exchange.context.Log->error ("FastCGI backend: %s", message.c_str());
+			}
+			break;
+
+		case fcgi::EndRequest:
+			if (header.contentLength < fcgi::EndRequestBodySize)
+				throw backend_error ("Invalid FastCGI end request record");
+
+			if ((unsigned char) content[4] != fcgi::RequestComplete)
+				throw backend_error ("FastCGI request rejected by backend, protocol status: "
+					+ boost::lexical_cast<string> ((int) (unsigned char) content[4]));
+
+			exchange.completed = true;
+			// backend keeps connection, unexpected data after request end - connection is closed
+			exchange.reusable = (offset == inbound.size());
+			break;
+
+		default:
+			throw backend_error ("Unexpected FastCGI record type: " + boost::lexical_cast<string> (header.type));
+		}
+	}
+
+	inbound.erase (0, offset);
+	return !exchange.completed;
+}
+
+void FastCgiHandler::sendToBackend (aconnect::socket_type s, aconnect::string_constref data) throw (backend_error)
+{
+	try {
+		aconnect::util::writeToSocket (s, data);
+	} catch (aconnect::socket_error const &ex) {
+		throw backend_error (ex.what());
+	}
+}
+
+bool FastCgiHandler::isDataAvailable (aconnect::socket_type s)
+{
+	fd_set readSet;
+	FD_ZERO (&readSet);
+	FD_SET (s, &readSet);
+
+	timeval timeout;
+	timeout.tv_sec = 0;
+	timeout.tv_usec = 0;
+
+	return (select ((int) s + 1, &readSet, NULL, NULL, &timeout) > 0);
+}
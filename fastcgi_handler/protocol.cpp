@@ -0,0 +1,239 @@
+
+#include <assert.h>
+#include <string.h>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "ahttplib.hpp"
+
+#include "protocol.hpp"
+
+namespace algo = boost::algorithm;
+
+namespace
+{
+	const size_t MaxResponseHeaderSize = 64 * 1024;
+	const int DefaultResponseStatus = 200;
+	const int RedirectResponseStatus = 302;
+
+	aconnect::string_constant CgiHeaderStatus = "Status";
+	aconnect::string_constant CgiHeaderLocation = "Location";
+
+	aconnect::char_type Padding[8] = {0};
+
+	// name-value pair length: 1 byte if < 128, else 4 bytes with high bit set
+	void appendLength (aconnect::string& output, size_t length)
+	{
+		if (length < 0x80) {
+			output += (aconnect::char_type) length;
+		} else {
+			output += (aconnect::char_type) (((length >> 24) & 0x7F) | 0x80);
+			output += (aconnect::char_type) ((length >> 16) & 0xFF);
+			output += (aconnect::char_type) ((length >> 8) & 0xFF);
+			output += (aconnect::char_type) (length & 0xFF);
+		}
+	}
+
+	void appendRecordHeader (aconnect::string& output, fcgi::RecordType type, int requestId,
+		size_t contentLength, size_t paddingLength)
+	{
+		output += (aconnect::char_type) fcgi::Version1;
+		output += (aconnect::char_type) type;
+		output += (aconnect::char_type) ((requestId >> 8) & 0xFF);
+		output += (aconnect::char_type) (requestId & 0xFF);
+		output += (aconnect::char_type) ((contentLength >> 8) & 0xFF);
+		output += (aconnect::char_type) (contentLength & 0xFF);
+		output += (aconnect::char_type) paddingLength;
+		output += '\0';
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	FastCGI
+void fcgi::appendRecord (aconnect::string& output, RecordType type, int requestId,
+						 aconnect::string_constptr data, size_t size)
+{
+	do {
+		const size_t contentLength = (size > MaxContentSize ? MaxContentSize : size);
+		// records are aligned to 8 bytes
+		const size_t paddingLength = (8 - contentLength % 8) % 8;
+
+		appendRecordHeader (output, type, requestId, contentLength, paddingLength);
+		output.append (data, contentLength);
+		output.append (Padding, paddingLength);
+
+		data += contentLength;
+		size -= contentLength;
+
+	} while (size > 0);
+}
+
+void fcgi::appendBeginRequest (aconnect::string& output, int requestId, bool keepConnection)
+{
+	aconnect::char_type body[8] = {0};
+	body[0] = (aconnect::char_type) ((RoleResponder >> 8) & 0xFF);
+	body[1] = (aconnect::char_type) (RoleResponder & 0xFF);
+	body[2] = (aconnect::char_type) (keepConnection ? KeepConnectionFlag : 0);
+
+	appendRecord (output, BeginRequest, requestId, body, sizeof (body));
+}
+
+void fcgi::appendParams (aconnect::string& output, int requestId, const aconnect::str2str_map& params)
+{
+	aconnect::string content;
+
+	for (aconnect::str2str_map::const_iterator it = params.begin(); it != params.end(); ++it)
+	{
+		appendLength (content, it->first.size());
+		appendLength (content, it->second.size());
+		content += it->first;
+		content += it->second;
+	}
+
+	if (!content.empty())
+		appendRecord (output, Params, requestId, content.c_str(), content.size());
+
+	appendRecord (output, Params, requestId, NULL, 0);
+}
+
+void fcgi::parseRecordHeader (aconnect::string_constptr data, RecordHeader& header) throw (backend_error)
+{
+	const unsigned char *bytes = (const unsigned char *) data;
+
+	if (bytes[0] != Version1)
+		throw backend_error ("Unsupported FastCGI record version: "
+			+ boost::lexical_cast<aconnect::string> ((int) bytes[0]));
+
+	header.type = bytes[1];
+	header.requestId = (bytes[2] << 8) | bytes[3];
+	header.contentLength = (bytes[4] << 8) | bytes[5];
+	header.paddingLength = bytes[6];
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	SCGI
+void scgi::appendRequestHeader (aconnect::string& output, const aconnect::str2str_map& params)
+{
+	aconnect::string content;
+
+	// CONTENT_LENGTH must be the first header
+	aconnect::str2str_map::const_iterator it = params.find ("CONTENT_LENGTH");
+	content.append ("CONTENT_LENGTH", sizeof ("CONTENT_LENGTH"));
+	content += (it != params.end() && !it->second.empty() ? it->second : "0");
+	content += '\0';
+
+	content.append ("SCGI\0" "1", sizeof ("SCGI\0" "1"));
+
+	for (it = params.begin(); it != params.end(); ++it)
+	{
+		if (it->first == "CONTENT_LENGTH")
+			continue;
+
+		content += it->first;
+		content += '\0';
+		content += it->second;
+		content += '\0';
+	}
+
+	output += boost::lexical_cast<aconnect::string> (content.size());
+	output += ':';
+	output += content;
+	output += ',';
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	CgiResponseWriter
+void CgiResponseWriter::write (aconnect::string_constptr data, size_t size) throw (backend_error)
+{
+	if (headerLoaded_) {
+		if (size > 0)
+			context_.Response.write (data, size);
+		return;
+	}
+
+	const size_t searchFrom = (header_.size() > 3 ? header_.size() - 3 : 0);
+	header_.append (data, size);
+
+	// header end: empty line, "\n" line separators are accepted too
+	size_t pos = header_.find ("\n\n", searchFrom);
+	size_t headerSize = (pos != aconnect::string::npos ? pos + 2 : aconnect::string::npos);
+
+	pos = header_.find ("\r\n\r\n", searchFrom);
+	if (pos != aconnect::string::npos && (headerSize == aconnect::string::npos || pos + 4 < headerSize))
+		headerSize = pos + 4;
+
+	if (headerSize == aconnect::string::npos) {
+		if (header_.size() > MaxResponseHeaderSize)
+			throw backend_error ("Backend response header is too long");
+		return;
+	}
+
+	loadHeader (headerSize);
+
+	if (header_.size() > headerSize)
+		context_.Response.write (header_.c_str() + headerSize, header_.size() - headerSize);
+
+	header_.clear();
+}
+
+void CgiResponseWriter::finish () throw (backend_error)
+{
+	if (!headerLoaded_)
+		throw backend_error ("Backend response header is incomplete");
+}
+
+void CgiResponseWriter::loadHeader (size_t headerSize) throw (backend_error)
+{
+	using aconnect::string;
+
+	ahttp::HttpResponseHeader& header = context_.Response.Header;
+	header.Status = DefaultResponseStatus;
+
+	// merged to headers set by server after loading
+	aconnect::str2str_map headers;
+	aconnect::str_vector cookies;
+
+	bool statusLoaded = false;
+	size_t lineStart = 0;
+
+	while (lineStart < headerSize)
+	{
+		size_t lineEnd = header_.find ('\n', lineStart);
+		assert (lineEnd != string::npos && lineEnd < headerSize);
+
+		string line = header_.substr (lineStart, lineEnd - lineStart);
+		lineStart = lineEnd + 1;
+
+		algo::trim_right (line);
+		if (line.empty())
+			break;
+
+		const size_t pos = line.find (':');
+		if (pos == string::npos || pos == 0)
+			throw backend_error ("Invalid backend response header line: " + line);
+
+		string name = algo::trim_copy (line.substr (0, pos));
+		string value = algo::trim_copy (line.substr (pos + 1));
+
+		if (algo::iequals (name, CgiHeaderStatus)) {
+			try {
+				header.Status = boost::lexical_cast<int> (value.substr (0, value.find (' ')));
+			} catch (boost::bad_lexical_cast &) {
+				throw backend_error ("Invalid backend response status: " + value);
+			}
+			statusLoaded = true;
+			continue;
+		}
+
+		if (!statusLoaded && algo::iequals (name, CgiHeaderLocation))
+			header.Status = RedirectResponseStatus;
+
+		ahttp::HttpResponseHeader::addHeader (headers, cookies, name, value);
+	}
+
+	header.mergeHeaders (headers, cookies);
+	headerLoaded_ = true;
+}
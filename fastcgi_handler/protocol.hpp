@@ -0,0 +1,115 @@
+#ifndef FASTCGI_HANDLER_PROTOCOL_H
+#define FASTCGI_HANDLER_PROTOCOL_H
+
+#include <stdexcept>
+#include <boost/noncopyable.hpp>
+
+#include "aconnect/types.hpp"
+
+namespace ahttp
+{
+	class HttpContext;
+}
+
+struct backend_error : public std::runtime_error
+{
+	backend_error (aconnect::string_constref message) : std::runtime_error (message) { }
+};
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	FastCGI 1.0 records: [version][type][requestId:2][contentLength:2][paddingLength][reserved]
+//	content[contentLength] padding[paddingLength], numbers in network byte order
+namespace fcgi
+{
+	enum RecordType
+	{
+		BeginRequest = 1,
+		AbortRequest,
+		EndRequest,
+		Params,
+		Stdin,
+		Stdout,
+		Stderr,
+		Data,
+		GetValues,
+		GetValuesResult,
+		UnknownType
+	};
+
+	enum ProtocolStatus
+	{
+		RequestComplete = 0,
+		CantMultiplexConnection,
+		Overloaded,
+		UnknownRole
+	};
+
+	const unsigned char Version1 = 1;
+	const unsigned char KeepConnectionFlag = 1;
+	const int RoleResponder = 1;
+	const size_t HeaderSize = 8;
+	const size_t EndRequestBodySize = 8;
+	const size_t MaxContentSize = 0xFFFF;
+
+	// backend connection serves one request at a time, so request id is constant
+	const int ConnectionRequestId = 1;
+
+	struct RecordHeader
+	{
+		RecordHeader () : type (0), requestId (0), contentLength (0), paddingLength (0) { }
+
+		int type;
+		int requestId;
+		size_t contentLength;
+		size_t paddingLength;
+	};
+
+	// long content is split to several records, empty content - stream end record
+	void appendRecord (aconnect::string& output, RecordType type, int requestId,
+		aconnect::string_constptr data, size_t size);
+
+	void appendBeginRequest (aconnect::string& output, int requestId, bool keepConnection);
+	// FCGI_PARAMS stream with terminating empty record
+	void appendParams (aconnect::string& output, int requestId, const aconnect::str2str_map& params);
+
+	// "data" must contain at least HeaderSize bytes
+	void parseRecordHeader (aconnect::string_constptr data, RecordHeader& header) throw (backend_error);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	SCGI request header: netstring "<len>:CONTENT_LENGTH\0<n>\0SCGI\01\0...," -
+//	request body follows it, backend closes connection after response
+namespace scgi
+{
+	void appendRequestHeader (aconnect::string& output, const aconnect::str2str_map& params);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	CGI response from backend: header lines ("Status: 404 Not Found", "Location: ..." etc.)
+//	are loaded to HTTP response header, content is streamed to client as it arrives
+class CgiResponseWriter : private boost::noncopyable
+{
+public:
+	CgiResponseWriter (ahttp::HttpContext& context) :
+		context_ (context), headerLoaded_ (false) { }
+
+	// client socket errors are not caught - aconnect::socket_error is thrown
+	void write (aconnect::string_constptr data, size_t size) throw (backend_error);
+	// throws backend_error if response header was not completed
+	void finish () throw (backend_error);
+
+	inline bool isContentStarted () const	{	return headerLoaded_;	}
+
+protected:
+	void loadHeader (size_t headerSize) throw (backend_error);
+
+	ahttp::HttpContext& context_;
+	bool headerLoaded_;
+	aconnect::string header_;
+};
+
+#endif // FASTCGI_HANDLER_PROTOCOL_H
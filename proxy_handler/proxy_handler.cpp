@@ -0,0 +1,691 @@
+// proxy_handler.cpp : HTTP reverse proxy handler (handler API v2)
+//
+
+#include <string.h>
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "ahttplib.hpp"
+#include "aconnect/util.hpp"
+
+#include "upstream_pool.hpp"
+
+namespace algo = boost::algorithm;
+
+// constants
+
+const aconnect::string UpstreamsParam = "upstreams";				// "host:port", comma separated
+const aconnect::string BalancingParam = "balancing";				// "round-robin" (default) or "least-connections"
+const aconnect::string MaxConnectionsParam = "max-connections";	// busy connections per upstream, 0 - unlimited
+const aconnect::string KeepaliveParam = "keepalive";				// idle connections kept per upstream
+const aconnect::string ConnectTimeoutParam = "connect-timeout";	// sec
+const aconnect::string IoTimeoutParam = "io-timeout";				// sec, upstream socket read/write timeout
+const aconnect::string MaxFailsParam = "max-fails";				// consecutive failures to mark upstream down
+const aconnect::string FailTimeoutParam = "fail-timeout";			// sec, upstream is not used after "max-fails" failures
+const aconnect::string ResponseBufferSizeParam = "response-buffer-size";	// bytes, see ProxyHandler::relayResponse
+const aconnect::string HostParam = "host";						// "Host" header sent to upstream, client one by default
+
+const size_t DefaultResponseBufferSize = 1024 * 1024;
+const size_t ReadBufferSize = 64 * 1024;
+const size_t MaxHeaderLineSize = 16 * 1024;
+const size_t MaxHeaderSize = 64 * 1024;
+
+aconnect::string_constant BalancingRoundRobin = "round-robin";
+aconnect::string_constant BalancingLeastConnections = "least-connections";
+aconnect::string_constant HeaderXForwardedFor = "X-Forwarded-For";
+aconnect::string_constant HeaderXForwardedProto = "X-Forwarded-Proto";
+aconnect::string_constant HeaderKeepAlive = "Keep-Alive";
+aconnect::string_constant ChunkedEncoding = "chunked";
+
+
+struct upstream_error : public std::runtime_error
+{
+	upstream_error (aconnect::string_constref message) : std::runtime_error (message) { }
+};
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	Buffered reader of upstream response: status line, headers and chunked body parsing
+class UpstreamReader : private boost::noncopyable
+{
+public:
+	UpstreamReader (aconnect::socket_type s, aconnect::string_ptr buff, size_t buffSize) :
+		socket_ (s), buff_ (buff), buffSize_ (buffSize), begin_ (0), end_ (0) { }
+
+	// loads next data portion, returns false when connection is closed by upstream
+	bool fill () throw (upstream_error);
+	// line without CRLF, throws upstream_error if line is too long or connection was closed
+	void readLine (aconnect::string& line) throw (upstream_error);
+
+	inline size_t available () const					{	return end_ - begin_;		}
+	inline aconnect::string_constptr data () const		{	return buff_ + begin_;		}
+	inline void consume (size_t size)					{	begin_ += size;				}
+
+protected:
+	aconnect::socket_type socket_;
+	aconnect::string_ptr buff_;
+	const size_t buffSize_;
+	size_t begin_;
+	size_t end_;
+};
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	Parsed upstream response header
+struct UpstreamResponse
+{
+	UpstreamResponse () : status (0), keepAlive (true), chunked (false), contentLength (-1) { }
+
+	int status;
+	bool keepAlive;
+	bool chunked;
+	long long contentLength;	// -1 - not set
+	aconnect::str2str_map headers;
+	aconnect::str_vector cookies;
+};
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	Forwards requests to HTTP upstreams over keep-alive connections. Upstream is selected
+//	by round-robin or least-connections among upstreams which are not marked down by
+//	passive health checks (connect/read failures); idempotent request without body is
+//	retried on the next upstream if it failed before response header was received.
+class ProxyHandler : public ahttp::IHttpHandler
+{
+public:
+	ProxyHandler () :
+		globalSettings_ (NULL),
+		leastConnections_ (false),
+		responseBufferSize_ (DefaultResponseBufferSize),
+		nextUpstream_ (0) { }
+	virtual ~ProxyHandler ();
+
+	virtual bool init (const aconnect::str2str_map& params, ahttp::HttpServerSettings* globalSettings);
+	virtual void threadInit ();
+	virtual bool process (ahttp::HttpContext& context);
+	virtual void shutdown ();
+	virtual void stats (aconnect::string& output);
+
+protected:
+	void formatRequestHeader (aconnect::string& output, const ahttp::HttpContext& context);
+
+	// returns NULL if all upstreams are tried or unavailable, selected upstream is marked as tried
+	Upstream* selectUpstream (std::vector<bool>& tried);
+
+	void readResponseHeader (UpstreamReader& reader, UpstreamResponse& response) throw (upstream_error);
+
+	/*
+	*	Response content with Content-Length up to "response-buffer-size" is read completely
+	*	and upstream connection is returned to pool before sending to client (slow client does
+	*	not hold upstream connection), larger content is relayed from upstream socket to
+	*	client one directly (splice on Linux). Chunked content is decoded and streamed.
+	*/
+	void relayResponse (ahttp::HttpContext& context, UpstreamConnection& connection,
+		UpstreamReader& reader, UpstreamResponse& response) throw (upstream_error);
+	void relayChunkedContent (ahttp::HttpContext& context, UpstreamReader& reader) throw (upstream_error);
+
+	ahttp::HttpServerSettings* globalSettings_;
+	UpstreamSettings settings_;
+	std::vector<Upstream*> upstreams_;
+	bool leastConnections_;
+	size_t responseBufferSize_;
+	aconnect::string host_;
+
+	boost::mutex mutex_;
+	size_t nextUpstream_;
+
+	// upstream response reading and request body sending buffers (ReadBufferSize each) - 
+	// allocated once per worker thread, too large for request arena blocks
+	boost::thread_specific_ptr<std::vector<aconnect::char_type> > buffers_;
+};
+
+
+namespace
+{
+	// hop-by-hop headers are not forwarded
+	bool isHopByHopHeader (aconnect::string_constref name)
+	{
+		using namespace ahttp::detail;
+
+		return algo::iequals (name, HeaderConnection)
+			|| algo::iequals (name, HeaderKeepAlive)
+			|| algo::iequals (name, HeaderProxyConnection)
+			|| algo::iequals (name, HeaderTE)
+			|| algo::iequals (name, HeaderTrailer)
+			|| algo::iequals (name, HeaderTransferEncoding)
+			|| algo::iequals (name, HeaderUpgrade);
+	}
+
+	void sendToUpstream (aconnect::socket_type s, aconnect::string_constptr data, size_t size) throw (upstream_error)
+	{
+		try {
+			aconnect::util::writeToSocket (s, data, (int) size);
+		} catch (aconnect::socket_error const &ex) {
+			throw upstream_error (ex.what());
+		}
+	}
+}
+
+
+/*
+*	Handler factory
+*/
+HANDLER_EXPORT ahttp::IHttpHandler* createHandler (int apiVersion)
+{
+	if (apiVersion != ahttp::HandlerApiVersion)
+		return NULL;
+
+	return new ProxyHandler ();
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	UpstreamReader
+bool UpstreamReader::fill () throw (upstream_error)
+{
+	if (begin_ == end_) {
+		begin_ = end_ = 0;
+	} else if (end_ == buffSize_) {
+		memmove (buff_, buff_ + begin_, end_ - begin_);
+		end_ -= begin_;
+		begin_ = 0;
+	}
+
+	if (end_ == buffSize_)
+		throw upstream_error ("Upstream reading buffer overflow");
+
+	const int received = recv (socket_, buff_ + end_, (int) (buffSize_ - end_), 0);
+
+	if (received < 0)
+		throw upstream_error (aconnect::socket_error (socket_, "Reading upstream response").what());
+
+	end_ += (size_t) received;
+	return (received > 0);
+}
+
+void UpstreamReader::readLine (aconnect::string& line) throw (upstream_error)
+{
+	while (true)
+	{
+		aconnect::string_constptr lineEnd = (aconnect::string_constptr) memchr (data(), '\n', available());
+
+		if (lineEnd) {
+			line.assign (data(), lineEnd - data());
+			consume (lineEnd - data() + 1);
+			algo::trim_right_if (line, algo::is_any_of ("\r"));
+			return;
+		}
+
+		if (available() > MaxHeaderLineSize)
+			throw upstream_error ("Upstream response line is too long");
+
+		if (!fill ())
+			throw upstream_error ("Upstream closed connection");
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	ProxyHandler
+ProxyHandler::~ProxyHandler ()
+{
+	for (size_t ndx = 0; ndx < upstreams_.size(); ++ndx)
+		delete upstreams_[ndx];
+}
+
+bool ProxyHandler::init (const aconnect::str2str_map& params, ahttp::HttpServerSettings* globalSettings)
+{
+	using namespace aconnect;
+
+	assert (globalSettings);
+	assert (globalSettings->logger());
+
+	globalSettings_ = globalSettings;
+
+	str2str_map::const_iterator it = params.find (BalancingParam);
+	if (it != params.end()) {
+		if (util::equals (it->second, BalancingLeastConnections)) {
+			leastConnections_ = true;
+		} else if (!util::equals (it->second, BalancingRoundRobin)) {
+			globalSettings->logger()->error ("Invalid '%s' parameter value: %s",
+				BalancingParam.c_str(), it->second.c_str() );
+			return false;
+		}
+	}
+
+	try
+	{
+		if ((it = params.find (MaxConnectionsParam)) != params.end())
+			settings_.maxConnections = boost::lexical_cast<size_t> (it->second);
+		if ((it = params.find (KeepaliveParam)) != params.end())
+			settings_.keepaliveConnections = boost::lexical_cast<size_t> (it->second);
+		if ((it = params.find (ConnectTimeoutParam)) != params.end())
+			settings_.connectTimeout = boost::lexical_cast<int> (it->second);
+		if ((it = params.find (IoTimeoutParam)) != params.end())
+			settings_.ioTimeout = boost::lexical_cast<int> (it->second);
+		if ((it = params.find (MaxFailsParam)) != params.end())
+			settings_.maxFails = boost::lexical_cast<int> (it->second);
+		if ((it = params.find (FailTimeoutParam)) != params.end())
+			settings_.failTimeout = boost::lexical_cast<int> (it->second);
+		if ((it = params.find (ResponseBufferSizeParam)) != params.end())
+			responseBufferSize_ = boost::lexical_cast<size_t> (it->second);
+
+	} catch (boost::bad_lexical_cast &) {
+		globalSettings->logger()->error ("Invalid '%s' parameter value: %s",
+			it->first.c_str(), it->second.c_str() );
+		return false;
+	}
+
+	it = params.find (HostParam);
+	if (it != params.end())
+		host_ = it->second;
+
+	it = params.find (UpstreamsParam);
+	if (it == params.end()) {
+		globalSettings->logger()->error ("Mandatory parameter '%s' is absent", UpstreamsParam.c_str() );
+		return false;
+	}
+
+	std::vector<string> addresses;
+	algo::split (addresses, it->second, algo::is_any_of (", \t"), algo::token_compress_on);
+
+	for (size_t ndx = 0; ndx < addresses.size(); ++ndx)
+	{
+		if (addresses[ndx].empty())
+			continue;
+
+		string host;
+		int port = 0;
+		if (!Upstream::parseAddress (addresses[ndx], host, port)) {
+			globalSettings->logger()->error ("Invalid upstream address: %s, \"host:port\" expected",
+				addresses[ndx].c_str() );
+			return false;
+		}
+
+		upstreams_.push_back (new Upstream (host, port, settings_));
+	}
+
+	if (upstreams_.empty()) {
+		globalSettings->logger()->error ("Parameter '%s' does not contain upstream addresses", UpstreamsParam.c_str() );
+		return false;
+	}
+
+	return true;
+}
+
+void ProxyHandler::threadInit ()
+{
+	if (!buffers_.get())
+		buffers_.reset (new std::vector<aconnect::char_type> (2 * ReadBufferSize));
+}
+
+bool ProxyHandler::process (ahttp::HttpContext& context)
+{
+	using namespace aconnect;
+	using ahttp::HttpServer;
+
+	string requestHeader;
+	formatRequestHeader (requestHeader, context);
+
+	// allocated by threadInit
+	string_ptr buff = &(*buffers_)[0];
+	string_ptr bodyBuff = buff + ReadBufferSize;
+
+	// idempotent request without body can be repeated on other upstream after sending
+	const bool canRepeat = (0 == context.RequestHeader.ContentLength &&
+		(context.Method == ahttp::HttpMethod::Get || context.Method == ahttp::HttpMethod::Head));
+	std::vector<bool> tried (upstreams_.size(), false);
+	bool staleRetried = false;
+
+	while (true)
+	{
+		Upstream *upstream = selectUpstream (tried);
+		if (!upstream) {
+			context.Log->error ("No available upstream for request: %s", context.VirtualPath.c_str());
+			HttpServer::processServerError (context, 502);
+			return true;
+		}
+
+		bool reused = false;
+		socket_type s = INVALID_SOCKET;
+
+		try {
+			s = upstream->lease (reused);
+		} catch (socket_error const &ex) {
+			context.Log->error ("%s", ex.what());
+			continue;
+		}
+
+		if (s == INVALID_SOCKET)
+			continue;
+
+		UpstreamConnection connection (*upstream, s);
+		UpstreamReader reader (s, buff, ReadBufferSize);
+		UpstreamResponse response;
+		bool headerSent = false, bodySent = false;
+
+		try
+		{
+			sendToUpstream (s, requestHeader.c_str(), requestHeader.size());
+			headerSent = true;
+
+			// request body is streamed to upstream as it is read from client
+			int bytesRead = 0;
+			while ((bytesRead = context.RequestStream.read (bodyBuff, (int) ReadBufferSize)) > 0) {
+				bodySent = true;
+				sendToUpstream (s, bodyBuff, bytesRead);
+			}
+
+			readResponseHeader (reader, response);
+
+		} catch (upstream_error const &ex) {
+			context.Log->error ("Upstream %s request failed: %s", upstream->address().c_str(), ex.what());
+
+			if (reused && !staleRetried) {
+				// idle connection could be closed by upstream after liveness check - it is not
+				// upstream failure, request is repeated on new connection
+				staleRetried = true;
+				upstream->closeIdleConnections ();
+				tried[std::find (upstreams_.begin(), upstreams_.end(), upstream) - upstreams_.begin()] = false;
+			} else {
+				upstream->registerFailure ();
+			}
+
+			if (!bodySent && (!headerSent || canRepeat))
+				continue;
+
+			HttpServer::processServerError (context, 502);
+			return true;
+		}
+
+		upstream->registerSuccess ();
+
+		try {
+			relayResponse (context, connection, reader, response);
+		} catch (upstream_error const &ex) {
+			context.Log->error ("Upstream %s response relaying failed: %s", upstream->address().c_str(), ex.what());
+			if (!context.Response.isHeadersSent() && !context.Response.isFinished())
+				HttpServer::processServerError (context, 502);
+			else
+				context.Response.abort (); // truncated content must not look complete
+		}
+
+		return true;
+	}
+}
+
+void ProxyHandler::shutdown ()
+{
+	for (size_t ndx = 0; ndx < upstreams_.size(); ++ndx)
+		upstreams_[ndx]->closeIdleConnections ();
+}
+
+void ProxyHandler::stats (aconnect::string& output)
+{
+	output += "balancing: ";
+	output += (leastConnections_ ? BalancingLeastConnections : BalancingRoundRobin);
+	output += "\r\n";
+
+	for (size_t ndx = 0; ndx < upstreams_.size(); ++ndx)
+		upstreams_[ndx]->stats (output);
+}
+
+void ProxyHandler::formatRequestHeader (aconnect::string& output, const ahttp::HttpContext& context)
+{
+	using namespace aconnect;
+	using namespace ahttp::detail;
+
+	const ahttp::HttpRequestHeader& header = context.RequestHeader;
+
+	output = header.Method + " " + header.Path + " HTTP/1.1\r\n";
+
+	string forwardedFor = util::formatIpAddr (context.Client->ip);
+	string host = (host_.empty() ? header.getHeader (HeaderHost) : host_);
+
+	for (str2str_map::const_iterator it = header.Headers.begin(); it != header.Headers.end(); ++it)
+	{
+		if (isHopByHopHeader (it->first)
+			|| algo::iequals (it->first, HeaderHost)
+			|| algo::iequals (it->first, HeaderExpect)
+			|| algo::iequals (it->first, HeaderXForwardedProto))
+			continue;
+
+		if (algo::iequals (it->first, HeaderXForwardedFor)) {
+			forwardedFor = it->second + ", " + forwardedFor;
+			continue;
+		}
+
+		output += it->first + HeaderValueDelimiter + it->second + HeadersDelimiter;
+	}
+
+	if (!host.empty())
+		output += string (HeaderHost) + HeaderValueDelimiter + host + HeadersDelimiter;
+
+	output += string (HeaderXForwardedFor) + HeaderValueDelimiter + forwardedFor + HeadersDelimiter;
+	output += string (HeaderXForwardedProto) + HeaderValueDelimiter + "http" + HeadersDelimiter;
+	output += string (HeaderConnection) + HeaderValueDelimiter + ConnectionKeepAlive + HeadersDelimiter;
+	output += HeadersDelimiter;
+}
+
+Upstream* ProxyHandler::selectUpstream (std::vector<bool>& tried)
+{
+	size_t first = 0;
+	{
+		boost::mutex::scoped_lock lock (mutex_);
+		first = nextUpstream_++;
+	}
+
+	const aconnect::util::timestamp_type now = aconnect::util::getTimestamp();
+	int selected = -1;
+
+	for (size_t ndx = 0; ndx < upstreams_.size(); ++ndx)
+	{
+		const size_t pos = (first + ndx) % upstreams_.size();
+		if (tried[pos] || !upstreams_[pos]->isAvailable (now))
+			continue;
+
+		// busy connections count is read without lock - it is only a hint
+		if (selected < 0 || (leastConnections_ &&
+			upstreams_[pos]->busyCount() < upstreams_[selected]->busyCount()))
+			selected = (int) pos;
+
+		if (!leastConnections_)
+			break;
+	}
+
+	if (selected < 0)
+		return NULL;
+
+	tried[selected] = true;
+	return upstreams_[selected];
+}
+
+void ProxyHandler::readResponseHeader (UpstreamReader& reader, UpstreamResponse& response) throw (upstream_error)
+{
+	using namespace aconnect;
+	using namespace ahttp::detail;
+
+	string line;
+
+	// interim 1xx responses are skipped
+	do {
+		reader.readLine (line);
+
+		// "HTTP/1.1 200 OK"
+		if (line.size() < 12 || !algo::starts_with (line, "HTTP/1."))
+			throw upstream_error ("Invalid upstream response status line: " + line);
+
+		try {
+			response.status = boost::lexical_cast<int> (line.substr (9, 3));
+		} catch (boost::bad_lexical_cast &) {
+			throw upstream_error ("Invalid upstream response status line: " + line);
+		}
+
+		response.keepAlive = (line[7] == '1');
+		response.headers.clear();
+		response.cookies.clear();
+
+		size_t headerSize = 0;
+		for (reader.readLine (line); !line.empty(); reader.readLine (line))
+		{
+			headerSize += line.size();
+			if (headerSize > MaxHeaderSize)
+				throw upstream_error ("Upstream response header is too long");
+
+			const size_t pos = line.find (':');
+			if (pos == string::npos || pos == 0)
+				throw upstream_error ("Invalid upstream response header line: " + line);
+
+			string name = algo::trim_copy (line.substr (0, pos));
+			string value = algo::trim_copy (line.substr (pos + 1));
+
+			if (algo::iequals (name, HeaderConnection)) {
+				if (algo::iequals (value, ConnectionClose))
+					response.keepAlive = false;
+				else if (algo::iequals (value, ConnectionKeepAlive))
+					response.keepAlive = true;
+
+			} else if (algo::iequals (name, HeaderTransferEncoding)) {
+				response.chunked = algo::iends_with (value, ChunkedEncoding);
+
+			} else if (algo::iequals (name, HeaderContentLength)) {
+				try {
+					response.contentLength = boost::lexical_cast<long long> (value);
+				} catch (boost::bad_lexical_cast &) {
+					throw upstream_error ("Invalid upstream response Content-Length: " + value);
+				}
+			}
+
+			if (!isHopByHopHeader (name) && !algo::iequals (name, HeaderContentLength))
+				ahttp::HttpResponseHeader::addHeader (response.headers, response.cookies, name, value);
+		}
+
+	} while (response.status >= 100 && response.status < 200);
+}
+
+void ProxyHandler::relayResponse (ahttp::HttpContext& context, UpstreamConnection& connection,
+								  UpstreamReader& reader, UpstreamResponse& response) throw (upstream_error)
+{
+	using namespace aconnect;
+	using ahttp::HttpResponse;
+
+	HttpResponse& output = context.Response;
+	output.Header.Status = response.status;
+	output.Header.mergeHeaders (response.headers, response.cookies);
+
+	// response without content
+	if (context.Method == ahttp::HttpMethod::Head || response.status == 204 || response.status == 304)
+	{
+		connection.complete (response.keepAlive && 0 == reader.available());
+		connection.release ();
+
+		if (response.contentLength >= 0 && context.Method == ahttp::HttpMethod::Head) {
+			output.Header.setContentLength ((size_t) response.contentLength);
+			output.flush ();
+		}
+		return;
+	}
+
+	if (response.chunked) {
+		relayChunkedContent (context, reader);
+		connection.complete (response.keepAlive && 0 == reader.available());
+		return;
+	}
+
+	// content till connection closing
+	if (response.contentLength < 0)
+	{
+		do {
+			output.write (reader.data(), reader.available());
+			reader.consume (reader.available());
+		} while (reader.fill());
+
+		return;
+	}
+
+	const size_t contentLength = (size_t) response.contentLength;
+	const size_t loaded = util::min2 (reader.available(), contentLength);
+
+	if (contentLength <= responseBufferSize_)
+	{
+		string content (reader.data(), loaded);
+		reader.consume (loaded);
+
+		while (content.size() < contentLength)
+		{
+			if (!reader.fill())
+				throw upstream_error ("Upstream closed connection before response completion");
+
+			const size_t size = util::min2 (reader.available(), contentLength - content.size());
+			content.append (reader.data(), size);
+			reader.consume (size);
+		}
+
+		connection.complete (response.keepAlive && 0 == reader.available());
+		connection.release ();
+
+		output.Header.setContentLength (contentLength);
+		output.write (content);
+		return;
+	}
+
+	output.Header.setContentLength (contentLength);
+	output.writeUnbuffered (reader.data(), loaded);
+	reader.consume (loaded);
+
+	try {
+		output.sendFromSocket (connection.socket(), contentLength - loaded);
+	} catch (socket_error const &) {
+		// failed side (upstream reading or client writing) is unknown - processed as client error
+		throw;
+	} catch (std::runtime_error const &ex) {
+		throw upstream_error (ex.what());
+	}
+
+	connection.complete (response.keepAlive && 0 == reader.available());
+}
+
+void ProxyHandler::relayChunkedContent (ahttp::HttpContext& context, UpstreamReader& reader) throw (upstream_error)
+{
+	using namespace aconnect;
+
+	string line;
+
+	while (true)
+	{
+		reader.readLine (line);
+
+		// chunk extensions are ignored
+		size_t chunkSize = 0;
+		const string sizeString = line.substr (0, line.find (';'));
+		if (sizeString.empty() || sizeString.find_first_not_of ("0123456789abcdefABCDEF \t") != string::npos)
+			throw upstream_error ("Invalid upstream response chunk size: " + line);
+		chunkSize = strtoul (sizeString.c_str(), NULL, 16);
+
+		if (0 == chunkSize)
+			break;
+
+		while (chunkSize > 0)
+		{
+			if (0 == reader.available() && !reader.fill())
+				throw upstream_error ("Upstream closed connection before response completion");
+
+			const size_t size = util::min2 (reader.available(), chunkSize);
+			context.Response.write (reader.data(), size);
+			reader.consume (size);
+			chunkSize -= size;
+		}
+
+		reader.readLine (line);
+		if (!line.empty())
+			throw upstream_error ("Invalid upstream response chunk end");
+	}
+
+	// trailers are not relayed
+	do {
+		reader.readLine (line);
+	} while (!line.empty());
+}
@@ -0,0 +1,273 @@
+
+#include <assert.h>
+#include <string.h>
+#include <boost/lexical_cast.hpp>
+
+#include "aconnect/network.hpp"
+#include "aconnect/util.hpp"
+
+#include "upstream_pool.hpp"
+
+namespace
+{
+	void setBlockingMode (aconnect::socket_type s, bool blocking) throw (aconnect::socket_error)
+	{
+#if defined (WIN32)
+		u_long mode = (blocking ? 0 : 1);
+		if (ioctlsocket (s, FIONBIO, &mode) != 0)
+			throw aconnect::socket_error (s, "Socket mode setup failed");
+#else
+		int flags = fcntl (s, F_GETFL, 0);
+		if (flags == -1 || fcntl (s, F_SETFL, blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK)) == -1)
+			throw aconnect::socket_error (s, "Socket mode setup failed");
+#endif
+	}
+}
+
+Upstream::Upstream (aconnect::string_constref host, int port, const UpstreamSettings& settings) :
+	host_ (host),
+	port_ (port),
+	address_ (host + ":" + boost::lexical_cast<aconnect::string> (port)),
+	settings_ (settings),
+	busyCount_ (0),
+	failsCount_ (0),
+	downUntil_ (0),
+	requestsCount_ (0),
+	connectionsCount_ (0),
+	failuresCount_ (0),
+	downCount_ (0)
+{
+}
+
+Upstream::~Upstream ()
+{
+	closeIdleConnections ();
+}
+
+bool Upstream::parseAddress (aconnect::string_constref address, aconnect::string& host, int& port)
+{
+	const size_t pos = address.rfind (':');
+	if (pos == aconnect::string::npos || pos == 0)
+		return false;
+
+	host = address.substr (0, pos);
+	try {
+		port = boost::lexical_cast<int> (address.substr (pos + 1));
+	} catch (boost::bad_lexical_cast &) {
+		return false;
+	}
+
+	return port > 0 && port <= 0xFFFF;
+}
+
+bool Upstream::isAvailable (aconnect::util::timestamp_type now)
+{
+	boost::mutex::scoped_lock lock (mutex_);
+
+	if (downUntil_ > now)
+		return false;
+
+	return (0 == settings_.maxConnections || busyCount_ < settings_.maxConnections);
+}
+
+aconnect::socket_type Upstream::lease (bool& reused) throw (aconnect::socket_error)
+{
+	using namespace aconnect;
+
+	reused = false;
+	{
+		boost::mutex::scoped_lock lock (mutex_);
+
+		while (!idle_.empty())
+		{
+			socket_type s = idle_.back();
+			idle_.pop_back();
+
+			if (isIdleConnectionAlive (s)) {
+				++busyCount_;
+				++requestsCount_;
+				reused = true;
+				return s;
+			}
+			closeConnection (s);
+		}
+
+		if (settings_.maxConnections > 0 && busyCount_ >= settings_.maxConnections)
+			return INVALID_SOCKET;
+
+		// connection slot is reserved before connecting (outside of lock)
+		++busyCount_;
+		++requestsCount_;
+	}
+
+	try {
+		socket_type s = connect ();
+
+		boost::mutex::scoped_lock lock (mutex_);
+		++connectionsCount_;
+		return s;
+
+	} catch (...) {
+		{
+			boost::mutex::scoped_lock lock (mutex_);
+			--busyCount_;
+		}
+		registerFailure ();
+		throw;
+	}
+}
+
+void Upstream::release (aconnect::socket_type s, bool reusable)
+{
+	{
+		boost::mutex::scoped_lock lock (mutex_);
+		assert (busyCount_ > 0);
+		--busyCount_;
+
+		if (reusable && idle_.size() < settings_.keepaliveConnections) {
+			idle_.push_back (s);
+			s = INVALID_SOCKET;
+		}
+	}
+
+	if (s != INVALID_SOCKET)
+		closeConnection (s);
+}
+
+void Upstream::registerSuccess ()
+{
+	boost::mutex::scoped_lock lock (mutex_);
+	failsCount_ = 0;
+}
+
+void Upstream::registerFailure ()
+{
+	std::vector<aconnect::socket_type> idle;
+	{
+		boost::mutex::scoped_lock lock (mutex_);
+		++failuresCount_;
+		++failsCount_;
+
+		if (settings_.maxFails <= 0 || failsCount_ < settings_.maxFails)
+			return;
+
+		failsCount_ = 0;
+		downUntil_ = aconnect::util::getTimestamp() + (aconnect::util::timestamp_type) settings_.failTimeout * 1000000;
+		++downCount_;
+
+		// idle connections of failed upstream are not trusted
+		idle.swap (idle_);
+	}
+
+	for (size_t ndx = 0; ndx < idle.size(); ++ndx)
+		closeConnection (idle[ndx]);
+}
+
+void Upstream::closeIdleConnections ()
+{
+	std::vector<aconnect::socket_type> idle;
+	{
+		boost::mutex::scoped_lock lock (mutex_);
+		idle.swap (idle_);
+	}
+
+	for (size_t ndx = 0; ndx < idle.size(); ++ndx)
+		closeConnection (idle[ndx]);
+}
+
+void Upstream::stats (aconnect::string& output)
+{
+	using boost::lexical_cast;
+	using aconnect::string;
+
+	const string prefix = "upstream[" + address_ + "].";
+
+	boost::mutex::scoped_lock lock (mutex_);
+
+	output += prefix + "state: " + (downUntil_ > aconnect::util::getTimestamp() ? "down" : "up") + "\r\n";
+	output += prefix + "busy: " + lexical_cast<string> (busyCount_) + "\r\n";
+	output += prefix + "idle: " + lexical_cast<string> (idle_.size()) + "\r\n";
+	output += prefix + "requests: " + lexical_cast<string> (requestsCount_) + "\r\n";
+	output += prefix + "connections: " + lexical_cast<string> (connectionsCount_) + "\r\n";
+	output += prefix + "failures: " + lexical_cast<string> (failuresCount_) + "\r\n";
+	output += prefix + "marked-down: " + lexical_cast<string> (downCount_) + "\r\n";
+}
+
+aconnect::socket_type Upstream::connect () throw (aconnect::socket_error)
+{
+	using namespace aconnect;
+
+	struct sockaddr_in addr;
+	util::zeroMemory (&addr, sizeof (addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons ((unsigned short) port_);
+	addr.sin_addr.s_addr = inet_addr (host_.c_str());
+
+	if (addr.sin_addr.s_addr == INADDR_NONE) {
+		// host name is resolved on each connect to follow DNS changes
+		struct addrinfo hints, *info = NULL;
+		util::zeroMemory (&hints, sizeof (hints));
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+
+		if (getaddrinfo (host_.c_str(), NULL, &hints, &info) != 0 || !info)
+			throw socket_error ("Upstream host resolving failed: " + host_);
+
+		addr.sin_addr = ((sockaddr_in*) info->ai_addr)->sin_addr;
+		freeaddrinfo (info);
+	}
+
+	socket_type s = util::createSocket (AF_INET, SOCK_STREAM);
+
+	try
+	{
+		// non-blocking connect - connection timeout is shorter than system one
+		setBlockingMode (s, false);
+
+		if (::connect (s, (sockaddr*) &addr, sizeof (addr)) != 0)
+		{
+			if (!util::checkSocketState (s, settings_.connectTimeout, true))
+				throw socket_error ("Upstream connection timeout expired: " + address_);
+
+			int error = 0;
+			socklen_t size = sizeof (error);
+			if (getsockopt (s, SOL_SOCKET, SO_ERROR, (char*) &error, &size) != 0 || error != 0)
+				throw socket_error ("Upstream connection failed: " + address_ + ", "
+					+ socket_error::getSocketErrorDesc (error, s));
+		}
+
+		setBlockingMode (s, true);
+
+		util::setSocketReadTimeout (s, settings_.ioTimeout);
+		util::setSocketWriteTimeout (s, settings_.ioTimeout);
+
+	} catch (...) {
+		closeConnection (s);
+		throw;
+	}
+
+	return s;
+}
+
+bool Upstream::isIdleConnectionAlive (aconnect::socket_type s)
+{
+	fd_set readSet;
+	FD_ZERO (&readSet);
+	FD_SET (s, &readSet);
+
+	timeval timeout;
+	timeout.tv_sec = 0;
+	timeout.tv_usec = 0;
+
+	// idle connection closed by upstream (or with unexpected data) is readable
+	return (0 == select ((int) s + 1, &readSet, NULL, NULL, &timeout));
+}
+
+void Upstream::closeConnection (aconnect::socket_type s)
+{
+	try {
+		aconnect::util::closeSocket (s);
+	} catch (aconnect::socket_error &) {
+		// connection is already broken
+	}
+}
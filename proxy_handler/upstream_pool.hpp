@@ -0,0 +1,117 @@
+#ifndef PROXY_HANDLER_UPSTREAM_POOL_H
+#define PROXY_HANDLER_UPSTREAM_POOL_H
+
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+
+#include "aconnect/types.hpp"
+#include "aconnect/error.hpp"
+#include "aconnect/time_util.hpp"
+
+struct UpstreamSettings
+{
+	UpstreamSettings () :
+		maxConnections (0), keepaliveConnections (16),
+		connectTimeout (5), ioTimeout (60),
+		maxFails (3), failTimeout (10) { }
+
+	size_t maxConnections;			// busy connections limit, 0 - unlimited
+	size_t keepaliveConnections;	// idle connections kept for reuse
+	int connectTimeout;				// sec
+	int ioTimeout;					// sec, socket read/write timeout
+	int maxFails;					// consecutive failures before upstream is marked down, 0 - never
+	int failTimeout;				// sec, upstream is not used while it is down
+};
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	HTTP upstream ("host:port"): pool of keep-alive connections and passive health state -
+//	upstream is skipped for "failTimeout" sec after "maxFails" consecutive failed requests
+class Upstream : private boost::noncopyable
+{
+public:
+	Upstream (aconnect::string_constref host, int port, const UpstreamSettings& settings);
+	~Upstream ();
+
+	// returns false if "host:port" format is invalid
+	static bool parseAddress (aconnect::string_constref address, aconnect::string& host, int& port);
+
+	// up and below connections limit
+	bool isAvailable (aconnect::util::timestamp_type now);
+
+	/*
+	*	Returns idle or new connection, INVALID_SOCKET if connections limit is reached.
+	*	Throws socket_error if connection failed (failure is registered).
+	*/
+	aconnect::socket_type lease (bool& reused) throw (aconnect::socket_error);
+	// "reusable" - response completed and upstream keeps connection open
+	void release (aconnect::socket_type s, bool reusable);
+
+	void registerSuccess ();
+	void registerFailure ();
+	void closeIdleConnections ();
+
+	// "name: value\r\n" records
+	void stats (aconnect::string& output);
+
+	inline size_t busyCount () const					{	return busyCount_;	}
+	inline aconnect::string_constref address () const	{	return address_;	}
+	inline aconnect::string_constref host () const		{	return host_;		}
+
+protected:
+	aconnect::socket_type connect () throw (aconnect::socket_error);
+	static bool isIdleConnectionAlive (aconnect::socket_type s);
+	static void closeConnection (aconnect::socket_type s);
+
+	const aconnect::string host_;
+	const int port_;
+	const aconnect::string address_;
+	const UpstreamSettings& settings_;
+
+	boost::mutex mutex_;
+	std::vector<aconnect::socket_type> idle_;
+	size_t busyCount_;
+
+	int failsCount_;
+	aconnect::util::timestamp_type downUntil_;
+
+	// statistics
+	size_t requestsCount_;
+	size_t connectionsCount_;
+	size_t failuresCount_;
+	size_t downCount_;
+};
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	Leased upstream connection: released as broken unless response is completed
+class UpstreamConnection : private boost::noncopyable
+{
+public:
+	UpstreamConnection (Upstream& upstream, aconnect::socket_type s) :
+		upstream_ (upstream), socket_ (s), reusable_ (false) { }
+	~UpstreamConnection () {
+		release ();
+	}
+
+	inline void complete (bool reusable)			{	reusable_ = reusable;	}
+	// connection can be returned to pool before response sending to client is completed
+	inline void release () {
+		if (socket_ != INVALID_SOCKET) {
+			upstream_.release (socket_, reusable_);
+			socket_ = INVALID_SOCKET;
+		}
+	}
+	inline aconnect::socket_type socket () const	{	return socket_;			}
+	inline Upstream& upstream ()					{	return upstream_;		}
+
+protected:
+	Upstream& upstream_;
+	aconnect::socket_type socket_;
+	bool reusable_;
+};
+
+#endif // PROXY_HANDLER_UPSTREAM_POOL_H
@@ -0,0 +1,110 @@
+
+#include <assert.h>
+
+#include "interpreter_pool.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	InterpreterPool
+void InterpreterPool::init (size_t count, aconnect::string_constptr moduleName, 
+						   init_interpreter_function initFunc) throw (std::runtime_error)
+{
+	assert (count > 0);
+	assert (interpreters_.empty());
+
+	boost::mutex::scoped_lock lock (mutex_);
+
+	PyEval_InitThreads ();	// creates and acquires GIL
+	mainThreadState_ = PyThreadState_Get();
+
+	for (size_t ndx = 0; ndx < count; ++ndx)
+	{
+		PyThreadState *state = Py_NewInterpreter ();
+		if (!state) {
+			PyThreadState_Swap (mainThreadState_);
+			PyEval_SaveThread ();
+			throw std::runtime_error ("Python sub-interpreter creation failed");
+		}
+
+		PyObject *module = PyImport_ImportModule (const_cast<char*> (moduleName));
+		if (!module) {
+			PyErr_Clear ();
+			Py_EndInterpreter (state);
+			PyThreadState_Swap (mainThreadState_);
+			PyEval_SaveThread ();
+			throw std::runtime_error (std::string ("Failed to import module in sub-interpreter: ") + moduleName);
+		}
+		Py_DECREF (module);
+
+		PythonInterpreter *interpreter = new PythonInterpreter ();
+		interpreter->state = state->interp;
+
+		if (initFunc) {
+			try {
+				initFunc (*interpreter);
+			} catch (...) {
+				delete interpreter;
+				Py_EndInterpreter (state);
+				PyThreadState_Swap (mainThreadState_);
+				PyEval_SaveThread ();
+				throw;
+			}
+		}
+
+		interpreters_.push_back (interpreter);
+		free_.push_back (interpreter);
+
+		// initial thread state is not needed - each lease creates own one
+		PyThreadState_Swap (mainThreadState_);
+		PyThreadState_Clear (state);
+		PyThreadState_Delete (state);
+	}
+
+	PyEval_SaveThread ();
+}
+
+PythonInterpreter* InterpreterPool::lease ()
+{
+	boost::mutex::scoped_lock lock (mutex_);
+
+	while (free_.empty())
+		freeCondition_.wait (lock);
+
+	PythonInterpreter *interpreter = free_.back();
+	free_.pop_back();
+
+	return interpreter;
+}
+
+void InterpreterPool::release (PythonInterpreter* interpreter)
+{
+	assert (interpreter);
+	{
+		boost::mutex::scoped_lock lock (mutex_);
+		free_.push_back (interpreter);
+	}
+	freeCondition_.notify_one ();
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	InterpreterLease
+InterpreterLease::InterpreterLease (InterpreterPool& pool) throw (std::runtime_error) :
+	pool_ (pool), interpreter_ (pool.lease()), threadState_ (NULL)
+{
+	threadState_ = PyThreadState_New (interpreter_->state);
+	if (!threadState_) {
+		pool_.release (interpreter_);
+		throw std::runtime_error ("Python thread state creation failed");
+	}
+
+	PyEval_RestoreThread (threadState_);
+}
+
+InterpreterLease::~InterpreterLease ()
+{
+	PyThreadState_Clear (threadState_);
+	PyThreadState_DeleteCurrent ();		// releases GIL
+
+	pool_.release (interpreter_);
+}
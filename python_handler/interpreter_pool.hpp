@@ -0,0 +1,115 @@
+#ifndef PYTHON_HANDLER_INTERPRETER_POOL_H
+#define PYTHON_HANDLER_INTERPRETER_POOL_H
+
+#include <vector>
+#include <map>
+#include <ctime>
+#include <stdexcept>
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+#include <boost/python.hpp>
+
+#include "aconnect/types.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	compiled script, reloaded when file modification time or size is changed
+struct CompiledScript
+{
+	CompiledScript () : modifyTime (0), size (0), code (NULL) { }
+
+	std::time_t modifyTime;
+	boost::uintmax_t size;
+	PyObject *code;				// owned reference - code object
+};
+
+class OutputRedirectorWrapper;
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	isolated Python sub-interpreter: own sys module, imported modules and __main__ namespace
+struct PythonInterpreter : private boost::noncopyable
+{
+	typedef std::map<aconnect::string, CompiledScript> scripts_map;
+
+	PythonInterpreter () : state (NULL), requestNamespace (NULL), output (NULL), application (NULL) { }
+
+	PyInterpreterState *state;
+	PyObject *requestNamespace;			// owned reference - scripts globals, reused by requests
+	OutputRedirectorWrapper *output;	// sys.stdout/sys.stderr, writes to current request
+	PyObject *application;				// owned reference - WSGI application callable, NULL in scripts mode
+	scripts_map scripts;		// compiled scripts cache (by script path), used by lease owner only
+};
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	Pool of sub-interpreters created by Py_NewInterpreter,
+//	interpreter is leased by worker thread for the request processing time.
+class InterpreterPool : private boost::noncopyable
+{
+public:
+	// called for each created interpreter (it is current), should throw std::runtime_error on failure
+	typedef void (*init_interpreter_function) (PythonInterpreter& interpreter);
+
+	InterpreterPool () : mainThreadState_ (NULL) { }
+
+	/**
+	*	Create "count" interpreters, import "moduleName" into each one and call "initFunc".
+	*	Must be called in the main thread after Py_Initialize,
+	*	GIL is released on exit (see InterpreterLease).
+	*/
+	void init (size_t count, aconnect::string_constptr moduleName, 
+		init_interpreter_function initFunc = NULL) throw (std::runtime_error);
+
+	// blocks until free interpreter is available
+	PythonInterpreter* lease ();
+	void release (PythonInterpreter* interpreter);
+
+	inline size_t size () const		{	return interpreters_.size();	}
+
+protected:
+	boost::mutex mutex_;
+	boost::condition freeCondition_;
+	std::vector<PythonInterpreter*> interpreters_;
+	std::vector<PythonInterpreter*> free_;
+	PyThreadState *mainThreadState_;
+};
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	Leases interpreter and makes it current for the calling thread:
+//	creates thread state in it and acquires GIL, releases both in destructor.
+class InterpreterLease : private boost::noncopyable
+{
+public:
+	InterpreterLease (InterpreterPool& pool) throw (std::runtime_error);
+	~InterpreterLease ();
+
+	inline PythonInterpreter& interpreter ()	{	return *interpreter_;	}
+
+protected:
+	InterpreterPool& pool_;
+	PythonInterpreter* interpreter_;
+	PyThreadState* threadState_;
+};
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	Releases GIL for blocking operation (socket I/O) - other interpreters
+//	can run meanwhile. GIL must be held by the calling thread.
+class GilReleaseGuard : private boost::noncopyable
+{
+public:
+	GilReleaseGuard () : state_ (PyEval_SaveThread()) { }
+	~GilReleaseGuard () {
+		PyEval_RestoreThread (state_);
+	}
+
+protected:
+	PyThreadState *state_;
+};
+
+#endif // PYTHON_HANDLER_INTERPRETER_POOL_H
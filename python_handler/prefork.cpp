@@ -0,0 +1,633 @@
+
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+#include <boost/cstdint.hpp>
+
+#if !defined (WIN32)
+#	include <errno.h>
+#	include <signal.h>
+#	include <unistd.h>
+#	include <poll.h>
+#	include <sys/types.h>
+#	include <sys/socket.h>
+#	include <sys/wait.h>
+#endif
+
+#include "ahttplib.hpp"
+#include "aconnect/time_util.hpp"
+
+#include "prefork.hpp"
+
+#if !defined (MSG_NOSIGNAL)
+#	define MSG_NOSIGNAL 0
+#endif
+
+namespace
+{
+	const size_t FrameHeaderSize = 5;			// type + length
+	const int RespawnDelay = 1;					// sec, minimal interval between worker starts in slot
+	const int SupervisorPollInterval = 1000;	// ms
+	const long LeasePollInterval = 100;			// ms, new workers are received from supervisor on lease
+
+	// supervisor -> server: started worker, its socket is attached (SCM_RIGHTS);
+	// server -> supervisor: worker must be killed (pid is checked by supervisor - 
+	// only supervisor reaps workers, so pid can not be reused meanwhile)
+	struct ControlMessage
+	{
+		boost::int32_t slot;
+		boost::int32_t pid;
+	};
+
+	void appendUInt32 (aconnect::string& output, boost::uint32_t value) {
+		output.append (reinterpret_cast<const char*> (&value), sizeof (value));
+	}
+
+	boost::uint32_t readUInt32 (aconnect::string_constref input, size_t& offset) throw (prefork::worker_error)
+	{
+		boost::uint32_t value = 0;
+		if (offset + sizeof (value) > input.size())
+			throw prefork::worker_error ("Invalid frame payload");
+
+		memcpy (&value, input.data() + offset, sizeof (value));
+		offset += sizeof (value);
+
+		return value;
+	}
+
+#if !defined (WIN32)
+	// returns "revents", "timeoutSec" <= 0 - wait infinitely
+	short waitSocket (int fd, short events, int timeoutSec) throw (prefork::worker_error)
+	{
+		struct pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = events;
+		pfd.revents = 0;
+
+		int res = 0;
+		do {
+			res = ::poll (&pfd, 1, timeoutSec > 0 ? timeoutSec * 1000 : -1);
+		} while (res < 0 && errno == EINTR);
+
+		if (res < 0)
+			throw prefork::worker_error ("Worker socket polling failed");
+		if (res == 0)
+			throw prefork::worker_error ("Worker I/O timeout expired");
+
+		return pfd.revents;
+	}
+
+	void fillFrameHeader (char* header, prefork::FrameType type, size_t size)
+	{
+		const boost::uint32_t length = (boost::uint32_t) size;
+
+		header[0] = (char) type;
+		memcpy (header + 1, &length, sizeof (length));
+	}
+
+	void writeAll (int fd, aconnect::string_constptr data, size_t size, int timeoutSec) throw (prefork::worker_error)
+	{
+		while (size > 0)
+		{
+			if (timeoutSec > 0)
+				waitSocket (fd, POLLOUT, timeoutSec);
+
+			ssize_t sent = ::send (fd, data, size, MSG_NOSIGNAL);
+			if (sent < 0 && errno == EINTR)
+				continue;
+			if (sent <= 0)
+				throw prefork::worker_error ("Writing to worker socket failed");
+
+			data += sent;
+			size -= sent;
+		}
+	}
+
+	void readAll (int fd, aconnect::string_ptr data, size_t size, int timeoutSec) throw (prefork::worker_error)
+	{
+		while (size > 0)
+		{
+			if (timeoutSec > 0)
+				waitSocket (fd, POLLIN, timeoutSec);
+
+			ssize_t received = ::recv (fd, data, size, 0);
+			if (received < 0 && errno == EINTR)
+				continue;
+			if (received == 0)
+				throw prefork::worker_error ("Worker connection closed");
+			if (received < 0)
+				throw prefork::worker_error ("Reading from worker socket failed");
+
+			data += received;
+			size -= received;
+		}
+	}
+
+	bool sendWorkerSocket (int controlFd, int slot, pid_t pid, int fd)
+	{
+		ControlMessage message;
+		message.slot = slot;
+		message.pid = pid;
+
+		struct iovec iov;
+		iov.iov_base = &message;
+		iov.iov_len = sizeof (message);
+
+		char control[CMSG_SPACE (sizeof (int))];
+		memset (control, 0, sizeof (control));
+
+		struct msghdr msg;
+		memset (&msg, 0, sizeof (msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof (control);
+
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR (&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN (sizeof (int));
+		memcpy (CMSG_DATA (cmsg), &fd, sizeof (int));
+
+		return ::sendmsg (controlFd, &msg, MSG_NOSIGNAL) == (ssize_t) sizeof (message);
+	}
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	Framing
+#if !defined (WIN32)
+
+void prefork::writeFrame (int fd, FrameType type,
+						  aconnect::string_constptr data, size_t size, int timeoutSec) throw (worker_error)
+{
+	char header[FrameHeaderSize];
+	fillFrameHeader (header, type, size);
+
+	writeAll (fd, header, FrameHeaderSize, timeoutSec);
+	if (size > 0)
+		writeAll (fd, data, size, timeoutSec);
+}
+
+prefork::FrameType prefork::readFrame (int fd, aconnect::string& payload, int timeoutSec) throw (worker_error)
+{
+	char header[FrameHeaderSize];
+	readAll (fd, header, FrameHeaderSize, timeoutSec);
+
+	boost::uint32_t length = 0;
+	memcpy (&length, header + 1, sizeof (length));
+
+	if (length > MaxFrameSize)
+		throw worker_error ("Frame size exceeds limit");
+
+	payload.resize (length);
+	if (length > 0)
+		readAll (fd, &payload[0], length, timeoutSec);
+
+	return (FrameType) header[0];
+}
+
+bool prefork::sendFrame (int fd, FrameType type, aconnect::string_constptr data, size_t size, 
+						 int timeoutSec, FrameListener& listener) throw (worker_error)
+{
+	char header[FrameHeaderSize];
+	fillFrameHeader (header, type, size);
+
+	aconnect::string_constptr parts[2] = { header, data };
+	size_t sizes[2] = { FrameHeaderSize, size };
+	aconnect::string payload;
+
+	for (int part = 0; part < 2; ++part)
+	{
+		while (sizes[part] > 0)
+		{
+			// worker output is read first - worker can wait for it before reading request
+			if (waitSocket (fd, POLLIN | POLLOUT, timeoutSec) & (POLLIN | POLLHUP | POLLERR)) 
+			{
+				const FrameType received = readFrame (fd, payload, timeoutSec);
+				if (!listener.frameReceived (received, payload))
+					return false;
+				continue;
+			}
+
+			ssize_t sent = ::send (fd, parts[part], sizes[part], MSG_NOSIGNAL | MSG_DONTWAIT);
+			if (sent < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+				continue;
+			if (sent <= 0)
+				throw worker_error ("Writing to worker socket failed");
+
+			parts[part] += sent;
+			sizes[part] -= sent;
+		}
+	}
+
+	return true;
+}
+
+#else
+
+void prefork::writeFrame (int fd, FrameType type,
+						  aconnect::string_constptr data, size_t size, int timeoutSec) throw (worker_error) {
+	throw worker_error ("Worker processes are not supported on Windows");
+}
+prefork::FrameType prefork::readFrame (int fd, aconnect::string& payload, int timeoutSec) throw (worker_error) {
+	throw worker_error ("Worker processes are not supported on Windows");
+}
+bool prefork::sendFrame (int fd, FrameType type, aconnect::string_constptr data, size_t size, 
+						 int timeoutSec, FrameListener& listener) throw (worker_error) {
+	throw worker_error ("Worker processes are not supported on Windows");
+}
+
+#endif
+
+void prefork::serializeMap (aconnect::string& output, const aconnect::str2str_map& map)
+{
+	appendUInt32 (output, (boost::uint32_t) map.size());
+
+	for (aconnect::str2str_map::const_iterator it = map.begin(); it != map.end(); ++it)
+	{
+		appendUInt32 (output, (boost::uint32_t) it->first.size());
+		output.append (it->first);
+		appendUInt32 (output, (boost::uint32_t) it->second.size());
+		output.append (it->second);
+	}
+}
+
+size_t prefork::deserializeMap (aconnect::str2str_map& map, aconnect::string_constref input,
+							  size_t offset) throw (worker_error)
+{
+	const boost::uint32_t count = readUInt32 (input, offset);
+
+	for (boost::uint32_t ndx = 0; ndx < count; ++ndx)
+	{
+		boost::uint32_t size = readUInt32 (input, offset);
+		if (offset + size > input.size())
+			throw worker_error ("Invalid frame payload");
+
+		aconnect::string key = input.substr (offset, size);
+		offset += size;
+
+		size = readUInt32 (input, offset);
+		if (offset + size > input.size())
+			throw worker_error ("Invalid frame payload");
+
+		map[key] = input.substr (offset, size);
+		offset += size;
+	}
+
+	return offset;
+}
+
+void prefork::serializeList (aconnect::string& output, const aconnect::str_vector& list)
+{
+	appendUInt32 (output, (boost::uint32_t) list.size());
+
+	for (aconnect::str_vector::const_iterator it = list.begin(); it != list.end(); ++it)
+	{
+		appendUInt32 (output, (boost::uint32_t) it->size());
+		output.append (*it);
+	}
+}
+
+size_t prefork::deserializeList (aconnect::str_vector& list, aconnect::string_constref input,
+								size_t offset) throw (worker_error)
+{
+	const boost::uint32_t count = readUInt32 (input, offset);
+
+	for (boost::uint32_t ndx = 0; ndx < count; ++ndx)
+	{
+		const boost::uint32_t size = readUInt32 (input, offset);
+		if (offset + size > input.size())
+			throw worker_error ("Invalid frame payload");
+
+		list.push_back (input.substr (offset, size));
+		offset += size;
+	}
+
+	return offset;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	WorkerConnection
+int WorkerConnection::read (aconnect::string_ptr buff, int buffSize)
+{
+	while (body_.empty() && !bodyCompleted_)
+		receiveBody ();
+
+	const int copied = (int) body_.copy (buff, buffSize);
+	body_.erase (0, copied);
+
+	return copied;
+}
+
+void WorkerConnection::setResponseHeader (int status, const aconnect::str2str_map& headers, 
+										 const aconnect::str_vector& cookies)
+{
+	status_ = status;
+	headers_ = headers;
+	cookies_ = cookies;
+}
+
+void WorkerConnection::write (aconnect::string_constref data)
+{
+	sendHeader ();
+	prefork::writeFrame (fd_, prefork::FrameData, data);
+}
+
+void WorkerConnection::logError (aconnect::string_constref message)
+{
+	prefork::writeFrame (fd_, prefork::FrameLog, message);
+}
+
+void WorkerConnection::finish (aconnect::string_constref error)
+{
+	// request body not read by application is skipped
+	while (!bodyCompleted_) {
+		body_.clear ();
+		receiveBody ();
+	}
+	body_.clear ();
+
+	if (error.empty()) {
+		sendHeader ();
+		prefork::writeFrame (fd_, prefork::FrameEnd, NULL, 0);
+	} else {
+		prefork::writeFrame (fd_, prefork::FrameError, error);
+	}
+}
+
+void WorkerConnection::receiveBody ()
+{
+	aconnect::string payload;
+
+	switch (prefork::readFrame (fd_, payload))
+	{
+	case prefork::FrameBody:
+		body_.append (payload);
+		break;
+	case prefork::FrameBodyEnd:
+		bodyCompleted_ = true;
+		break;
+	default:
+		throw prefork::worker_error ("Unexpected frame, request body expected");
+	}
+}
+
+void WorkerConnection::sendHeader ()
+{
+	if (headerSent_)
+		return;
+
+	aconnect::string payload;
+	appendUInt32 (payload, (boost::uint32_t) status_);
+	prefork::serializeMap (payload, headers_);
+	prefork::serializeList (payload, cookies_);
+
+	prefork::writeFrame (fd_, prefork::FrameHeader, payload);
+	headerSent_ = true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	WorkerProcessPool
+#if defined (WIN32)
+
+void WorkerProcessPool::init (size_t count, worker_main_function workerMain) throw (std::runtime_error) {
+	throw std::runtime_error ("Worker processes are not supported on Windows");
+}
+int WorkerProcessPool::lease (int timeoutSec)					{	return -1;	}
+void WorkerProcessPool::release (int slot, bool healthy)		{	}
+void WorkerProcessPool::receiveWorkers ()						{	}
+void WorkerProcessPool::runSupervisor (int controlFd, size_t count, worker_main_function workerMain)	{	}
+
+#else
+
+void WorkerProcessPool::init (size_t count, worker_main_function workerMain) throw (std::runtime_error)
+{
+	assert (count > 0);
+	assert (workerMain);
+
+	int sockets[2];
+	if (::socketpair (AF_UNIX, SOCK_SEQPACKET, 0, sockets) != 0)
+		throw std::runtime_error ("Supervisor control socket creation failed");
+
+	pid_t pid = ::fork ();
+	if (pid < 0) {
+		::close (sockets[0]);
+		::close (sockets[1]);
+		throw std::runtime_error ("Supervisor process creation failed");
+	}
+
+	if (pid == 0) {
+		::close (sockets[0]);
+		runSupervisor (sockets[1], count, workerMain);
+		::_exit (0);
+	}
+
+	::close (sockets[1]);
+
+	boost::mutex::scoped_lock lock (mutex_);
+	controlFd_ = sockets[0];
+	slots_.resize (count);
+}
+
+int WorkerProcessPool::lease (int timeoutSec)
+{
+	using namespace aconnect::util;
+
+	const timestamp_type deadline = getTimestamp() + (timestamp_type) timeoutSec * 1000000;
+
+	boost::mutex::scoped_lock lock (mutex_);
+
+	while (true)
+	{
+		receiveWorkers ();
+
+		for (size_t ndx = 0; ndx < slots_.size(); ++ndx) {
+			if (slots_[ndx].fd != -1 && !slots_[ndx].busy) {
+				slots_[ndx].busy = true;
+				return (int) ndx;
+			}
+		}
+
+		if (getTimestamp() >= deadline)
+			return -1;
+
+		boost::xtime waitTime = createTimePeriod (0);
+		waitTime.nsec += LeasePollInterval * 1000000;
+		if (waitTime.nsec >= 1000000000) {
+			waitTime.sec += 1;
+			waitTime.nsec -= 1000000000;
+		}
+
+		freeCondition_.timed_wait (lock, waitTime);
+	}
+}
+
+void WorkerProcessPool::release (int slot, bool healthy)
+{
+	{
+		boost::mutex::scoped_lock lock (mutex_);
+		WorkerSlot& worker = slots_[slot];
+
+		if (worker.pendingFd != -1) {
+			// leased worker was finished and respawned meanwhile
+			::close (worker.fd);
+			worker.fd = worker.pendingFd;
+			worker.pid = worker.pendingPid;
+			worker.pendingFd = -1;
+			worker.pendingPid = 0;
+		
+		} else if (!healthy) {
+			// worker state is unknown (can be hung in application code) - 
+			// supervisor kills it and starts new one
+			ControlMessage message;
+			message.slot = slot;
+			message.pid = worker.pid;
+			::send (controlFd_, &message, sizeof (message), MSG_DONTWAIT | MSG_NOSIGNAL);
+
+			::close (worker.fd);
+			worker.fd = -1;
+			worker.pid = 0;
+		}
+
+		worker.busy = false;
+	}
+
+	freeCondition_.notify_one ();
+}
+
+void WorkerProcessPool::receiveWorkers ()
+{
+	while (true)
+	{
+		ControlMessage message;
+		struct iovec iov;
+		iov.iov_base = &message;
+		iov.iov_len = sizeof (message);
+
+		char control[CMSG_SPACE (sizeof (int))];
+
+		struct msghdr msg;
+		memset (&msg, 0, sizeof (msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof (control);
+
+		if (::recvmsg (controlFd_, &msg, MSG_DONTWAIT) != (ssize_t) sizeof (message))
+			return;
+
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR (&msg);
+		if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		int fd = -1;
+		memcpy (&fd, CMSG_DATA (cmsg), sizeof (int));
+
+		if (message.slot < 0 || message.slot >= (int) slots_.size()) {
+			::close (fd);
+			continue;
+		}
+
+		WorkerSlot& worker = slots_[message.slot];
+		
+		// leasing thread still uses socket of previous worker - it is replaced on release
+		if (worker.busy) {
+			if (worker.pendingFd != -1)
+				::close (worker.pendingFd);
+			worker.pendingFd = fd;
+			worker.pendingPid = message.pid;
+			continue;
+		}
+
+		if (worker.fd != -1)	// previous worker in slot died while it was free
+			::close (worker.fd);
+
+		worker.fd = fd;
+		worker.pid = message.pid;
+	}
+}
+
+void WorkerProcessPool::runSupervisor (int controlFd, size_t count, worker_main_function workerMain)
+{
+	::signal (SIGHUP, SIG_IGN);
+	::signal (SIGPIPE, SIG_IGN);
+
+	std::vector<pid_t> pids (count, 0);
+	std::vector<time_t> startTimes (count, 0);
+	bool serverStopped = false;
+
+	while (!serverStopped)
+	{
+		for (size_t slot = 0; slot < count; ++slot)
+		{
+			if (pids[slot] != 0 || ::time (NULL) - startTimes[slot] < RespawnDelay)
+				continue;
+
+			int sockets[2];
+			if (::socketpair (AF_UNIX, SOCK_STREAM, 0, sockets) != 0)
+				continue;
+
+			startTimes[slot] = ::time (NULL);
+			pid_t pid = ::fork ();
+
+			if (pid == 0) {
+				::close (controlFd);
+				::close (sockets[0]);
+				workerMain (sockets[1]);
+				::_exit (0);
+			}
+
+			::close (sockets[1]);
+
+			if (pid > 0) {
+				pids[slot] = pid;
+				if (!sendWorkerSocket (controlFd, (int) slot, pid, sockets[0]))
+					serverStopped = true;
+			}
+
+			::close (sockets[0]);
+		}
+
+		struct pollfd pfd;
+		pfd.fd = controlFd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+
+		if (::poll (&pfd, 1, SupervisorPollInterval) > 0) 
+		{
+			// kill requests for hung workers, end of stream - server is stopped
+			ControlMessage message;
+			ssize_t received;
+			
+			while ((received = ::recv (controlFd, &message, sizeof (message), MSG_DONTWAIT)) == (ssize_t) sizeof (message)) {
+				if (message.slot >= 0 && message.slot < (int) count 
+					&& message.pid > 0 && pids[message.slot] == message.pid)
+					::kill (message.pid, SIGKILL);
+			}
+
+			if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+				serverStopped = true;
+		}
+
+		int status = 0;
+		pid_t pid;
+		while ((pid = ::waitpid (-1, &status, WNOHANG)) > 0) {
+			for (size_t slot = 0; slot < count; ++slot)
+				if (pids[slot] == pid)
+					pids[slot] = 0;
+		}
+	}
+
+	for (size_t slot = 0; slot < count; ++slot)
+		if (pids[slot] != 0)
+			::kill (pids[slot], SIGTERM);
+
+	while (::waitpid (-1, NULL, 0) > 0)
+		;
+}
+
+#endif
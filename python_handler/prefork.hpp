@@ -0,0 +1,161 @@
+#ifndef PYTHON_HANDLER_PREFORK_H
+#define PYTHON_HANDLER_PREFORK_H
+
+#include <vector>
+#include <stdexcept>
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+
+#include "aconnect/types.hpp"
+#include "wsgi.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	Pre-forked worker processes support (POSIX only).
+//	Server and worker exchange frames over Unix domain socket:
+//	[uint8 type][uint32 payload length][payload], host byte order (same host)
+namespace prefork
+{
+	enum FrameType
+	{
+		FrameRequest = 1,	// server -> worker: serialized environ map
+		FrameBody,			// server -> worker: request body chunk
+		FrameBodyEnd,		// server -> worker: request body completed
+		FrameHeader,		// worker -> server: uint32 status + serialized headers map
+		FrameData,			// worker -> server: response content chunk
+		FrameEnd,			// worker -> server: response completed
+		FrameError,			// worker -> server: application failed, payload - error description
+		FrameLog			// worker -> server: message for server log ("wsgi.errors")
+	};
+
+	const size_t MaxFrameSize = 16 * 1024 * 1024;
+
+	struct worker_error : public std::runtime_error
+	{
+		worker_error (aconnect::string_constref message) : std::runtime_error (message) { }
+	};
+
+	// server side: frames received from worker while request frame is sent
+	class FrameListener
+	{
+	public:
+		virtual ~FrameListener () { }
+		// returns false when response is completed
+		virtual bool frameReceived (FrameType type, aconnect::string& payload) = 0;
+	};
+
+	// "timeoutSec" > 0 - worker_error is thrown if socket is not ready during this period
+	void writeFrame (int fd, FrameType type,
+		aconnect::string_constptr data, size_t size, int timeoutSec = 0) throw (worker_error);
+
+	inline void writeFrame (int fd, FrameType type, aconnect::string_constref data, int timeoutSec = 0) throw (worker_error) {
+		writeFrame (fd, type, data.c_str(), data.size(), timeoutSec);
+	}
+
+	// throws worker_error on socket error, closed connection or expired timeout
+	FrameType readFrame (int fd, aconnect::string& payload, int timeoutSec = 0) throw (worker_error);
+
+	/*
+	*	Server side frame writing: frames sent by worker meanwhile are passed to "listener" -
+	*	worker can send response before whole request body is read, so neither side blocks 
+	*	on full socket buffer. Returns false if "listener" reported response completion.
+	*/
+	bool sendFrame (int fd, FrameType type, aconnect::string_constptr data, size_t size, 
+		int timeoutSec, FrameListener& listener) throw (worker_error);
+
+	void serializeMap (aconnect::string& output, const aconnect::str2str_map& map);
+	// returns offset after map data
+	size_t deserializeMap (aconnect::str2str_map& map, aconnect::string_constref input,
+		size_t offset = 0) throw (worker_error);
+
+	void serializeList (aconnect::string& output, const aconnect::str_vector& list);
+	size_t deserializeList (aconnect::str_vector& list, aconnect::string_constref input,
+		size_t offset = 0) throw (worker_error);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	Worker process side of WSGI connection: request body is received in FrameBody frames
+//	when application reads it (server reads response frames while body is sent), 
+//	unread body is skipped at response completion
+class WorkerConnection : public WsgiConnection
+{
+public:
+	WorkerConnection (int fd) :
+		fd_ (fd), bodyCompleted_ (false), headerSent_ (false), status_ (500) { }
+
+	virtual int read (aconnect::string_ptr buff, int buffSize);
+	virtual void setResponseHeader (int status, const aconnect::str2str_map& headers, 
+		const aconnect::str_vector& cookies);
+	virtual void write (aconnect::string_constref data);
+	virtual void logError (aconnect::string_constref message);
+
+	// completes response: FrameEnd or FrameError (if "error" is not empty)
+	void finish (aconnect::string_constref error = aconnect::string());
+
+protected:
+	void receiveBody ();
+	void sendHeader ();
+
+	int fd_;
+	bool bodyCompleted_;
+	bool headerSent_;
+	aconnect::string body_;
+	int status_;
+	aconnect::str2str_map headers_;
+	aconnect::str_vector cookies_;
+};
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	Server side pool of worker processes.
+//	Workers are forked by supervisor process (forked from server at handlers initialization,
+//	before server threads are started), supervisor respawns finished workers and passes
+//	server end of the new worker socket back to server (SCM_RIGHTS).
+//	Worker exceeded I/O timeout is killed by supervisor (on server request at release) 
+//	and restarted.
+class WorkerProcessPool : private boost::noncopyable
+{
+public:
+	// executed in worker process: serves requests from "fd" until connection is closed
+	typedef void (*worker_main_function) (int fd);
+
+	WorkerProcessPool () : controlFd_ (-1) { }
+
+	// must be called before server threads start
+	void init (size_t count, worker_main_function workerMain) throw (std::runtime_error);
+
+	// returns worker slot or -1 if no worker became free in "timeoutSec"
+	int lease (int timeoutSec);
+	// unhealthy worker is killed, supervisor will start new one
+	void release (int slot, bool healthy);
+
+	inline int socket (int slot)	{	return slots_[slot].fd;		}
+
+protected:
+	struct WorkerSlot
+	{
+		WorkerSlot () : fd (-1), pid (0), busy (false), pendingFd (-1), pendingPid (0) { }
+
+		int fd;
+		int pid;
+		bool busy;
+		// worker respawned while slot was leased, applied on release
+		int pendingFd;
+		int pendingPid;
+	};
+
+	// non-blocking: accept sockets of started workers from supervisor
+	void receiveWorkers ();
+
+	static void runSupervisor (int controlFd, size_t count, worker_main_function workerMain);
+
+	boost::mutex mutex_;
+	boost::condition freeCondition_;
+	std::vector<WorkerSlot> slots_;
+	int controlFd_;
+};
+
+#endif // PYTHON_HANDLER_PREFORK_H
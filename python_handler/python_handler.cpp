@@ -1,14 +1,21 @@
 // python_handler.cpp : Defines the entry point for the DLL application.
 //
 
+#include <string.h>
+#include <fstream>
 #include <boost/algorithm/string.hpp>
 #include <boost/thread.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_array.hpp>
 
 #include "ahttplib.hpp"
 #include "aconnect/util.hpp"
 
 #include "wrappers.hpp"
+#include "interpreter_pool.hpp"
+#include "wsgi.hpp"
+#include "prefork.hpp"
 
 namespace algo = boost::algorithm;
 namespace fs = boost::filesystem;
@@ -18,12 +25,32 @@ namespace fs = boost::filesystem;
 // constants
 
 const aconnect::string UploadsDirParam = "uploads-dir";
+const aconnect::string InterpretersCountParam = "interpreters-count";
+const aconnect::string ApplicationParam = "application";	// WSGI application: "module:callable"
+const aconnect::string PythonPathParam = "python-path";		// added to sys.path
+const aconnect::string WorkerProcessesParam = "worker-processes";		// > 0: run application in pre-forked processes
+const aconnect::string WorkerWaitTimeoutParam = "worker-wait-timeout";	// sec, 503 is returned when all workers are busy
+const aconnect::string WorkerTimeoutParam = "worker-timeout";			// sec, worker I/O timeout - hung worker is restarted
+const int DefaultWorkerWaitTimeout = 5;
+const int DefaultWorkerTimeout = 60;
+const int WorkerBodyChunkSize = 64 * 1024;
+aconnect::string_constant ModuleName = "python_handler";
+
+// one interpreter per hardware thread by default
+inline size_t defaultInterpretersCount () {
+	return aconnect::util::max2 ((size_t) boost::thread::hardware_concurrency(), (size_t) 1);
+}
 
 // globals
-boost::mutex pythonExecMutex;
 aconnect::string uploadsDirPath;
+aconnect::string pythonPath;
+aconnect::string applicationModule, applicationName;
 ahttp::HttpServerSettings *globalServerSettings;
-python::object mainModule;
+InterpreterPool interpreterPool;
+WorkerProcessPool workerPool;
+size_t workerProcessesCount = 0;
+int workerWaitTimeout = DefaultWorkerWaitTimeout;
+int workerTimeout = DefaultWorkerTimeout;
 
 #if defined (WIN32)
 
@@ -40,7 +67,14 @@ python::object mainModule;
     }
 #endif
 
-void executeScript (aconnect::string_constref, HttpContextWrapper * );
+void executeScript (aconnect::string_constref, HttpContextWrapper *, PythonInterpreter& );
+void initInterpreter (PythonInterpreter& interpreter);
+aconnect::string initPython ();
+aconnect::string loadPythonError();
+void processPythonError (ahttp::HttpContext& context, aconnect::string errDesc);
+void processWorkerRequest (ahttp::HttpContext& context);
+void runWorkerProcess (int fd);
+PyObject* loadScriptCode (aconnect::string_constref, PythonInterpreter& );
 
 
 /* 
@@ -51,18 +85,60 @@ HANDLER_EXPORT bool initHandler  (const aconnect::str2str_map& params, ahttp::Ht
 	assert (globalSettings);
 	assert (globalSettings->logger());
 
-	boost::mutex::scoped_lock lock(pythonExecMutex);
-
 	globalServerSettings = globalSettings;
 
-	Py_InitializeEx (1);
+	size_t interpretersCount = defaultInterpretersCount();
+	aconnect::str2str_map::const_iterator it = params.find(InterpretersCountParam);
+	if (it != params.end()) {
+		try {
+			interpretersCount = boost::lexical_cast<size_t> (it->second);
+		} catch (boost::bad_lexical_cast &) {
+			globalSettings->logger()->error ("Invalid '%s' parameter value: %s", 
+				InterpretersCountParam.c_str(), it->second.c_str() );
+			return false;
+		}
+		if (interpretersCount == 0)
+			interpretersCount = defaultInterpretersCount();
+	}
 
-	if ( 0 == Py_IsInitialized()) {
-		globalSettings->logger()->error ("Python interpreter was not initialized correctly");
-		return false;
+	it = params.find(WorkerProcessesParam);
+	if (it != params.end()) {
+		try {
+			workerProcessesCount = boost::lexical_cast<size_t> (it->second);
+			
+			it = params.find(WorkerWaitTimeoutParam);
+			if (it != params.end())
+				workerWaitTimeout = boost::lexical_cast<int> (it->second);
+
+			it = params.find(WorkerTimeoutParam);
+			if (it != params.end())
+				workerTimeout = boost::lexical_cast<int> (it->second);
+
+		} catch (boost::bad_lexical_cast &) {
+			globalSettings->logger()->error ("Invalid '%s' parameter value: %s", 
+				it->first.c_str(), it->second.c_str() );
+			return false;
+		}
 	}
 
-	aconnect::str2str_map::const_iterator it = params.find(UploadsDirParam);
+	it = params.find(PythonPathParam);
+	if (it != params.end())
+		pythonPath = it->second;
+
+	it = params.find(ApplicationParam);
+	if (it != params.end()) 
+	{
+		size_t pos = it->second.find (':');
+		if (pos == aconnect::string::npos || pos == 0 || pos == it->second.size() - 1) {
+			globalSettings->logger()->error ("Invalid '%s' parameter value: %s, \"module:callable\" expected", 
+				ApplicationParam.c_str(), it->second.c_str() );
+			return false;
+		}
+		applicationModule = it->second.substr (0, pos);
+		applicationName = it->second.substr (pos + 1);
+	}
+
+	it = params.find(UploadsDirParam);
 	
 	if (it != params.end()) {
 		uploadsDirPath = it->second;
@@ -72,66 +148,124 @@ HANDLER_EXPORT bool initHandler  (const aconnect::str2str_map& params, ahttp::Ht
 		globalSettings->logger()->error ("Mandatory parameter '%s' is absent", UploadsDirParam.c_str() );
 	}
 
-	try {
-		
-		// Register the module with the interpreter
-		if (PyImport_AppendInittab("python_handler", initpython_handler) == -1)
-		{
-			globalSettings->logger()->error ("Failed to register 'python_handler' in the interpreter's built-in modules");
+	if (workerProcessesCount > 0) 
+	{
+		// Python is initialized in worker processes only
+		if (applicationModule.empty()) {
+			globalSettings->logger()->error ("Parameter '%s' is required for worker processes mode", 
+				ApplicationParam.c_str() );
 			return false;
 		}
 
-		// Retrieve the main module
-		mainModule = python::import("__main__");
-		
-		// register classes
-		python::import ("python_handler");
+		try {
+			workerPool.init (workerProcessesCount, runWorkerProcess);
+		} catch (std::exception const &ex) {
+			globalSettings->logger()->error("Python worker processes start failed: %s", ex.what());
+			return false;
+		}
+
+		globalSettings->logger()->info ("Python handler initialized, worker processes count: %d, application: %s:%s", 
+			(int) workerProcessesCount, applicationModule.c_str(), applicationName.c_str());
+		return true;
+	}
+
+	aconnect::string errDesc = initPython ();
+	if (!errDesc.empty()) {
+		globalSettings->logger()->error (errDesc.c_str());
+		return false;
+	}
+
+	try {
+		interpreterPool.init (interpretersCount, ModuleName, initInterpreter);
+
+	} catch (std::exception const &ex) {
+		globalSettings->logger()->error("Python interpreter initialization failed: %s", ex.what());
+		return false;
 
 	} catch (...) {
 		globalSettings->logger()->error("Python interpreter initialization failed: unknown exception caught");
 		return false;
 	}
 
+	globalSettings->logger()->info ("Python handler initialized, interpreters count: %d", (int) interpretersCount);
+	if (!applicationModule.empty())
+		globalSettings->logger()->info ("WSGI application loaded: %s:%s", 
+			applicationModule.c_str(), applicationName.c_str());
+
 	return true;
 }
 
-
-class GilThreadStateGuard
+/* 
+*	Initialize Python and register module classes in the main interpreter,
+*	returns error description on failure
+*/
+aconnect::string initPython ()
 {
-public:
-	GilThreadStateGuard (PyGILState_STATE gstate) :
-	  gstate_ (gstate) { }
+	// Register the module with the interpreter - must be performed before Py_Initialize
+	if (PyImport_AppendInittab(const_cast<char*> (ModuleName), initpython_handler) == -1)
+		return "Failed to register 'python_handler' in the interpreter's built-in modules";
 
-	  ~GilThreadStateGuard () {
-		  PyGILState_Release (gstate_);
-		  
-	  }
-protected:
-	PyGILState_STATE gstate_;
-};
+	Py_InitializeEx (1);
+
+	if ( 0 == Py_IsInitialized())
+		return "Python interpreter was not initialized correctly";
 
-class ThreadStateGuard
+	try {
+		// Boost.Python converters registry is global - classes are registered once
+		python::scope moduleScope (python::import (ModuleName));
+		registerWsgiClasses ();
+		registerOutputRedirector ();
+		registerContextExtensions ();
+
+	} catch (python::error_already_set const &) {
+		return "Python interpreter initialization failed: " + loadPythonError ();
+	} catch (std::exception const &ex) {
+		return aconnect::string ("Python interpreter initialization failed: ") + ex.what();
+	}
+
+	return aconnect::string();
+}
+
+/* 
+*	Per-interpreter initialization: create scripts namespace, redirect output, 
+*	update sys.path and import WSGI application (if configured)
+*/
+void initInterpreter (PythonInterpreter& interpreter)
 {
-public:
-	ThreadStateGuard (PyThreadState *state, void(*onDestroy)(PyThreadState *) = PyEval_RestoreThread ) :
-	  state_ (state), onDestroy_(onDestroy) { assert(state); }
-	  ~ThreadStateGuard () {
-		  onDestroy_ (state_);
+	try 
+	{
+		interpreter.requestNamespace = PyDict_New ();
+		if (!interpreter.requestNamespace)
+			python::throw_error_already_set();
+
+		// sys.stdout/sys.stderr are set once, target is switched per request
+		interpreter.output = new OutputRedirectorWrapper ();
+		python::reference_existing_object::apply<OutputRedirectorWrapper*>::type converter;
+		python::handle<> outputHandle ( converter (interpreter.output) );
+
+		PySys_SetObject (const_cast<char*> ("stdout"), outputHandle.get());
+		PySys_SetObject (const_cast<char*> ("stderr"), outputHandle.get());
+
+		if (!pythonPath.empty()) {
+			python::object sysPath (python::handle<> (python::borrowed (PySys_GetObject (const_cast<char*> ("path")))));
+			sysPath.attr ("insert") (0, pythonPath);
+		}
+
+		if (!applicationModule.empty()) {
+			python::object application = python::import (applicationModule.c_str()).attr (applicationName.c_str());
+			interpreter.application = python::incref (application.ptr());
+		}
+
+	} catch (python::error_already_set const &) {
+		throw std::runtime_error (loadPythonError ());
+	}
+}
 
-	  }
-protected:
-	PyThreadState *state_;
-	void(*onDestroy_)(PyThreadState *);
-};
-    
 
-    
 aconnect::string loadPythonError()
 {
 	using namespace python;
 
-	boost::mutex::scoped_lock lock(pythonExecMutex);
-
 	aconnect::string exDesc;
 	PyObject* type = NULL, 
 		*value = NULL, 
@@ -185,7 +319,9 @@ HANDLER_EXPORT bool processHandlerRequest (ahttp::HttpContext& context)
 	using namespace ahttp;
 	using namespace aconnect;
 	
-	if ( !util::fileExists (context.FileSystemPath.string()) ) {
+	const bool applicationMode = !applicationModule.empty();
+
+	if ( !applicationMode && !util::fileExists (context.FileSystemPath.string()) ) {
 		HttpServer::processError404 (context);
 		return true;
 	}
@@ -193,35 +329,39 @@ HANDLER_EXPORT bool processHandlerRequest (ahttp::HttpContext& context)
 	if (!context.isClientConnected())
 		return true;
 
+	if (workerProcessesCount > 0) {
+		processWorkerRequest (context);
+		return true;
+	}
+
 	// init context
 	context.UploadsDirPath = uploadsDirPath;
 	HttpContextWrapper wrapper (&context);
 
-	// boost::mutex::scoped_lock lock(pythonExecMutex);
-
-    // UNDONE: Investigate mutli-threaded Python!
-	/*
-	PyEval_InitThreads( );
-	if ( !PyEval_ThreadsInitialized() )
-        throw aconnect::request_processing_error ("Threading support is not initialized");
-	*/
-    
-	/*
-	// PyGILState_Ensure does not work correctly
-        PyGILState_STATE gstate = PyGILState_Ensure();
-        GilThreadStateGuard guard (gstate);
-    */
-
-	// PyThreadState *threadState = PyEval_SaveThread();
-	// ThreadStateGuard guard (threadState);
-
-	// PyThreadState* threadState = Py_NewInterpreter( );
-	// ThreadStateGuard guard (threadState, Py_EndInterpreter);
-	
 	try 
 	{
-		executeScript (context.FileSystemPath.string(), &wrapper);
-		context.setHtmlResponse();
+		// waits for free interpreter, GIL is held until lease is destroyed
+		// (released by wrapper during socket I/O); lease can fail - 500 is sent
+		InterpreterLease lease (interpreterPool);
+
+		try 
+		{
+			if (applicationMode) {
+				str2str_map environ;
+				fillEnviron (environ, context);
+
+				HttpContextConnection connection (&context);
+				runWsgiApplication (python::object (python::handle<> (python::borrowed (lease.interpreter().application))), 
+					environ, connection);
+			} else {
+				executeScript (context.FileSystemPath.string(), &wrapper, lease.interpreter());
+				context.setHtmlResponse();
+			}
+		
+		// Python error is loaded while interpreter is still leased
+		} catch (python::error_already_set const &)  {
+			processPythonError (context, loadPythonError ());
+		}
 			
 	} catch (std::exception const &ex)  {
 		context.Log->error ("Exception caught (%s): %s", 
@@ -229,20 +369,6 @@ HANDLER_EXPORT bool processHandlerRequest (ahttp::HttpContext& context)
 		
 		HttpServer::processServerError(context, 500, ex.what());
 	
-	} catch (python::error_already_set const &)  {
-		string errDesc = loadPythonError ();
-
-		if (errDesc.find ('%') == string::npos)
-			context.Log->error (errDesc.c_str());
-		else
-			context.Log->error ( algo::replace_all_copy(errDesc, "%", "%%").c_str() );
-
-		// prepare HTML response
-		errDesc = util::escapeHtml (errDesc);
-		algo::replace_all (errDesc, "\n", "<br />");
-		algo::replace_all (errDesc, "  ", "&nbsp;&nbsp;");
-		HttpServer::processServerError(context, 500, errDesc.c_str() );
-		
 	} catch (...)  {
 		context.Log->error ("Unknown exception caught");
 		HttpServer::processServerError(context, 500);
@@ -252,41 +378,281 @@ HANDLER_EXPORT bool processHandlerRequest (ahttp::HttpContext& context)
 	return true;
 }
 
+void processPythonError (ahttp::HttpContext& context, aconnect::string errDesc)
+{
+	using namespace aconnect;
+
+	if (errDesc.find ('%') == string::npos)
+		context.Log->error (errDesc.c_str());
+	else
+		context.Log->error ( algo::replace_all_copy(errDesc, "%", "%%").c_str() );
 
-void executeScript (aconnect::string_constref scriptPath, HttpContextWrapper *wrapper )
+	// prepare HTML response
+	errDesc = util::escapeHtml (errDesc);
+	algo::replace_all (errDesc, "\n", "<br />");
+	algo::replace_all (errDesc, "  ", "&nbsp;&nbsp;");
+	ahttp::HttpServer::processServerError(context, 500, errDesc.c_str() );
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	Worker processes mode
+
+// returns worker to pool, worker in unknown state (request was not completed) is killed
+class WorkerLease : private boost::noncopyable
 {
-	using namespace python;
-	
-	// Retrieve the main module's namespace
-	dict global (mainModule.attr("__dict__"));
-	dict local (global.copy ());
-	
-	// prepare globals
-	reference_existing_object::apply<HttpContextWrapper*>::type converter;
-	handle<> wrapperHandle ( converter( wrapper ) );
+public:
+	WorkerLease (WorkerProcessPool& pool, int slot) : pool_ (pool), slot_ (slot), completed_ (false) { }
+	~WorkerLease () {
+		pool_.release (slot_, completed_);
+	}
+
+	inline void complete ()		{	completed_ = true;	}
+
+protected:
+	WorkerProcessPool& pool_;
+	int slot_;
+	bool completed_;
+};
+
+// writes worker response frames to client
+class WorkerResponseReader : public prefork::FrameListener
+{
+public:
+	WorkerResponseReader (ahttp::HttpContext& context) : context_ (context), contentStarted_ (false) { }
+
+	virtual bool frameReceived (prefork::FrameType type, aconnect::string& payload);
+	inline bool isContentStarted () const	{	return contentStarted_;	}
+
+protected:
+	ahttp::HttpContext& context_;
+	bool contentStarted_;
+};
+
+bool WorkerResponseReader::frameReceived (prefork::FrameType type, aconnect::string& payload)
+{
+	using namespace aconnect;
+
+	if (type == prefork::FrameHeader) {
+		size_t offset = sizeof (boost::uint32_t);
+		if (payload.size() < offset)
+			throw prefork::worker_error ("Invalid response header frame");
+
+		boost::uint32_t status = 0;
+		memcpy (&status, payload.data(), sizeof (status));
+
+		str2str_map headers;
+		str_vector cookies;
+		offset = prefork::deserializeMap (headers, payload, offset);
+		prefork::deserializeList (cookies, payload, offset);
+
+		context_.Response.Header.Status = (int) status;
+		context_.Response.Header.mergeHeaders (headers, cookies);
+
+	} else if (type == prefork::FrameData) {
+		contentStarted_ = true;
+		context_.Response.write (payload);
+
+	} else if (type == prefork::FrameLog) {
+		context_.Log->error ("WSGI application: %s", payload.c_str());
 
-	local["http_context"] = wrapperHandle;
-	PySys_SetObject("stdout", wrapperHandle.get());	// 'write' method will be used
-	PySys_SetObject("stderr", wrapperHandle.get());	// 'write' method will be used
+	} else if (type == prefork::FrameEnd) {
+		return false;
+
+	} else if (type == prefork::FrameError) {
+		if (contentStarted_)
+			context_.Log->error ("WSGI application failed after response sending started: %s", payload.c_str());
+		else
+			processPythonError (context_, payload);
+		return false;
+
+	} else {
+		throw prefork::worker_error ("Unexpected frame from worker process");
+	}
+
+	return true;
+}
 
-	PyObject *pyfile = NULL;
-	// copied from exec_file function
-	// exec_file (scriptPath.c_str(), global, local);
+void processWorkerRequest (ahttp::HttpContext& context)
+{
+	using namespace aconnect;
+	using ahttp::HttpServer;
 
+	const int slot = workerPool.lease (workerWaitTimeout);
+	if (slot < 0) {
+		context.Log->warn ("All Python worker processes are busy, request rejected: %s", context.VirtualPath.c_str());
+		HttpServer::processServerError (context, 503);
+		return;
+	}
+
+	WorkerLease lease (workerPool, slot);
+	const int fd = workerPool.socket (slot);
+	WorkerResponseReader reader (context);
+
+	try
 	{
-		boost::mutex::scoped_lock lock(pythonExecMutex);
-		pyfile = PyFile_FromString (const_cast<char*>(scriptPath.c_str()), "r");
+		str2str_map environ;
+		fillEnviron (environ, context);
+
+		string payload;
+		prefork::serializeMap (payload, environ);
+		prefork::writeFrame (fd, prefork::FrameRequest, payload, workerTimeout);
+
+		// request body is streamed, response frames are processed meanwhile
+		boost::scoped_array<char_type> buff (new char_type [WorkerBodyChunkSize]);
+		int bytesRead = 0;
+		bool bodySent = true;
+
+		while (bodySent && (bytesRead = context.RequestStream.read (buff.get(), WorkerBodyChunkSize)) > 0)
+			bodySent = prefork::sendFrame (fd, prefork::FrameBody, buff.get(), bytesRead, workerTimeout, reader);
+
+		if (!bodySent || !prefork::sendFrame (fd, prefork::FrameBodyEnd, NULL, 0, workerTimeout, reader))
+			throw prefork::worker_error ("Worker response completed before request body");
+
+		while (reader.frameReceived (prefork::readFrame (fd, payload, workerTimeout), payload))
+			;
+
+		lease.complete ();
+
+	} catch (prefork::worker_error const &ex) {
+		context.Log->error ("Python worker process failed: %s", ex.what());
+		if (!reader.isContentStarted())
+			HttpServer::processServerError (context, 502);
 	}
+}
 
-	python::handle<> file (pyfile);
+/* 
+*	Worker process main function: initializes Python, imports application and
+*	serves requests from server until connection is closed
+*/
+void runWorkerProcess (int fd)
+{
+	aconnect::string initError = initPython ();
+	PythonInterpreter interpreter;
+
+	if (initError.empty()) {
+		try {
+			initInterpreter (interpreter);
+		} catch (std::exception const &ex) {
+			initError = ex.what();
+		}
+	}
+
+	try
+	{
+		aconnect::string payload;
+
+		while (true)
+		{
+			if (prefork::readFrame (fd, payload) != prefork::FrameRequest)
+				throw prefork::worker_error ("Unexpected frame, request expected");
+
+			aconnect::str2str_map environ;
+			prefork::deserializeMap (environ, payload);
+
+			WorkerConnection connection (fd);
+			aconnect::string errDesc = initError;
+
+			if (errDesc.empty()) {
+				try {
+					runWsgiApplication (python::object (python::handle<> (python::borrowed (interpreter.application))),
+						environ, connection);
+
+				} catch (python::error_already_set const &) {
+					errDesc = loadPythonError ();
+				} catch (prefork::worker_error const &) {
+					throw;
+				} catch (std::exception const &ex) {
+					errDesc = ex.what();
+				}
+			}
+
+			connection.finish (errDesc);
+		}
 
-	PyObject* result = PyRun_File (PyFile_AsFile(file.get()),
-		scriptPath.c_str(),
-		Py_file_input,
-		global.ptr(), 
-		local.ptr());
+	} catch (prefork::worker_error const &) {
+		// server closed connection or protocol failed - supervisor will start new worker
+	}
+}
+
+
+// binds interpreter output and namespace to the request, both are reset on destruction
+class RequestScope : private boost::noncopyable
+{
+public:
+	RequestScope (PythonInterpreter& interpreter, HttpContextWrapper *wrapper) : interpreter_ (interpreter) {
+		interpreter_.output->setTarget (wrapper);
+	}
+	~RequestScope () {
+		// release script objects while request is alive - they can refer to http_context
+		PyDict_Clear (interpreter_.requestNamespace);
+		interpreter_.output->setTarget (NULL);
+	}
+
+protected:
+	PythonInterpreter& interpreter_;
+};
+
+void executeScript (aconnect::string_constref scriptPath, HttpContextWrapper *wrapper, PythonInterpreter& interpreter )
+{
+	using namespace python;
+
+	PyObject* code = loadScriptCode (scriptPath, interpreter);
+
+	RequestScope requestScope (interpreter, wrapper);
+	
+	// prepare globals: script is executed as __main__ in the reused (cleared) namespace
+	reference_existing_object::apply<HttpContextWrapper*>::type converter;
+	handle<> wrapperHandle ( converter( wrapper ) );
+
+	PyObject* globals = interpreter.requestNamespace;
+	if ( PyDict_SetItemString (globals, "__builtins__", PyEval_GetBuiltins()) != 0 
+		|| PyDict_SetItemString (globals, "__name__", object("__main__").ptr()) != 0
+		|| PyDict_SetItemString (globals, "http_context", wrapperHandle.get()) != 0 )
+		throw_error_already_set();
+
+	PyObject* result = PyEval_EvalCode ((PyCodeObject*) code,
+		globals, 
+		globals);
 	
 	if (!result) 
 		throw_error_already_set();
+
+	Py_DECREF (result);
+}
+
+/* 
+*	Returns compiled script from the interpreter cache (borrowed reference),
+*	script is (re)compiled when it is absent in cache or file was changed.
+*/
+PyObject* loadScriptCode (aconnect::string_constref scriptPath, PythonInterpreter& interpreter)
+{
+	std::time_t modifyTime = fs::last_write_time (scriptPath);
+	boost::uintmax_t size = fs::file_size (scriptPath);
+
+	CompiledScript& script = interpreter.scripts[scriptPath];
+	if (script.code && script.modifyTime == modifyTime && script.size == size)
+		return script.code;
+
+	std::ifstream file (scriptPath.c_str(), std::ios::binary);
+	if ( file.fail() )
+		throw std::runtime_error ("Script file opening failed: " + scriptPath);
+
+	boost::scoped_array<aconnect::char_type> buff (new aconnect::char_type [(size_t) size]);
+	file.read (buff.get(), (std::streamsize) size);
+	
+	aconnect::string source (buff.get(), (size_t) file.gcount());
+	algo::replace_all (source, "\r\n", "\n");	// compiler expects '\n' line endings
+
+	PyObject* code = Py_CompileString (source.c_str(), scriptPath.c_str(), Py_file_input);
+	if (!code)
+		python::throw_error_already_set();
+
+	Py_XDECREF (script.code);
+	script.code = code;
+	script.modifyTime = modifyTime;
+	script.size = size;
+
+	return code;
 }
 
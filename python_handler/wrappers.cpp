@@ -1,9 +1,53 @@
+#include <limits>
 #include <boost/scoped_array.hpp>
 
 #include "ahttplib.hpp"
 #include "aconnect/util.hpp"
 
 #include "wrappers.hpp"
+#include "interpreter_pool.hpp"
+
+namespace
+{
+	const int DefaultBodyChunkSize = 64 * 1024;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// 
+//	
+PythonBufferView::PythonBufferView (python::object obj, bool writable) : 
+  object_ (obj), viewAcquired_ (false), data_ (NULL), size_ (0)
+{
+  if (PyObject_CheckBuffer (obj.ptr())) 
+  {
+	  if (PyObject_GetBuffer (obj.ptr(), &view_, writable ? PyBUF_WRITABLE : PyBUF_SIMPLE) == -1)
+		  python::throw_error_already_set();
+
+	  viewAcquired_ = true;
+	  data_ = (aconnect::string_ptr) view_.buf;
+	  size_ = (size_t) view_.len;
+	  return;
+  }
+
+  // old-style buffer objects
+  void *buff = NULL;
+  Py_ssize_t size = 0;
+  int res = writable ? 
+	  PyObject_AsWriteBuffer (obj.ptr(), &buff, &size) : 
+	  PyObject_AsReadBuffer (obj.ptr(), (const void**) &buff, &size);
+  
+  if (res == -1)
+	  python::throw_error_already_set();
+  
+  data_ = (aconnect::string_ptr) buff;
+  size_ = (size_t) size;
+}
+
+PythonBufferView::~PythonBufferView () 
+{
+  if (viewAcquired_)
+	  PyBuffer_Release (&view_);
+}
 
 //////////////////////////////////////////////////////////////////////////
 // 
@@ -33,11 +77,67 @@ std::string RequestWrapper::rawRead (int buffSize)	{
   requestReadInRawForm_ = true;
 
   boost::scoped_array<aconnect::char_type> buff (new aconnect::char_type [buffSize]);
-  int bytesRead = context_->RequestStream.read (buff.get(), buffSize);
+  int bytesRead = 0;
+  {
+	  GilReleaseGuard guard;
+	  bytesRead = context_->RequestStream.read (buff.get(), buffSize);
+  }
 
   return std::string (buff.get(), bytesRead);
 }
 
+int RequestWrapper::readInto (python::object buffer) {
+
+  if (requestLoaded_) 
+	  throwRequestProcessedError ();
+
+  requestReadInRawForm_ = true;
+
+  PythonBufferView view (buffer, true);
+  if (0 == view.size())
+	  return 0;
+
+  int bytesRead = 0;
+  {
+	  GilReleaseGuard guard;
+	  bytesRead = context_->RequestStream.read (view.data(), 
+		  (int) aconnect::util::min2 (view.size(), (size_t) std::numeric_limits<int>::max()));
+  }
+
+  return bytesRead;
+}
+
+python::object RequestWrapper::iterBody (python::object buffer, int size) {
+
+  if (buffer.ptr() == Py_None) {
+	  if (size <= 0)
+		  size = DefaultBodyChunkSize;
+	  buffer = python::object (python::handle<> (PyByteArray_FromStringAndSize (NULL, size)));
+  }
+
+  return python::object (RequestBodyIterator (this, buffer));
+}
+
+python::object RequestBodyIterator::next () {
+
+  const int bytesRead = request_->readInto (buffer_);
+  if (bytesRead <= 0) {
+	  PyErr_SetNone (PyExc_StopIteration);
+	  python::throw_error_already_set();
+  }
+
+  PyObject* view = PyMemoryView_FromObject (buffer_.ptr());
+#if PY_MAJOR_VERSION < 3
+  // old-style buffers (array.array) do not support memoryview in Python 2
+  if (!view) {
+	  PyErr_Clear ();
+	  return python::object (python::handle<> (PyBuffer_FromReadWriteObject (buffer_.ptr(), 0, bytesRead)));
+  }
+#endif
+
+  return python::object (python::handle<> (view)).slice (0, bytesRead);
+}
+
 void RequestWrapper::processRequest() 
 {
   if (requestReadInRawForm_)
@@ -47,6 +147,7 @@ void RequestWrapper::processRequest()
 	  return;
 
   // load request data
+  GilReleaseGuard guard;
   context_->parseQueryStringParams ();
   context_->parseCookies();
   context_->parsePostParams ();
@@ -58,12 +159,32 @@ void RequestWrapper::processRequest()
 // 
 //	wrapper for ahttp::HttpContext - cover some HttpContext functionality
 void HttpContextWrapper::write (aconnect::string_constref data) {
+  writeData (data.c_str(), data.size());
+}
+
+void HttpContextWrapper::writeBuffer (python::object data) {
+  // unicode has no defined byte representation - it must be encoded by script
+  if (PyUnicode_Check (data.ptr())) {
+	  PyErr_SetString (PyExc_TypeError, "HTTP response content must be str or buffer, encode unicode before writing");
+	  python::throw_error_already_set();
+  }
+
+  PythonBufferView view (data, false);
+  writeData (view.data(), view.size());
+}
+
+void HttpContextWrapper::writeData (aconnect::string_constptr buff, size_t size) {
   assert (context_);
   if (!contentWritten_)
 	  contentWritten_ = true;
 
+  GilReleaseGuard guard;
   context_->setHtmlResponse();
-  context_->Response.write (data);
+
+  if (streaming_)
+	  context_->Response.writeUnbuffered (buff, size);
+  else
+	  context_->Response.write (buff, size);
 }
 
 void HttpContextWrapper::writeEscaped (aconnect::string_constref data) {
@@ -72,6 +193,7 @@ void HttpContextWrapper::writeEscaped (aconnect::string_constref data) {
 
 void HttpContextWrapper::flush () {
   assert (context_);
+  GilReleaseGuard guard;
   context_->Response.flush();
 }
 
@@ -83,4 +205,49 @@ void HttpContextWrapper::setContentType (aconnect::string_constref contentType,
   context_->Response.Header.setContentType (contentType, charset);
 }
 
+void HttpContextWrapper::setHeader (aconnect::string_constref name, aconnect::string_constref value) {
+  assert (context_);
+  if (contentWritten_)
+	  return throwResponseWrittenError();
 
+  context_->Response.Header.Headers[name] = value;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// 
+//	persistent interpreter output
+void registerOutputRedirector () {
+  python::class_<OutputRedirectorWrapper, boost::noncopyable> ("OutputRedirector", python::no_init)
+	  .def ("write", &OutputRedirectorWrapper::write)
+	  .def ("flush", &OutputRedirectorWrapper::flush);
+}
+
+
+void registerContextExtensions () {
+  using namespace python;
+
+  const converter::registration *reg = converter::registry::query (type_id<HttpContextWrapper>());
+  if (!reg || !reg->m_class_object)
+	  throw std::runtime_error ("HttpContext class is not registered");
+
+  object contextClass (handle<> (borrowed (reg->get_class_object())));
+  
+  setattr (contextClass, "write", make_function (&HttpContextWrapper::writeBuffer));
+  setattr (contextClass, "set_streaming", make_function (&HttpContextWrapper::setStreaming));
+  setattr (contextClass, "set_header", make_function (&HttpContextWrapper::setHeader));
+
+  reg = converter::registry::query (type_id<RequestWrapper>());
+  if (!reg || !reg->m_class_object)
+	  throw std::runtime_error ("Request class is not registered");
+
+  object requestClass (handle<> (borrowed (reg->get_class_object())));
+
+  setattr (requestClass, "readinto", make_function (&RequestWrapper::readInto));
+  setattr (requestClass, "iter_body", make_function (&RequestWrapper::iterBody, 
+	  with_custodian_and_ward_postcall<0, 1> (), 
+	  (arg ("self"), arg ("buffer") = object(), arg ("size") = DefaultBodyChunkSize)));
+
+  class_<RequestBodyIterator> ("RequestBodyIterator", no_init)
+	  .def ("__iter__", &RequestBodyIterator::iter)
+	  .def ("next", &RequestBodyIterator::next);
+}
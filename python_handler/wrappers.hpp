@@ -10,6 +10,28 @@ namespace python = boost::python;
 
 #include "aconnect/types.hpp"
 
+//////////////////////////////////////////////////////////////////////////
+// 
+//	memory of object supporting buffer protocol (str, bytearray, memoryview, array), 
+//	released in destructor; throws python::error_already_set if buffer is not available
+class PythonBufferView : private boost::noncopyable
+{
+public:
+	PythonBufferView (python::object obj, bool writable);
+	~PythonBufferView ();
+
+	inline aconnect::string_ptr data ()	{	return data_;	}
+	inline size_t size () const			{	return size_;	}
+
+protected:
+	python::object object_;
+	Py_buffer view_;
+	bool viewAcquired_;
+	aconnect::string_ptr data_;
+	size_t size_;
+};
+
+
 //////////////////////////////////////////////////////////////////////////
 class TracebackLoaderWrapper : private boost::noncopyable
 {
@@ -85,6 +107,10 @@ public:
 
 	  aconnect::string_constptr param (aconnect::string_constref key);
 	  std::string rawRead (int buffSize);
+	  // reads request body directly to writable buffer, returns bytes count (0 - body is read)
+	  int readInto (python::object buffer);
+	  // iterator over request body, "buffer" is refilled on each step (None - new bytearray of "size")
+	  python::object iterBody (python::object buffer, int size);
 	  void processRequest();
 
 
@@ -105,6 +131,31 @@ protected:
 };
 
 
+//////////////////////////////////////////////////////////////////////////
+// 
+//	request body iterator: yields memoryview of the filled part of buffer,
+//	content must be processed before the next step
+class RequestBodyIterator
+{
+public:
+	RequestBodyIterator (RequestWrapper *request, python::object buffer) : 
+		request_ (request), buffer_ (buffer) 
+	{
+		assert (request);
+	}
+
+	python::object next ();
+
+	static inline python::object iter (python::object self) {
+		return self;
+	}
+
+protected:
+	RequestWrapper *request_;
+	python::object buffer_;
+};
+
+
 //////////////////////////////////////////////////////////////////////////
 // 
 //	wrapper for ahttp::HttpContext - cover some HttpContext functionality
@@ -112,7 +163,7 @@ class HttpContextWrapper : private boost::noncopyable
 {
 public:
 	HttpContextWrapper (ahttp::HttpContext *context) : 
-	  context_ (context), contentWritten_ (false), 
+	  context_ (context), contentWritten_ (false), streaming_ (false),
 		  requestHeader_ (context ? &context->RequestHeader : NULL),
 		  request_ (context) 
 	  {
@@ -154,17 +205,29 @@ public:
 	  //	response modification
 
 	  void write (aconnect::string_constref data);
+	  // writes str/bytearray/buffer/memoryview content without intermediate string copy
+	  void writeBuffer (python::object data);
+	  void writeData (aconnect::string_constptr buff, size_t size);
 	  void writeEscaped (aconnect::string_constref data);
 	  void flush ();
 	  void setContentType (aconnect::string_constref contentType, aconnect::string_constref charset="");
+	  // "X-Sendfile"/"X-Accel-Redirect" header delegates file sending to server
+	  void setHeader (aconnect::string_constref name, aconnect::string_constref value);
 
 	  inline void setUtf8Html () {
 		  setContentType (ahttp::detail::ContentTypeTextHtml, ahttp::detail::ContentCharsetUtf8);
 	  }
 
+	  // streaming mode: written data is sent to socket immediately (in "chunked" mode), 
+	  // response buffer is not used
+	  inline void setStreaming (bool streaming) {
+		  streaming_ = streaming;
+	  }
+
 protected:	
 	ahttp::HttpContext *context_;
 	bool contentWritten_;
+	bool streaming_;
 
 public:
 	RequestHeaderWrapper requestHeader_;
@@ -174,5 +237,37 @@ public:
 
 
 
+//////////////////////////////////////////////////////////////////////////
+// 
+//	persistent sys.stdout/sys.stderr of interpreter - writes to the response of 
+//	the request currently executed in interpreter, output without request is dropped
+class OutputRedirectorWrapper : private boost::noncopyable
+{
+public:
+	OutputRedirectorWrapper () : target_ (NULL) { }
+
+	inline void write (python::object data) {
+		if (target_)
+			target_->writeBuffer (data);
+	}
+	inline void flush () {
+		if (target_)
+			target_->flush ();
+	}
+
+	inline void setTarget (HttpContextWrapper *target)	{	target_ = target;	}
+
+protected:
+	HttpContextWrapper *target_;
+};
+
+// registers OutputRedirectorWrapper in the current Boost.Python scope
+void registerOutputRedirector ();
+
+// adds buffer-aware "write", "set_streaming" and "set_header" to registered HttpContext class,
+// "readinto" and "iter_body" to registered Request class
+void registerContextExtensions ();
+
+
 #endif // PYTHON_HANDLER_WRAPPERS_H
 
@@ -0,0 +1,393 @@
+
+#include <limits>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_array.hpp>
+
+#include "ahttplib.hpp"
+#include "aconnect/util.hpp"
+
+#include "wsgi.hpp"
+#include "wrappers.hpp"
+#include "interpreter_pool.hpp"
+
+namespace algo = boost::algorithm;
+
+namespace
+{
+	const int ReadChunkSize = 8192;
+
+	aconnect::string_constant EnvironHeaderPrefix = "HTTP_";
+	aconnect::string_constant DefaultServerName = "localhost";
+
+	// calls result.close() if it is defined (WSGI requirement), pending Python error is preserved
+	void closeApplicationResult (python::object& result)
+	{
+		if (!PyObject_HasAttrString (result.ptr(), "close"))
+			return;
+
+		PyObject *type = NULL, *value = NULL, *traceback = NULL;
+		PyErr_Fetch (&type, &value, &traceback);
+
+		try {
+			result.attr ("close")();
+		} catch (python::error_already_set const &) {
+			if (type)
+				PyErr_Clear ();
+			else
+				throw;
+		}
+
+		if (type)
+			PyErr_Restore (type, value, traceback);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	HttpContextConnection
+int HttpContextConnection::read (aconnect::string_ptr buff, int buffSize)
+{
+	if (context_->RequestStream.isRead())
+		return 0;
+
+	return context_->RequestStream.read (buff, buffSize);
+}
+
+void HttpContextConnection::setResponseHeader (int status, const aconnect::str2str_map& headers, 
+											  const aconnect::str_vector& cookies)
+{
+	ahttp::HttpResponseHeader& header = context_->Response.Header;
+
+	if (!headerSet_) {
+		serverHeaders_ = header.Headers;
+		serverCookies_ = header.Cookies;
+		headerSet_ = true;
+	} else {
+		header.Headers = serverHeaders_;
+		header.Cookies = serverCookies_;
+	}
+
+	header.Status = status;
+	header.mergeHeaders (headers, cookies);
+}
+
+void HttpContextConnection::write (aconnect::string_constref data)
+{
+	context_->Response.write (data);
+}
+
+void HttpContextConnection::logError (aconnect::string_constref message)
+{
+	context_->Log->error ("WSGI application: %s", message.c_str());
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	WsgiInputWrapper
+bool WsgiInputWrapper::loadBuffer (int size)
+{
+	if (size <= 0)
+		return false;
+
+	boost::scoped_array<aconnect::char_type> buff (new aconnect::char_type [size]);
+	int bytesRead = 0;
+	{
+		GilReleaseGuard guard;
+		bytesRead = connection_->read (buff.get(), size);
+	}
+
+	if (bytesRead <= 0)
+		return false;
+
+	buffer_.append (buff.get(), bytesRead);
+	return true;
+}
+
+std::string WsgiInputWrapper::read (int size)
+{
+	std::string result;
+
+	if (size < 0) {
+		while (loadBuffer (ReadChunkSize))
+			;
+		result.swap (buffer_);
+		return result;
+	}
+
+	while ((int) buffer_.size() < size && loadBuffer (size - (int) buffer_.size()))
+		;
+
+	result = buffer_.substr (0, size);
+	buffer_.erase (0, result.size());
+
+	return result;
+}
+
+std::string WsgiInputWrapper::readline (int size)
+{
+	size_t pos = std::string::npos;
+
+	while ( (pos = buffer_.find ('\n')) == std::string::npos
+			&& (size < 0 || (int) buffer_.size() < size)
+			&& loadBuffer (ReadChunkSize) )
+		;
+
+	size_t length = (pos == std::string::npos ? buffer_.size() : pos + 1);
+	if (size >= 0 && length > (size_t) size)
+		length = size;
+
+	std::string result = buffer_.substr (0, length);
+	buffer_.erase (0, length);
+
+	return result;
+}
+
+int WsgiInputWrapper::readinto (python::object buffer)
+{
+	PythonBufferView view (buffer, true);
+
+	// data loaded by readline() is returned first
+	if (!buffer_.empty()) {
+		const size_t copied = buffer_.copy (view.data(), view.size());
+		buffer_.erase (0, copied);
+		return (int) copied;
+	}
+
+	if (0 == view.size())
+		return 0;
+
+	int bytesRead = 0;
+	{
+		GilReleaseGuard guard;
+		bytesRead = connection_->read (view.data(), 
+			(int) aconnect::util::min2 (view.size(), (size_t) std::numeric_limits<int>::max()));
+	}
+
+	return (bytesRead > 0 ? bytesRead : 0);
+}
+
+python::list WsgiInputWrapper::readlines (int hint)
+{
+	python::list lines;
+	int totalSize = 0;
+
+	for (std::string line = readline (); !line.empty(); line = readline ())
+	{
+		lines.append (line);
+		totalSize += (int) line.size();
+
+		if (hint > 0 && totalSize >= hint)
+			break;
+	}
+
+	return lines;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	WsgiErrorsWrapper
+void WsgiErrorsWrapper::write (aconnect::string_constref data)
+{
+	aconnect::string message = algo::trim_right_copy (data);
+	if (!message.empty())
+		connection_->logError (message);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	WsgiResponseWrapper
+python::object WsgiResponseWrapper::startResponse (python::object self,
+	aconnect::string_constref status, python::list headers, python::object excInfo)
+{
+	WsgiResponseWrapper& response = python::extract<WsgiResponseWrapper&> (self);
+
+	if (response.started_ && excInfo.ptr() == Py_None) {
+		PyErr_SetString (PyExc_RuntimeError, "WSGI start_response has been already called");
+		python::throw_error_already_set();
+	}
+
+	// headers already sent - error cannot be reported to client, re-raise it
+	if (response.contentWritten_ && excInfo.ptr() != Py_None) {
+		PyErr_SetObject (python::object (excInfo[0]).ptr(), python::object (excInfo[1]).ptr());
+		python::throw_error_already_set();
+	}
+
+	response.setStatus (status, headers);
+	return self.attr ("write");
+}
+
+void WsgiResponseWrapper::setStatus (aconnect::string_constref status, python::list headers)
+{
+	int statusCode = 0;
+	try {
+		statusCode = boost::lexical_cast<int> (status.substr (0, status.find (' ')));
+	} catch (boost::bad_lexical_cast &) {
+		PyErr_SetString (PyExc_ValueError, ("Invalid WSGI response status: " + status).c_str());
+		python::throw_error_already_set();
+	}
+
+	// headers can be repeated: values are combined, "Set-Cookie" lines are kept
+	aconnect::str2str_map responseHeaders;
+	aconnect::str_vector cookies;
+
+	const int headersCount = (int) python::len (headers);
+	for (int ndx = 0; ndx < headersCount; ++ndx)
+	{
+		python::object header = headers[ndx];
+
+		aconnect::string name = python::extract<aconnect::string> (header[0]);
+		aconnect::string value = python::extract<aconnect::string> (header[1]);
+
+		ahttp::HttpResponseHeader::addHeader (responseHeaders, cookies, name, value);
+	}
+
+	connection_->setResponseHeader (statusCode, responseHeaders, cookies);
+	started_ = true;
+}
+
+void WsgiResponseWrapper::write (aconnect::string_constref data)
+{
+	if (!started_) {
+		PyErr_SetString (PyExc_RuntimeError, "WSGI start_response must be called before response writing");
+		python::throw_error_already_set();
+	}
+
+	if (data.empty())
+		return;
+
+	contentWritten_ = true;
+
+	GilReleaseGuard guard;
+	connection_->write (data);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	Module level functions
+void registerWsgiClasses ()
+{
+	using namespace python;
+
+	class_<WsgiInputWrapper, boost::noncopyable> ("WsgiInput", no_init)
+		.def ("read", &WsgiInputWrapper::read, (arg ("size") = -1))
+		.def ("readline", &WsgiInputWrapper::readline, (arg ("size") = -1))
+		.def ("readlines", &WsgiInputWrapper::readlines, (arg ("hint") = -1))
+		.def ("readinto", &WsgiInputWrapper::readinto);
+
+	class_<WsgiErrorsWrapper, boost::noncopyable> ("WsgiErrors", no_init)
+		.def ("write", &WsgiErrorsWrapper::write)
+		.def ("flush", &WsgiErrorsWrapper::flush);
+
+	class_<WsgiResponseWrapper, boost::noncopyable> ("WsgiResponse", no_init)
+		.def ("__call__", &WsgiResponseWrapper::startResponse,
+			(arg ("self"), arg ("status"), arg ("headers"), arg ("exc_info") = object()))
+		.def ("write", &WsgiResponseWrapper::write);
+}
+
+void fillEnviron (aconnect::str2str_map& environ, const ahttp::HttpContext& context)
+{
+	using namespace aconnect;
+	using boost::lexical_cast;
+
+	const ahttp::HttpRequestHeader& header = context.RequestHeader;
+
+	string queryString;
+	size_t pos = header.Path.find ('?');
+	if (pos != string::npos)
+		queryString = header.Path.substr (pos + 1);
+
+	string serverName = header.getHeader (ahttp::detail::HeaderHost);
+	if ((pos = serverName.find (':')) != string::npos)
+		serverName.erase (pos);
+	if (serverName.empty())
+		serverName = DefaultServerName;
+
+	environ["REQUEST_METHOD"] = header.Method;
+	environ["SCRIPT_NAME"] = "";
+	environ["PATH_INFO"] = context.VirtualPath;
+	environ["QUERY_STRING"] = queryString;
+	environ["SERVER_NAME"] = serverName;
+	environ["SERVER_PORT"] = lexical_cast<string> (context.Client->server->port());
+	environ["SERVER_PROTOCOL"] = "HTTP/" + lexical_cast<string> (header.VersionHigh)
+		+ "." + lexical_cast<string> (header.VersionLow);
+	environ["REMOTE_ADDR"] = util::formatIpAddr (context.Client->ip);
+	environ["REMOTE_PORT"] = lexical_cast<string> (context.Client->port);
+
+	for (str2str_map::const_iterator it = header.Headers.begin(); it != header.Headers.end(); ++it)
+	{
+		if (algo::iequals (it->first, ahttp::detail::HeaderContentType)) {
+			environ["CONTENT_TYPE"] = it->second;
+
+		} else if (algo::iequals (it->first, ahttp::detail::HeaderContentLength)) {
+			environ["CONTENT_LENGTH"] = it->second;
+
+		} else {
+			string name = EnvironHeaderPrefix + algo::to_upper_copy (it->first);
+			algo::replace_all (name, "-", "_");
+			environ[name] = it->second;
+		}
+	}
+}
+
+void runWsgiApplication (python::object application,
+						 const aconnect::str2str_map& environ,
+						 WsgiConnection& connection)
+{
+	using namespace python;
+
+	WsgiInputWrapper input (&connection);
+	WsgiErrorsWrapper errors (&connection);
+	WsgiResponseWrapper response (&connection);
+
+	reference_existing_object::apply<WsgiInputWrapper*>::type inputConverter;
+	reference_existing_object::apply<WsgiErrorsWrapper*>::type errorsConverter;
+	reference_existing_object::apply<WsgiResponseWrapper*>::type responseConverter;
+
+	dict environDict;
+	for (aconnect::str2str_map::const_iterator it = environ.begin(); it != environ.end(); ++it)
+		environDict[it->first] = it->second;
+
+	// each interpreter (process) serves one request at a time and does not share state with others
+	environDict[WsgiKeys::Version] = make_tuple (1, 0);
+	environDict[WsgiKeys::UrlScheme] = "http";
+	environDict[WsgiKeys::MultiThread] = false;
+	environDict[WsgiKeys::MultiProcess] = true;
+	environDict[WsgiKeys::RunOnce] = false;
+	environDict[WsgiKeys::Input] = object (handle<> (inputConverter (&input)));
+	environDict[WsgiKeys::Errors] = object (handle<> (errorsConverter (&errors)));
+
+	object startResponse (handle<> (responseConverter (&response)));
+	object result = application (environDict, startResponse);
+
+	try
+	{
+		object iterator (handle<> (PyObject_GetIter (result.ptr())));
+
+		while (PyObject *item = PyIter_Next (iterator.ptr()))
+		{
+			handle<> itemHandle (item);
+			char *data = NULL;
+			Py_ssize_t size = 0;
+
+			if (PyString_AsStringAndSize (item, &data, &size) == -1)
+				throw_error_already_set();
+
+			response.write (aconnect::string (data, (size_t) size));
+		}
+
+		if (PyErr_Occurred())
+			throw_error_already_set();
+
+		if (!response.isStarted()) {
+			PyErr_SetString (PyExc_RuntimeError, "WSGI application did not call start_response");
+			throw_error_already_set();
+		}
+
+	} catch (error_already_set const &) {
+		closeApplicationResult (result);
+		throw;
+	}
+
+	closeApplicationResult (result);
+}
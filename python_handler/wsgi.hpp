@@ -0,0 +1,154 @@
+#ifndef PYTHON_HANDLER_WSGI_H
+#define PYTHON_HANDLER_WSGI_H
+
+#include <boost/noncopyable.hpp>
+#include <boost/python.hpp>
+
+namespace python = boost::python;
+
+#include "aconnect/types.hpp"
+
+namespace WsgiKeys
+{
+	aconnect::string_constant Input = "wsgi.input";
+	aconnect::string_constant Errors = "wsgi.errors";
+	aconnect::string_constant Version = "wsgi.version";
+	aconnect::string_constant UrlScheme = "wsgi.url_scheme";
+	aconnect::string_constant MultiThread = "wsgi.multithread";
+	aconnect::string_constant MultiProcess = "wsgi.multiprocess";
+	aconnect::string_constant RunOnce = "wsgi.run_once";
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	WSGI request body source and response sink: HTTP context in the server process
+//	or channel to server in the worker process (see prefork.hpp)
+class WsgiConnection
+{
+public:
+	virtual ~WsgiConnection () { }
+
+	// read request body, returns 0 when body is read; called without GIL
+	virtual int read (aconnect::string_ptr buff, int buffSize) = 0;
+	// can be called several times until content writing is started,
+	// "cookies" - "Set-Cookie" values (see ahttp::HttpResponseHeader::addHeader)
+	virtual void setResponseHeader (int status, const aconnect::str2str_map& headers, 
+		const aconnect::str_vector& cookies) = 0;
+	// called without GIL
+	virtual void write (aconnect::string_constref data) = 0;
+	virtual void logError (aconnect::string_constref message) = 0;
+};
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	WSGI connection for in-process execution
+class HttpContextConnection : public WsgiConnection
+{
+public:
+	HttpContextConnection (ahttp::HttpContext *context) : context_ (context), headerSet_ (false) {
+		assert (context);
+	}
+
+	virtual int read (aconnect::string_ptr buff, int buffSize);
+	virtual void setResponseHeader (int status, const aconnect::str2str_map& headers, 
+		const aconnect::str_vector& cookies);
+	virtual void write (aconnect::string_constref data);
+	virtual void logError (aconnect::string_constref message);
+
+protected:
+	ahttp::HttpContext *context_;
+	
+	// headers set by server before application response - restored on repeated "start_response"
+	bool headerSet_;
+	aconnect::str2str_map serverHeaders_;
+	aconnect::str_vector serverCookies_;
+};
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	"wsgi.input" stream - request body, read without GIL
+class WsgiInputWrapper : private boost::noncopyable
+{
+public:
+	WsgiInputWrapper (WsgiConnection *connection) : connection_ (connection) {
+		assert (connection);
+	}
+
+	std::string read (int size = -1);
+	std::string readline (int size = -1);
+	python::list readlines (int hint = -1);
+	// fills writable buffer (bytearray, memoryview, array) without intermediate str, 
+	// returns bytes count, 0 - body is read
+	int readinto (python::object buffer);
+
+protected:
+	// loads up to "size" bytes to buffer_, returns false when request is read
+	bool loadBuffer (int size);
+
+	WsgiConnection *connection_;
+	std::string buffer_;
+};
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	"wsgi.errors" stream - writes to server log
+class WsgiErrorsWrapper : private boost::noncopyable
+{
+public:
+	WsgiErrorsWrapper (WsgiConnection *connection) : connection_ (connection) {
+		assert (connection);
+	}
+
+	void write (aconnect::string_constref data);
+	inline void flush ()	{	}
+
+protected:
+	WsgiConnection *connection_;
+};
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+//	"start_response" callable and response writer for WSGI application
+class WsgiResponseWrapper : private boost::noncopyable
+{
+public:
+	WsgiResponseWrapper (WsgiConnection *connection) :
+		connection_ (connection), started_ (false), contentWritten_ (false) {
+		assert (connection);
+	}
+
+	// returns "write" callable
+	static python::object startResponse (python::object self,
+		aconnect::string_constref status, python::list headers, python::object excInfo);
+
+	void write (aconnect::string_constref data);
+
+	inline bool isStarted () const	{	return started_;	}
+
+protected:
+	void setStatus (aconnect::string_constref status, python::list headers);
+
+	WsgiConnection *connection_;
+	bool started_;
+	bool contentWritten_;
+};
+
+
+// registers WSGI wrapper classes in the current Boost.Python scope
+void registerWsgiClasses ();
+
+// fill CGI-like environ variables from HTTP request (without "wsgi.*" keys)
+void fillEnviron (aconnect::str2str_map& environ, const ahttp::HttpContext& context);
+
+/*
+*	Call WSGI application in the current interpreter and write response to connection,
+*	throws python::error_already_set on application failure
+*/
+void runWsgiApplication (python::object application, 
+						 const aconnect::str2str_map& environ, 
+						 WsgiConnection& connection);
+
+#endif // PYTHON_HANDLER_WSGI_H